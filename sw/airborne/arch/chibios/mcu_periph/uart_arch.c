@@ -842,6 +842,27 @@ uint8_t uart_getch(struct uart_periph *p)
   return ret;
 }
 
+uint16_t uart_rx_span(struct uart_periph *p, uint8_t **data)
+{
+  struct SerialInit *init_struct = (struct SerialInit*)(p->init_struct);
+  chMtxLock(init_struct->rx_mtx);
+  uint16_t insert = p->rx_insert_idx;
+  chMtxUnlock(init_struct->rx_mtx);
+  *data = &p->rx_buf[p->rx_extract_idx];
+  if (insert >= p->rx_extract_idx) {
+    return insert - p->rx_extract_idx;
+  }
+  return UART_RX_BUFFER_SIZE - p->rx_extract_idx;
+}
+
+void uart_rx_consume(struct uart_periph *p, uint16_t len)
+{
+  struct SerialInit *init_struct = (struct SerialInit*)(p->init_struct);
+  chMtxLock(init_struct->rx_mtx);
+  p->rx_extract_idx = (p->rx_extract_idx + len) % UART_RX_BUFFER_SIZE;
+  chMtxUnlock(init_struct->rx_mtx);
+}
+
 /**
  * Set baudrate
  */
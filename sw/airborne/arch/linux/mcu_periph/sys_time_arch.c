@@ -28,6 +28,8 @@
 #include <stdio.h>
 #include <pthread.h>
 #include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <time.h>
 #include "rt_priority.h"
 
@@ -40,8 +42,13 @@
 #endif
 
 pthread_t sys_time_thread;
+static pthread_t sys_time_main_thread;
 static struct timespec startup_time;
 
+/** eventfd that wakes up the main loop and the epoll set it is waiting on */
+static int sys_time_event_fd = -1;
+static int sys_time_epoll_fd = -1;
+
 static void sys_tick_handler(void);
 void *sys_time_thread_main(void *data);
 
@@ -98,6 +105,21 @@ void sys_time_arch_init(void)
 
   clock_gettime(CLOCK_MONOTONIC, &startup_time);
 
+  /* called from the main loop thread, which doesn't need to wake itself up */
+  sys_time_main_thread = pthread_self();
+
+  /* Create the main loop events before any thread can signal them */
+  sys_time_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  sys_time_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (sys_time_event_fd == -1 || sys_time_epoll_fd == -1) {
+    perror("Could not setup sys_time events");
+  } else {
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = sys_time_event_fd };
+    if (epoll_ctl(sys_time_epoll_fd, EPOLL_CTL_ADD, sys_time_event_fd, &ev) == -1) {
+      perror("Could not add sys_time event");
+    }
+  }
+
   int ret = pthread_create(&sys_time_thread, NULL, sys_time_thread_main, NULL);
   if (ret) {
     perror("Could not setup sys_time_thread");
@@ -132,15 +154,60 @@ static void sys_tick_handler(void)
   sys_time.nb_tick = sys_time_ticks_of_sec(d_sec) + sys_time_ticks_of_usec(d_nsec / 1000);
 
   /* advance virtual timers */
+  bool elapsed = false;
   for (unsigned int i = 0; i < SYS_TIME_NB_TIMER; i++) {
     if (sys_time.timer[i].in_use &&
         sys_time.nb_tick >= sys_time.timer[i].end_time) {
       sys_time.timer[i].end_time += sys_time.timer[i].duration;
       sys_time.timer[i].elapsed = true;
+      elapsed = true;
       /* call registered callbacks, WARNING: they will be executed in the sys_time thread! */
       if (sys_time.timer[i].cb) {
         sys_time.timer[i].cb(i);
       }
     }
   }
+
+  /* only wake up the main loop when there are periodic tasks to run */
+  if (elapsed) {
+    sys_time_event_notify();
+  }
+}
+
+uint32_t sys_time_usec_of_monotonic(struct timespec *ts)
+{
+  return sys_time_elapsed_us(&startup_time, ts);
+}
+
+void sys_time_event_notify(void)
+{
+  uint64_t one = 1;
+  if (sys_time_event_fd != -1 && write(sys_time_event_fd, &one, sizeof(one)) < 0) {
+    /* EAGAIN means the counter is saturated, main loop is woken up anyway */
+  }
+}
+
+void sys_time_event_notify_from_thread(void)
+{
+  if (!pthread_equal(pthread_self(), sys_time_main_thread)) {
+    sys_time_event_notify();
+  }
+}
+
+void sys_time_event_wait(void)
+{
+  if (sys_time_epoll_fd == -1) {
+    /* no events available, fall back to sleeping a single tick */
+    usleep(sys_time.resolution * 1e6);
+    return;
+  }
+
+  struct epoll_event ev;
+  if (epoll_wait(sys_time_epoll_fd, &ev, 1, -1) > 0) {
+    /* reset the counter, all notifications up to now are handled by the next loop */
+    uint64_t cnt;
+    if (read(sys_time_event_fd, &cnt, sizeof(cnt)) < 0) {
+      /* EAGAIN, already reset */
+    }
+  }
 }
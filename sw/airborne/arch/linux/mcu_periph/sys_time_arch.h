@@ -57,6 +57,27 @@ static inline void sys_time_usleep(uint32_t us)
   usleep(us);
 }
 
+/**
+ * Wake up the main loop waiting in sys_time_event_wait().
+ * Can be called from any thread, e.g. after new data was received
+ * or a result was produced for the event functions.
+ */
+extern void sys_time_event_notify(void);
+
+/**
+ * Wake up the main loop, only when called from another thread.
+ * For code that runs both in the main loop and in other threads (e.g. ABI callbacks),
+ * so the main loop doesn't wake itself up for nothing.
+ */
+extern void sys_time_event_notify_from_thread(void);
+
+/**
+ * Block until there is work for the main loop.
+ * Returns when a sys_time timer elapsed or sys_time_event_notify() was called
+ * since the previous call.
+ */
+extern void sys_time_event_wait(void);
+
 /** elapsed time in microsecs between two timespecs */
 static inline unsigned int sys_time_elapsed_us(struct timespec *prev, struct timespec *now)
 {
@@ -70,4 +91,12 @@ static inline unsigned int sys_time_elapsed_us(struct timespec *prev, struct tim
   return d_sec * 1000000 + d_nsec / 1000;
 }
 
+/**
+ * Convert a CLOCK_MONOTONIC time (e.g. a driver timestamp) to microseconds since startup.
+ * Same time base as get_sys_time_usec(), but without its sys tick resolution.
+ * @param ts monotonic time
+ * @return time in usec since startup (same overflow as get_sys_time_usec)
+ */
+extern uint32_t sys_time_usec_of_monotonic(struct timespec *ts);
+
 #endif /* SYS_TIME_ARCH_H */
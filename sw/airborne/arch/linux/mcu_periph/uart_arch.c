@@ -26,6 +26,7 @@
 #include BOARD_CONFIG
 
 #include "mcu_periph/uart.h"
+#include "mcu_periph/sys_time.h"
 
 #include <stdint.h>
 #include <unistd.h>
@@ -38,22 +39,101 @@
 #include "rt_priority.h"
 
 #include <pthread.h>
-#include <sys/select.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 
 #ifndef UART_THREAD_PRIO
 #define UART_THREAD_PRIO 11
 #endif
 
+/** Maximum number of epoll events handled per wake up of the uart thread */
+#ifndef UART_EPOLL_EVENTS
+#define UART_EPOLL_EVENTS 8
+#endif
+
+/*
+ * The rx and tx buffers of each port are lock-free single producer single consumer rings.
+ * The rx ring is filled by the uart thread and emptied by the main loop,
+ * the tx ring is filled by the main loop and flushed by the uart thread.
+ * Each side only writes its own index, published with release and read with acquire semantics.
+ */
+#define UartIdxLoad(_idx) __atomic_load_n(&(_idx), __ATOMIC_ACQUIRE)
+#define UartIdxStore(_idx, _val) __atomic_store_n(&(_idx), (_val), __ATOMIC_RELEASE)
+
+/** All enabled ports, NULL terminated */
+static struct uart_periph *const uart_ports[] = {
+#if USE_UART0
+  &uart0,
+#endif
+#if USE_UART1
+  &uart1,
+#endif
+#if USE_UART2
+  &uart2,
+#endif
+#if USE_UART3
+  &uart3,
+#endif
+#if USE_UART4
+  &uart4,
+#endif
+#if USE_UART5
+  &uart5,
+#endif
+#if USE_UART6
+  &uart6,
+#endif
+  NULL
+};
+
+static int uart_epoll_fd = -1;    ///< epoll set of the open ports and the tx kick
+static int uart_tx_kick_fd = -1;  ///< eventfd signalled by uart_event() when there is data to send
+
+/*
+ * When a tx ring is too full, the main loop waits for the uart thread to write it out.
+ * The uart thread only takes the mutex when someone is waiting, sending stays lock-free otherwise.
+ */
+static pthread_mutex_t uart_tx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uart_tx_cond = PTHREAD_COND_INITIALIZER;
+static int uart_tx_waiting = 0;
+
+/** tx_extract_idx + 1 of each port when its last wait timed out, 0 when the port is not stalled */
+static uint16_t uart_tx_stalled[sizeof(uart_ports) / sizeof(uart_ports[0])];
+
 static void uart_receive_handler(struct uart_periph *periph);
+static void uart_flush(struct uart_periph *periph);
 static void *uart_thread(void *data __attribute__((unused)));
-static pthread_mutex_t uart_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 //#define TRACE(fmt,args...)    fprintf(stderr, fmt, args)
 #define TRACE(fmt,args...)
 
 void uart_arch_init(void)
 {
-  pthread_mutex_init(&uart_mutex, NULL);
+  uart_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  uart_tx_kick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (uart_epoll_fd == -1 || uart_tx_kick_fd == -1) {
+    fprintf(stderr, "uart_arch_init: Could not create the epoll events.\n");
+    return;
+  }
+
+  /* the tx kick is the only event without a port */
+  struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+  epoll_ctl(uart_epoll_fd, EPOLL_CTL_ADD, uart_tx_kick_fd, &ev);
+
+  /* add the ports that could be opened */
+  for (int i = 0; uart_ports[i] != NULL; i++) {
+    struct uart_periph *periph = uart_ports[i];
+    if (periph->reg_addr == NULL) {
+      continue;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = periph;
+    if (epoll_ctl(uart_epoll_fd, EPOLL_CTL_ADD, ((struct SerialPort *)periph->reg_addr)->fd, &ev) == -1) {
+      fprintf(stderr, "uart_arch_init: Could not add %s to epoll.\n", periph->dev);
+    }
+  }
 
   pthread_t tid;
   if (pthread_create(&tid, NULL, uart_thread, NULL) != 0) {
@@ -66,146 +146,45 @@ static void *uart_thread(void *data __attribute__((unused)))
 {
   get_rt_prio(UART_THREAD_PRIO);
 
-  /* file descriptor list */
-  fd_set fds_master;
-  /* maximum file descriptor number */
-  int fdmax = 0;
-
-  /* clear the fd list */
-  FD_ZERO(&fds_master);
-  /* add used fds */
-  int __attribute__ ((unused)) fd;
-#if USE_UART0
-  if (uart0.reg_addr != NULL) {
-    fd = ((struct SerialPort *)uart0.reg_addr)->fd;
-    FD_SET(fd, &fds_master);
-    if (fd > fdmax) {
-      fdmax =fd;
-    }
-  }
-#endif
-#if USE_UART1
-  if (uart1.reg_addr != NULL) {
-    fd = ((struct SerialPort *)uart1.reg_addr)->fd;
-    FD_SET(fd, &fds_master);
-    if (fd > fdmax) {
-      fdmax =fd;
-    }
-  }
-#endif
-#if USE_UART2
-  if (uart2.reg_addr != NULL) {
-    fd = ((struct SerialPort *)uart2.reg_addr)->fd;
-    FD_SET(fd, &fds_master);
-    if (fd > fdmax) {
-      fdmax =fd;
-    }
-  }
-#endif
-#if USE_UART3
-  if (uart3.reg_addr != NULL) {
-    fd = ((struct SerialPort *)uart3.reg_addr)->fd;
-    FD_SET(fd, &fds_master);
-    if (fd > fdmax) {
-      fdmax =fd;
-    }
-  }
-#endif
-#if USE_UART4
-  if (uart4.reg_addr != NULL) {
-    fd = ((struct SerialPort *)uart4.reg_addr)->fd;
-    FD_SET(fd, &fds_master);
-    if (fd > fdmax) {
-      fdmax =fd;
-    }
-  }
-#endif
-#if USE_UART5
-  if (uart5.reg_addr != NULL) {
-    fd = ((struct SerialPort *)uart5.reg_addr)->fd;
-    FD_SET(fd, &fds_master);
-    if (fd > fdmax) {
-      fdmax =fd;
-    }
-  }
-#endif
-#if USE_UART6
-  if (uart6.reg_addr != NULL) {
-    fd = ((struct SerialPort *)uart6.reg_addr)->fd;
-    FD_SET(fd, &fds_master);
-    if (fd > fdmax) {
-      fdmax =fd;
-    }
-  }
-#endif
-
-  /* fds to be read, modified after each select */
-  fd_set fds;
+  struct epoll_event events[UART_EPOLL_EVENTS];
 
   while (1) {
-    /* reset list of fds to check */
-    fds = fds_master;
-
-    if (select(fdmax + 1, &fds, NULL, NULL, NULL) < 0) {
-      fprintf(stderr, "uart_thread: select failed!");
-    }
-    else {
-#if USE_UART0
-      if (uart0.reg_addr != NULL) {
-        fd = ((struct SerialPort *)uart0.reg_addr)->fd;
-        if (FD_ISSET(fd, &fds)) {
-          uart_receive_handler(&uart0);
-        }
-      }
-#endif
-#if USE_UART1
-      if (uart1.reg_addr != NULL) {
-        fd = ((struct SerialPort *)uart1.reg_addr)->fd;
-        if (FD_ISSET(fd, &fds)) {
-          uart_receive_handler(&uart1);
-        }
+    int nb = epoll_wait(uart_epoll_fd, events, UART_EPOLL_EVENTS, -1);
+    if (nb < 0) {
+      if (errno != EINTR) {
+        fprintf(stderr, "uart_thread: epoll_wait failed!");
       }
-#endif
-#if USE_UART2
-      if (uart2.reg_addr != NULL) {
-        fd = ((struct SerialPort *)uart2.reg_addr)->fd;
-        if (FD_ISSET(fd, &fds)) {
-          uart_receive_handler(&uart2);
-        }
-      }
-#endif
-#if USE_UART3
-      if (uart3.reg_addr != NULL) {
-        fd = ((struct SerialPort *)uart3.reg_addr)->fd;
-        if (FD_ISSET(fd, &fds)) {
-          uart_receive_handler(&uart3);
-        }
-      }
-#endif
-#if USE_UART4
-      if (uart4.reg_addr != NULL) {
-        fd = ((struct SerialPort *)uart4.reg_addr)->fd;
-        if (FD_ISSET(fd, &fds)) {
-          uart_receive_handler(&uart4);
+      continue;
+    }
+
+    bool received = false;
+    for (int i = 0; i < nb; i++) {
+      struct uart_periph *periph = events[i].data.ptr;
+
+      if (periph == NULL) {
+        /* end of an event cycle, flush all the ports at once */
+        uint64_t cnt;
+        if (read(uart_tx_kick_fd, &cnt, sizeof(cnt)) > 0) {
+          for (int p = 0; uart_ports[p] != NULL; p++) {
+            uart_flush(uart_ports[p]);
+          }
         }
+        continue;
       }
-#endif
-#if USE_UART5
-      if (uart5.reg_addr != NULL) {
-        fd = ((struct SerialPort *)uart5.reg_addr)->fd;
-        if (FD_ISSET(fd, &fds)) {
-          uart_receive_handler(&uart5);
-        }
+
+      if (events[i].events & EPOLLOUT) {
+        /* port was full, continue sending */
+        uart_flush(periph);
       }
-#endif
-#if USE_UART6
-      if (uart6.reg_addr != NULL) {
-        fd = ((struct SerialPort *)uart6.reg_addr)->fd;
-        if (FD_ISSET(fd, &fds)) {
-          uart_receive_handler(&uart6);
-        }
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        uart_receive_handler(periph);
+        received = true;
       }
-#endif
+    }
+
+    if (received) {
+      /* wake up the main loop to handle the new bytes */
+      sys_time_event_notify();
     }
   }
 
@@ -267,70 +246,269 @@ void uart_periph_set_bits_stop_parity(struct uart_periph *periph, uint8_t bits,
   serial_port_set_bits_stop_parity(port, bits, stop, parity);
 }
 
-void uart_put_byte(struct uart_periph *periph, long fd __attribute__((unused)), uint8_t data)
+/**
+ * Free space in the tx ring, called from the producer side (main loop)
+ * @param p The uart peripheral
+ * @return number of bytes that can be added
+ */
+static inline uint16_t uart_tx_space(struct uart_periph *p)
 {
-  if (periph->reg_addr == NULL) { return; } // device not initialized ?
+  int16_t space = UartIdxLoad(p->tx_extract_idx) - p->tx_insert_idx;
+  if (space <= 0) {
+    space += UART_TX_BUFFER_SIZE;
+  }
+  return (uint16_t)(space - 1);
+}
 
-  /* write single byte to serial port */
-  struct SerialPort *port = (struct SerialPort *)(periph->reg_addr);
+/**
+ * Wait until there is space for len bytes in the tx ring, called from the producer side (main loop)
+ * Bytes which are written without checking the space first are never dropped in the middle of a message
+ * because the ring is momentarily full. The queued bytes are sent right away and the wait is at most
+ * UART_TX_TIMEOUT ms, so a port which doesn't accept any data doesn't block the main loop forever.
+ * @param p The uart peripheral
+ * @param len The number of bytes to add
+ * @return TRUE if len bytes can be added
+ */
+static bool uart_tx_wait(struct uart_periph *p, uint16_t len)
+{
+  if (uart_tx_space(p) >= len) {
+    return true;
+  }
+  if (len >= UART_TX_BUFFER_SIZE) {
+    return false;
+  }
+
+  /* don't wait again as long as a port which timed out hasn't sent anything */
+  uint8_t idx = 0;
+  while (uart_ports[idx] != p) {
+    idx++;
+  }
+  if (uart_tx_stalled[idx] == UartIdxLoad(p->tx_extract_idx) + 1) {
+    uart_event();
+    return false;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += (UART_TX_TIMEOUT % 1000) * 1000000L;
+  deadline.tv_sec += UART_TX_TIMEOUT / 1000 + deadline.tv_nsec / 1000000000L;
+  deadline.tv_nsec %= 1000000000L;
+
+  pthread_mutex_lock(&uart_tx_mutex);
+  __atomic_add_fetch(&uart_tx_waiting, 1, __ATOMIC_SEQ_CST);
+  uart_event();
+  bool fits;
+  while (!(fits = (uart_tx_space(p) >= len))) {
+    if (pthread_cond_timedwait(&uart_tx_cond, &uart_tx_mutex, &deadline) == ETIMEDOUT) {
+      fits = (uart_tx_space(p) >= len);
+      break;
+    }
+  }
+  __atomic_sub_fetch(&uart_tx_waiting, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&uart_tx_mutex);
 
-  int ret = 0;
-  do{
-    ret = write((int)(port->fd), &data, 1);
-  } while(ret < 1 && errno == EAGAIN); //FIXME: max retry
+  uart_tx_stalled[idx] = fits ? 0 : UartIdxLoad(p->tx_extract_idx) + 1;
+  return fits;
+}
 
-  if (ret < 1) {
-    TRACE("uart_put_byte: write %d failed [%d: %s]\n", data, ret, strerror(errno));
+/**
+ * Count bytes which are dropped because the tx ring stayed full
+ * @param p The uart peripheral
+ * @param len The number of dropped bytes
+ */
+static void uart_tx_drop(struct uart_periph *p, uint16_t len)
+{
+  if (p->tx_dropped == 0) {
+    fprintf(stderr, "uart: tx buffer of %s full, dropping data\n", p->dev);
   }
+  p->tx_dropped += len;
 }
 
+/*
+ * The check doesn't wait, the telemetry scheduler and the batch device use it to find out
+ * what fits right now. A caller which gets FALSE skips the whole message.
+ */
+bool uart_check_free_space(struct uart_periph *p, long *fd __attribute__((unused)), uint16_t len)
+{
+  if (uart_tx_space(p) >= len) {
+    return true;
+  }
+  /* not enough space, start sending what is already queued */
+  uart_event();
+  return false;
+}
 
-static void __attribute__ ((unused)) uart_receive_handler(struct uart_periph *periph)
+void uart_put_byte(struct uart_periph *p, long fd __attribute__((unused)), uint8_t data)
 {
-  unsigned char c = 'D';
+  if (p->reg_addr == NULL) { return; } // device not initialized ?
 
+  if (!uart_tx_wait(p, 1)) {
+    TRACE("uart_put_byte: tx_buf full! discarding byte: %x\n", data);
+    uart_tx_drop(p, 1);
+    return;
+  }
+  p->tx_buf[p->tx_insert_idx] = data;
+  UartIdxStore(p->tx_insert_idx, (p->tx_insert_idx + 1) % UART_TX_BUFFER_SIZE);
+}
+
+void uart_put_buffer(struct uart_periph *p, long fd __attribute__((unused)), const uint8_t *data, uint16_t len)
+{
+  if (p->reg_addr == NULL) { return; } // device not initialized ?
+
+  /* a buffer larger than the ring is sent in parts */
+  while (len > UART_TX_BUFFER_SIZE / 2) {
+    uart_put_buffer(p, fd, data, UART_TX_BUFFER_SIZE / 2);
+    data += UART_TX_BUFFER_SIZE / 2;
+    len -= UART_TX_BUFFER_SIZE / 2;
+  }
+
+  if (!uart_tx_wait(p, len)) {
+    TRACE("uart_put_buffer: tx_buf full! discarding %d bytes\n", len);
+    uart_tx_drop(p, len);
+    return;
+  }
+  /* copy in at most two parts around the end of the ring */
+  uint16_t insert = p->tx_insert_idx;
+  uint16_t first = Min(len, UART_TX_BUFFER_SIZE - insert);
+  memcpy(&p->tx_buf[insert], data, first);
+  memcpy(p->tx_buf, data + first, len - first);
+  UartIdxStore(p->tx_insert_idx, (insert + len) % UART_TX_BUFFER_SIZE);
+}
+
+/**
+ * Signal the uart thread to write all the queued bytes.
+ * Called at every event cycle from mcu_event(), so everything queued
+ * during a cycle is written in a single batch per port.
+ */
+void uart_event(void)
+{
+  for (int i = 0; uart_ports[i] != NULL; i++) {
+    struct uart_periph *p = uart_ports[i];
+    if (p->reg_addr != NULL && UartIdxLoad(p->tx_extract_idx) != p->tx_insert_idx) {
+      uint64_t one = 1;
+      if (uart_tx_kick_fd != -1 && write(uart_tx_kick_fd, &one, sizeof(one)) < 0) {
+        /* EAGAIN means the counter is saturated, uart thread is woken up anyway */
+      }
+      return;
+    }
+  }
+}
+
+/**
+ * Write the queued bytes of a port, called from the uart thread (consumer side).
+ * When the port can't take everything, the port is polled for EPOLLOUT
+ * until the tx ring is empty again.
+ */
+static void uart_flush(struct uart_periph *periph)
+{
   if (periph->reg_addr == NULL) { return; } // device not initialized ?
 
   struct SerialPort *port = (struct SerialPort *)(periph->reg_addr);
-  int fd = port->fd;
-
-  pthread_mutex_lock(&uart_mutex);
+  uint16_t extract = periph->tx_extract_idx;
+  uint16_t insert = UartIdxLoad(periph->tx_insert_idx);
+
+  if (insert != extract) {
+    /* the queued bytes are in at most two parts around the end of the ring */
+    struct iovec iov[2];
+    int iovcnt = 1;
+    iov[0].iov_base = &periph->tx_buf[extract];
+    if (insert > extract) {
+      iov[0].iov_len = insert - extract;
+    } else {
+      iov[0].iov_len = UART_TX_BUFFER_SIZE - extract;
+      iov[1].iov_base = periph->tx_buf;
+      iov[1].iov_len = insert;
+      iovcnt = (insert > 0) ? 2 : 1;
+    }
 
-  if (read(fd, &c, 1) > 0) {
-    //printf("r %x %c\n",c,c);
-    uint16_t temp = (periph->rx_insert_idx + 1) % UART_RX_BUFFER_SIZE;
-    // check for more room in queue
-    if (temp != periph->rx_extract_idx) {
-      periph->rx_buf[periph->rx_insert_idx] = c;
-      periph->rx_insert_idx = temp;  // update insert index
+    ssize_t ret = writev(port->fd, iov, iovcnt);
+    if (ret > 0) {
+      extract = (extract + ret) % UART_TX_BUFFER_SIZE;
+      __atomic_store_n(&periph->tx_extract_idx, extract, __ATOMIC_SEQ_CST);
+      /* wake up the main loop if it waits for space */
+      if (__atomic_load_n(&uart_tx_waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&uart_tx_mutex);
+        pthread_cond_broadcast(&uart_tx_cond);
+        pthread_mutex_unlock(&uart_tx_mutex);
+      }
+    } else if (ret < 0 && errno != EAGAIN) {
+      TRACE("uart_flush: write failed [%d: %s]\n", ret, strerror(errno));
     }
-    else {
-      TRACE("uart_receive_handler: rx_buf full! discarding received byte: %x %c\n", c, c);
+  }
+
+  /* wait for the port to become writable when not everything could be written */
+  uint8_t waiting = (extract != insert);
+  if (waiting != periph->tx_running) {
+    struct epoll_event ev = { .events = EPOLLIN | (waiting ? EPOLLOUT : 0), .data.ptr = periph };
+    epoll_ctl(uart_epoll_fd, EPOLL_CTL_MOD, port->fd, &ev);
+    periph->tx_running = waiting;
+  }
+}
+
+static void uart_receive_handler(struct uart_periph *periph)
+{
+  if (periph->reg_addr == NULL) { return; } // device not initialized ?
+
+  struct SerialPort *port = (struct SerialPort *)(periph->reg_addr);
+  uint16_t insert = periph->rx_insert_idx;
+  uint16_t extract = UartIdxLoad(periph->rx_extract_idx);
+
+  /* free space, one byte stays empty to distinguish a full from an empty ring */
+  uint16_t space = (extract + UART_RX_BUFFER_SIZE - insert - 1) % UART_RX_BUFFER_SIZE;
+  if (space == 0) {
+    /* rx_buf full, discard the received bytes so the port doesn't stay readable */
+    uint8_t discard[64];
+    if (read(port->fd, discard, sizeof(discard)) > 0) {
+      TRACE("uart_receive_handler: rx_buf full! discarding received bytes on %s\n", periph->dev);
+      periph->ore++;
     }
+    return;
+  }
+
+  /* read directly into the ring, in at most two parts around its end */
+  struct iovec iov[2];
+  iov[0].iov_base = &periph->rx_buf[insert];
+  iov[0].iov_len = Min(space, UART_RX_BUFFER_SIZE - insert);
+  iov[1].iov_base = periph->rx_buf;
+  iov[1].iov_len = space - iov[0].iov_len;
+
+  ssize_t ret = readv(port->fd, iov, (iov[1].iov_len > 0) ? 2 : 1);
+  if (ret > 0) {
+    UartIdxStore(periph->rx_insert_idx, (insert + ret) % UART_RX_BUFFER_SIZE);
   }
-  pthread_mutex_unlock(&uart_mutex);
 }
 
 uint8_t uart_getch(struct uart_periph *p)
 {
-  pthread_mutex_lock(&uart_mutex);
   uint8_t ret = p->rx_buf[p->rx_extract_idx];
-  p->rx_extract_idx = (p->rx_extract_idx + 1) % UART_RX_BUFFER_SIZE;
-  pthread_mutex_unlock(&uart_mutex);
+  UartIdxStore(p->rx_extract_idx, (p->rx_extract_idx + 1) % UART_RX_BUFFER_SIZE);
   return ret;
 }
 
 uint16_t uart_char_available(struct uart_periph *p)
 {
-  pthread_mutex_lock(&uart_mutex);
-  int16_t available = p->rx_insert_idx - p->rx_extract_idx;
+  int16_t available = UartIdxLoad(p->rx_insert_idx) - p->rx_extract_idx;
   if (available < 0) {
     available += UART_RX_BUFFER_SIZE;
   }
-  pthread_mutex_unlock(&uart_mutex);
   return (uint16_t)available;
 }
 
+uint16_t uart_rx_span(struct uart_periph *p, uint8_t **data)
+{
+  uint16_t insert = UartIdxLoad(p->rx_insert_idx);
+  *data = &p->rx_buf[p->rx_extract_idx];
+  if (insert >= p->rx_extract_idx) {
+    return insert - p->rx_extract_idx;
+  }
+  return UART_RX_BUFFER_SIZE - p->rx_extract_idx;
+}
+
+void uart_rx_consume(struct uart_periph *p, uint16_t len)
+{
+  UartIdxStore(p->rx_extract_idx, (p->rx_extract_idx + len) % UART_RX_BUFFER_SIZE);
+}
+
 #if USE_UART0
 void uart0_init(void)
 {
@@ -31,7 +31,12 @@
 #define UART_RX_BUFFER_SIZE 512
 #endif
 #ifndef UART_TX_BUFFER_SIZE
-#define UART_TX_BUFFER_SIZE 512
+#define UART_TX_BUFFER_SIZE 1024
+#endif
+
+/** Maximum time in ms to wait for space in the tx buffer before data is dropped */
+#ifndef UART_TX_TIMEOUT
+#define UART_TX_TIMEOUT 100
 #endif
 
 #include "mcu_periph/uart.h"
@@ -24,13 +24,16 @@
  */
 
 #include "mcu_periph/udp.h"
+#include "mcu_periph/sys_time.h"
 #include "udp_socket.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 
 #include <pthread.h>
 #include <sys/select.h>
+#include <sys/socket.h>
 
 #include "rt_priority.h"
 
@@ -38,13 +41,18 @@
 #define UDP_THREAD_PRIO 10
 #endif
 
+/*
+ * The rx buffer of each peripheral is a lock-free single producer single consumer ring.
+ * It is filled by the udp thread and emptied by the main loop,
+ * each side only writes its own index, published with release and read with acquire semantics.
+ */
+#define UdpIdxLoad(_idx) __atomic_load_n(&(_idx), __ATOMIC_ACQUIRE)
+#define UdpIdxStore(_idx, _val) __atomic_store_n(&(_idx), (_val), __ATOMIC_RELEASE)
+
 static void *udp_thread(void *data __attribute__((unused)));
-static pthread_mutex_t udp_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 void udp_arch_init(void)
 {
-  pthread_mutex_init(&udp_mutex, NULL);
-
 #ifdef USE_UDP0
   UDP0Init();
 #endif
@@ -80,12 +88,10 @@ void udp_arch_periph_init(struct udp_periph *p, char *host, int port_out, int po
  */
 uint16_t udp_char_available(struct udp_periph *p)
 {
-  pthread_mutex_lock(&udp_mutex);
-  int16_t available = p->rx_insert_idx - p->rx_extract_idx;
+  int16_t available = UdpIdxLoad(p->rx_insert_idx) - p->rx_extract_idx;
   if (available < 0) {
     available += UDP_RX_BUFFER_SIZE;
   }
-  pthread_mutex_unlock(&udp_mutex);
   return (uint16_t)available;
 }
 
@@ -96,44 +102,68 @@ uint16_t udp_char_available(struct udp_periph *p)
  */
 uint8_t udp_getch(struct udp_periph *p)
 {
-  pthread_mutex_lock(&udp_mutex);
   uint8_t ret = p->rx_buf[p->rx_extract_idx];
-  p->rx_extract_idx = (p->rx_extract_idx + 1) % UDP_RX_BUFFER_SIZE;
-  pthread_mutex_unlock(&udp_mutex);
+  UdpIdxStore(p->rx_extract_idx, (p->rx_extract_idx + 1) % UDP_RX_BUFFER_SIZE);
   return ret;
 }
 
+/**
+ * Read all the available bytes from the receive buffer, up to len.
+ * @param p pointer to UDP peripheral
+ * @param buf destination buffer
+ * @param len size of the destination buffer
+ * @return number of bytes copied to buf
+ */
+uint16_t udp_read(struct udp_periph *p, uint8_t *buf, uint16_t len)
+{
+  uint16_t extract = p->rx_extract_idx;
+  uint16_t available = udp_char_available(p);
+  uint16_t nb = Min(available, len);
+  uint16_t first = Min(nb, UDP_RX_BUFFER_SIZE - extract);
+  memcpy(buf, &p->rx_buf[extract], first);
+  memcpy(buf + first, p->rx_buf, nb - first);
+  UdpIdxStore(p->rx_extract_idx, (extract + nb) % UDP_RX_BUFFER_SIZE);
+  return nb;
+}
+
 /**
  * Read bytes from UDP
+ * The datagram is received directly in the rx ring, in at most two parts around its end.
  */
 void udp_receive(struct udp_periph *p)
 {
   if (p == NULL) return;
   if (p->network == NULL) return;
 
-  int16_t i;
-  int16_t available = UDP_RX_BUFFER_SIZE - udp_char_available(p);
-  uint8_t buf[UDP_RX_BUFFER_SIZE];
   struct UdpSocket *sock = (struct UdpSocket *) p->network;
+  uint16_t insert = p->rx_insert_idx;
+  uint16_t extract = UdpIdxLoad(p->rx_extract_idx);
 
-  if (available <= 0) {
-    return;  // No space
+  /* free space, one byte stays empty to distinguish a full from an empty ring */
+  uint16_t space = (extract + UDP_RX_BUFFER_SIZE - insert - 1) % UDP_RX_BUFFER_SIZE;
+  if (space == 0) {
+    /* rx_buf full, discard the datagram so the socket doesn't stay readable */
+    recv(sock->sockfd, NULL, 0, MSG_DONTWAIT);
+    return;
   }
 
-  socklen_t slen = sizeof(struct sockaddr_in);
-  ssize_t byte_read = recvfrom(sock->sockfd, buf, available, MSG_DONTWAIT,
-                               (struct sockaddr *)&sock->addr_in, &slen);
+  struct iovec iov[2];
+  iov[0].iov_base = &p->rx_buf[insert];
+  iov[0].iov_len = Min(space, UDP_RX_BUFFER_SIZE - insert);
+  iov[1].iov_base = p->rx_buf;
+  iov[1].iov_len = space - iov[0].iov_len;
 
-  pthread_mutex_lock(&udp_mutex);
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &sock->addr_in;
+  msg.msg_namelen = sizeof(struct sockaddr_in);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = (iov[1].iov_len > 0) ? 2 : 1;
 
+  ssize_t byte_read = recvmsg(sock->sockfd, &msg, MSG_DONTWAIT);
   if (byte_read > 0) {
-    for (i = 0; i < byte_read; i++) {
-      p->rx_buf[p->rx_insert_idx] = buf[i];
-      p->rx_insert_idx = (p->rx_insert_idx + 1) % UDP_RX_BUFFER_SIZE;
-    }
+    UdpIdxStore(p->rx_insert_idx, (insert + byte_read) % UDP_RX_BUFFER_SIZE);
   }
-
-  pthread_mutex_unlock(&udp_mutex);
 }
 
 /**
@@ -242,6 +272,8 @@ static void *udp_thread(void *data __attribute__((unused)))
         udp_receive(&udp2);
       }
 #endif
+      /* wake up the main loop to handle the new bytes */
+      sys_time_event_notify();
     }
   }
   return 0;
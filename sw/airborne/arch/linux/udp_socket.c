@@ -24,6 +24,10 @@
  * Easily create and use UDP sockets.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE   // sendmmsg
+#endif
+
 #include "udp_socket.h"
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -149,6 +153,71 @@ int udp_socket_send_dontwait(struct UdpSocket *sock, uint8_t *buffer, uint32_t l
   return bytes_sent;
 }
 
+/**
+ * Maximum amount of packets given to the kernel in a single call
+ */
+#ifndef UDP_SOCKET_MAX_BATCH
+#define UDP_SOCKET_MAX_BATCH 64
+#endif
+
+/**
+ * Send multiple packets, each gathered from io vectors, non-blocking.
+ * Uses a single sendmmsg call on Linux (sendmsg per packet otherwise).
+ * Just like udp_socket_send_dontwait, packets that can not be queued are dropped.
+ * @param[in] sock  pointer to UdpSocket struct
+ * @param[in] iov      io vectors of all packets (iov_per_packet consecutive vectors per packet)
+ * @param[in] iov_per_packet  amount of io vectors per packet
+ * @param[in] cnt      amount of packets
+ * @return number of packets sent (-1 on error)
+ */
+int udp_socket_send_batch_dontwait(struct UdpSocket *sock, struct iovec *iov, uint8_t iov_per_packet, uint16_t cnt)
+{
+  if (sock == NULL) {
+    return -1;
+  }
+
+  int sent = 0;
+  uint16_t done = 0;
+  while (done < cnt) {
+    uint16_t batch = cnt - done;
+    if (batch > UDP_SOCKET_MAX_BATCH) {
+      batch = UDP_SOCKET_MAX_BATCH;
+    }
+
+#ifdef __linux__
+    struct mmsghdr msgs[UDP_SOCKET_MAX_BATCH];
+    memset(msgs, 0, batch * sizeof(struct mmsghdr));
+    for (uint16_t i = 0; i < batch; i++) {
+      msgs[i].msg_hdr.msg_name = &sock->addr_out;
+      msgs[i].msg_hdr.msg_namelen = sizeof(sock->addr_out);
+      msgs[i].msg_hdr.msg_iov = &iov[(done + i) * iov_per_packet];
+      msgs[i].msg_hdr.msg_iovlen = iov_per_packet;
+    }
+
+    int ret = sendmmsg(sock->sockfd, msgs, batch, MSG_DONTWAIT);
+#else
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &sock->addr_out;
+    msg.msg_namelen = sizeof(sock->addr_out);
+    msg.msg_iov = &iov[done * iov_per_packet];
+    msg.msg_iovlen = iov_per_packet;
+
+    int ret = (sendmsg(sock->sockfd, &msg, MSG_DONTWAIT) < 0) ? -1 : 1;
+#endif
+
+    if (ret <= 0) {
+      // The first packet could not be queued, drop it and try the others
+      TRACE(TRACE_ERROR, "error sending batch to sock %d (%s)\n", ret, strerror(errno));
+      done++;
+    } else {
+      done += ret;
+      sent += ret;
+    }
+  }
+  return sent;
+}
+
 /**
  * Receive a UDP packet, dont wait.
  * Sets the MSG_DONTWAIT flag, returns 0 if no data is available.
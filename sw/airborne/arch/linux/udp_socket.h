@@ -29,6 +29,7 @@
 #define UDP_SOCKET_H
 
 #include <netinet/in.h>
+#include <sys/uio.h>
 #include "std.h"
 
 struct UdpSocket {
@@ -66,6 +67,18 @@ extern int udp_socket_send(struct UdpSocket *sock, uint8_t *buffer, uint32_t len
  */
 extern int udp_socket_send_dontwait(struct UdpSocket *sock, uint8_t *buffer, uint32_t len);
 
+/**
+ * Send multiple packets, each gathered from io vectors, non-blocking.
+ * Uses a single sendmmsg call on Linux. Packets that can not be queued are dropped.
+ * @param[in] sock  pointer to UdpSocket struct
+ * @param[in] iov      io vectors of all packets (iov_per_packet consecutive vectors per packet)
+ * @param[in] iov_per_packet  amount of io vectors per packet
+ * @param[in] cnt      amount of packets
+ * @return number of packets sent (-1 on error)
+ */
+extern int udp_socket_send_batch_dontwait(struct UdpSocket *sock, struct iovec *iov, uint8_t iov_per_packet,
+    uint16_t cnt);
+
 /**
  * Receive a UDP packet, dont wait.
  * @param[in] sock  pointer to UdpSocket struct
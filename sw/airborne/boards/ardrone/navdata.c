@@ -47,6 +47,7 @@
 #include "subsystems/ahrs.h"
 #include "subsystems/abi.h"
 #include "mcu_periph/gpio.h"
+#include "mcu_periph/sys_time.h"
 
 /* Internal used functions */
 static void *navdata_read(void *data __attribute__((unused)));
@@ -315,6 +316,7 @@ static void *navdata_read(void *data __attribute__((unused)))
       pthread_mutex_lock(&navdata_mutex);
       navdata_available = true;
       pthread_mutex_unlock(&navdata_mutex);
+      sys_time_event_notify();
     }
   }
 
@@ -41,7 +41,17 @@ int main(void)
 {
   main_init();
 
-#if LIMIT_EVENT_POLLING
+#if USE_EVENT_LOOP
+  /* Only run the main loop when there is work to do:
+   * a sys_time timer elapsed or another thread signalled new data
+   * with sys_time_event_notify() (Linux only).
+   */
+  while (1) {
+    handle_periodic_tasks();
+    main_event();
+    sys_time_event_wait();
+  }
+#elif LIMIT_EVENT_POLLING
   /* Limit main loop frequency to 1kHz.
    * This is a kludge until we can better leverage threads and have real events.
    * Without this limit the event flags will constantly polled as fast as possible,
@@ -36,6 +36,7 @@
 #include "firmwares/rotorcraft/stabilization/stabilization_attitude_quat_transformations.h"
 
 #include "math/pprz_algebra_float.h"
+#include "math/pprz_wls_alloc_float.h"
 #include "state.h"
 #include "generated/airframe.h"
 #include "subsystems/radio_control.h"
@@ -60,8 +61,12 @@ struct ReferenceSystem reference_acceleration = {
   STABILIZATION_INDI_REF_RATE_R,
 };
 
-//only 4 actuators supported for now
+// number of actuators, the G1 and G2 rows must have this many elements
+#ifdef STABILIZATION_INDI_NUM_ACT
+#define INDI_NUM_ACT STABILIZATION_INDI_NUM_ACT
+#else
 #define INDI_NUM_ACT 4
+#endif
 // outputs: roll, pitch, yaw, thrust
 #define INDI_OUTPUTS 4
 // Factor that the estimated G matrix is allowed to deviate from initial one
@@ -69,6 +74,38 @@ struct ReferenceSystem reference_acceleration = {
 // Scaling for the control effectiveness to make it readible
 #define INDI_G_SCALING 1000.0
 
+/** Relative change of a row of G (w.r.t. its largest element) above which
+ *  the pseudo-inverse is computed again during adaptation
+ */
+#ifndef STABILIZATION_INDI_G_UPDATE_TOL
+#define STABILIZATION_INDI_G_UPDATE_TOL 0.01
+#endif
+
+/** Use a weighted least squares allocation with actuator limits
+ *  instead of the pseudo-inverse of G
+ */
+#ifndef STABILIZATION_INDI_ALLOCATION_WLS
+#define STABILIZATION_INDI_ALLOCATION_WLS FALSE
+#endif
+
+#if STABILIZATION_INDI_ALLOCATION_WLS
+#if INDI_NUM_ACT > WLS_N_U_MAX
+#error "STABILIZATION_INDI_NUM_ACT is larger than WLS_N_U_MAX"
+#endif
+/** Priority of the roll, pitch, yaw and thrust objectives */
+#ifndef STABILIZATION_INDI_WLS_WV
+#define STABILIZATION_INDI_WLS_WV {1000, 1000, 1, 100}
+#endif
+/** Weight of the control objective w.r.t. the actuator increments */
+#ifndef STABILIZATION_INDI_WLS_GAMMA_SQ
+#define STABILIZATION_INDI_WLS_GAMMA_SQ 100.0
+#endif
+#ifndef STABILIZATION_INDI_WLS_MAX_ITER
+#define STABILIZATION_INDI_WLS_MAX_ITER 10
+#endif
+static float indi_wls_wv[INDI_OUTPUTS] = STABILIZATION_INDI_WLS_WV;
+#endif
+
 #if STABILIZATION_INDI_USE_ADAPTIVE
 bool indi_use_adaptive = true;
 #else
@@ -340,6 +377,44 @@ static void stabilization_indi_calc_cmd(struct Int32Quat *att_err, bool rate_con
   //G2 is scaled by INDI_G_SCALING to make it readable
   g2_times_du = g2_times_du/INDI_G_SCALING;
 
+#if STABILIZATION_INDI_ALLOCATION_WLS
+  // Make sure the thrust is bounded
+  Bound(stabilization_cmd[COMMAND_THRUST],0, MAX_PPRZ);
+
+  // Desired increments of the outputs, the thrust objective brings the actuators
+  // to the thrust command when it is not given by the outer loop
+  float v[INDI_OUTPUTS] = {angular_accel_ref.p - angular_acceleration[0],
+                           angular_accel_ref.q - angular_acceleration[1],
+                           angular_accel_ref.r - angular_acceleration[2] + g2_times_du,
+                           0.f};
+  if(indi_thrust_increment_set) {
+    v[3] = indi_thrust_increment;
+  } else {
+    for(i=0; i<INDI_NUM_ACT; i++) {
+      v[3] += g1g2[3][i] * (stabilization_cmd[COMMAND_THRUST] - actuator_state_filt_vect[i]);
+    }
+  }
+
+  // Solve in normalized actuator units (fraction of MAX_PPRZ) so that the weights
+  // don't depend on the scale of G
+  float B_n[INDI_OUTPUTS][INDI_NUM_ACT];
+  float du_min[INDI_NUM_ACT], du_max[INDI_NUM_ACT], du_n[INDI_NUM_ACT];
+  for(i=0; i<INDI_NUM_ACT; i++) {
+    int8_t j;
+    for(j=0; j<INDI_OUTPUTS; j++) {
+      B_n[j][i] = g1g2[j][i] * MAX_PPRZ;
+    }
+    du_min[i] = ((act_is_servo[i] ? -MAX_PPRZ : 0) - actuator_state_filt_vect[i]) / MAX_PPRZ;
+    du_max[i] = (MAX_PPRZ - actuator_state_filt_vect[i]) / MAX_PPRZ;
+    du_n[i] = 0.f;
+  }
+  pprz_wls_alloc_float(du_n, v, du_min, du_max, B_n[0], indi_wls_wv, NULL, NULL,
+                       STABILIZATION_INDI_WLS_GAMMA_SQ, INDI_NUM_ACT, INDI_OUTPUTS, STABILIZATION_INDI_WLS_MAX_ITER);
+  float_vect_smul(indi_du, du_n, MAX_PPRZ, INDI_NUM_ACT);
+
+  // Add the increments to the actuators, thrust included
+  float_vect_sum(indi_u, actuator_state_filt_vect, indi_du, INDI_NUM_ACT);
+#else
   // Calculate the increment for each actuator
   for(i=0; i<INDI_NUM_ACT; i++) {
     indi_du[i] = (g1g2_pseudo_inv[i][0] * (angular_accel_ref.p - angular_acceleration[0]))
@@ -379,6 +454,7 @@ static void stabilization_indi_calc_cmd(struct Int32Quat *att_err, bool rate_con
     float indi_cmd_scaling = stabilization_cmd[COMMAND_THRUST] / avg_u_in;
     float_vect_smul(indi_u, indi_u, indi_cmd_scaling, INDI_NUM_ACT);
   }
+#endif
 
   // Bound the inputs to the actuators
   for(i=0; i<INDI_NUM_ACT; i++) {
@@ -607,21 +683,41 @@ void lms_estimation(void) {
 
 /**
  * Function that calculates the pseudo-inverse of (G1+G2).
+ *
+ * During adaptation G changes a little at each step, so the pseudo-inverse
+ * is only computed again when a row of G1+G2 moved by more than
+ * STABILIZATION_INDI_G_UPDATE_TOL of its largest element since the last inversion.
+ * With the WLS allocation, only G1+G2 is needed.
  */
 void calc_g1g2_pseudo_inv(void) {
 
   //sum of G1 and G2
   int8_t i;
   int8_t j;
+  float g1g2_new[INDI_OUTPUTS][INDI_NUM_ACT];
+  bool changed = false;
   for(i=0; i<INDI_OUTPUTS; i++) {
+    float row_max = 0;
     for(j=0; j<INDI_NUM_ACT; j++) {
       if(i!=2)
-        g1g2[i][j] = g1[i][j]/INDI_G_SCALING;
+        g1g2_new[i][j] = g1[i][j]/INDI_G_SCALING;
       else
-        g1g2[i][j] = (g1[i][j] + g2[j])/INDI_G_SCALING;
+        g1g2_new[i][j] = (g1[i][j] + g2[j])/INDI_G_SCALING;
+      row_max = Max(row_max, fabsf(g1g2_new[i][j]));
+    }
+    for(j=0; j<INDI_NUM_ACT && !changed; j++) {
+      changed = fabsf(g1g2_new[i][j] - g1g2[i][j]) > STABILIZATION_INDI_G_UPDATE_TOL * row_max;
     }
   }
 
+  if(!changed && !STABILIZATION_INDI_ALLOCATION_WLS) {
+    return;
+  }
+  float_vect_copy(g1g2[0], g1g2_new[0], INDI_OUTPUTS*INDI_NUM_ACT);
+  if(STABILIZATION_INDI_ALLOCATION_WLS) {
+    return; // the allocation uses G1+G2 directly
+  }
+
   //G1G2*transpose(G1G2)
   //calculate matrix multiplication of its transpose INDI_OUTPUTSxnum_act x num_actxINDI_OUTPUTS
   float element = 0;
@@ -638,13 +734,13 @@ void calc_g1g2_pseudo_inv(void) {
   }
 
   //there are numerical errors if the scaling is not right.
-  float_vect_scale(g1g2_trans_mult[0], 100.0, INDI_OUTPUTS*INDI_NUM_ACT);
+  float_vect_scale(g1g2_trans_mult[0], 100.0, INDI_OUTPUTS*INDI_OUTPUTS);
 
   //inverse of 4x4 matrix
   float_mat_inv_4d(g1g2inv[0], g1g2_trans_mult[0]);
 
   //scale back
-  float_vect_scale(g1g2inv[0], 100.0, INDI_OUTPUTS*INDI_NUM_ACT);
+  float_vect_scale(g1g2inv[0], 100.0, INDI_OUTPUTS*INDI_OUTPUTS);
 
   //G1G2'*G1G2inv
   //calculate matrix multiplication INDI_NUM_ACTxINDI_OUTPUTS x INDI_OUTPUTSxINDI_OUTPUTS
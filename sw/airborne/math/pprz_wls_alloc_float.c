@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file pprz_wls_alloc_float.c
+ * @brief Weighted least squares control allocation with actuator limits.
+ *
+ */
+
+#include "math/pprz_wls_alloc_float.h"
+#include <math.h>
+
+/** Number of rows of the stacked least squares problem */
+#define WLS_M (WLS_N_V_MAX + WLS_N_U_MAX)
+
+/** Tolerance on the Lagrange multipliers and on degenerate columns */
+#define WLS_TOL 1e-7f
+
+/**
+ * Solve min ||A p - d|| with a Householder QR decomposition.
+ * A and d are overwritten.
+ *
+ * @param A matrix [m x n], only the first n columns are used
+ * @param d right hand side [m]
+ * @param p solution [n]
+ */
+static void wls_lsq(float A[WLS_M][WLS_N_U_MAX], float *d, float *p, int m, int n)
+{
+  int i, j, k;
+  for (k = 0; k < n; k++) {
+    float norm = 0.f;
+    for (i = k; i < m; i++) {
+      norm += A[i][k] * A[i][k];
+    }
+    norm = sqrtf(norm);
+    if (norm < WLS_TOL) {
+      continue; // zero column, p[k] will be 0
+    }
+    float alpha = (A[k][k] > 0.f) ? -norm : norm;
+    // householder vector v = x - alpha e_k, stored in column k
+    A[k][k] -= alpha;
+    float vnorm2 = 0.f;
+    for (i = k; i < m; i++) {
+      vnorm2 += A[i][k] * A[i][k];
+    }
+    // apply H = I - 2 v v' / (v' v) to the remaining columns and to d
+    for (j = k + 1; j < n; j++) {
+      float s = 0.f;
+      for (i = k; i < m; i++) {
+        s += A[i][k] * A[i][j];
+      }
+      s = 2.f * s / vnorm2;
+      for (i = k; i < m; i++) {
+        A[i][j] -= s * A[i][k];
+      }
+    }
+    float s = 0.f;
+    for (i = k; i < m; i++) {
+      s += A[i][k] * d[i];
+    }
+    s = 2.f * s / vnorm2;
+    for (i = k; i < m; i++) {
+      d[i] -= s * A[i][k];
+    }
+    A[k][k] = alpha;
+  }
+
+  // back substitution with R
+  for (k = n - 1; k >= 0; k--) {
+    float s = d[k];
+    for (j = k + 1; j < n; j++) {
+      s -= A[k][j] * p[j];
+    }
+    p[k] = (fabsf(A[k][k]) < WLS_TOL) ? 0.f : s / A[k][k];
+  }
+}
+
+int pprz_wls_alloc_float(float *u, const float *v, const float *umin, const float *umax, const float *B,
+                         const float *Wv, const float *Wu, const float *up, float gamma_sq,
+                         int n_u, int n_v, int imax)
+{
+  float A[WLS_M][WLS_N_U_MAX];
+  float b[WLS_M];
+  float d[WLS_M];
+  int8_t W[WLS_N_U_MAX]; // working set: 0 free, -1 at lower bound, 1 at upper bound
+  int m = n_v + n_u;
+  int i, j, k;
+
+  if (n_u > WLS_N_U_MAX || n_v > WLS_N_V_MAX) {
+    return -1;
+  }
+
+  // stacked problem [gamma_sq Wv B; Wu] u = [gamma_sq Wv v; Wu up]
+  for (i = 0; i < n_v; i++) {
+    float w = gamma_sq * (Wv ? Wv[i] : 1.f);
+    for (j = 0; j < n_u; j++) {
+      A[i][j] = w * B[i * n_u + j];
+    }
+    b[i] = w * v[i];
+  }
+  for (i = 0; i < n_u; i++) {
+    float w = Wu ? Wu[i] : 1.f;
+    for (j = 0; j < n_u; j++) {
+      A[n_v + i][j] = (i == j) ? w : 0.f;
+    }
+    b[n_v + i] = up ? w * up[i] : 0.f;
+  }
+
+  // start from a feasible point with an empty working set
+  for (j = 0; j < n_u; j++) {
+    Bound(u[j], umin[j], umax[j]);
+    W[j] = 0;
+  }
+
+  for (int iter = 1; iter <= imax; iter++) {
+    // residual d = b - A u
+    for (i = 0; i < m; i++) {
+      d[i] = b[i];
+      for (j = 0; j < n_u; j++) {
+        d[i] -= A[i][j] * u[j];
+      }
+    }
+
+    // optimal step p on the free actuators
+    int free_idx[WLS_N_U_MAX];
+    int n_free = 0;
+    for (j = 0; j < n_u; j++) {
+      if (W[j] == 0) {
+        free_idx[n_free++] = j;
+      }
+    }
+    float p[WLS_N_U_MAX] = {0.f};
+    if (n_free > 0) {
+      float A_free[WLS_M][WLS_N_U_MAX];
+      float d_free[WLS_M];
+      float p_free[WLS_N_U_MAX];
+      for (i = 0; i < m; i++) {
+        for (k = 0; k < n_free; k++) {
+          A_free[i][k] = A[i][free_idx[k]];
+        }
+        d_free[i] = d[i];
+      }
+      wls_lsq(A_free, d_free, p_free, m, n_free);
+      for (k = 0; k < n_free; k++) {
+        p[free_idx[k]] = p_free[k];
+      }
+    }
+
+    // largest feasible fraction of the step, and the bound that limits it
+    float alpha = 1.f;
+    int limit = -1;
+    for (k = 0; k < n_free; k++) {
+      j = free_idx[k];
+      float a = alpha;
+      if (u[j] + p[j] > umax[j]) {
+        a = (umax[j] - u[j]) / p[j];
+      } else if (u[j] + p[j] < umin[j]) {
+        a = (umin[j] - u[j]) / p[j];
+      }
+      if (a < alpha) {
+        alpha = a;
+        limit = j;
+      }
+    }
+
+    if (limit < 0) {
+      // full step is feasible
+      for (j = 0; j < n_u; j++) {
+        u[j] += p[j];
+      }
+      for (i = 0; i < m; i++) {
+        for (j = 0; j < n_u; j++) {
+          d[i] -= A[i][j] * p[j];
+        }
+      }
+      // Lagrange multipliers of the active bounds, lambda = W .* (A' d)
+      float lambda_min = -WLS_TOL;
+      int release = -1;
+      for (j = 0; j < n_u; j++) {
+        if (W[j] == 0) {
+          continue;
+        }
+        float lambda = 0.f;
+        for (i = 0; i < m; i++) {
+          lambda += A[i][j] * d[i];
+        }
+        lambda *= W[j];
+        if (lambda < lambda_min) {
+          lambda_min = lambda;
+          release = j;
+        }
+      }
+      if (release < 0) {
+        return iter; // optimal
+      }
+      W[release] = 0;
+    } else {
+      // partial step up to the first violated bound, which becomes active
+      for (j = 0; j < n_u; j++) {
+        u[j] += alpha * p[j];
+      }
+      if (p[limit] > 0.f) {
+        u[limit] = umax[limit];
+        W[limit] = 1;
+      } else {
+        u[limit] = umin[limit];
+        W[limit] = -1;
+      }
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file pprz_wls_alloc_float.h
+ * @brief Weighted least squares control allocation with actuator limits.
+ *
+ */
+
+#ifndef PPRZ_WLS_ALLOC_FLOAT_H
+#define PPRZ_WLS_ALLOC_FLOAT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "std.h"
+
+/** Maximum number of actuators (columns of the effectiveness matrix)
+ *  The work arrays are sized at compile time from these values.
+ */
+#ifndef WLS_N_U_MAX
+#define WLS_N_U_MAX 8
+#endif
+
+/** Maximum number of controlled outputs (rows of the effectiveness matrix) */
+#ifndef WLS_N_V_MAX
+#define WLS_N_V_MAX 4
+#endif
+
+/** Weighted least squares control allocation
+ *
+ * Active set solver of
+ *  @f[
+ *  \min_u \| W_u (u - u_p) \|^2 + \gamma \| W_v (B u - v) \|^2
+ *  \quad \mathrm{s.t.} \quad u_{min} \le u \le u_{max}
+ *  @f]
+ * Each iteration solves the unconstrained problem on the free actuators with a
+ * Householder QR decomposition, then either adds the first violated bound to the
+ * working set or releases the bound with the most negative Lagrange multiplier.
+ *
+ * Härkegård, O. "Efficient active set algorithms for solving constrained least squares
+ * problems in aircraft control allocation", CDC 2002.
+ *
+ * @param[in,out] u initial guess (clipped to the bounds) and solution [n_u]
+ * @param[in] v desired control objective [n_v]
+ * @param[in] umin lower bounds of u [n_u]
+ * @param[in] umax upper bounds of u [n_u]
+ * @param[in] B control effectiveness matrix, row major [n_v x n_u]
+ * @param[in] Wv diagonal of the output weighting matrix [n_v], NULL for identity
+ * @param[in] Wu diagonal of the actuator weighting matrix [n_u], NULL for identity
+ * @param[in] up preferred actuator values [n_u], NULL for zeros
+ * @param[in] gamma_sq square root of the weight gamma on the control objective
+ * @param[in] n_u number of actuators (<= WLS_N_U_MAX)
+ * @param[in] n_v number of outputs (<= WLS_N_V_MAX)
+ * @param[in] imax maximum number of iterations
+ * @return number of iterations, -1 if the maximum was reached before convergence
+ */
+extern int pprz_wls_alloc_float(float *u, const float *v, const float *umin, const float *umax, const float *B,
+                                const float *Wv, const float *Wu, const float *up, float gamma_sq,
+                                int n_u, int n_v, int imax);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* PPRZ_WLS_ALLOC_FLOAT_H */
@@ -230,6 +230,10 @@ void mcu_init(void)
 
 void mcu_event(void)
 {
+#if USING_UART
+  uart_event();
+#endif
+
 #if USING_I2C
   i2c_event();
 #endif
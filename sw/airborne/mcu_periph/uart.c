@@ -238,6 +238,7 @@ void uart_periph_init(struct uart_periph *p)
   p->ore = 0;
   p->ne_err = 0;
   p->fe_err = 0;
+  p->tx_dropped = 0;
   p->device.periph = (void *)p;
   p->device.check_free_space = (check_free_space_t) uart_check_free_space;
   p->device.put_byte = (put_byte_t) uart_put_byte;
@@ -292,10 +293,29 @@ uint16_t WEAK uart_char_available(struct uart_periph *p)
   return (uint16_t)available;
 }
 
+uint16_t WEAK uart_rx_span(struct uart_periph *p, uint8_t **data)
+{
+  uint16_t insert = p->rx_insert_idx;
+  *data = &p->rx_buf[p->rx_extract_idx];
+  if (insert >= p->rx_extract_idx) {
+    return insert - p->rx_extract_idx;
+  }
+  return UART_RX_BUFFER_SIZE - p->rx_extract_idx;
+}
+
+void WEAK uart_rx_consume(struct uart_periph *p, uint16_t len)
+{
+  p->rx_extract_idx = (p->rx_extract_idx + len) % UART_RX_BUFFER_SIZE;
+}
+
 void WEAK uart_arch_init(void)
 {
 }
 
+void WEAK uart_event(void)
+{
+}
+
 void WEAK uart_periph_invert_data_logic(struct uart_periph *p __attribute__((unused)), bool invert_rx __attribute__((unused)), bool invert_tx __attribute__((unused)))
 {
 }
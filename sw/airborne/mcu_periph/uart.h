@@ -88,6 +88,7 @@ struct uart_periph {
   volatile uint16_t ore;    ///< overrun error counter
   volatile uint16_t ne_err; ///< noise error counter
   volatile uint16_t fe_err; ///< framing error counter
+  volatile uint16_t tx_dropped; ///< bytes dropped because the tx buffer stayed full (linux)
   /** Generic device interface */
   struct link_device device;
 };
@@ -110,9 +111,33 @@ extern uint8_t uart_getch(struct uart_periph *p);
  */
 extern uint16_t uart_char_available(struct uart_periph *p);
 
+/**
+ * Get the received bytes that are contiguous in the receive buffer, without copying them.
+ * When the received bytes wrap around the end of the buffer, only the first part is returned,
+ * the rest is returned by the next call after uart_rx_consume().
+ * The bytes stay valid until they are released with uart_rx_consume().
+ * @param p uart peripheral
+ * @param data set to the first received byte
+ * @return number of contiguous bytes available at data
+ */
+extern uint16_t uart_rx_span(struct uart_periph *p, uint8_t **data);
+
+/**
+ * Release received bytes from the receive buffer.
+ * @param p uart peripheral
+ * @param len number of bytes to release, at most the length returned by uart_rx_span()
+ */
+extern void uart_rx_consume(struct uart_periph *p, uint16_t len);
+
 
 extern void uart_arch_init(void);
 
+/**
+ * UART event function, called from mcu_event().
+ * Architectures that buffer the transmitted bytes flush them from here.
+ */
+extern void uart_event(void);
+
 #if USE_UART0
 extern struct uart_periph uart0;
 extern void uart0_init(void);
@@ -32,11 +32,16 @@
 #include "mcu_periph/udp_arch.h"
 #include "pprzlink/pprzlink_device.h"
 
+/** Size of the receive ring, one byte is always kept free (max 32768) */
+#ifndef UDP_RX_BUFFER_SIZE
 #define UDP_RX_BUFFER_SIZE 256
+#endif
 #define UDP_TX_BUFFER_SIZE 256
 
 struct udp_periph {
-  /** Receive buffer */
+  /** Receive buffer
+   *  single producer (arch receive function) / single consumer (main loop) ring
+   */
   uint8_t rx_buf[UDP_RX_BUFFER_SIZE];
   uint16_t rx_insert_idx;
   uint16_t rx_extract_idx;
@@ -54,6 +59,7 @@ extern bool     udp_check_free_space(struct udp_periph *p, long *fd, uint16_t le
 extern void     udp_put_byte(struct udp_periph *p, long fd, uint8_t data);
 extern uint16_t udp_char_available(struct udp_periph *p);
 extern uint8_t  udp_getch(struct udp_periph *p);
+extern uint16_t udp_read(struct udp_periph *p, uint8_t *buf, uint16_t len);
 extern void     udp_arch_periph_init(struct udp_periph *p, char *host, int port_out, int port_in, bool broadcast);
 extern void     udp_send_message(struct udp_periph *p, long fd);
 extern void     udp_send_raw(struct udp_periph *p, long fd, uint8_t *buffer, uint16_t size);
@@ -29,165 +29,408 @@
 
 #include "blob_finder.h"
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 
-void image_labeling(struct image_t *input, struct image_t *output, struct image_filter_t *filters, uint8_t filters_cnt,
-                    struct image_label_t *labels, uint16_t *labels_count)
+/**
+ * Number of horizontal strips (threads) the image is labeled in (1 == only the calling thread).
+ * Every strip gets an equal part of the labels, the strips are merged afterwards.
+ */
+#ifndef BLOB_LABELING_THREADS
+#define BLOB_LABELING_THREADS 1
+#endif
+
+/** Maximum number of threads, the worker structures are allocated at compile time */
+#ifndef BLOB_LABELING_MAX_THREADS
+#define BLOB_LABELING_MAX_THREADS 4
+#endif
+
+/** Label of the pixels not passing any filter */
+#define BLOB_NO_LABEL 0xFFFF
+
+uint8_t blob_labeling_threads = BLOB_LABELING_THREADS;
+
+/* A labeling job: one image with its filters */
+struct blob_job_t {
+  const uint8_t *input_buf;       ///< The UYVY input image
+  uint16_t *output_buf;           ///< The label image
+  uint16_t w;                     ///< Width of the input image
+  uint16_t h;                     ///< Height of the input image
+  uint16_t output_w;              ///< Width of the label image
+  struct image_label_t *labels;   ///< The labels
+  uint32_t lut_y[256];            ///< Bit f is set when the Y value passes filter f
+  uint32_t lut_u[256];            ///< Bit f is set when the U value passes filter f
+  uint32_t lut_v[256];            ///< Bit f is set when the V value passes filter f
+};
+
+/* A horizontal strip of the image */
+struct blob_strip_t {
+  pthread_t thread;               ///< The worker thread labeling this strip
+  uint16_t y_start;               ///< First row of the strip
+  uint16_t y_end;                 ///< Last row (exclusive) of the strip
+  uint16_t label_start;           ///< First label of the strip
+  uint16_t label_size;            ///< Amount of labels available for the strip
+  uint16_t label_cnt;             ///< Amount of labels used by the strip
+  bool overflow;                  ///< The strip ran out of labels
+};
+
+/* The pool of worker threads, shared by all image_labeling calls */
+static struct {
+  pthread_mutex_t owner;          ///< Held by the image_labeling call using the workers
+  pthread_mutex_t mutex;          ///< Protects the job information
+  pthread_cond_t job_cond;        ///< Signalled when a new job is available
+  pthread_cond_t done_cond;       ///< Signalled when all workers finished the job
+  uint8_t started;                ///< Amount of workers started
+  uint8_t active;                 ///< Amount of strips of the current job
+  uint8_t busy;                   ///< Amount of workers still working on the current job
+  uint32_t job_id;                ///< Incremented for every new job
+  struct blob_job_t *job;         ///< The current job
+  struct blob_strip_t strips[BLOB_LABELING_MAX_THREADS];
+} blob_pool = {
+  .owner = PTHREAD_MUTEX_INITIALIZER,
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .job_cond = PTHREAD_COND_INITIALIZER,
+  .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * Find the root of a label, halving the path on the way.
+ * The root of a set is always its lowest label, so every label points to a lower (or the same) label.
+ * @param[in] *labels The labels, the id is used as parent
+ * @param[in] lid The label
+ * @return The root label
+ */
+static inline uint16_t blob_find(struct image_label_t *labels, uint16_t lid)
 {
-  uint8_t *input_buf = (uint8_t *)input->buf;
-  uint16_t *output_buf = (uint16_t *)output->buf;
+  while (labels[lid].id != lid) {
+    labels[lid].id = labels[labels[lid].id].id;
+    lid = labels[lid].id;
+  }
+  return lid;
+}
 
-  // Initialize labels
-  uint16_t labels_size = *labels_count;
-  uint16_t labels_cnt = 0;
-  uint16_t i, x, y;
+/**
+ * Merge the sets of two labels
+ * @param[in] *labels The labels, the id is used as parent
+ * @param[in] a The first label
+ * @param[in] b The second label
+ */
+static inline void blob_union(struct image_label_t *labels, uint16_t a, uint16_t b)
+{
+  a = blob_find(labels, a);
+  b = blob_find(labels, b);
+  if (a < b) {
+    labels[b].id = a;
+  } else {
+    labels[a].id = b;
+  }
+}
 
-  // Initialize first line with empty groups
-  uint16_t *p = output_buf;
-  for (i = 0; i < output->w; i++) {
-    *p++ = 0xffff;
-  }
-
-  // Do steps of 2 for YUV image
-  // Skip first line as we need previous groups for connectivity
-  for (y = 1; y < input->h; y++) {
-    for (x = 0; x < input->w / 2; x++) {
-      uint16_t lid = 0;
-      uint8_t p_y = (input_buf[y * input->w * 2 + x * 4 + 1] + input_buf[y * input->w * 2 + x * 4 + 3]) / 2;
-      uint8_t p_u = input_buf[y * input->w * 2 + x * 4];
-      uint8_t p_v = input_buf[y * input->w * 2 + x * 4 + 2];
-
-      // Go trough the filters
-      uint8_t f = 0;
-      for (; f < filters_cnt; f++) {
-        if (p_y > filters[f].y_min && p_y < filters[f].y_max &&
-            p_u > filters[f].u_min && p_u < filters[f].u_max &&
-            p_v > filters[f].v_min && p_v < filters[f].v_max) {
-          break;
-        }
-      }
+/**
+ * Label a strip of the image with 8-connectivity.
+ * The neighbours are checked in the order top, top right, top left, left: when the top pixel
+ * belongs to the same filter all other neighbours are connected to it, so only the top right
+ * label can start an equivalence.
+ * @param[in] *job The labeling job
+ * @param[in,out] *strip The strip, the amount of used labels is returned in it
+ */
+static void blob_label_strip(struct blob_job_t *job, struct blob_strip_t *strip)
+{
+  struct image_label_t *labels = job->labels;
+  uint16_t label_end = strip->label_start + strip->label_size;
+  uint16_t lid_new = strip->label_start;
+  bool overflow = false;
+
+#define BLOB_MATCH(lid) ((lid) != BLOB_NO_LABEL && labels[(lid)].filter == f)
 
-      // Check if this pixel belongs to a filter else goto next
-      if (f >= filters_cnt) {
-        output_buf[y * output->w + x] = 0xFFFF;
+  for (uint16_t y = strip->y_start; y < strip->y_end; y++) {
+    const uint8_t *in = job->input_buf + (uint32_t)y * job->w * 2;
+    uint16_t *out = job->output_buf + (uint32_t)y * job->output_w;
+    const uint16_t *up = (y > strip->y_start) ? out - job->output_w : NULL;
+
+    for (uint16_t x = 0; x < job->w; x++) {
+      // Classify the pixel: UYVY, every pixel has its own Y and shares U/V with its neighbour
+      const uint8_t *uyvy = in + (x & 0xFFFE) * 2;
+      uint32_t mask = job->lut_u[uyvy[0]] & job->lut_v[uyvy[2]] & job->lut_y[in[x * 2 + 1]];
+      if (mask == 0) {
+        out[x] = BLOB_NO_LABEL;
         continue;
       }
+      uint8_t f = __builtin_ctz(mask);
 
-      // Check pixel above (if the same filter then take same group)
-      lid = output_buf[(y - 1) * output->w + x];
-      if (y > 0 && lid < labels_size && labels[lid].filter == f) {
-        output_buf[y * output->w + x] = lid;
-        labels[lid].pixel_cnt++;
-        labels[lid].x_sum += x;
-        labels[lid].y_sum += y;
+      uint16_t lid;
+      uint16_t lid_l = (x > 0) ? out[x - 1] : BLOB_NO_LABEL;
+      if (up != NULL && BLOB_MATCH(up[x])) {
+        // Top
+        lid = up[x];
+      } else if (up != NULL && x < job->w - 1 && BLOB_MATCH(up[x + 1])) {
+        // Top right, can connect to top left or left
+        lid = up[x + 1];
+        if (x > 0 && BLOB_MATCH(up[x - 1])) {
+          blob_union(labels, lid, up[x - 1]);
+        } else if (BLOB_MATCH(lid_l)) {
+          blob_union(labels, lid, lid_l);
+        }
+      } else if (up != NULL && x > 0 && BLOB_MATCH(up[x - 1])) {
+        // Top left
+        lid = up[x - 1];
+      } else if (BLOB_MATCH(lid_l)) {
+        // Left
+        lid = lid_l;
+      } else if (lid_new < label_end) {
+        // Create a new label
+        lid = lid_new++;
+        labels[lid].id = lid;
+        labels[lid].filter = f;
+        labels[lid].pixel_cnt = 0;
+        labels[lid].x_min = x;
+        labels[lid].x_max = x;
+        labels[lid].y_min = y;
+        labels[lid].x_sum = 0;
+        labels[lid].y_sum = 0;
+      } else {
+        // Out of labels
+        out[x] = BLOB_NO_LABEL;
+        overflow = true;
         continue;
       }
 
-      // Check pixel top right (check for merging)
-      lid = output_buf[(y - 1) * output->w + x + 1];
-      if (y > 0 && x < output->w - 1 && lid < labels_size && labels[lid].filter == f) {
-
-        // Merging labels if needed
-        uint16_t lid_tl = output_buf[(y - 1) * output->w + x - 1]; // Top left
-        uint16_t lid_l = output_buf[y * output->w + x - 1]; // Left
-        uint16_t m = labels[lid].id, n = labels[lid].id;
-        if (x > 0 && lid_tl < labels_size && labels[lid_tl].filter == f) {
-          // Merge with top left
-          m = labels[lid].id;
-          n = labels[lid_tl].id;
-        } else if (x > 0 && lid_l < labels_size && labels[lid_l].filter == f) {
-          // Merge with left
-          m = labels[lid].id;
-          n = labels[lid_l].id;
-        }
+      out[x] = lid;
+      labels[lid].pixel_cnt++;
+      labels[lid].x_sum += x;
+      labels[lid].y_sum += y;
+      labels[lid].y_max = y;
+      if (x < labels[lid].x_min) { labels[lid].x_min = x; }
+      if (x > labels[lid].x_max) { labels[lid].x_max = x; }
+    }
+  }
 
-        // Change the id of the highest id label
-        if (m != n) {
-          if (m > n) {
-            m = n;
-            n = labels[lid].id;
-          }
-
-          for (i = 0; i < labels_cnt; i++) {
-            if (labels[i].id == n) {
-              labels[i].id = m;
-            }
-          }
-        }
+#undef BLOB_MATCH
 
-        // Update the label
-        output_buf[y * output->w + x] = lid;
-        labels[lid].pixel_cnt++;
-        labels[lid].x_sum += x;
-        labels[lid].y_sum += y;
-        continue;
-      }
+  strip->label_cnt = lid_new - strip->label_start;
+  strip->overflow = overflow;
+}
 
-      // Take top left
-      lid = output_buf[(y - 1) * output->w + x - 1];
-      if (y > 0 && x > 0 && lid < labels_size && labels[lid].filter == f) {
-        output_buf[y * output->w + x] = lid;
-        labels[lid].pixel_cnt++;
-        labels[lid].x_sum += x;
-        labels[lid].y_sum += y;
-        continue;
-      }
+/**
+ * The worker thread, labels its strip for every job
+ * @param[in] *data The strip structure
+ */
+static void *blob_worker_thread(void *data)
+{
+  struct blob_strip_t *strip = (struct blob_strip_t *)data;
+  uint8_t idx = strip - blob_pool.strips;
+  uint32_t last_job = 0;
 
-      // Take left
-      lid = output_buf[y * output->w + x - 1];
-      if (x > 0 && lid < labels_size && labels[lid].filter == f) {
-        output_buf[y * output->w + x] = lid;
-        labels[lid].pixel_cnt++;
-        labels[lid].x_sum += x;
-        labels[lid].y_sum += y;
-        continue;
-      }
+  pthread_mutex_lock(&blob_pool.mutex);
+  while (true) {
+    // Wait for a new job
+    while (blob_pool.job_id == last_job) {
+      pthread_cond_wait(&blob_pool.job_cond, &blob_pool.mutex);
+    }
+    last_job = blob_pool.job_id;
+
+    // Not needed for this job
+    if (idx >= blob_pool.active) {
+      continue;
+    }
+
+    struct blob_job_t *job = blob_pool.job;
+    pthread_mutex_unlock(&blob_pool.mutex);
 
-      // Check if there is enough space
-      if (labels_cnt >= labels_size - 1) {
+    blob_label_strip(job, strip);
+
+    // Report back
+    pthread_mutex_lock(&blob_pool.mutex);
+    if (--blob_pool.busy == 0) {
+      pthread_cond_signal(&blob_pool.done_cond);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Label the image in strips, split over the calling thread and the workers
+ * @param[in] *job The labeling job
+ * @param[in] labels_size The amount of labels available
+ * @param[out] *strips The labeled strips [BLOB_LABELING_MAX_THREADS]
+ * @return The amount of strips
+ */
+static uint8_t blob_label_strips(struct blob_job_t *job, uint16_t labels_size, struct blob_strip_t *strips)
+{
+  uint8_t n_threads = blob_labeling_threads;
+  if (n_threads > BLOB_LABELING_MAX_THREADS) {
+    n_threads = BLOB_LABELING_MAX_THREADS;
+  }
+
+  // Label in one strip when the workers are used by another caller (e.g. another camera)
+  if (n_threads > 1 && pthread_mutex_trylock(&blob_pool.owner) != 0) {
+    n_threads = 1;
+  }
+
+  if (n_threads > 1) {
+    // Start extra workers if needed (they keep running for the next calls)
+    while (blob_pool.started + 1 < n_threads) {
+      struct blob_strip_t *strip = &blob_pool.strips[blob_pool.started + 1];
+      if (pthread_create(&strip->thread, NULL, blob_worker_thread, strip) != 0) {
+        printf("[blob_finder] Could not create worker thread %d\n", blob_pool.started + 1);
         break;
       }
+      blob_pool.started++;
+    }
+    if (n_threads > blob_pool.started + 1) {
+      n_threads = blob_pool.started + 1;
+    }
+    if (n_threads > job->h) {
+      n_threads = 1;
+    }
+    if (n_threads <= 1) {
+      pthread_mutex_unlock(&blob_pool.owner);
+    }
+  }
+
+  if (n_threads <= 1) {
+    strips[0].y_start = 0;
+    strips[0].y_end = job->h;
+    strips[0].label_start = 0;
+    strips[0].label_size = labels_size;
+    blob_label_strip(job, &strips[0]);
+    return 1;
+  }
+
+  // Hand out the strips, the calling thread takes the first one
+  pthread_mutex_lock(&blob_pool.mutex);
+  for (uint8_t t = 0; t < n_threads; t++) {
+    blob_pool.strips[t].y_start = (uint32_t)job->h * t / n_threads;
+    blob_pool.strips[t].y_end = (uint32_t)job->h * (t + 1) / n_threads;
+    blob_pool.strips[t].label_start = (uint32_t)labels_size * t / n_threads;
+    blob_pool.strips[t].label_size = (uint32_t)labels_size * (t + 1) / n_threads - blob_pool.strips[t].label_start;
+  }
+  blob_pool.job = job;
+  blob_pool.active = n_threads;
+  blob_pool.busy = n_threads - 1;
+  blob_pool.job_id++;
+  pthread_cond_broadcast(&blob_pool.job_cond);
+  pthread_mutex_unlock(&blob_pool.mutex);
+
+  blob_label_strip(job, &blob_pool.strips[0]);
 
-      // Create new group
-      lid = labels_cnt;
-      output_buf[y * output->w + x] = lid;
-      labels[lid].id = lid;
-      labels[lid].filter = f;
-      labels[lid].pixel_cnt = 1;
-      labels[lid].x_min = x;
-      labels[lid].y_min = y;
-      labels[lid].x_sum = x;
-      labels[lid].y_sum = y;
-      labels_cnt++;
+  // Wait for the workers to finish
+  pthread_mutex_lock(&blob_pool.mutex);
+  while (blob_pool.busy > 0) {
+    pthread_cond_wait(&blob_pool.done_cond, &blob_pool.mutex);
+  }
+  pthread_mutex_unlock(&blob_pool.mutex);
+  memcpy(strips, blob_pool.strips, n_threads * sizeof(struct blob_strip_t));
+  pthread_mutex_unlock(&blob_pool.owner);
+  return n_threads;
+}
+
+void image_labeling(struct image_t *input, struct image_t *output, struct image_filter_t *filters, uint8_t filters_cnt,
+                    struct image_label_t *labels, uint16_t *labels_count)
+{
+  struct blob_job_t job;
+  uint16_t labels_size = (*labels_count < BLOB_NO_LABEL) ? *labels_count : BLOB_NO_LABEL;
+  uint16_t i, x, y;
+
+  if (filters_cnt > 32) {
+    printf("[blob_finder] Only the first 32 of %d filters are used\n", filters_cnt);
+    filters_cnt = 32;
+  }
+
+  // Color lookup tables, a pixel passes filter f when bit f is set in the tables of its Y, U and V value
+  for (i = 0; i < 256; i++) {
+    job.lut_y[i] = 0;
+    job.lut_u[i] = 0;
+    job.lut_v[i] = 0;
+    for (uint8_t f = 0; f < filters_cnt; f++) {
+      if (i > filters[f].y_min && i < filters[f].y_max) { job.lut_y[i] |= 1u << f; }
+      if (i > filters[f].u_min && i < filters[f].u_max) { job.lut_u[i] |= 1u << f; }
+      if (i > filters[f].v_min && i < filters[f].v_max) { job.lut_v[i] |= 1u << f; }
     }
   }
 
-  if (labels_cnt >= labels_size - 1) {
-    printf("Break did not work: we have %d labels\n", labels_cnt);
+  job.input_buf = (const uint8_t *)input->buf;
+  job.output_buf = (uint16_t *)output->buf;
+  job.w = input->w & 0xFFFE;  // UYVY holds pairs of pixels
+  job.h = input->h;
+  job.output_w = output->w;
+  job.labels = labels;
+
+  // Label the strips
+  struct blob_strip_t strips[BLOB_LABELING_MAX_THREADS];
+  uint8_t n_strips = blob_label_strips(&job, labels_size, strips);
+  for (uint8_t s = 0; s < n_strips; s++) {
+    if (strips[s].overflow) {
+      printf("[blob_finder] Out of labels (%d in %d strips), not all pixels are labeled\n", labels_size, n_strips);
+      break;
+    }
   }
 
-  // Merge connected labels
-  for (i = 0; i < labels_cnt; i++) {
-    if (labels[i].id != i) {
-      uint16_t new_id = labels[i].id;
-      labels[new_id].pixel_cnt += labels[i].pixel_cnt;
-      labels[new_id].x_sum += labels[i].x_sum;
-      labels[new_id].y_sum += labels[i].y_sum;
+  // Merge the labels over the strip borders
+  for (uint8_t s = 1; s < n_strips; s++) {
+    y = strips[s].y_start;
+    uint16_t *out = job.output_buf + (uint32_t)y * job.output_w;
+    uint16_t *up = out - job.output_w;
+    for (x = 0; x < job.w; x++) {
+      if (out[x] == BLOB_NO_LABEL) {
+        continue;
+      }
+      uint8_t f = labels[out[x]].filter;
+      for (int16_t dx = -1; dx <= 1; dx++) {
+        if ((x == 0 && dx < 0) || (x == job.w - 1 && dx > 0)) {
+          continue;
+        }
+        uint16_t lid = up[x + dx];
+        if (lid != BLOB_NO_LABEL && labels[lid].filter == f) {
+          blob_union(labels, out[x], lid);
+        }
+      }
+    }
+  }
 
-      //printf("%d == %d,  ",new_id, i);
+  // Point every label directly to its root (parents are always lower labels)
+  for (uint8_t s = 0; s < n_strips; s++) {
+    for (i = strips[s].label_start; i < strips[s].label_start + strips[s].label_cnt; i++) {
+      labels[i].id = labels[labels[i].id].id;
+    }
+  }
 
-      if (labels[i].x_min < labels[new_id].x_min) { labels[new_id].x_min = labels[i].x_min; }
-      if (labels[i].y_min < labels[new_id].y_min) { labels[new_id].y_min = labels[i].y_min; }
+  // Gather the moments of every blob in its root and number the blobs from 0
+  uint16_t blob_id[labels_size > 0 ? labels_size : 1];
+  uint16_t blobs_cnt = 0;
+  for (uint8_t s = 0; s < n_strips; s++) {
+    for (i = strips[s].label_start; i < strips[s].label_start + strips[s].label_cnt; i++) {
+      uint16_t root = labels[i].id;
+      if (root == i) {
+        blob_id[i] = blobs_cnt;
+        if (blobs_cnt != i) {
+          labels[blobs_cnt] = labels[i];
+        }
+        labels[blobs_cnt].id = blobs_cnt;
+        blobs_cnt++;
+      } else {
+        struct image_label_t *blob = &labels[blob_id[root]];
+        blob_id[i] = blob_id[root];
+        blob->pixel_cnt += labels[i].pixel_cnt;
+        blob->x_sum += labels[i].x_sum;
+        blob->y_sum += labels[i].y_sum;
+        if (labels[i].x_min < blob->x_min) { blob->x_min = labels[i].x_min; }
+        if (labels[i].x_max > blob->x_max) { blob->x_max = labels[i].x_max; }
+        if (labels[i].y_min < blob->y_min) { blob->y_min = labels[i].y_min; }
+        if (labels[i].y_max > blob->y_max) { blob->y_max = labels[i].y_max; }
+      }
     }
   }
 
-  *labels_count = labels_cnt;
+  *labels_count = blobs_cnt;
 
-  // Replace ID's
-  for (y = 0; y < input->h; y++) {
-    for (x = 0; x < input->w / 2; x++) {
-      uint16_t lid = output_buf[y * output->w + x];
-      if (lid < labels_cnt) {
-        output_buf[y * output->w + x] = labels[lid].id;
+  // Replace the labels by the blob ids
+  for (y = 0; y < job.h; y++) {
+    uint16_t *out = job.output_buf + (uint32_t)y * job.output_w;
+    for (x = 0; x < job.w; x++) {
+      if (out[x] != BLOB_NO_LABEL) {
+        out[x] = blob_id[out[x]];
       }
     }
   }
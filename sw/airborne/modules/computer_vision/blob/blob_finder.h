@@ -50,6 +50,8 @@ struct image_label_t {
   uint32_t pixel_cnt;       ///< Number of pixels in the blob
   uint16_t x_min;           ///< Top left corner
   uint16_t y_min;
+  uint16_t x_max;           ///< Bottom right corner
+  uint16_t y_max;
   uint32_t x_sum;           ///< Sum of all x coordinates (used to find center of gravity)
   uint32_t y_sum;
 
@@ -59,6 +61,19 @@ struct image_label_t {
   uint16_t corners[4];
 };
 
+extern uint8_t blob_labeling_threads;
+
+/**
+ * Label the connected (8-connectivity) pixels passing the same color filter.
+ * Every pixel of the UYVY image is classified with its own Y and the U/V it shares with its neighbour.
+ * A pixel passes filter f when min < value < max for all of Y, U and V, the first passing filter is used.
+ * @param[in] *input The UYVY input image
+ * @param[out] *output The label image (int16 per pixel, at least as large as the input), 0xFFFF when no filter passed
+ * @param[in] *filters The color filters (max 32)
+ * @param[in] filters_cnt The amount of filters
+ * @param[out] *labels The blobs, numbered from 0 with their pixel count, coordinate sums and bounding box
+ * @param[in,out] *labels_count The size of labels in, the amount of blobs out
+ */
 void image_labeling(struct image_t *input, struct image_t *output, struct image_filter_t *filters, uint8_t filters_cnt,
                     struct image_label_t *labels, uint16_t *labels_count);
 
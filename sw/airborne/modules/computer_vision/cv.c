@@ -30,10 +30,22 @@
 
 #include "cv.h"
 #include "rt_priority.h"
+#include "mcu_periph/sys_time.h"
 
+/**
+ * Share the frames of the video device with the asynchronous listeners instead of
+ * copying them. The async listener reads the shared buffer while the next listeners run,
+ * so a frame is only shared when the async listener and all the synchronous listeners
+ * after it are marked read_only. The others (like the blob locator overlay) may change
+ * the frame in place and the async listener gets a copy.
+ */
+#ifndef CV_ASYNC_ZERO_COPY
+#define CV_ASYNC_ZERO_COPY TRUE
+#endif
+PRINT_CONFIG_VAR(CV_ASYNC_ZERO_COPY)
 
 void cv_attach_listener(struct video_config_t *device, struct video_listener *new_listener);
-int8_t cv_async_function(struct cv_async *async, struct image_t *img);
+int8_t cv_async_function(struct cv_async *async, struct image_t *img, bool share);
 void *cv_async_thread(void *args);
 
 
@@ -54,6 +66,8 @@ struct video_listener *cv_add_to_device(struct video_config_t *device, cv_functi
   new_listener->next = NULL;
   new_listener->async = NULL;
   new_listener->maximum_fps = 0;
+  new_listener->latency = 0;
+  new_listener->read_only = false;
 
   // Initialise the device that we want our function to use
   add_video_device(device);
@@ -89,7 +103,9 @@ struct video_listener *cv_add_to_device_async(struct video_config_t *device, cv_
   listener->async->thread_priority = nice_level;
 
   // Explicitly mark img_copy as uninitialized
+  listener->async->device = device;
   listener->async->img_copy.buf_size = 0;
+  listener->async->img_is_shared = false;
 
   // Initialize mutex and condition variable
   pthread_mutex_init(&listener->async->img_mutex, NULL);
@@ -102,21 +118,30 @@ struct video_listener *cv_add_to_device_async(struct video_config_t *device, cv_
 }
 
 
-int8_t cv_async_function(struct cv_async *async, struct image_t *img)
+int8_t cv_async_function(struct cv_async *async, struct image_t *img, bool share)
 {
   // If the previous image is not yet processed, return
   if (!async->img_processed || pthread_mutex_trylock(&async->img_mutex) != 0) {
     return -1;
   }
 
-  // If the image has not been initialized, do it
-  if (async->img_copy.buf_size == 0) {
-    image_create(&async->img_copy, img->w, img->h, img->type);
-  }
+#if CV_ASYNC_ZERO_COPY
+  // Try to share the frame with the video thread without copying
+  if (share && video_thread_image_ref(async->device, img)) {
+    async->img_shared = *img;
+    async->img_is_shared = true;
+  } else
+#endif
+  {
+    // If the image has not been initialized, do it
+    if (async->img_copy.buf_size == 0) {
+      image_create(&async->img_copy, img->w, img->h, img->type);
+    }
 
-  // Copy image
-// TODO:this takes time causing some thread lag, should be replaced with gpu operation
-  image_copy(img, &async->img_copy);
+    // Copy image, only when the frame could not be shared
+    image_copy(img, &async->img_copy);
+    async->img_is_shared = false;
+  }
 
   // Inform thread of new image
   async->img_processed = false;
@@ -148,10 +173,23 @@ void *cv_async_thread(void *args)
     }
 
     // Execute vision function from this thread
-    listener->func(&async->img_copy);
+    if (async->img_is_shared) {
+      listener->func(&async->img_shared);
+      video_thread_latency_update(&listener->latency, async->img_shared.pprz_ts);
+      video_thread_image_unref(async->device, &async->img_shared);
+      async->img_is_shared = false;
+    } else {
+      listener->func(&async->img_copy);
+      video_thread_latency_update(&listener->latency, async->img_copy.pprz_ts);
+    }
 
     // Mark image as processed
     async->img_processed = true;
+
+#if USE_EVENT_LOOP
+    // Wake up the main loop to handle the results
+    sys_time_event_notify();
+#endif
   }
 
   pthread_mutex_unlock(&async->img_mutex);
@@ -159,9 +197,28 @@ void *cv_async_thread(void *args)
 }
 
 
+/**
+ * Check whether a frame can be shared with an asynchronous listener instead of copied
+ * @param[in] *async_listener The asynchronous listener
+ * @return TRUE when neither this listener nor the next synchronous ones change the frame
+ */
+static bool cv_async_can_share(struct video_listener *async_listener)
+{
+  if (!async_listener->read_only) {
+    return false;
+  }
+  for (struct video_listener *l = async_listener->next; l != NULL; l = l->next) {
+    if (l->active && l->async == NULL && !l->read_only) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void cv_run_device(struct video_config_t *device, struct image_t *img)
 {
   struct image_t *result;
+  uint32_t capture_ts = img->pprz_ts;
 
   // Loop through computer vision pipeline
   for (struct video_listener *listener = device->cv_listener; listener != NULL; listener = listener->next) {
@@ -177,13 +234,14 @@ void cv_run_device(struct video_config_t *device, struct image_t *img)
 
     if (listener->async != NULL) {
       // Send image to asynchronous thread, only update listener if successful
-      if (!cv_async_function(listener->async, img)) {
+      if (!cv_async_function(listener->async, img, cv_async_can_share(listener))) {
         // Store timestamp
         listener->ts = img->ts;
       }
     } else {
       // Execute the cvFunction and catch result
       result = listener->func(img);
+      video_thread_latency_update(&listener->latency, capture_ts);
 
       // If result gives an image pointer, use it in the next stage
       if (result != NULL) {
@@ -45,7 +45,10 @@ struct cv_async {
   pthread_mutex_t img_mutex;
   pthread_cond_t img_available;
   volatile bool img_processed;
-  struct image_t img_copy;
+  struct video_config_t *device;  ///< The device the images are coming from
+  struct image_t img_copy;        ///< Private copy, only used when the frame could not be shared
+  struct image_t img_shared;      ///< Referenced (zero-copy) frame of the video device
+  bool img_is_shared;             ///< Whether img_shared or img_copy holds the current image
 };
 
 struct video_listener {
@@ -53,13 +56,18 @@ struct video_listener {
   struct cv_async *async;
   struct timeval ts;
   cv_function func;
+  float latency;              ///< Filtered time from frame capture to the end of this listener (us)
 
   // Can be set by user
   uint16_t maximum_fps;
   volatile bool active;
+  bool read_only;             ///< The function doesn't change the image in place (default false), see CV_ASYNC_ZERO_COPY
 };
 
 extern bool add_video_device(struct video_config_t *device);
+extern bool video_thread_image_ref(struct video_config_t *device, struct image_t *img);
+extern void video_thread_image_unref(struct video_config_t *device, struct image_t *img);
+extern void video_thread_latency_update(float *latency, uint32_t pprz_ts);
 
 extern struct video_listener *cv_add_to_device(struct video_config_t *device, cv_function func);
 extern struct video_listener *cv_add_to_device_async(struct video_config_t *device, cv_function func, int nice_level);
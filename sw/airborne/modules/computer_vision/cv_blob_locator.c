@@ -154,7 +154,7 @@ struct image_t* cv_blob_locator_func(struct image_t *img) {
   // Find largest
   for (int i=0; i<labels_count; i++) {
     // Only consider large blobs
-    if (labels[i].pixel_cnt > 50) {
+    if (labels[i].pixel_cnt > 100) {
       if (labels[i].pixel_cnt > largest_size) {
         largest_size = labels[i].pixel_cnt;
         largest_id = i;
@@ -167,37 +167,38 @@ struct image_t* cv_blob_locator_func(struct image_t *img) {
     uint8_t *p = (uint8_t*) img->buf;
     uint16_t* l = (uint16_t*) dst.buf;
     for (int y=0;y<dst.h;y++) {
-      for (int x=0;x<dst.w/2;x++) {
+      for (int x=0;x<dst.w;x++) {
         if (l[y*dst.w+x] != 0xffff) {
           uint8_t c=0xff;
           if (l[y*dst.w+x] == largest_id) {
             c = 0;
           }
-          p[y*dst.w*2+x*4]=c;
-          p[y*dst.w*2+x*4+1]=0x80;
-          p[y*dst.w*2+x*4+2]=c;
-          p[y*dst.w*2+x*4+3]=0x80;
+          p[y*dst.w*2+(x&0xfffe)*2]=c;
+          p[y*dst.w*2+x*2+1]=0x80;
+          p[y*dst.w*2+(x&0xfffe)*2+2]=c;
         }
       }
     }
 
 
-    uint16_t cgx = labels[largest_id].x_sum / labels[largest_id].pixel_cnt * 2;
+    uint16_t cgx = labels[largest_id].x_sum / labels[largest_id].pixel_cnt;
     uint16_t cgy = labels[largest_id].y_sum / labels[largest_id].pixel_cnt;
 
     if ((cgx > 1) && (cgx < (dst.w-2)) &&
         (cgy > 1) && (cgy < (dst.h-2))
         ) {
-      p[cgy*dst.w*2+cgx*2-4] = 0xff;
-      p[cgy*dst.w*2+cgx*2-2] = 0x00;
-      p[cgy*dst.w*2+cgx*2] = 0xff;
-      p[cgy*dst.w*2+cgx*2+2] = 0x00;
-      p[cgy*dst.w*2+cgx*2+4] = 0xff;
-      p[cgy*dst.w*2+cgx*2+6] = 0x00;
-      p[(cgy-1)*dst.w*2+cgx*2] = 0xff;
-      p[(cgy-1)*dst.w*2+cgx*2+2] = 0x00;
-      p[(cgy+1)*dst.w*2+cgx*2] = 0xff;
-      p[(cgy+1)*dst.w*2+cgx*2+2] = 0x00;
+      // start of the UYVY pair of the center pixel
+      uint16_t cx = cgx & 0xfffe;
+      p[cgy*dst.w*2+cx*2-4] = 0xff;
+      p[cgy*dst.w*2+cx*2-2] = 0x00;
+      p[cgy*dst.w*2+cx*2] = 0xff;
+      p[cgy*dst.w*2+cx*2+2] = 0x00;
+      p[cgy*dst.w*2+cx*2+4] = 0xff;
+      p[cgy*dst.w*2+cx*2+6] = 0x00;
+      p[(cgy-1)*dst.w*2+cx*2] = 0xff;
+      p[(cgy-1)*dst.w*2+cx*2+2] = 0x00;
+      p[(cgy+1)*dst.w*2+cx*2] = 0xff;
+      p[(cgy+1)*dst.w*2+cx*2+2] = 0x00;
     }
 
 
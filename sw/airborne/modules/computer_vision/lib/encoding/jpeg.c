@@ -14,12 +14,32 @@
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "jpeg.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 /**
  * @file modules/computer_vision/lib/encoding/jpeg.c
  * Encode images with the use of the JPEG encoding
  */
 
+/**
+ * Use a vectorized (NEON on ARM, SSE2 on x86) level shift, DCT and quantization.
+ * This gives bit-exact the same coefficients as the scalar code.
+ */
+#ifndef JPEG_USE_SIMD
+#define JPEG_USE_SIMD TRUE
+#endif
+
+#if JPEG_USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define JPEG_NEON 1
+#elif JPEG_USE_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define JPEG_SSE2 1
+#endif
+
 static inline unsigned char svs_size_code(int w)
 {
   // 1=(40,30) 2=(128,96) 3=(160,120) 5=(320,240) 7=(640,480) 9=(1280,1024);
@@ -62,6 +82,9 @@ int jpeg_create_svs_header(unsigned char *jpegbuf, int32_t size, int w)
 
 #define JPEG_BLOCK_SIZE 64
 
+/* Worst case size of an encoded block: 20 bits DC, 63 times 26 bits AC and every byte stuffed */
+#define JPEG_BLOCK_MAX_BYTES 420
+
 
 typedef struct JPEG_ENCODER_STRUCTURE {
 
@@ -101,26 +124,66 @@ typedef struct JPEG_ENCODER_STRUCTURE {
   uint32_t   lcode;
   uint16_t   bitindex;
 
+  // Reads an MCU from the input image (depends on the image format)
+  void (*read_format)(struct JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint8_t *input_ptr);
+
 } JPEG_ENCODER_STRUCTURE;
 
 
 static void jpeg_initialization(JPEG_ENCODER_STRUCTURE *, uint32_t, uint32_t, uint32_t);
 
-static uint8_t *jpeg_write_markers(JPEG_ENCODER_STRUCTURE *, uint8_t *, uint32_t, uint32_t, uint32_t);
+static uint8_t *jpeg_write_markers(JPEG_ENCODER_STRUCTURE *, uint8_t *, uint32_t, uint32_t, uint32_t, uint16_t);
 
 static void jpeg_read_400_format(JPEG_ENCODER_STRUCTURE *, uint8_t *);
 static void jpeg_read_422_format(JPEG_ENCODER_STRUCTURE *, uint8_t *);
 
+static uint8_t *jpeg_encode_rows(JPEG_ENCODER_STRUCTURE *, uint32_t, uint8_t *, uint8_t *, uint16_t, uint16_t, bool);
 static uint8_t *jpeg_encodeMCU(JPEG_ENCODER_STRUCTURE *, uint32_t, uint8_t *);
+static void jpeg_transform(JPEG_ENCODER_STRUCTURE *, int16_t *, uint16_t *);
 
+#if !JPEG_NEON && !JPEG_SSE2
 static void jpeg_levelshift(int16_t *);
 static void jpeg_DCT(int16_t *);
 
 static void jpeg_quantization(JPEG_ENCODER_STRUCTURE *, int16_t *, uint16_t *);
+#endif
 static uint8_t *jpeg_huffman(JPEG_ENCODER_STRUCTURE *, uint16_t, uint8_t *);
 
+static uint8_t *jpeg_restart_bitstream(JPEG_ENCODER_STRUCTURE *, uint8_t *, uint8_t);
 static uint8_t *jpeg_close_bitstream(JPEG_ENCODER_STRUCTURE *, uint8_t *);
 
+/* A worker thread of the encoder, encodes a strip of MCU rows */
+struct jpeg_worker_t {
+  pthread_t thread;                 ///< The worker thread
+  JPEG_ENCODER_STRUCTURE jpeg;      ///< Private encoder state of this worker
+  uint16_t from;                    ///< First MCU row of the strip
+  uint16_t to;                      ///< Last MCU row (exclusive) of the strip
+  uint8_t *buf;                     ///< Output buffer of the strip (kept for the next calls)
+  uint32_t buf_size;                ///< Allocated size of the output buffer
+  uint32_t len;                     ///< Length of the encoded strip
+};
+
+/* The pool of worker threads, shared by all jpeg_encode_image_mt calls */
+static struct {
+  pthread_mutex_t owner;            ///< Held by the jpeg_encode_image_mt call using the workers
+  pthread_mutex_t mutex;            ///< Protects the job information
+  pthread_cond_t job_cond;          ///< Signalled when a new job is available
+  pthread_cond_t done_cond;         ///< Signalled when all workers finished the job
+  uint8_t started;                  ///< Amount of workers started
+  uint8_t active;                   ///< Amount of workers taking part in the current job
+  uint8_t busy;                     ///< Amount of workers still working on the current job
+  uint32_t job_id;                  ///< Incremented for every new job
+  uint32_t image_format;            ///< Image format of the current job
+  uint8_t *input;                   ///< Input image buffer of the current job
+  uint32_t row_size;                ///< Size of an MCU row in the input buffer
+  struct jpeg_worker_t workers[JPEG_MAX_THREADS - 1];
+} jpeg_pool = {
+  .owner = PTHREAD_MUTEX_INITIALIZER,
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .job_cond = PTHREAD_COND_INITIALIZER,
+  .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
 static const uint16_t luminance_dc_code_table [] = {
   0x0000, 0x0002, 0x0003, 0x0004, 0x0005, 0x0006,
   0x000E, 0x001E, 0x003E, 0x007E, 0x00FE, 0x01FE
@@ -283,8 +346,6 @@ static const uint8_t zigzag_table [] = {
 };
 
 
-void (*read_format)(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint8_t *input_ptr);
-
 static void jpeg_initialization(JPEG_ENCODER_STRUCTURE *jpeg, uint32_t image_format, uint32_t image_width, uint32_t image_height)
 {
   uint16_t mcu_width, mcu_height, bytes_per_pixel;
@@ -300,7 +361,7 @@ static void jpeg_initialization(JPEG_ENCODER_STRUCTURE *jpeg, uint32_t image_for
     jpeg->vertical_mcus = (uint16_t)((image_height + mcu_height - 1) >> 3);
 
     bytes_per_pixel = 1;
-    read_format = jpeg_read_400_format;
+    jpeg->read_format = jpeg_read_400_format;
   } else {
     jpeg->mcu_width = mcu_width = 16;
     jpeg->horizontal_mcus = (uint16_t)((image_width + mcu_width - 1) >> 4);
@@ -308,7 +369,7 @@ static void jpeg_initialization(JPEG_ENCODER_STRUCTURE *jpeg, uint32_t image_for
     jpeg->mcu_height = mcu_height = 8;
     jpeg->vertical_mcus = (uint16_t)((image_height + mcu_height - 1) >> 3);
     bytes_per_pixel = 2;
-    read_format = jpeg_read_422_format;
+    jpeg->read_format = jpeg_read_422_format;
   }
 
   jpeg->rows_in_bottom_mcus = (uint16_t)(image_height - (jpeg->vertical_mcus - 1) * mcu_height);
@@ -407,7 +468,6 @@ void MakeTables(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, int q)
  */
 void jpeg_encode_image(struct image_t *in, struct image_t *out, uint32_t quality_factor, bool add_dri_header)
 {
-  uint16_t i, j;
   uint8_t *output_ptr = out->buf;
   uint8_t *input_ptr = in->buf;
   uint32_t image_format = FOUR_ZERO_ZERO;
@@ -432,10 +492,205 @@ void jpeg_encode_image(struct image_t *in, struct image_t *out, uint32_t quality
 
   /* Writing Marker Data */
   if (add_dri_header) {
-    output_ptr = jpeg_write_markers(jpeg_encoder_structure, output_ptr, image_format, in->w, in->h);
+    output_ptr = jpeg_write_markers(jpeg_encoder_structure, output_ptr, image_format, in->w, in->h, 0);
+  }
+
+  /* Encode all MCU rows and close the bitstream */
+  output_ptr = jpeg_encode_rows(jpeg_encoder_structure, image_format, input_ptr, output_ptr, 0,
+                                jpeg_encoder_structure->vertical_mcus, false);
+  out->w = in->w;
+  out->h = in->h;
+  out->buf_size = output_ptr - (uint8_t *)out->buf;
+}
+
+/**
+ * The worker thread, encodes its strip of MCU rows for every job
+ * @param[in] *data The worker structure
+ */
+static void *jpeg_worker_thread(void *data)
+{
+  struct jpeg_worker_t *worker = (struct jpeg_worker_t *)data;
+  uint8_t idx = worker - jpeg_pool.workers;
+  uint32_t last_job = 0;
+
+  pthread_mutex_lock(&jpeg_pool.mutex);
+  while (true) {
+    // Wait for a new job
+    while (jpeg_pool.job_id == last_job) {
+      pthread_cond_wait(&jpeg_pool.job_cond, &jpeg_pool.mutex);
+    }
+    last_job = jpeg_pool.job_id;
+
+    // Not needed for this job
+    if (idx >= jpeg_pool.active) {
+      continue;
+    }
+
+    uint8_t *input_ptr = jpeg_pool.input + worker->from * jpeg_pool.row_size;
+    uint32_t row_size = jpeg_pool.row_size;
+    uint32_t image_format = jpeg_pool.image_format;
+    pthread_mutex_unlock(&jpeg_pool.mutex);
+
+    // Worst case size of an encoded MCU row including the restart marker
+    uint32_t row_max = worker->jpeg.horizontal_mcus * JPEG_BLOCK_MAX_BYTES * ((image_format == FOUR_TWO_TWO) ? 4 : 1) + 8;
+
+    // Encode row by row, so the output buffer can grow if needed
+    worker->len = 0;
+    for (uint16_t row = worker->from; row < worker->to; row++) {
+      if (worker->len + row_max > worker->buf_size) {
+        uint32_t size = worker->len + row_max * (worker->to - row);
+        uint8_t *buf = realloc(worker->buf, size);
+        if (buf == NULL) {
+          printf("[jpeg] Could not allocate %u bytes for worker %d\n", size, idx);
+          break;
+        }
+        worker->buf = buf;
+        worker->buf_size = size;
+      }
+
+      uint8_t *end = jpeg_encode_rows(&worker->jpeg, image_format, input_ptr, worker->buf + worker->len, row, row + 1,
+                                      true);
+      worker->len = end - worker->buf;
+      input_ptr += row_size;
+    }
+
+    // Report back
+    pthread_mutex_lock(&jpeg_pool.mutex);
+    if (--jpeg_pool.busy == 0) {
+      pthread_cond_signal(&jpeg_pool.done_cond);
+    }
   }
 
-  for (i = 1; i <= jpeg_encoder_structure->vertical_mcus; i++) {
+  return NULL;
+}
+
+/**
+ * Encode an YUV422 or grayscale image with a restart interval after every MCU row.
+ * The restart intervals are independent of each other, so strips of MCU rows are
+ * encoded in parallel by the calling thread and the workers and then concatenated.
+ * @param[in] *in The input image
+ * @param[out] *out The output JPEG image
+ * @param[in] quality_factor Quality factor of the encoding (0-99)
+ * @param[in] add_dri_header Add the DRI header (needed for full JPEG)
+ * @param[in] n_threads The amount of threads to use (including the calling thread)
+ */
+void jpeg_encode_image_mt(struct image_t *in, struct image_t *out, uint32_t quality_factor, bool add_dri_header,
+                          uint8_t n_threads)
+{
+  uint8_t *output_ptr = out->buf;
+  uint8_t *input_ptr = in->buf;
+  uint32_t image_format = FOUR_ZERO_ZERO;
+  uint8_t bytes_per_pixel = 1;
+
+  if (in->type == IMAGE_YUV422) {
+    image_format = FOUR_TWO_TWO;
+    bytes_per_pixel = 2;
+  }
+
+  JPEG_ENCODER_STRUCTURE JpegStruct;
+  JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure = &JpegStruct;
+
+  jpeg_initialization(jpeg_encoder_structure, image_format, in->w, in->h);
+  MakeTables(jpeg_encoder_structure, quality_factor);
+
+  /* Writing Marker Data, the restart interval is one MCU row */
+  if (add_dri_header) {
+    output_ptr = jpeg_write_markers(jpeg_encoder_structure, output_ptr, image_format, in->w, in->h,
+                                    jpeg_encoder_structure->horizontal_mcus);
+  }
+
+  uint16_t rows = jpeg_encoder_structure->vertical_mcus;
+  if (n_threads > JPEG_MAX_THREADS) {
+    n_threads = JPEG_MAX_THREADS;
+  }
+  if (n_threads > rows) {
+    n_threads = rows;
+  }
+
+  // Encode serially when the workers are used by another caller (e.g. another camera)
+  if (n_threads <= 1 || pthread_mutex_trylock(&jpeg_pool.owner) != 0) {
+    n_threads = 1;
+  } else {
+    // Start extra workers if needed (they keep running for the next calls)
+    while (jpeg_pool.started < n_threads - 1) {
+      if (pthread_create(&jpeg_pool.workers[jpeg_pool.started].thread, NULL, jpeg_worker_thread,
+                         &jpeg_pool.workers[jpeg_pool.started]) != 0) {
+        printf("[jpeg] Could not create worker thread %d\n", jpeg_pool.started);
+        break;
+      }
+      jpeg_pool.started++;
+    }
+    if (n_threads > jpeg_pool.started + 1) {
+      n_threads = jpeg_pool.started + 1;
+    }
+    if (n_threads <= 1) {
+      pthread_mutex_unlock(&jpeg_pool.owner);
+    }
+  }
+
+  if (n_threads <= 1) {
+    output_ptr = jpeg_encode_rows(jpeg_encoder_structure, image_format, input_ptr, output_ptr, 0, rows, true);
+  } else {
+    // Hand out the strips, the calling thread takes the first one
+    uint32_t row_size = (uint32_t)in->w * jpeg_encoder_structure->mcu_height * bytes_per_pixel;
+    pthread_mutex_lock(&jpeg_pool.mutex);
+    jpeg_pool.image_format = image_format;
+    jpeg_pool.input = input_ptr;
+    jpeg_pool.row_size = row_size;
+    jpeg_pool.active = n_threads - 1;
+    jpeg_pool.busy = n_threads - 1;
+    for (uint8_t t = 0; t < n_threads - 1; t++) {
+      struct jpeg_worker_t *worker = &jpeg_pool.workers[t];
+      memcpy(&worker->jpeg, jpeg_encoder_structure, sizeof(JPEG_ENCODER_STRUCTURE));
+      worker->from = (uint32_t)rows * (t + 1) / n_threads;
+      worker->to = (uint32_t)rows * (t + 2) / n_threads;
+    }
+    jpeg_pool.job_id++;
+    pthread_cond_broadcast(&jpeg_pool.job_cond);
+    pthread_mutex_unlock(&jpeg_pool.mutex);
+
+    output_ptr = jpeg_encode_rows(jpeg_encoder_structure, image_format, input_ptr, output_ptr, 0, rows / n_threads,
+                                  true);
+
+    // Wait for the workers to finish
+    pthread_mutex_lock(&jpeg_pool.mutex);
+    while (jpeg_pool.busy > 0) {
+      pthread_cond_wait(&jpeg_pool.done_cond, &jpeg_pool.mutex);
+    }
+    pthread_mutex_unlock(&jpeg_pool.mutex);
+
+    // Concatenate the strips (each one ends at a byte aligned restart marker)
+    for (uint8_t t = 0; t < n_threads - 1; t++) {
+      struct jpeg_worker_t *worker = &jpeg_pool.workers[t];
+      memcpy(output_ptr, worker->buf, worker->len);
+      output_ptr += worker->len;
+    }
+    pthread_mutex_unlock(&jpeg_pool.owner);
+  }
+
+  out->w = in->w;
+  out->h = in->h;
+  out->buf_size = output_ptr - (uint8_t *)out->buf;
+}
+
+/**
+ * Encode a range of MCU rows
+ * The last MCU row of the image closes the bitstream.
+ * @param[in] *jpeg_encoder_structure The encoder
+ * @param[in] image_format The image format
+ * @param[in] *input_ptr Start of the first MCU row in the input image
+ * @param[out] *output_ptr Where to write the encoded data
+ * @param[in] from First MCU row to encode
+ * @param[in] to Last MCU row (exclusive) to encode
+ * @param[in] restart Write a restart marker after every MCU row
+ * @return The end of the encoded data
+ */
+static uint8_t *jpeg_encode_rows(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint32_t image_format,
+                                 uint8_t *input_ptr, uint8_t *output_ptr, uint16_t from, uint16_t to, bool restart)
+{
+  uint16_t i, j;
+
+  for (i = from + 1; i <= to; i++) {
     if (i < jpeg_encoder_structure->vertical_mcus) {
       jpeg_encoder_structure->rows = jpeg_encoder_structure->mcu_height;
     } else {
@@ -451,7 +706,7 @@ void jpeg_encode_image(struct image_t *in, struct image_t *out, uint32_t quality
         jpeg_encoder_structure->incr = jpeg_encoder_structure->length_minus_width;
       }
 
-      read_format(jpeg_encoder_structure, input_ptr);
+      jpeg_encoder_structure->read_format(jpeg_encoder_structure, input_ptr);
 
       /* Encode the data in MCU */
       output_ptr = jpeg_encodeMCU(jpeg_encoder_structure, image_format, output_ptr);
@@ -460,41 +715,264 @@ void jpeg_encode_image(struct image_t *in, struct image_t *out, uint32_t quality
     }
 
     input_ptr += jpeg_encoder_structure->offset;
+
+    /* Restart marker after every MCU row, except for the last one */
+    if (restart && i < jpeg_encoder_structure->vertical_mcus) {
+      output_ptr = jpeg_restart_bitstream(jpeg_encoder_structure, output_ptr, (i - 1) & 0x7);
+    }
   }
 
   /* Close Routine */
-  output_ptr = jpeg_close_bitstream(jpeg_encoder_structure, output_ptr);
-  out->w = in->w;
-  out->h = in->h;
-  out->buf_size = output_ptr - (uint8_t *)out->buf;
+  if (to == jpeg_encoder_structure->vertical_mcus) {
+    output_ptr = jpeg_close_bitstream(jpeg_encoder_structure, output_ptr);
+  }
+  return output_ptr;
 }
 
 static uint8_t *jpeg_encodeMCU(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint32_t image_format, uint8_t *output_ptr)
 {
-  jpeg_levelshift(jpeg_encoder_structure->Y1);
-  jpeg_DCT(jpeg_encoder_structure->Y1);
-  jpeg_quantization(jpeg_encoder_structure, jpeg_encoder_structure->Y1, jpeg_encoder_structure->ILqt);
+  jpeg_transform(jpeg_encoder_structure, jpeg_encoder_structure->Y1, jpeg_encoder_structure->ILqt);
   output_ptr = jpeg_huffman(jpeg_encoder_structure, 1, output_ptr);
 
   if (image_format == FOUR_TWO_TWO) {
-    jpeg_levelshift(jpeg_encoder_structure->Y2);
-    jpeg_DCT(jpeg_encoder_structure->Y2);
-    jpeg_quantization(jpeg_encoder_structure, jpeg_encoder_structure->Y2, jpeg_encoder_structure->ILqt);
+    jpeg_transform(jpeg_encoder_structure, jpeg_encoder_structure->Y2, jpeg_encoder_structure->ILqt);
     output_ptr = jpeg_huffman(jpeg_encoder_structure, 1, output_ptr);
 
-    jpeg_levelshift(jpeg_encoder_structure->CB);
-    jpeg_DCT(jpeg_encoder_structure->CB);
-    jpeg_quantization(jpeg_encoder_structure, jpeg_encoder_structure->CB, jpeg_encoder_structure->ICqt);
+    jpeg_transform(jpeg_encoder_structure, jpeg_encoder_structure->CB, jpeg_encoder_structure->ICqt);
     output_ptr = jpeg_huffman(jpeg_encoder_structure, 2, output_ptr);
 
-    jpeg_levelshift(jpeg_encoder_structure->CR);
-    jpeg_DCT(jpeg_encoder_structure->CR);
-    jpeg_quantization(jpeg_encoder_structure, jpeg_encoder_structure->CR, jpeg_encoder_structure->ICqt);
+    jpeg_transform(jpeg_encoder_structure, jpeg_encoder_structure->CR, jpeg_encoder_structure->ICqt);
     output_ptr = jpeg_huffman(jpeg_encoder_structure, 3, output_ptr);
   }
   return output_ptr;
 }
 
+#if JPEG_NEON || JPEG_SSE2
+
+/* DCT constants and shifts, see jpeg_DCT() */
+#define JPEG_C1 1420
+#define JPEG_C2 1338
+#define JPEG_C3 1204
+#define JPEG_C5 805
+#define JPEG_C6 554
+#define JPEG_C7 283
+
+#if JPEG_NEON
+typedef int16x8_t jpeg_vec_t;
+#define JPEG_VADD(a, b) vaddq_s16(a, b)
+#define JPEG_VSUB(a, b) vsubq_s16(a, b)
+#define JPEG_VSHR(a, s) vshlq_s16(a, vdupq_n_s16(-(s)))
+
+/* (a * ca + b * cb) >> s, with the products and sum in 32 bit */
+static inline jpeg_vec_t jpeg_vmul2(jpeg_vec_t a, jpeg_vec_t b, int16_t ca, int16_t cb, int s)
+{
+  int32x4_t shift = vdupq_n_s32(-s);
+  int32x4_t lo = vmlal_n_s16(vmull_n_s16(vget_low_s16(a), ca), vget_low_s16(b), cb);
+  int32x4_t hi = vmlal_n_s16(vmull_n_s16(vget_high_s16(a), ca), vget_high_s16(b), cb);
+  return vcombine_s16(vmovn_s32(vshlq_s32(lo, shift)), vmovn_s32(vshlq_s32(hi, shift)));
+}
+
+/* (a * ca + b * cb + c * cc + d * cd) >> s, with the products and sum in 32 bit */
+static inline jpeg_vec_t jpeg_vmul4(jpeg_vec_t a, jpeg_vec_t b, jpeg_vec_t c, jpeg_vec_t d,
+                                    int16_t ca, int16_t cb, int16_t cc, int16_t cd, int s)
+{
+  int32x4_t shift = vdupq_n_s32(-s);
+  int32x4_t lo = vmull_n_s16(vget_low_s16(a), ca);
+  lo = vmlal_n_s16(lo, vget_low_s16(b), cb);
+  lo = vmlal_n_s16(lo, vget_low_s16(c), cc);
+  lo = vmlal_n_s16(lo, vget_low_s16(d), cd);
+  int32x4_t hi = vmull_n_s16(vget_high_s16(a), ca);
+  hi = vmlal_n_s16(hi, vget_high_s16(b), cb);
+  hi = vmlal_n_s16(hi, vget_high_s16(c), cc);
+  hi = vmlal_n_s16(hi, vget_high_s16(d), cd);
+  return vcombine_s16(vmovn_s32(vshlq_s32(lo, shift)), vmovn_s32(vshlq_s32(hi, shift)));
+}
+
+/* Transpose an 8x8 block of 16 bit values */
+static inline void jpeg_vtranspose(jpeg_vec_t v[8])
+{
+  int16x8x2_t t01 = vtrnq_s16(v[0], v[1]);
+  int16x8x2_t t23 = vtrnq_s16(v[2], v[3]);
+  int16x8x2_t t45 = vtrnq_s16(v[4], v[5]);
+  int16x8x2_t t67 = vtrnq_s16(v[6], v[7]);
+  int32x4x2_t u02 = vtrnq_s32(vreinterpretq_s32_s16(t01.val[0]), vreinterpretq_s32_s16(t23.val[0]));
+  int32x4x2_t u13 = vtrnq_s32(vreinterpretq_s32_s16(t01.val[1]), vreinterpretq_s32_s16(t23.val[1]));
+  int32x4x2_t u46 = vtrnq_s32(vreinterpretq_s32_s16(t45.val[0]), vreinterpretq_s32_s16(t67.val[0]));
+  int32x4x2_t u57 = vtrnq_s32(vreinterpretq_s32_s16(t45.val[1]), vreinterpretq_s32_s16(t67.val[1]));
+  v[0] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(u02.val[0]), vget_low_s32(u46.val[0])));
+  v[1] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(u13.val[0]), vget_low_s32(u57.val[0])));
+  v[2] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(u02.val[1]), vget_low_s32(u46.val[1])));
+  v[3] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(u13.val[1]), vget_low_s32(u57.val[1])));
+  v[4] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(u02.val[0]), vget_high_s32(u46.val[0])));
+  v[5] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(u13.val[0]), vget_high_s32(u57.val[0])));
+  v[6] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(u02.val[1]), vget_high_s32(u46.val[1])));
+  v[7] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(u13.val[1]), vget_high_s32(u57.val[1])));
+}
+
+#else /* JPEG_SSE2 */
+typedef __m128i jpeg_vec_t;
+#define JPEG_VADD(a, b) _mm_add_epi16(a, b)
+#define JPEG_VSUB(a, b) _mm_sub_epi16(a, b)
+#define JPEG_VSHR(a, s) _mm_sra_epi16(a, _mm_cvtsi32_si128(s))
+
+/* (a * ca + b * cb) >> s, with the products and sum in 32 bit */
+static inline jpeg_vec_t jpeg_vmul2(jpeg_vec_t a, jpeg_vec_t b, int16_t ca, int16_t cb, int s)
+{
+  __m128i shift = _mm_cvtsi32_si128(s);
+  __m128i c = _mm_set_epi16(cb, ca, cb, ca, cb, ca, cb, ca);
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c);
+  __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c);
+  return _mm_packs_epi32(_mm_sra_epi32(lo, shift), _mm_sra_epi32(hi, shift));
+}
+
+/* (a * ca + b * cb + c * cc + d * cd) >> s, with the products and sum in 32 bit */
+static inline jpeg_vec_t jpeg_vmul4(jpeg_vec_t a, jpeg_vec_t b, jpeg_vec_t c, jpeg_vec_t d,
+                                    int16_t ca, int16_t cb, int16_t cc, int16_t cd, int s)
+{
+  __m128i shift = _mm_cvtsi32_si128(s);
+  __m128i cab = _mm_set_epi16(cb, ca, cb, ca, cb, ca, cb, ca);
+  __m128i ccd = _mm_set_epi16(cd, cc, cd, cc, cd, cc, cd, cc);
+  __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), cab),
+                             _mm_madd_epi16(_mm_unpacklo_epi16(c, d), ccd));
+  __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), cab),
+                             _mm_madd_epi16(_mm_unpackhi_epi16(c, d), ccd));
+  return _mm_packs_epi32(_mm_sra_epi32(lo, shift), _mm_sra_epi32(hi, shift));
+}
+
+/* Transpose an 8x8 block of 16 bit values */
+static inline void jpeg_vtranspose(jpeg_vec_t v[8])
+{
+  __m128i a0 = _mm_unpacklo_epi16(v[0], v[1]);
+  __m128i a1 = _mm_unpackhi_epi16(v[0], v[1]);
+  __m128i a2 = _mm_unpacklo_epi16(v[2], v[3]);
+  __m128i a3 = _mm_unpackhi_epi16(v[2], v[3]);
+  __m128i a4 = _mm_unpacklo_epi16(v[4], v[5]);
+  __m128i a5 = _mm_unpackhi_epi16(v[4], v[5]);
+  __m128i a6 = _mm_unpacklo_epi16(v[6], v[7]);
+  __m128i a7 = _mm_unpackhi_epi16(v[6], v[7]);
+  __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+  __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+  __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+  __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+  __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+  __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+  __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+  __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+  v[0] = _mm_unpacklo_epi64(b0, b4);
+  v[1] = _mm_unpackhi_epi64(b0, b4);
+  v[2] = _mm_unpacklo_epi64(b1, b5);
+  v[3] = _mm_unpackhi_epi64(b1, b5);
+  v[4] = _mm_unpacklo_epi64(b2, b6);
+  v[5] = _mm_unpackhi_epi64(b2, b6);
+  v[6] = _mm_unpacklo_epi64(b3, b7);
+  v[7] = _mm_unpackhi_epi64(b3, b7);
+}
+#endif
+
+/**
+ * One dimensional DCT of 8 lanes at once, v[k] holds element k of each lane.
+ * All intermediate values fit in 16 bit for level shifted 8 bit input (|x| < 8192).
+ * @param[in,out] v The 8 vectors
+ * @param[in] s_dc Shift of the 0 and 4 outputs
+ * @param[in] s_ac Shift of the other outputs
+ */
+static inline void jpeg_vDCT(jpeg_vec_t v[8], int s_dc, int s_ac)
+{
+  jpeg_vec_t x8 = JPEG_VADD(v[0], v[7]);
+  jpeg_vec_t x0 = JPEG_VSUB(v[0], v[7]);
+  jpeg_vec_t x7 = JPEG_VADD(v[1], v[6]);
+  jpeg_vec_t x1 = JPEG_VSUB(v[1], v[6]);
+  jpeg_vec_t x6 = JPEG_VADD(v[2], v[5]);
+  jpeg_vec_t x2 = JPEG_VSUB(v[2], v[5]);
+  jpeg_vec_t x5 = JPEG_VADD(v[3], v[4]);
+  jpeg_vec_t x3 = JPEG_VSUB(v[3], v[4]);
+
+  jpeg_vec_t x4 = JPEG_VADD(x8, x5);
+  x8 = JPEG_VSUB(x8, x5);
+  x5 = JPEG_VADD(x7, x6);
+  x7 = JPEG_VSUB(x7, x6);
+
+  v[0] = JPEG_VSHR(JPEG_VADD(x4, x5), s_dc);
+  v[4] = JPEG_VSHR(JPEG_VSUB(x4, x5), s_dc);
+
+  v[2] = jpeg_vmul2(x8, x7, JPEG_C2, JPEG_C6, s_ac);
+  v[6] = jpeg_vmul2(x8, x7, JPEG_C6, -JPEG_C2, s_ac);
+
+  v[7] = jpeg_vmul4(x0, x1, x2, x3, JPEG_C7, -JPEG_C5, JPEG_C3, -JPEG_C1, s_ac);
+  v[5] = jpeg_vmul4(x0, x1, x2, x3, JPEG_C5, -JPEG_C1, JPEG_C7, JPEG_C3, s_ac);
+  v[3] = jpeg_vmul4(x0, x1, x2, x3, JPEG_C3, -JPEG_C7, -JPEG_C1, -JPEG_C5, s_ac);
+  v[1] = jpeg_vmul4(x0, x1, x2, x3, JPEG_C1, JPEG_C3, JPEG_C5, JPEG_C7, s_ac);
+}
+
+/**
+ * Level shift, DCT and quantization of one block (8x8), vectorized
+ * Gives the same result as jpeg_levelshift(), jpeg_DCT() and jpeg_quantization().
+ */
+static void jpeg_transform(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, int16_t *data, uint16_t *quant_table_ptr)
+{
+  jpeg_vec_t v[8];
+  int16_t coeff[JPEG_BLOCK_SIZE];
+  uint8_t i;
+
+#if JPEG_NEON
+  int16x8_t shift = vdupq_n_s16(128);
+  for (i = 0; i < 8; i++) {
+    v[i] = vsubq_s16(vld1q_s16(&data[i * 8]), shift);
+  }
+#else
+  __m128i shift = _mm_set1_epi16(128);
+  for (i = 0; i < 8; i++) {
+    v[i] = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&data[i * 8]), shift);
+  }
+#endif
+
+  // Rows (as columns of the transposed block) and then columns
+  jpeg_vtranspose(v);
+  jpeg_vDCT(v, 0, 10);
+  jpeg_vtranspose(v);
+  jpeg_vDCT(v, 3, 13);
+
+  // Quantization (q * data + 0x4000) >> 15, q <= 0x8000 is split in two halves to fit signed 16 bit
+#if JPEG_NEON
+  int32x4_t round = vdupq_n_s32(0x4000);
+  for (i = 0; i < 8; i++) {
+    uint16x8_t q = vld1q_u16(&quant_table_ptr[i * 8]);
+    int16x8_t qa = vreinterpretq_s16_u16(vshrq_n_u16(q, 1));
+    int16x8_t qb = vreinterpretq_s16_u16(vsubq_u16(q, vshrq_n_u16(q, 1)));
+    int32x4_t lo = vmlal_s16(vmlal_s16(round, vget_low_s16(v[i]), vget_low_s16(qa)), vget_low_s16(v[i]), vget_low_s16(qb));
+    int32x4_t hi = vmlal_s16(vmlal_s16(round, vget_high_s16(v[i]), vget_high_s16(qa)), vget_high_s16(v[i]),
+                             vget_high_s16(qb));
+    vst1q_s16(&coeff[i * 8], vcombine_s16(vshrn_n_s32(lo, 15), vshrn_n_s32(hi, 15)));
+  }
+#else
+  __m128i round = _mm_set1_epi32(0x4000);
+  for (i = 0; i < 8; i++) {
+    __m128i q = _mm_loadu_si128((__m128i *)&quant_table_ptr[i * 8]);
+    __m128i qa = _mm_srli_epi16(q, 1);
+    __m128i qb = _mm_sub_epi16(q, qa);
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(v[i], v[i]), _mm_unpacklo_epi16(qa, qb));
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(v[i], v[i]), _mm_unpackhi_epi16(qa, qb));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 15);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 15);
+    _mm_storeu_si128((__m128i *)&coeff[i * 8], _mm_packs_epi32(lo, hi));
+  }
+#endif
+
+  for (i = 0; i < JPEG_BLOCK_SIZE; i++) {
+    jpeg_encoder_structure->Temp [zigzag_table [i]] = coeff [i];
+  }
+}
+
+#else /* !JPEG_NEON && !JPEG_SSE2 */
+
+/* Level shift, DCT and quantization of one block (8x8) */
+static void jpeg_transform(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, int16_t *data, uint16_t *quant_table_ptr)
+{
+  jpeg_levelshift(data);
+  jpeg_DCT(data);
+  jpeg_quantization(jpeg_encoder_structure, data, quant_table_ptr);
+}
+
 /* Level shifting to get 8 bit SIGNED values for the data  */
 static void jpeg_levelshift(int16_t *const data)
 {
@@ -594,6 +1072,8 @@ static void jpeg_DCT(int16_t *data)
   }
 }
 
+#endif /* JPEG_NEON || JPEG_SSE2 */
+
 #define PUTBITS    \
   {    \
     bits_in_next_word = (int16_t) (jpeg_encoder_structure->bitindex + numbits - 32);    \
@@ -714,6 +1194,37 @@ static uint8_t *jpeg_huffman(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uin
   return output_ptr;
 }
 
+/* For bit Stuffing (with 1-bits) and RSTn marker, the next interval starts at a byte boundary with reset DC predictions */
+static uint8_t *jpeg_restart_bitstream(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint8_t *output_ptr,
+                                       uint8_t marker_nr)
+{
+  uint16_t i, count;
+
+  if (jpeg_encoder_structure->bitindex > 0) {
+    uint16_t fill = 32 - jpeg_encoder_structure->bitindex;
+    uint32_t lcode = (jpeg_encoder_structure->lcode << fill) | ((1UL << fill) - 1);
+
+    count = (jpeg_encoder_structure->bitindex + 7) >> 3;
+
+    for (i = 0; i < count; i++)
+      if ((*output_ptr++ = (uint8_t)(lcode >> (24 - 8 * i))) == 0xff) {
+        *output_ptr++ = 0;
+      }
+  }
+
+  // Restart marker
+  *output_ptr++ = 0xFF;
+  *output_ptr++ = 0xD0 + marker_nr;
+
+  jpeg_encoder_structure->lcode = 0;
+  jpeg_encoder_structure->bitindex = 0;
+
+  jpeg_encoder_structure->ldc1 = 0;
+  jpeg_encoder_structure->ldc2 = 0;
+  jpeg_encoder_structure->ldc3 = 0;
+  return output_ptr;
+}
+
 /* For bit Stuffing and EOI marker */
 static uint8_t *jpeg_close_bitstream(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint8_t *output_ptr)
 {
@@ -741,7 +1252,7 @@ static uint8_t *jpeg_close_bitstream(JPEG_ENCODER_STRUCTURE *jpeg_encoder_struct
   return output_ptr;
 }
 
-static uint8_t *jpeg_write_markers(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint8_t *output_ptr, uint32_t image_format, uint32_t image_width, uint32_t image_height)
+static uint8_t *jpeg_write_markers(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint8_t *output_ptr, uint32_t image_format, uint32_t image_width, uint32_t image_height, uint16_t restart_interval)
 {
   uint16_t i, header_length;
   uint8_t number_of_components;
@@ -844,6 +1355,16 @@ static uint8_t *jpeg_write_markers(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structur
     *output_ptr++ = markerdata [i];
   }
 
+  // Define restart interval (DRI), amount of MCUs per restart interval
+  if (restart_interval > 0) {
+    *output_ptr++ = 0xFF;
+    *output_ptr++ = 0xDD;
+    *output_ptr++ = 0x00;
+    *output_ptr++ = 0x04;
+    *output_ptr++ = (uint8_t)(restart_interval >> 8);
+    *output_ptr++ = (uint8_t) restart_interval;
+  }
+
 
   // Scan header(SOF)
 
@@ -928,6 +1449,7 @@ static uint8_t *jpeg_write_markers(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structur
   }
 }*/
 
+#if !JPEG_NEON && !JPEG_SSE2
 /* multiply DCT Coefficients with Quantization table and store in ZigZag location */
 static void jpeg_quantization(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, int16_t *const data, uint16_t *const quant_table_ptr)
 {
@@ -941,6 +1463,7 @@ static void jpeg_quantization(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, in
     jpeg_encoder_structure->Temp [zigzag_table [i]] = (int16_t) value;
   }
 }
+#endif
 
 static void jpeg_read_400_format(JPEG_ENCODER_STRUCTURE *jpeg_encoder_structure, uint8_t *input_ptr)
 {
@@ -31,9 +31,18 @@
 #define FOUR_FOUR_FOUR          3
 #define RGB                     4
 
+/* Maximum amount of threads used to encode a single image */
+#ifndef JPEG_MAX_THREADS
+#define JPEG_MAX_THREADS 4
+#endif
+
 /* JPEG encode an image */
 void jpeg_encode_image(struct image_t *in, struct image_t *out, uint32_t quality_factor, bool add_dri_header);
 
+/* JPEG encode an image with a restart interval every MCU row, splitting the rows over multiple threads */
+void jpeg_encode_image_mt(struct image_t *in, struct image_t *out, uint32_t quality_factor, bool add_dri_header,
+                          uint8_t n_threads);
+
 /* Create an SVS header */
 int jpeg_create_svs_header(unsigned char *buf, int32_t size, int w);
 
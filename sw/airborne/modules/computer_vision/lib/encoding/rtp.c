@@ -28,9 +28,35 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "rtp.h"
 
+/** Maximum JPEG payload per RTP packet */
+#ifndef RTP_MAX_PACKET_SIZE
+#define RTP_MAX_PACKET_SIZE 1400
+#endif
+
+/** Amount of packets sent with a single system call (size of the header ring) */
+#ifndef RTP_BATCH_SIZE
+#define RTP_BATCH_SIZE 16
+#endif
+
+/** Pace the packets of a frame to this rate in kbit/s, to not burst the Wi-Fi queues (0 = disabled) */
+#ifndef RTP_PACING_RATE
+#define RTP_PACING_RATE 0
+#endif
+
+#define KRtpHeaderSize 12           // size of the RTP header
+#define KJpegHeaderSize 8           // size of the special JPEG payload header
+#define KRestartHeaderSize 4        // size of the restart marker header
+#define KMaxHeaderSize (KRtpHeaderSize + KJpegHeaderSize + KRestartHeaderSize)
+
+static uint8_t rtp_header_fill(uint8_t *RtpBuf, uint32_t m_SequenceNumber, uint32_t m_Timestamp, uint32_t m_offset,
+                               uint8_t marker_bit, int w, int h, uint8_t format_code, uint8_t quality_code,
+                               uint8_t has_dri_header);
+static inline void rtp_header_update(uint8_t *RtpBuf, uint32_t m_SequenceNumber, uint32_t m_offset,
+                                     uint8_t marker_bit);
 static void rtp_packet_send(struct UdpSocket *udp, uint8_t *Jpeg, int JpegLen, uint32_t m_SequenceNumber,
                             uint32_t m_Timestamp, uint32_t m_offset, uint8_t marker_bit, int w, int h, uint8_t format_code, uint8_t quality_code,
                             uint8_t has_dri_header);
@@ -87,22 +113,27 @@ void rtp_frame_test(struct UdpSocket *udp)
 
 /**
  * Send an RTP frame
+ * The fragment headers are prepared once in a ring and only the sequence number, offset and
+ * marker bit are updated per packet. The packets are sent in batches, gathered straight
+ * from the headers and the JPEG buffer without copying.
  * @param[in] *udp The UDP connection to send the frame over
  * @param[in] *img The image to send over the RTP connection
  * @param[in] format_code 0 for YUV422 and 1 for YUV421
  * @param[in] quality_code The JPEG encoding quality
- * @param[in] has_dri_header Whether we have an DRI header or not
+ * @param[in] has_dri_header Whether the image has a restart interval every MCU row (jpeg_encode_image_mt)
  * @param[in] frame_time Time image was taken in usec (if set to 0 or less it is calculated)
  * @param[in] packet_number The frame number of the rtp stream
  */
 void rtp_frame_send(struct UdpSocket *udp, struct image_t *img, uint8_t format_code,
                     uint8_t quality_code, uint8_t has_dri_header, uint32_t frame_time, uint32_t *packet_number)
 {
+  uint8_t header_ring[RTP_BATCH_SIZE][KMaxHeaderSize];
+  struct iovec iov[RTP_BATCH_SIZE * 2];
   uint32_t offset = 0;
   uint32_t jpeg_size = img->buf_size;
   uint8_t *jpeg_ptr = img->buf;
-
-#define MAX_PACKET_SIZE 1400
+  uint16_t cnt = 0;
+  uint8_t i;
 
   if (frame_time <= 0) {
     struct timeval tv;
@@ -110,22 +141,52 @@ void rtp_frame_send(struct UdpSocket *udp, struct image_t *img, uint8_t format_c
     frame_time = (tv.tv_sec % (256 * 256)) + tv.tv_usec;
   }
 
+  // Prepare the headers, they only differ in sequence number, offset and marker bit
+  uint8_t header_size = rtp_header_fill(header_ring[0], 0, frame_time, 0, 0, img->w, img->h, format_code,
+                                        quality_code, has_dri_header);
+  for (i = 1; i < RTP_BATCH_SIZE; i++) {
+    memcpy(header_ring[i], header_ring[0], header_size);
+  }
+
+#if RTP_PACING_RATE > 0
+  struct timespec next_batch;
+  clock_gettime(CLOCK_MONOTONIC, &next_batch);
+#endif
+
   // Split frame into packets
-  for (; jpeg_size > 0;) {
-    uint32_t len = MAX_PACKET_SIZE;
+  while (offset < jpeg_size) {
+    uint32_t len = RTP_MAX_PACKET_SIZE;
     uint8_t lastpacket = 0;
 
-    if (jpeg_size <= len) {
+    if (jpeg_size - offset <= len) {
       lastpacket = 1;
-      len = jpeg_size;
+      len = jpeg_size - offset;
     }
 
-    rtp_packet_send(udp, jpeg_ptr, len, (*packet_number)++, frame_time, offset, lastpacket, img->w, img->h, format_code,
-                    quality_code, has_dri_header);
+    rtp_header_update(header_ring[cnt], (*packet_number)++, offset, lastpacket);
+    iov[cnt * 2].iov_base = header_ring[cnt];
+    iov[cnt * 2].iov_len = header_size;
+    iov[cnt * 2 + 1].iov_base = jpeg_ptr + offset;
+    iov[cnt * 2 + 1].iov_len = len;
+    cnt++;
+    offset += len;
 
-    jpeg_size -= len;
-    jpeg_ptr  += len;
-    offset    += len;
+    // Flush the ring
+    if (cnt == RTP_BATCH_SIZE || lastpacket) {
+      udp_socket_send_batch_dontwait(udp, iov, 2, cnt);
+
+#if RTP_PACING_RATE > 0
+      if (!lastpacket) {
+        // Wait until the batch would have been sent at the pacing rate (bits / (kbit/s) = msec)
+        uint64_t nsec = next_batch.tv_nsec + (uint64_t)cnt * (RTP_MAX_PACKET_SIZE + header_size) * 8 * 1000000 /
+                        RTP_PACING_RATE;
+        next_batch.tv_sec += nsec / 1000000000;
+        next_batch.tv_nsec = nsec % 1000000000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_batch, NULL);
+      }
+#endif
+      cnt = 0;
+    }
   }
 }
 
@@ -149,7 +210,7 @@ void rtp_frame_send(struct UdpSocket *udp, struct image_t *img, uint8_t format_c
  * @param[in] h The height of the image
  * @param[in] format_code 0 for YUV422 and 1 for YUV421
  * @param[in] quality_code The JPEG encoding quality
- * @param[in] has_dri_header Whether we have an DRI header or not
+ * @param[in] has_dri_header Whether the image has a restart interval every MCU row (adds the restart marker header)
  */
 static void rtp_packet_send(
   struct UdpSocket *udp,
@@ -160,14 +221,37 @@ static void rtp_packet_send(
   uint8_t format_code, uint8_t quality_code,
   uint8_t has_dri_header)
 {
+  uint8_t RtpBuf[KMaxHeaderSize];
+  struct iovec iov[2];
 
-#define KRtpHeaderSize 12           // size of the RTP header
-#define KJpegHeaderSize 8           // size of the special JPEG payload header
+  iov[0].iov_base = RtpBuf;
+  iov[0].iov_len = rtp_header_fill(RtpBuf, m_SequenceNumber, m_Timestamp, m_offset, marker_bit, w, h, format_code,
+                                   quality_code, has_dri_header);
+  iov[1].iov_base = Jpeg;
+  iov[1].iov_len = JpegLen;
 
-  uint8_t     RtpBuf[2048];
-  int         RtpPacketSize = JpegLen + KRtpHeaderSize + KJpegHeaderSize;
+  udp_socket_send_batch_dontwait(udp, iov, 2, 1);
+}
 
-  memset(RtpBuf, 0x00, sizeof(RtpBuf));
+/**
+ * Fill the RTP and JPEG payload headers of a packet
+ * @param[out] *RtpBuf The header buffer (KMaxHeaderSize bytes)
+ * @param[in] m_SequenceNumber RTP sequence number
+ * @param[in] m_Timestamp Timestamp of the image in usec
+ * @param[in] m_offset 3 byte fragmentation offset for fragmented images
+ * @param[in] marker_bit RTP marker bit
+ * @param[in] w The width of the JPEG image
+ * @param[in] h The height of the image
+ * @param[in] format_code 0 for YUV422 and 1 for YUV421
+ * @param[in] quality_code The JPEG encoding quality
+ * @param[in] has_dri_header Whether the image has a restart interval every MCU row (adds the restart marker header)
+ * @return The size of the headers
+ */
+static uint8_t rtp_header_fill(uint8_t *RtpBuf, uint32_t m_SequenceNumber, uint32_t m_Timestamp, uint32_t m_offset,
+                               uint8_t marker_bit, int w, int h, uint8_t format_code, uint8_t quality_code,
+                               uint8_t has_dri_header)
+{
+  memset(RtpBuf, 0x00, KMaxHeaderSize);
 
   /*
    The RTP header has the following format:
@@ -189,9 +273,6 @@ static void rtp_packet_send(
   m_Timestamp *= 9 / 100; // convert timestamp to units of 1 / 90000 Hz
   // Prepare the 12 byte RTP header
   RtpBuf[0]  = 0x80;                               // RTP version
-  RtpBuf[1]  = 0x1a + (marker_bit << 7);           // JPEG payload (26) and marker bit
-  RtpBuf[2]  = m_SequenceNumber >> 8;
-  RtpBuf[3]  = m_SequenceNumber & 0x0FF;           // each packet is counted with a sequence counter
   RtpBuf[4]  = (m_Timestamp & 0xFF000000) >> 24;   // each image gets a timestamp
   RtpBuf[5]  = (m_Timestamp & 0x00FF0000) >> 16;
   RtpBuf[6]  = (m_Timestamp & 0x0000FF00) >> 8;
@@ -216,20 +297,48 @@ static void rtp_packet_send(
 
   // Prepare the 8 byte payload JPEG header
   RtpBuf[12] = 0x00;                               // type specific
-  RtpBuf[13] = (m_offset & 0x00FF0000) >> 16;      // 3 byte fragmentation offset for fragmented images
-  RtpBuf[14] = (m_offset & 0x0000FF00) >> 8;
-  RtpBuf[15] = (m_offset & 0x000000FF);
-  RtpBuf[16] = 0x00;                             // type: 0 422 or 1 421
-  RtpBuf[17] = 60;                               // quality scale factor
-  RtpBuf[16] = format_code;                      // type: 0 422 or 1 421
+  RtpBuf[16] = format_code;                        // type: 0 422 or 1 421
   if (has_dri_header) {
     RtpBuf[16] |= 0x40;  // DRI flag
   }
-  RtpBuf[17] = quality_code;                     // quality scale factor
-  RtpBuf[18] = w / 8;                            // width  / 8 -> 48 pixel
-  RtpBuf[19] = h / 8;                            // height / 8 -> 32 pixel
-  // append the JPEG scan data to the RTP buffer
-  memcpy(&RtpBuf[20], Jpeg, JpegLen);
+  RtpBuf[17] = quality_code;                       // quality scale factor
+  RtpBuf[18] = w / 8;                              // width  / 8 -> 48 pixel
+  RtpBuf[19] = h / 8;                              // height / 8 -> 32 pixel
 
-  udp_socket_send_dontwait(udp, RtpBuf, RtpPacketSize);
-};
+  /* Restart Marker header (only with the DRI flag):
+
+    0                   1                   2                   3
+    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |       Restart Interval        |F|L|       Restart Count       |
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   */
+  if (has_dri_header) {
+    uint16_t restart_interval = (w + 15) / 16;     // one row of 16x8 MCUs
+    RtpBuf[20] = restart_interval >> 8;
+    RtpBuf[21] = restart_interval & 0xFF;
+    RtpBuf[22] = 0xFF;                             // F=1, L=1 and count 0x3FFF: packets are not
+    RtpBuf[23] = 0xFF;                             // aligned with the restart intervals
+  }
+
+  rtp_header_update(RtpBuf, m_SequenceNumber, m_offset, marker_bit);
+  return KRtpHeaderSize + KJpegHeaderSize + (has_dri_header ? KRestartHeaderSize : 0);
+}
+
+/**
+ * Update the packet specific fields of a prepared header
+ * @param[in,out] *RtpBuf The header buffer
+ * @param[in] m_SequenceNumber RTP sequence number
+ * @param[in] m_offset 3 byte fragmentation offset for fragmented images
+ * @param[in] marker_bit RTP marker bit
+ */
+static inline void rtp_header_update(uint8_t *RtpBuf, uint32_t m_SequenceNumber, uint32_t m_offset,
+                                     uint8_t marker_bit)
+{
+  RtpBuf[1]  = 0x1a + (marker_bit << 7);           // JPEG payload (26) and marker bit
+  RtpBuf[2]  = m_SequenceNumber >> 8;
+  RtpBuf[3]  = m_SequenceNumber & 0x0FF;           // each packet is counted with a sequence counter
+  RtpBuf[13] = (m_offset & 0x00FF0000) >> 16;      // 3 byte fragmentation offset for fragmented images
+  RtpBuf[14] = (m_offset & 0x0000FF00) >> 8;
+  RtpBuf[15] = (m_offset & 0x000000FF);
+}
@@ -43,12 +43,44 @@
 #include "mcu_periph/sys_time.h"
 
 #define CLEAR(x) memset(&(x), 0, sizeof (x))
+
+/**
+ * The amount of buffers that always stay with the driver and capturing thread.
+ * Extra references (v4l2_image_ref) are refused when they would eat into these.
+ */
+#define V4L2_BUFFERS_RESERVED 2
+
+/** Maximum time in seconds v4l2_image_get_batch() waits for a complete batch (same as the capture timeout) */
+#define V4L2_BATCH_TIMEOUT 2
 static void *v4l2_capture_thread(void *data);
 
+/**
+ * Time of a dequeued buffer in us since system startup
+ * When the driver stamps the buffers with the monotonic clock (at the start of
+ * the exposure or at the end of the frame), this time is used because it doesn't
+ * contain the scheduling latency of the capture thread. Else the time at which the
+ * capture thread woke up is used.
+ * @param[in] *buf The dequeued buffer
+ * @param[in] now_ts The time at which the capture thread woke up
+ * @return The time of the image in us since system startup
+ */
+static uint32_t v4l2_buffer_timestamp(struct v4l2_buffer *buf, uint32_t now_ts)
+{
+  if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC &&
+      (buf->timestamp.tv_sec != 0 || buf->timestamp.tv_usec != 0)) {
+    struct timespec ts;
+    ts.tv_sec = buf->timestamp.tv_sec;
+    ts.tv_nsec = buf->timestamp.tv_usec * 1000;
+    return sys_time_usec_of_monotonic(&ts);
+  }
+  return now_ts;
+}
+
 /**
  * The main capturing thread
- * This thread handles the queue and dequeue of buffers, to make sure only the latest
- * image buffer is preserved for image processing.
+ * This thread handles the queue and dequeue of buffers. In V4L2_CAPTURE_LATEST mode
+ * only the latest image buffer is preserved for image processing, in V4L2_CAPTURE_QUEUE
+ * mode the frames are kept in order until the queue is full.
  * @param[in] *data The Video 4 Linux 2 device pointer
  * @return 0 on succes, -1 if it isn able to fetch an image,
  * -2 on timeout of taking an image, -3 on failing buffer dequeue
@@ -98,24 +130,36 @@ static void *v4l2_capture_thread(void *data)
 
     // Copy the timestamp
     dev->buffers[buf.index].timestamp = buf.timestamp;
-    dev->buffers[buf.index].pprz_timestamp = now_ts;
+    dev->buffers[buf.index].pprz_timestamp = v4l2_buffer_timestamp(&buf, now_ts);
+    dev->buffers[buf.index].sequence = buf.sequence;
 
-    // Update the dequeued id
-    // We need lock because between setting prev_idx and updating the deq_idx the deq_idx could change
+    // Add the buffer to the queue and drop the oldest frames when it is full
+    // or when the driver would run out of buffers
+    uint8_t drop_idx[dev->buffers_cnt];
+    uint8_t drop_cnt = 0;
     pthread_mutex_lock(&dev->mutex);
-    uint16_t prev_idx = dev->buffers_deq_idx;
-    dev->buffers_deq_idx = buf.index;
+    dev->queue[(dev->queue_head + dev->queue_cnt) % dev->buffers_cnt] = buf.index;
+    dev->queue_cnt++;
+    while (dev->queue_cnt > 1 && (dev->queue_cnt > dev->queue_size ||
+                                  dev->queue_cnt + dev->buffers_held + V4L2_BUFFERS_RESERVED > dev->buffers_cnt)) {
+      drop_idx[drop_cnt++] = dev->queue[dev->queue_head];
+      dev->queue_head = (dev->queue_head + 1) % dev->buffers_cnt;
+      dev->queue_cnt--;
+      if (dev->mode == V4L2_CAPTURE_QUEUE) {
+        dev->frames_dropped++;
+      }
+    }
+    pthread_cond_broadcast(&dev->cond);
     pthread_mutex_unlock(&dev->mutex);
 
-    // Enqueue the previous image if not empty
-    if (prev_idx != V4L2_IMG_NONE) {
-      // Enqueue the previous buffer
+    // Enqueue the dropped buffers again
+    for (uint8_t i = 0; i < drop_cnt; i++) {
       CLEAR(buf);
       buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
       buf.memory = V4L2_MEMORY_MMAP;
-      buf.index = prev_idx;
+      buf.index = drop_idx[i];
       if (ioctl(dev->fd, VIDIOC_QBUF, &buf) < 0) {
-        printf("[v4l2-capture] Could not enqueue %d for %s\n", prev_idx, dev->name);
+        printf("[v4l2-capture] Could not enqueue %d for %s\n", drop_idx[i], dev->name);
       }
     }
 
@@ -309,6 +353,15 @@ struct v4l2_device *v4l2_init(char *device_name, struct img_size_t size, struct
     }
   }
 
+  // Allocate the queue of dequeued frames
+  uint8_t *queue = calloc(req.count, sizeof(uint8_t));
+  if (queue == NULL) {
+    printf("[v4l2] Not enough memory for %s to initialize the frame queue\n", device_name);
+    free(buffers);
+    close(fd);
+    return NULL;
+  }
+
   // Create the device only when everything succeeded
   struct v4l2_device *dev = (struct v4l2_device *)malloc(sizeof(struct v4l2_device));
   CLEAR(*dev);
@@ -318,38 +371,65 @@ struct v4l2_device *v4l2_init(char *device_name, struct img_size_t size, struct
   dev->h = size.h;
   dev->buffers_cnt = req.count;
   dev->buffers = buffers;
+  dev->queue = queue;
+  dev->mode = V4L2_CAPTURE_LATEST;
+  dev->queue_size = 1;
+  pthread_mutex_init(&dev->mutex, NULL);
+  pthread_cond_init(&dev->cond, NULL);
   return dev;
 }
 
 /**
- * Get the latest image buffer and lock it (Thread safe, BLOCKING)
- * This functions blocks until image access is granted. This should not take that long, because
- * it is only locked while enqueueing an image.
- * Make sure you free the image after processing with v4l2_image_free()!
- * @param[in] *dev The V4L2 video device we want to get an image from
- * @param[out] *img The image that we got from the video device
+ * Set which frames are kept for the users (Thread safe)
+ * In V4L2_CAPTURE_LATEST mode only the most recent frame is kept and older frames are
+ * enqueued again. In V4L2_CAPTURE_QUEUE mode up to queue_size frames are kept in
+ * order, so consumers that need every frame (like optical flow or visual odometry)
+ * can get them with v4l2_image_get() or in batches with v4l2_image_get_batch().
+ * The queue is limited by the amount of buffers that are not reserved for the driver.
+ * @param[in] *dev The V4L2 video device
+ * @param[in] mode The capture mode
+ * @param[in] queue_size The maximum number of queued frames in V4L2_CAPTURE_QUEUE mode
+ * (0 for as many as the buffers allow)
  */
-void v4l2_image_get(struct v4l2_device *dev, struct image_t *img)
+void v4l2_set_capture_mode(struct v4l2_device *dev, enum v4l2_capture_mode mode, uint8_t queue_size)
 {
-  uint16_t img_idx = V4L2_IMG_NONE;
-
-  // Continu to wait for an image
-  while (img_idx == V4L2_IMG_NONE) {
-    // We first check if the deq_idx is ok, this reduces the amount of locks
-    if (dev->buffers_deq_idx != V4L2_IMG_NONE) {
-      pthread_mutex_lock(&dev->mutex);
-
-      // We need to check it here again, because it could be changed
-      if (dev->buffers_deq_idx != V4L2_IMG_NONE) {
-        img_idx = dev->buffers_deq_idx;
-        dev->buffers_deq_idx = V4L2_IMG_NONE;
-      }
+  uint8_t max_size = (dev->buffers_cnt > V4L2_BUFFERS_RESERVED) ? dev->buffers_cnt - V4L2_BUFFERS_RESERVED : 1;
 
-      pthread_mutex_unlock(&dev->mutex);
-    }
+  pthread_mutex_lock(&dev->mutex);
+  dev->mode = mode;
+  if (mode == V4L2_CAPTURE_LATEST) {
+    dev->queue_size = 1;
+  } else if (queue_size == 0 || queue_size > max_size) {
+    dev->queue_size = max_size;
+  } else {
+    dev->queue_size = queue_size;
   }
+  pthread_mutex_unlock(&dev->mutex);
+}
 
-  // Set the image
+/**
+ * Take the oldest frame from the queue and hold it (mutex must be locked)
+ * @param[in] *dev The V4L2 video device
+ * @return The buffer index of the frame
+ */
+static uint8_t v4l2_queue_pop(struct v4l2_device *dev)
+{
+  uint8_t img_idx = dev->queue[dev->queue_head];
+  dev->queue_head = (dev->queue_head + 1) % dev->buffers_cnt;
+  dev->queue_cnt--;
+  dev->buffers[img_idx].ref_cnt = 1;
+  dev->buffers_held++;
+  return img_idx;
+}
+
+/**
+ * Fill an image with a held buffer
+ * @param[in] *dev The V4L2 video device
+ * @param[out] *img The image to fill
+ * @param[in] img_idx The buffer index
+ */
+static void v4l2_image_set(struct v4l2_device *dev, struct image_t *img, uint8_t img_idx)
+{
   img->type = IMAGE_YUV422;
   img->w = dev->w;
   img->h = dev->h;
@@ -357,12 +437,33 @@ void v4l2_image_get(struct v4l2_device *dev, struct image_t *img)
   img->buf_size = dev->buffers[img_idx].length;
   img->buf = dev->buffers[img_idx].buf;
   img->ts = dev->buffers[img_idx].timestamp;
-  img->pprz_ts =  dev->buffers[img_idx].pprz_timestamp;
+  img->pprz_ts = dev->buffers[img_idx].pprz_timestamp;
+}
+
+/**
+ * Get the next image buffer and lock it (Thread safe, BLOCKING)
+ * This functions sleeps until the capturing thread signals a new frame. In
+ * V4L2_CAPTURE_LATEST mode this is the latest image, in V4L2_CAPTURE_QUEUE mode
+ * the oldest queued image.
+ * Make sure you free the image after processing with v4l2_image_free()!
+ * @param[in] *dev The V4L2 video device we want to get an image from
+ * @param[out] *img The image that we got from the video device
+ */
+void v4l2_image_get(struct v4l2_device *dev, struct image_t *img)
+{
+  pthread_mutex_lock(&dev->mutex);
+  while (dev->queue_cnt == 0) {
+    pthread_cond_wait(&dev->cond, &dev->mutex);
+  }
+  uint8_t img_idx = v4l2_queue_pop(dev);
+  pthread_mutex_unlock(&dev->mutex);
+
+  v4l2_image_set(dev, img, img_idx);
 }
 
 /**
- * Get the latest image and lock it (Thread safe, NON BLOCKING)
- * This function returns NULL if it can't get access to the current image.
+ * Get the next image and lock it (Thread safe, NON BLOCKING)
+ * This function returns FALSE if there is no new image available.
  * Make sure you free the image after processing with v4l2_image_free())!
  * @param[in] *dev The V4L2 video device we want to get an image from
  * @param[out] *img The image that we got from the video device
@@ -370,36 +471,107 @@ void v4l2_image_get(struct v4l2_device *dev, struct image_t *img)
  */
 bool v4l2_image_get_nonblock(struct v4l2_device *dev, struct image_t *img)
 {
-  uint16_t img_idx = V4L2_IMG_NONE;
+  uint8_t img_idx = V4L2_IMG_NONE;
 
-  // Try to get the current image
+  // Try to get the next image
   pthread_mutex_lock(&dev->mutex);
-  if (dev->buffers_deq_idx != V4L2_IMG_NONE) {
-    img_idx = dev->buffers_deq_idx;
-    dev->buffers_deq_idx = V4L2_IMG_NONE;
+  if (dev->queue_cnt > 0) {
+    img_idx = v4l2_queue_pop(dev);
   }
   pthread_mutex_unlock(&dev->mutex);
 
   // Check if we really got an image
   if (img_idx == V4L2_IMG_NONE) {
     return false;
-  } else {
-    // Set the image
-    img->type = IMAGE_YUV422;
-    img->w = dev->w;
-    img->h = dev->h;
-    img->buf_idx = img_idx;
-    img->buf_size = dev->buffers[img_idx].length;
-    img->buf = dev->buffers[img_idx].buf;
-    img->ts = dev->buffers[img_idx].timestamp;
-    img->pprz_ts = dev->buffers[img_idx].pprz_timestamp;
-    return true;
   }
+  v4l2_image_set(dev, img, img_idx);
+  return true;
+}
+
+/**
+ * Get a batch of consecutive images and lock them (Thread safe, BLOCKING)
+ * This function sleeps until nb frames are queued (V4L2_CAPTURE_QUEUE mode) and takes
+ * them at once in capture order, so a consumer which processes several frames together
+ * (like multi-frame visual odometry) pays for a single wakeup. The video thread itself
+ * uses v4l2_image_get(), it processes every frame as soon as possible.
+ * The amount is limited to the size of the queue and to the frames the capture thread
+ * can queue while other buffers are held. When capturing stops or no complete batch
+ * arrives within V4L2_BATCH_TIMEOUT seconds, the frames queued so far are returned.
+ * Every image must be freed after processing with v4l2_image_free()!
+ * @param[in] *dev The V4L2 video device we want to get the images from
+ * @param[out] *imgs Array of at least nb images
+ * @param[in] nb The number of images wanted
+ * @return The number of images that were taken (can be 0)
+ */
+uint8_t v4l2_image_get_batch(struct v4l2_device *dev, struct image_t *imgs, uint8_t nb)
+{
+  uint8_t img_idx[dev->buffers_cnt];
+  uint8_t i;
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += V4L2_BATCH_TIMEOUT;
+
+  pthread_mutex_lock(&dev->mutex);
+  while (dev->thread != (pthread_t) NULL) {
+    // the capture thread doesn't queue more than this, recomputed as other users take or free buffers
+    uint8_t max_nb = Min(nb, dev->queue_size);
+    if (dev->buffers_held + V4L2_BUFFERS_RESERVED < dev->buffers_cnt) {
+      max_nb = Min(max_nb, dev->buffers_cnt - dev->buffers_held - V4L2_BUFFERS_RESERVED);
+    } else {
+      max_nb = 1;
+    }
+    if (dev->queue_cnt >= max_nb || pthread_cond_timedwait(&dev->cond, &dev->mutex, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  nb = Min(nb, dev->queue_cnt);
+  for (i = 0; i < nb; i++) {
+    img_idx[i] = v4l2_queue_pop(dev);
+  }
+  pthread_mutex_unlock(&dev->mutex);
+
+  for (i = 0; i < nb; i++) {
+    v4l2_image_set(dev, &imgs[i], img_idx[i]);
+  }
+  return nb;
+}
+
+/**
+ * Take an extra reference on an image buffer (Thread safe)
+ * This allows the same memory mapped buffer to be shared by multiple users (like
+ * asynchronous computer vision listeners) without copying it. Every successful
+ * reference must be released with v4l2_image_free(), the buffer is only enqueued
+ * again when the last user released it.
+ * @param[in] *dev The video for linux device which the image is from
+ * @param[in] *img The image (obtained with v4l2_image_get) to reference
+ * @return Whether the reference was taken, FALSE if the image is not a held buffer
+ * of this device or if too few buffers would be left for capturing
+ */
+bool v4l2_image_ref(struct v4l2_device *dev, struct image_t *img)
+{
+  bool referenced = false;
+
+  // Only images pointing to one of our own buffers can be referenced
+  if (img->buf_idx >= dev->buffers_cnt || img->buf != dev->buffers[img->buf_idx].buf) {
+    return false;
+  }
+
+  pthread_mutex_lock(&dev->mutex);
+  if (dev->buffers[img->buf_idx].ref_cnt > 0 && dev->buffers_held + V4L2_BUFFERS_RESERVED < dev->buffers_cnt) {
+    dev->buffers[img->buf_idx].ref_cnt++;
+    referenced = true;
+  }
+  pthread_mutex_unlock(&dev->mutex);
+
+  return referenced;
 }
 
 /**
  * Free the image and enqueue the buffer (Thread safe)
- * This must be done after processing the image, because else all buffers are locked
+ * This must be done after processing the image, because else all buffers are locked.
+ * When other references to the buffer are still held (see v4l2_image_ref()), only
+ * the reference count is decreased and the last user enqueues the buffer.
  * @param[in] *dev The video for linux device which the image is from
  * @param[in] *img The image to free
  */
@@ -407,6 +579,21 @@ void v4l2_image_free(struct v4l2_device *dev, struct image_t *img)
 {
   struct v4l2_buffer buf;
 
+  // Release our reference and check if we were the last user
+  pthread_mutex_lock(&dev->mutex);
+  if (dev->buffers[img->buf_idx].ref_cnt > 0) {
+    dev->buffers[img->buf_idx].ref_cnt--;
+  }
+  bool last_ref = (dev->buffers[img->buf_idx].ref_cnt == 0);
+  if (last_ref && dev->buffers_held > 0) {
+    dev->buffers_held--;
+  }
+  pthread_mutex_unlock(&dev->mutex);
+
+  if (!last_ref) {
+    return;
+  }
+
   // Enqueue the buffer
   CLEAR(buf);
   buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -436,9 +623,13 @@ bool v4l2_start_capture(struct v4l2_device *dev)
   }
 
   // Enqueue all buffers
-  dev->buffers_deq_idx = V4L2_IMG_NONE;
+  dev->queue_head = 0;
+  dev->queue_cnt = 0;
+  dev->frames_dropped = 0;
+  dev->buffers_held = 0;
   for (i = 0; i < dev->buffers_cnt; ++i) {
     struct v4l2_buffer buf;
+    dev->buffers[i].ref_cnt = 0;
 
     CLEAR(buf);
     buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -508,7 +699,12 @@ bool v4l2_stop_capture(struct v4l2_device *dev)
 
   // Wait for the thread to be finished
   pthread_join(dev->thread, NULL);
+
+  // Wake up the users waiting for a batch
+  pthread_mutex_lock(&dev->mutex);
   dev->thread = (pthread_t) NULL;
+  pthread_cond_broadcast(&dev->cond);
+  pthread_mutex_unlock(&dev->mutex);
   return true;
 }
 
@@ -534,6 +730,10 @@ void v4l2_close(struct v4l2_device *dev)
 
   // Close the file pointer and free all memory
   close(dev->fd);
+  pthread_cond_destroy(&dev->cond);
+  pthread_mutex_destroy(&dev->mutex);
+  free(dev->queue);
+  free(dev->buffers);
   free(dev->name);
   free(dev);
 }
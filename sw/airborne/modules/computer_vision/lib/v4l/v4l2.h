@@ -37,12 +37,20 @@
 
 #define V4L2_IMG_NONE 255  ///< There currently no image available
 
+/** How the dequeued frames are handed to the users */
+enum v4l2_capture_mode {
+  V4L2_CAPTURE_LATEST = 0,    ///< Only the latest frame is kept, older ones are enqueued again (default)
+  V4L2_CAPTURE_QUEUE          ///< Every frame is kept in order, the oldest is dropped when the queue is full
+};
+
 /* V4L2 memory mapped image buffer */
 struct v4l2_img_buf {
   size_t length;              ///< The size of the buffer
   struct timeval timestamp;   ///< The time value of the image
   uint32_t pprz_timestamp;    ///< The time of the image in us since system startup
+  uint32_t sequence;          ///< The frame sequence number given by the driver
   void *buf;                  ///< Pointer to the memory mapped buffer
+  uint8_t ref_cnt;            ///< Amount of users holding this buffer (enqueued again when it drops to zero)
 };
 
 /* V4L2 device */
@@ -53,8 +61,15 @@ struct v4l2_device {
   uint16_t w;                       ///< The width of the image
   uint16_t h;                       ///< The height of the image
   uint8_t buffers_cnt;              ///< The number of image buffers
-  volatile uint8_t buffers_deq_idx; ///< The current dequeued index
-  pthread_mutex_t mutex;            ///< Mutex lock for enqueue/dequeue of buffers (change the deq_idx)
+  uint8_t buffers_held;             ///< The amount of buffers currently held by users (ref_cnt > 0)
+  enum v4l2_capture_mode mode;      ///< Which frames are kept for the users
+  uint8_t *queue;                   ///< Dequeued frames not yet taken by a user, oldest first (ring of buffers_cnt)
+  uint8_t queue_head;               ///< Index of the oldest frame in the queue
+  uint8_t queue_cnt;                ///< The number of frames in the queue
+  uint8_t queue_size;               ///< Maximum number of frames in the queue (1 in V4L2_CAPTURE_LATEST mode)
+  uint32_t frames_dropped;          ///< Frames dropped from a full queue in V4L2_CAPTURE_QUEUE mode
+  pthread_mutex_t mutex;            ///< Mutex lock for enqueue/dequeue of buffers (change the queue)
+  pthread_cond_t cond;              ///< Signaled when a frame is added to the queue
   struct v4l2_img_buf *buffers;     ///< The memory mapped image buffers
 };
 
@@ -64,6 +79,9 @@ struct v4l2_device *v4l2_init(char *device_name, struct img_size_t size, struct
                               uint32_t _pixelformat);
 void v4l2_image_get(struct v4l2_device *dev, struct image_t *img);
 bool v4l2_image_get_nonblock(struct v4l2_device *dev, struct image_t *img);
+uint8_t v4l2_image_get_batch(struct v4l2_device *dev, struct image_t *imgs, uint8_t nb);
+void v4l2_set_capture_mode(struct v4l2_device *dev, enum v4l2_capture_mode mode, uint8_t queue_size);
+bool v4l2_image_ref(struct v4l2_device *dev, struct image_t *img);
 void v4l2_image_free(struct v4l2_device *dev, struct image_t *img);
 bool v4l2_start_capture(struct v4l2_device *dev);
 bool v4l2_stop_capture(struct v4l2_device *dev);
@@ -32,8 +32,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "fast_rosten.h"
 
+/**
+ * Use the NEON (ARM) or SSE2 (x86) segment test for 16 pixels at once in fast9_detect_grid.
+ * Gives the same corners as the scalar code.
+ */
+#ifndef FAST9_USE_SIMD
+#define FAST9_USE_SIMD TRUE
+#endif
+
+#if FAST9_USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define FAST9_NEON 1
+#elif FAST9_USE_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define FAST9_SSE2 1
+#endif
+
 static void fast_make_offsets(int32_t *pixel, uint16_t row_stride, uint8_t pixel_size);
 
 /**
@@ -3654,6 +3671,422 @@ void fast9_detect(struct image_t *img, uint8_t threshold, uint16_t min_dist, uin
   *num_corners = corner_cnt;
 }
 
+/* A corner candidate of fast9_detect_grid */
+struct fast9_candidate_t {
+  uint16_t x;
+  uint16_t y;
+  uint16_t score;
+};
+
+/**
+ * Compass pre-test of one pixel
+ * A FAST9 corner has at least 2 of the 4 compass pixels (0, 4, 8 and 12) brighter or
+ * darker than the center, because every arc of 9 pixels contains 2 of them.
+ * @param[in] *p Pointer to the center pixel
+ * @param[in] *pixel The offsets of the circle pixels
+ * @param[in] threshold The FAST9 threshold
+ * @return Whether the pixel can be a corner
+ */
+static inline bool fast9_pretest(const uint8_t *p, const int32_t *pixel, uint8_t threshold)
+{
+  int16_t cb = *p + threshold;
+  int16_t c_b = *p - threshold;
+  uint8_t bright = (p[pixel[0]] > cb) + (p[pixel[4]] > cb) + (p[pixel[8]] > cb) + (p[pixel[12]] > cb);
+  uint8_t dark = (p[pixel[0]] < c_b) + (p[pixel[4]] < c_b) + (p[pixel[8]] < c_b) + (p[pixel[12]] < c_b);
+  return bright >= 2 || dark >= 2;
+}
+
+#if FAST9_SSE2 || FAST9_NEON
+#if FAST9_SSE2
+typedef __m128i fast9_vec_t;
+#define FAST9_AND(_a, _b) _mm_and_si128(_a, _b)
+#define FAST9_OR(_a, _b) _mm_or_si128(_a, _b)
+#define FAST9_LOAD16(_q) ((pixel_size == 1) ? _mm_loadu_si128((const __m128i *)(_q)) : \
+    _mm_packus_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)((_q) - 1)), 8), \
+                     _mm_srli_epi16(_mm_loadu_si128((const __m128i *)((_q) + 15)), 8)))
+/* Comparisons giving 0xFF when true, on unsigned bytes */
+#define FAST9_GT(_a, _b) _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(_a, _b), _mm_setzero_si128()), _mm_set1_epi8(-1))
+#define FAST9_COUNT_GE2(_a, _b, _c, _d) _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(_mm_setzero_si128(), \
+    _mm_add_epi8(_mm_add_epi8(_a, _b), _mm_add_epi8(_c, _d))), _mm_set1_epi8(1)), _mm_setzero_si128()), _mm_set1_epi8(-1))
+#define FAST9_MOVEMASK(_a) ((uint32_t)_mm_movemask_epi8(_a))
+#else
+typedef uint8x16_t fast9_vec_t;
+#define FAST9_AND(_a, _b) vandq_u8(_a, _b)
+#define FAST9_OR(_a, _b) vorrq_u8(_a, _b)
+#define FAST9_LOAD16(_q) ((pixel_size == 1) ? vld1q_u8(_q) : vld2q_u8((_q) - 1).val[1])
+#define FAST9_GT(_a, _b) vcgtq_u8(_a, _b)
+#define FAST9_COUNT_GE2(_a, _b, _c, _d) vcgeq_u8(vreinterpretq_u8_s8(vnegq_s8(vreinterpretq_s8_u8( \
+    vaddq_u8(vaddq_u8(_a, _b), vaddq_u8(_c, _d))))), vdupq_n_u8(2))
+static inline uint32_t fast9_movemask(uint8x16_t a)
+{
+  static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  uint8x16_t m = vandq_u8(a, vld1q_u8(bits));
+  uint8x8_t s = vpadd_u8(vget_low_u8(m), vget_high_u8(m));
+  s = vpadd_u8(s, s);
+  s = vpadd_u8(s, s);
+  return vget_lane_u8(s, 0) | (vget_lane_u8(s, 1) << 8);
+}
+#define FAST9_MOVEMASK(_a) fast9_movemask(_a)
+#endif
+
+/**
+ * Check for 9 contiguous pixels on the circle, for 16 pixels at once
+ * @param[in] *m The comparison result of every circle pixel (0xFF when brighter/darker)
+ * @return 0xFF for the pixels that have an arc of 9
+ */
+static inline fast9_vec_t fast9_arc16(const fast9_vec_t *m)
+{
+  fast9_vec_t r2[23], r4[21], arc;
+  uint8_t i;
+  for (i = 0; i < 23; i++) {
+    r2[i] = FAST9_AND(m[i & 15], m[(i + 1) & 15]);
+  }
+  for (i = 0; i < 21; i++) {
+    r4[i] = FAST9_AND(r2[i], r2[i + 2]);
+  }
+  arc = FAST9_AND(FAST9_AND(r4[0], r4[4]), m[8]);
+  for (i = 1; i < 16; i++) {
+    arc = FAST9_OR(arc, FAST9_AND(FAST9_AND(r4[i], r4[i + 4]), m[(i + 8) & 15]));
+  }
+  return arc;
+}
+
+/**
+ * FAST9 segment test of 16 consecutive pixels
+ * The compass pixels are tested first, because a FAST9 corner has at least 2 of the
+ * 4 compass pixels (0, 4, 8 and 12) brighter or darker than the center.
+ * @param[in] *p Pointer to the first center pixel
+ * @param[in] *pixel The offsets of the circle pixels
+ * @param[in] pixel_size The size of a pixel in bytes (the luminance is the second byte of YUV422 pixels)
+ * @param[in] threshold The FAST9 threshold
+ * @return Bit mask of the pixels that are a corner
+ */
+static inline uint32_t fast9_detect16(const uint8_t *p, const int32_t *pixel, uint8_t pixel_size, uint8_t threshold)
+{
+  fast9_vec_t bright[16], dark[16];
+  uint8_t i;
+#if FAST9_SSE2
+  const fast9_vec_t t = _mm_set1_epi8(threshold);
+  fast9_vec_t c = FAST9_LOAD16(p);
+  fast9_vec_t cb = _mm_adds_epu8(c, t);
+  fast9_vec_t c_b = _mm_subs_epu8(c, t);
+#else
+  const fast9_vec_t t = vdupq_n_u8(threshold);
+  fast9_vec_t c = FAST9_LOAD16(p);
+  fast9_vec_t cb = vqaddq_u8(c, t);
+  fast9_vec_t c_b = vqsubq_u8(c, t);
+#endif
+
+  // Compass pre-test
+  for (i = 0; i < 16; i += 4) {
+    fast9_vec_t v = FAST9_LOAD16(p + pixel[i]);
+    bright[i] = FAST9_GT(v, cb);
+    dark[i] = FAST9_GT(c_b, v);
+  }
+  uint32_t mask = FAST9_MOVEMASK(FAST9_OR(FAST9_COUNT_GE2(bright[0], bright[4], bright[8], bright[12]),
+                                          FAST9_COUNT_GE2(dark[0], dark[4], dark[8], dark[12])));
+  if (mask == 0) {
+    return 0;
+  }
+
+  // Full segment test
+  for (i = 0; i < 16; i++) {
+    if (i % 4 != 0) {
+      fast9_vec_t v = FAST9_LOAD16(p + pixel[i]);
+      bright[i] = FAST9_GT(v, cb);
+      dark[i] = FAST9_GT(c_b, v);
+    }
+  }
+  return mask & FAST9_MOVEMASK(FAST9_OR(fast9_arc16(bright), fast9_arc16(dark)));
+}
+#undef FAST9_LOAD16
+#endif
+
+/**
+ * Check for 9 contiguous set bits in a 16 bit circle mask
+ */
+static inline bool fast9_arc(uint32_t mask)
+{
+  uint32_t m = mask | (mask << 16); // doubled for the wrap around
+  uint32_t r = m & (m >> 1);
+  r &= r >> 2;
+  r &= r >> 4;
+  return (r & (m >> 8)) != 0;
+}
+
+/**
+ * FAST9 segment test and corner score of a pixel
+ * The score is the sum of the differences above the threshold of the brighter or the
+ * darker circle pixels (the largest of the two).
+ * @param[in] *p Pointer to the center pixel
+ * @param[in] *pixel The offsets of the circle pixels
+ * @param[in] threshold The FAST9 threshold
+ * @return The corner score, 0 if the pixel is no corner
+ */
+static uint16_t fast9_score(const uint8_t *p, const int32_t *pixel, uint8_t threshold)
+{
+  int16_t cb = *p + threshold;
+  int16_t c_b = *p - threshold;
+  uint32_t bright = 0, dark = 0;
+  uint8_t i;
+
+  // Segment test without branches, the circle pixels of textured images are unpredictable
+  for (i = 0; i < 16; i++) {
+    int16_t v = p[pixel[i]];
+    bright |= (uint32_t)(v > cb) << i;
+    dark |= (uint32_t)(v < c_b) << i;
+  }
+  bool is_bright = fast9_arc(bright);
+  bool is_dark = fast9_arc(dark);
+  if (!is_bright && !is_dark) {
+    return 0;
+  }
+
+  uint16_t sum_bright = 0, sum_dark = 0;
+  for (i = 0; i < 16; i++) {
+    int16_t v = p[pixel[i]];
+    sum_bright += (bright >> i & 1) ? v - cb : 0;
+    sum_dark += (dark >> i & 1) ? c_b - v : 0;
+  }
+  if (!is_dark) {
+    return sum_bright;
+  } else if (!is_bright) {
+    return sum_dark;
+  }
+  return Max(sum_bright, sum_dark);
+}
+
+/** Upper bound of the corner score (16 circle pixels that differ at most 255) */
+#define FAST9_SCORE_MAX (16 * 255 + 1)
+
+/**
+ * Sort corner candidates on decreasing score with a counting sort
+ * Candidates with the same score keep their scan order.
+ * @param[in] *cand The candidates
+ * @param[in] cnt The number of candidates
+ * @return The sorted candidates (NULL when out of memory), must be freed
+ */
+static struct fast9_candidate_t *fast9_sort_candidates(const struct fast9_candidate_t *cand, uint32_t cnt)
+{
+  uint32_t *start = calloc(FAST9_SCORE_MAX + 1, sizeof(uint32_t));
+  struct fast9_candidate_t *sorted = malloc((cnt + 1) * sizeof(struct fast9_candidate_t));
+  if (start == NULL || sorted == NULL) {
+    free(start);
+    free(sorted);
+    return NULL;
+  }
+
+  // Count per score and give the highest scores the first positions
+  uint32_t i;
+  for (i = 0; i < cnt; i++) {
+    start[FAST9_SCORE_MAX - cand[i].score]++;
+  }
+  uint32_t pos = 0;
+  for (i = 0; i <= FAST9_SCORE_MAX; i++) {
+    uint32_t n = start[i];
+    start[i] = pos;
+    pos += n;
+  }
+  for (i = 0; i < cnt; i++) {
+    sorted[start[FAST9_SCORE_MAX - cand[i].score]++] = cand[i];
+  }
+  free(start);
+  return sorted;
+}
+
+/**
+ * Do a FAST9 corner detection with score based non-maximum suppression.
+ * Unlike fast9_detect, the corners are not taken in scan order: every corner has to be the
+ * maximum score of its 3x3 neighbourhood, and the strongest corners are selected first.
+ * The minimum distance is checked in constant time with an occupancy grid of min_dist
+ * sized cells, which holds at most one corner each. Optionally the image is split in
+ * cells of cell_size pixels that each get at most cell_max corners, which spreads the
+ * corners over the image whatever the texture of the scene.
+ * A compass pre-test (vectorized when possible) rejects most pixels before the full
+ * segment test, so the detection time depends little on the image.
+ * The array *ret_corners is reallocated in this function when it becomes too full,
+ * *ret_corners_length is updated appropriately.
+ * @param[in] *img The image to do the corner detection on
+ * @param[in] threshold The threshold which we use for FAST9
+ * @param[in] min_dist The minimum distance in pixels between detections
+ * @param[in] x_padding The padding in the x direction to not scan for corners
+ * @param[in] y_padding The padding in the y direction to not scan for corners
+ * @param[in] cell_size The size in pixels of the cells of the corner budget (0 for no budget)
+ * @param[in] cell_max The maximum amount of corners per cell (0 for no budget)
+ * @param[out] *num_corners reference to the amount of corners found, set by this function
+ * @param[in,out] *ret_corners_length the length of the array *ret_corners.
+ * @param[in,out] **ret_corners array which contains the corners that were detected.
+ */
+void fast9_detect_grid(struct image_t *img, uint8_t threshold, uint16_t min_dist, uint16_t x_padding,
+                       uint16_t y_padding, uint16_t cell_size, uint16_t cell_max, uint16_t *num_corners,
+                       uint16_t *ret_corners_length, struct point_t **ret_corners)
+{
+  int32_t pixel[16];
+  uint8_t pixel_size = (img->type == IMAGE_YUV422) ? 2 : 1;
+  uint16_t x_start = 3 + x_padding, y_start = 3 + y_padding;
+  uint16_t x_end = (img->w > 3 + x_padding) ? img->w - 3 - x_padding : 0;
+  uint16_t y_end = (img->h > 3 + y_padding) ? img->h - 3 - y_padding : 0;
+  uint16_t x, y;
+
+  *num_corners = 0;
+  if (x_start >= x_end || y_start >= y_end) {
+    return;
+  }
+
+  fast_make_offsets(pixel, img->w, pixel_size);
+
+  // Scores of the last 3 rows (with a zero border) and the local maxima found
+  uint16_t *scores = calloc(3 * (img->w + 2), sizeof(uint16_t));
+  uint32_t cand_size = 256, cand_cnt = 0;
+  struct fast9_candidate_t *cand = malloc(cand_size * sizeof(struct fast9_candidate_t));
+  if (scores == NULL || cand == NULL) {
+    free(scores);
+    free(cand);
+    return;
+  }
+
+  bool cand_full = false;
+  for (y = y_start; y <= y_end && !cand_full; y++) {
+    uint16_t *row = &scores[(y % 3) * (img->w + 2) + 1];
+    memset(row - 1, 0, (img->w + 2) * sizeof(uint16_t));
+
+    // Score all the pixels of this row that pass the pre-test
+    if (y < y_end) {
+      const uint8_t *line = ((uint8_t *)img->buf) + y * img->w * pixel_size + pixel_size / 2;
+      x = x_start;
+#if FAST9_SSE2 || FAST9_NEON
+      for (; x + 16 <= x_end; x += 16) {
+        uint32_t mask = fast9_detect16(line + x * pixel_size, pixel, pixel_size, threshold);
+        while (mask) {
+          uint8_t i = __builtin_ctz(mask);
+          mask &= mask - 1;
+          row[x + i] = fast9_score(line + (x + i) * pixel_size, pixel, threshold);
+        }
+      }
+#endif
+      for (; x < x_end; x++) {
+        const uint8_t *p = line + x * pixel_size;
+        if (fast9_pretest(p, pixel, threshold)) {
+          row[x] = fast9_score(p, pixel, threshold);
+        }
+      }
+    }
+
+    // Keep the local maxima of the previous row
+    if (y == y_start) {
+      continue;
+    }
+    const uint16_t *prev = &scores[((y + 2) % 3) * (img->w + 2) + 1];
+    const uint16_t *prev2 = &scores[((y + 1) % 3) * (img->w + 2) + 1];
+    for (x = x_start; x < x_end; x++) {
+      uint16_t s = prev[x];
+      if (s == 0) {
+        continue;
+      }
+      // Strictly larger than the neighbours before in scan order, at least as large as the ones after
+      if (s <= prev[x - 1] || s < prev[x + 1] || s < row[x - 1] || s < row[x] || s < row[x + 1]) {
+        continue;
+      }
+      if (s <= prev2[x - 1] || s <= prev2[x] || s <= prev2[x + 1]) {
+        continue;
+      }
+      if (cand_cnt >= cand_size) {
+        // Out of memory: stop scanning and keep the candidates found so far
+        struct fast9_candidate_t *tmp = realloc(cand, 2 * cand_size * sizeof(struct fast9_candidate_t));
+        if (tmp == NULL) {
+          cand_full = true;
+          break;
+        }
+        cand = tmp;
+        cand_size *= 2;
+      }
+      cand[cand_cnt].x = x;
+      cand[cand_cnt].y = y - 1;
+      cand[cand_cnt].score = s;
+      cand_cnt++;
+    }
+  }
+  free(scores);
+
+  // Strongest corners first
+  struct fast9_candidate_t *sorted = fast9_sort_candidates(cand, cand_cnt);
+  free(cand);
+  if (sorted == NULL) {
+    return;
+  }
+  cand = sorted;
+
+  // Occupancy grid for the minimum distance, holding the corner index + 1 of each cell
+  uint16_t occ_w = 0, occ_h = 0;
+  uint16_t *occ = NULL;
+  if (min_dist > 0) {
+    occ_w = (img->w + min_dist - 1) / min_dist;
+    occ_h = (img->h + min_dist - 1) / min_dist;
+    occ = calloc(occ_w * occ_h, sizeof(uint16_t));
+  }
+
+  // Corner budget per cell
+  uint16_t budget_w = 0;
+  uint16_t *budget = NULL;
+  if (cell_size > 0 && cell_max > 0) {
+    budget_w = (img->w + cell_size - 1) / cell_size;
+    budget = calloc(budget_w * ((img->h + cell_size - 1) / cell_size), sizeof(uint16_t));
+  }
+
+  uint16_t corner_cnt = 0;
+  for (uint32_t c = 0; c < cand_cnt; c++) {
+    x = cand[c].x;
+    y = cand[c].y;
+
+    if (budget != NULL && budget[(y / cell_size) * budget_w + x / cell_size] >= cell_max) {
+      continue;
+    }
+
+    if (occ != NULL) {
+      uint16_t cx = x / min_dist, cy = y / min_dist;
+      bool too_close = false;
+      for (uint16_t j = (cy > 0) ? cy - 1 : 0; j <= cy + 1 && j < occ_h && !too_close; j++) {
+        for (uint16_t i = (cx > 0) ? cx - 1 : 0; i <= cx + 1 && i < occ_w; i++) {
+          uint16_t idx = occ[j * occ_w + i];
+          if (idx > 0 && abs((int32_t)(*ret_corners)[idx - 1].x - x) < min_dist &&
+              abs((int32_t)(*ret_corners)[idx - 1].y - y) < min_dist) {
+            too_close = true;
+            break;
+          }
+        }
+      }
+      if (too_close) {
+        continue;
+      }
+    }
+
+    // When we have more corner than allocted space reallocate
+    if (corner_cnt >= *ret_corners_length) {
+      struct point_t *tmp = realloc(*ret_corners, sizeof(struct point_t) * (*ret_corners_length) * 2);
+      if (tmp == NULL) {
+        break;
+      }
+      *ret_corners_length *= 2;
+      *ret_corners = tmp;
+    }
+    (*ret_corners)[corner_cnt].x = x;
+    (*ret_corners)[corner_cnt].y = y;
+    corner_cnt++;
+
+    if (occ != NULL) {
+      occ[(y / min_dist) * occ_w + x / min_dist] = corner_cnt;
+    }
+    if (budget != NULL) {
+      budget[(y / cell_size) * budget_w + x / cell_size]++;
+    }
+  }
+
+  free(occ);
+  free(budget);
+  free(cand);
+  *num_corners = corner_cnt;
+}
+
 /**
  * Make offsets for FAST9 calculation
  * @param[out] *pixel The offset array of the different pixels
@@ -38,5 +38,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "lib/vision/image.h"
 
 void fast9_detect(struct image_t *img, uint8_t threshold, uint16_t min_dist, uint16_t x_padding, uint16_t y_padding, uint16_t *num_corners,uint16_t *ret_corners_length,struct point_t *ret_corners);
+void fast9_detect_grid(struct image_t *img, uint8_t threshold, uint16_t min_dist, uint16_t x_padding,
+                       uint16_t y_padding, uint16_t cell_size, uint16_t cell_max, uint16_t *num_corners,
+                       uint16_t *ret_corners_length, struct point_t **ret_corners);
 
 #endif
@@ -27,6 +27,119 @@
 #include "image.h"
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/**
+ * Use vectorized (NEON on ARM, SSE2 on x86) versions of the image primitives.
+ * The implementation is chosen at compile time and gives bit-exact the same results
+ * as the scalar code, which is used when no vector unit is available.
+ */
+#ifndef IMAGE_USE_SIMD
+#define IMAGE_USE_SIMD TRUE
+#endif
+
+#if IMAGE_USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define IMAGE_NEON 1
+#elif IMAGE_USE_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_SSE2 1
+#endif
+
+/**
+ * Amount of buffers kept in the image pool.
+ * Buffers handed out by the pool are never given back to the heap, so in steady state
+ * (the same image sizes every frame) image_create_pooled() does not touch the heap.
+ */
+#ifndef IMAGE_POOL_SIZE
+#define IMAGE_POOL_SIZE 32
+#endif
+
+/* A buffer in the image pool */
+struct image_pool_buf_t {
+  void *buf;              ///< The allocated buffer (NULL when the slot is empty)
+  uint32_t size;          ///< The allocated size of the buffer
+  bool used;              ///< Whether the buffer is currently handed out
+};
+
+/* Lookup table from buffer pointer to pool slot + 1 (0 is empty), so a buffer is freed without searching the pool */
+#define IMAGE_POOL_HASH_SIZE (IMAGE_POOL_SIZE * 2)
+#define IMAGE_POOL_HASH_EMPTY 0
+
+static struct image_pool_buf_t image_pool[IMAGE_POOL_SIZE];
+static int16_t image_pool_hash[IMAGE_POOL_HASH_SIZE];
+static pthread_mutex_t image_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool image_pool_full_reported = false;
+struct image_pool_stats_t image_pool_stats;
+
+/** Hash of a buffer pointer in the lookup table */
+static inline uint16_t image_pool_hash_idx(void *buf)
+{
+  // The lower bits are always zero due to the malloc alignment
+  return (uint16_t)(((uintptr_t)buf >> 4) % IMAGE_POOL_HASH_SIZE);
+}
+
+/**
+ * Rebuild the lookup table after a pool buffer was (re)allocated
+ * This only happens together with a new allocation, not in steady state.
+ */
+static void image_pool_hash_rebuild(void)
+{
+  for (uint16_t i = 0; i < IMAGE_POOL_HASH_SIZE; i++) {
+    image_pool_hash[i] = IMAGE_POOL_HASH_EMPTY;
+  }
+  for (int16_t s = 0; s < IMAGE_POOL_SIZE; s++) {
+    if (image_pool[s].buf == NULL) {
+      continue;
+    }
+    uint16_t i = image_pool_hash_idx(image_pool[s].buf);
+    while (image_pool_hash[i] != IMAGE_POOL_HASH_EMPTY) {
+      i = (i + 1) % IMAGE_POOL_HASH_SIZE;
+    }
+    image_pool_hash[i] = s + 1;
+  }
+}
+
+/**
+ * Find the pool slot of a buffer
+ * @param[in] *buf The buffer
+ * @return The pool slot, or -1 when the buffer is not from the pool
+ */
+static int16_t image_pool_find(void *buf)
+{
+  // The table is at most half full, so there is always an empty entry to stop at
+  uint16_t i = image_pool_hash_idx(buf);
+  while (image_pool_hash[i] != IMAGE_POOL_HASH_EMPTY) {
+    int16_t s = image_pool_hash[i] - 1;
+    if (image_pool[s].buf == buf) {
+      return s;
+    }
+    i = (i + 1) % IMAGE_POOL_HASH_SIZE;
+  }
+  return -1;
+}
+
+/**
+ * Calculate the buffer size of an image
+ * @param[in] width The width of the image
+ * @param[in] height The height of the image
+ * @param[in] type The type of image
+ * @return The buffer size in bytes
+ */
+static uint32_t image_buf_size(uint16_t width, uint16_t height, enum image_type type)
+{
+  // Depending on the type the size differs
+  if (type == IMAGE_YUV422) {
+    return sizeof(uint8_t) * 2 * width * height;
+  } else if (type == IMAGE_JPEG) {
+    return sizeof(uint8_t) * 2 * width * height;  // At maximum quality this is enough
+  } else if (type == IMAGE_GRADIENT) {
+    return sizeof(int16_t) * width * height;
+  } else {
+    return sizeof(uint8_t) * width * height;
+  }
+}
 
 /**
  * Create a new image
@@ -41,29 +154,127 @@ void image_create(struct image_t *img, uint16_t width, uint16_t height, enum ima
   img->type = type;
   img->w = width;
   img->h = height;
+  img->buf_size = image_buf_size(width, height, type);
+  img->buf = malloc(img->buf_size);
+}
 
-  // Depending on the type the size differs
-  if (type == IMAGE_YUV422) {
-    img->buf_size = sizeof(uint8_t) * 2 * width * height;
-  } else if (type == IMAGE_JPEG) {
-    img->buf_size = sizeof(uint8_t) * 2 * width * height;  // At maximum quality this is enough
-  } else if (type == IMAGE_GRADIENT) {
-    img->buf_size = sizeof(int16_t) * width * height;
+/**
+ * Create a new image with a buffer from the image pool
+ * The image must be freed with image_free(), which gives the buffer back to the pool.
+ * Use this for images which are created and freed every frame.
+ * @param[out] *img The output image
+ * @param[in] width The width of the image
+ * @param[in] height The height of the image
+ * @param[in] type The type of image (YUV422 or grayscale)
+ */
+void image_create_pooled(struct image_t *img, uint16_t width, uint16_t height, enum image_type type)
+{
+  img->type = type;
+  img->w = width;
+  img->h = height;
+  img->buf_size = image_buf_size(width, height, type);
+  img->buf = image_pool_alloc(img->buf_size);
+}
+
+/**
+ * Get a buffer from the image pool
+ * The smallest free buffer which fits (and is not more than twice as big) is reused,
+ * otherwise an empty or unused slot gets a new allocation. When all slots are in use
+ * the buffer is allocated on the heap.
+ * @param[in] size The wanted size of the buffer in bytes
+ * @return The buffer, must be freed with image_pool_free()
+ */
+void *image_pool_alloc(uint32_t size)
+{
+  void *buf = NULL;
+  int16_t best = -1, empty = -1, unused = -1;
+
+  pthread_mutex_lock(&image_pool_mutex);
+  for (int16_t i = 0; i < IMAGE_POOL_SIZE; i++) {
+    if (image_pool[i].buf == NULL) {
+      if (empty < 0) { empty = i; }
+    } else if (!image_pool[i].used) {
+      if (image_pool[i].size >= size && image_pool[i].size / 2 <= size
+          && (best < 0 || image_pool[i].size < image_pool[best].size)) {
+        best = i;
+      }
+      unused = i;
+    }
+  }
+
+  if (best >= 0) {
+    image_pool_stats.hits++;
   } else {
-    img->buf_size = sizeof(uint8_t) * width * height;
+    // Allocate in an empty slot, or replace a buffer which is not used
+    best = (empty >= 0) ? empty : unused;
+    if (best >= 0) {
+      free(image_pool[best].buf);
+      image_pool[best].buf = malloc(size);
+      image_pool[best].size = size;
+      image_pool_hash_rebuild();
+      image_pool_stats.misses++;
+    }
   }
 
-  img->buf = malloc(img->buf_size);
+  bool report_full = false;
+  if (best >= 0 && image_pool[best].buf != NULL) {
+    image_pool[best].used = true;
+    image_pool_stats.in_use++;
+    buf = image_pool[best].buf;
+  } else {
+    image_pool_stats.overflows++;
+    if (!image_pool_full_reported) {
+      image_pool_full_reported = true;
+      report_full = true;
+    }
+  }
+  pthread_mutex_unlock(&image_pool_mutex);
+
+  // The pool is full, fall back to the heap
+  if (buf == NULL) {
+    if (report_full) {
+      printf("[image] All %d pool buffers are in use, allocating on the heap (increase IMAGE_POOL_SIZE)\n",
+             IMAGE_POOL_SIZE);
+    }
+    buf = malloc(size);
+  }
+  return buf;
+}
+
+/**
+ * Give a buffer back to the image pool
+ * Buffers which are not from the pool are freed on the heap, so this also works for
+ * buffers allocated with a plain malloc().
+ * @param[in] *buf The buffer to free
+ */
+void image_pool_free(void *buf)
+{
+  if (buf == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&image_pool_mutex);
+  int16_t slot = image_pool_find(buf);
+  if (slot >= 0) {
+    image_pool[slot].used = false;
+    image_pool_stats.in_use--;
+  }
+  pthread_mutex_unlock(&image_pool_mutex);
+
+  if (slot < 0) {
+    free(buf);
+  }
 }
 
 /**
  * Free the image
+ * This works for images created with image_create() and image_create_pooled()
  * @param[in] *img The image to free
  */
 void image_free(struct image_t *img)
 {
   if (img->buf != NULL) {
-    free(img->buf);
+    image_pool_free(img->buf);
     img->buf = NULL;
   }
 }
@@ -84,6 +295,7 @@ void image_copy(struct image_t *input, struct image_t *output)
   output->h = input->h;
   output->buf_size = input->buf_size;
   output->ts = input->ts;
+  output->pprz_ts = input->pprz_ts;
   memcpy(output->buf, input->buf, input->buf_size);
 }
 
@@ -117,19 +329,47 @@ void image_to_grayscale(struct image_t *input, struct image_t *output)
 {
   uint8_t *source = input->buf;
   uint8_t *dest = output->buf;
-  source++;
+  uint32_t pixels = (uint32_t)output->w * output->h;
+  uint32_t i = 0;
 
   // Copy the creation timestamp (stays the same)
   output->ts = input->ts;
 
-  // Copy the pixels
-  for (int y = 0; y < output->h; y++) {
-    for (int x = 0; x < output->w; x++) {
-      if (output->type == IMAGE_YUV422) {
-        *dest++ = 127;  // U / V
-      }
-      *dest++ = *source;    // Y
-      source += 2;
+  if (output->type == IMAGE_YUV422) {
+#if IMAGE_NEON
+    const uint8x16_t uv = vdupq_n_u8(127);
+    for (; i + 16 <= pixels; i += 16) {
+      uint8x16x2_t px = vld2q_u8(source + 2 * i);
+      px.val[0] = uv;
+      vst2q_u8(dest + 2 * i, px);
+    }
+#elif IMAGE_SSE2
+    const __m128i uv = _mm_set1_epi16(127);
+    const __m128i y_mask = _mm_set1_epi16((int16_t)0xFF00);
+    for (; i + 8 <= pixels; i += 8) {
+      __m128i px = _mm_loadu_si128((__m128i *)(source + 2 * i));
+      _mm_storeu_si128((__m128i *)(dest + 2 * i), _mm_or_si128(_mm_and_si128(px, y_mask), uv));
+    }
+#endif
+    for (; i < pixels; i++) {
+      dest[2 * i] = 127;                  // U / V
+      dest[2 * i + 1] = source[2 * i + 1];  // Y
+    }
+  } else {
+#if IMAGE_NEON
+    for (; i + 16 <= pixels; i += 16) {
+      uint8x16x2_t px = vld2q_u8(source + 2 * i);
+      vst1q_u8(dest + i, px.val[1]);
+    }
+#elif IMAGE_SSE2
+    for (; i + 16 <= pixels; i += 16) {
+      __m128i lo = _mm_srli_epi16(_mm_loadu_si128((__m128i *)(source + 2 * i)), 8);
+      __m128i hi = _mm_srli_epi16(_mm_loadu_si128((__m128i *)(source + 2 * i + 16)), 8);
+      _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < pixels; i++) {
+      dest[i] = source[2 * i + 1];  // Y
     }
   }
 }
@@ -219,6 +459,12 @@ void image_yuv422_downsample(struct image_t *input, struct image_t *output, uint
   // Copy the creation timestamp (stays the same)
   output->ts = input->ts;
 
+  // Without downsampling the rows are just copied
+  if (downsample == 1) {
+    memcpy(dest, source, (uint32_t)output->w * output->h * 2);
+    return;
+  }
+
   // Go trough all the pixels
   for (uint16_t y = 0; y < output->h; y++) {
     for (uint16_t x = 0; x < output->w; x += 2) {
@@ -245,7 +491,7 @@ void image_yuv422_downsample(struct image_t *input, struct image_t *output, uint
 void image_add_border(struct image_t *input, struct image_t *output, uint8_t border_size)
 {
   // Create padded image based on input
-  image_create(output, input->w + 2 * border_size, input->h + 2 * border_size, input->type);
+  image_create_pooled(output, input->w + 2 * border_size, input->h + 2 * border_size, input->type);
 
   uint8_t *input_buf = (uint8_t *)input->buf;
   uint8_t *output_buf = (uint8_t *)output->buf;
@@ -276,11 +522,18 @@ void image_add_border(struct image_t *input, struct image_t *output, uint8_t bor
   }
 }
 
+/* The filter sum is at most 9998 * 255, for which (sum * PYRAMID_DIV_MUL) >> PYRAMID_DIV_SHIFT == sum / 10000 */
+#define PYRAMID_DIV_MUL 3435974
+#define PYRAMID_DIV_SHIFT 35
+
 /**
  * This function takes previous padded pyramid level and outputs next level of pyramid without padding.
  * For calculating new pixel value 5x5 filter matrix suggested by Bouguet is used:
  * [1/16 1/8 3/4 1/8 1/16]' x [1/16 1/8 3/4 1/8 1/16]
  * To avoid decimal numbers, all coefficients are multiplied by 10000.
+ * The vector code computes 8 output pixels at once with exactly the same integer result:
+ * the rows and columns with the same coefficients are added first, and the division
+ * by 10000 is a multiplication with PYRAMID_DIV_MUL followed by a shift.
  *
  * @param[in]  *input  - input image (grayscale only)
  * @param[out] *output - the output image
@@ -290,7 +543,7 @@ void image_add_border(struct image_t *input, struct image_t *output, uint8_t bor
 void pyramid_next_level(struct image_t *input, struct image_t *output, uint8_t border_size)
 {
   // Create output image, new image size is half the size of input image without padding (border)
-  image_create(output, (input->w + 1 - 2 * border_size) / 2, (input->h + 1 - 2 * border_size) / 2, input->type);
+  image_create_pooled(output, (input->w + 1 - 2 * border_size) / 2, (input->h + 1 - 2 * border_size) / 2, input->type);
 
   uint8_t *input_buf = (uint8_t *)input->buf;
   uint8_t *output_buf = (uint8_t *)output->buf;
@@ -300,9 +553,118 @@ void pyramid_next_level(struct image_t *input, struct image_t *output, uint8_t b
   int32_t sum = 0;
 
   for (uint16_t i = 0; i != output->h; i++) {
+    uint16_t j = 0;
+    row = border_size + 2 * i; // First skip border, then every second pixel
+
+#if IMAGE_NEON || IMAGE_SSE2
+    const uint8_t *rows[5] = { &input_buf[(row - 2) * w], &input_buf[(row - 1) * w], &input_buf[row * w],
+                               &input_buf[(row + 1) * w], &input_buf[(row + 2) * w]
+                             };
+#endif
+#if IMAGE_NEON
+    const uint16x8_t even_mask = vdupq_n_u16(0xFF);
+    const uint32x2_t div_mul = vdup_n_u32(PYRAMID_DIV_MUL);
+    // 8 outputs read the columns col - 2 up to col + 17 of the input rows
+    for (; j + 8 <= output->w && border_size + 2 * j + 17 < w; j += 8) {
+      col = border_size + 2 * j;
 
-    for (uint16_t j = 0; j != output->w; j++) {
-      row = border_size + 2 * i; // First skip border, then every second pixel
+      // For every row the columns col - 2, col - 1, col, col + 1 and col + 2 of the 8 outputs
+      uint16x8_t px[5][5];
+      for (uint8_t r = 0; r < 5; r++) {
+        uint16x8_t v0 = vreinterpretq_u16_u8(vld1q_u8(&rows[r][col - 2]));
+        uint16x8_t v1 = vreinterpretq_u16_u8(vld1q_u8(&rows[r][col]));
+        uint16x8_t v2 = vreinterpretq_u16_u8(vld1q_u8(&rows[r][col + 2]));
+        px[r][0] = vandq_u16(v0, even_mask);
+        px[r][1] = vshrq_n_u16(v0, 8);
+        px[r][2] = vandq_u16(v1, even_mask);
+        px[r][3] = vshrq_n_u16(v1, 8);
+        px[r][4] = vandq_u16(v2, even_mask);
+      }
+
+      // Add the rows with the same coefficients, then the columns
+      uint16x8_t a[5], b[5];
+      for (uint8_t c = 0; c < 5; c++) {
+        a[c] = vaddq_u16(px[0][c], px[4][c]);
+        b[c] = vaddq_u16(px[1][c], px[3][c]);
+      }
+      uint16x8_t t39 = vaddq_u16(a[0], a[4]);
+      uint16x8_t t156 = vaddq_u16(vaddq_u16(a[1], a[3]), vaddq_u16(b[0], b[4]));
+      uint16x8_t t234 = vaddq_u16(vaddq_u16(a[2], px[2][0]), px[2][4]);
+      uint16x8_t t625 = vaddq_u16(b[1], b[3]);
+      uint16x8_t t938 = vaddq_u16(vaddq_u16(b[2], px[2][1]), px[2][3]);
+      uint16x8_t t1406 = px[2][2];
+
+      uint32x4_t sums[2];
+      for (uint8_t h = 0; h < 2; h++) {
+        uint32x4_t acc = vmull_n_u16(h ? vget_high_u16(t39) : vget_low_u16(t39), 39);
+        acc = vmlal_n_u16(acc, h ? vget_high_u16(t156) : vget_low_u16(t156), 156);
+        acc = vmlal_n_u16(acc, h ? vget_high_u16(t234) : vget_low_u16(t234), 234);
+        acc = vmlal_n_u16(acc, h ? vget_high_u16(t625) : vget_low_u16(t625), 625);
+        acc = vmlal_n_u16(acc, h ? vget_high_u16(t938) : vget_low_u16(t938), 938);
+        acc = vmlal_n_u16(acc, h ? vget_high_u16(t1406) : vget_low_u16(t1406), 1406);
+
+        // Divide by 10000 with the high part of the 64 bit products
+        uint32x2_t lo = vshrn_n_u64(vmull_u32(vget_low_u32(acc), div_mul), 32);
+        uint32x2_t hi = vshrn_n_u64(vmull_u32(vget_high_u32(acc), div_mul), 32);
+        sums[h] = vshrq_n_u32(vcombine_u32(lo, hi), PYRAMID_DIV_SHIFT - 32);
+      }
+      vst1_u8(&output_buf[i * output->w + j], vmovn_u16(vcombine_u16(vmovn_u32(sums[0]), vmovn_u32(sums[1]))));
+    }
+#elif IMAGE_SSE2
+    const __m128i even_mask = _mm_set1_epi16(0xFF);
+    const __m128i div_mul = _mm_set1_epi32(PYRAMID_DIV_MUL);
+    const __m128i w39_156 = _mm_set1_epi32(39 | (156 << 16));
+    const __m128i w234_625 = _mm_set1_epi32(234 | (625 << 16));
+    const __m128i w938_1406 = _mm_set1_epi32(938 | (1406 << 16));
+    // 8 outputs read the columns col - 2 up to col + 17 of the input rows
+    for (; j + 8 <= output->w && border_size + 2 * j + 17 < w; j += 8) {
+      col = border_size + 2 * j;
+
+      // For every row the columns col - 2, col - 1, col, col + 1 and col + 2 of the 8 outputs
+      __m128i px[5][5];
+      for (uint8_t r = 0; r < 5; r++) {
+        __m128i v0 = _mm_loadu_si128((__m128i *)&rows[r][col - 2]);
+        __m128i v1 = _mm_loadu_si128((__m128i *)&rows[r][col]);
+        __m128i v2 = _mm_loadu_si128((__m128i *)&rows[r][col + 2]);
+        px[r][0] = _mm_and_si128(v0, even_mask);
+        px[r][1] = _mm_srli_epi16(v0, 8);
+        px[r][2] = _mm_and_si128(v1, even_mask);
+        px[r][3] = _mm_srli_epi16(v1, 8);
+        px[r][4] = _mm_and_si128(v2, even_mask);
+      }
+
+      // Add the rows with the same coefficients, then the columns
+      __m128i a[5], b[5];
+      for (uint8_t c = 0; c < 5; c++) {
+        a[c] = _mm_add_epi16(px[0][c], px[4][c]);
+        b[c] = _mm_add_epi16(px[1][c], px[3][c]);
+      }
+      __m128i t39 = _mm_add_epi16(a[0], a[4]);
+      __m128i t156 = _mm_add_epi16(_mm_add_epi16(a[1], a[3]), _mm_add_epi16(b[0], b[4]));
+      __m128i t234 = _mm_add_epi16(_mm_add_epi16(a[2], px[2][0]), px[2][4]);
+      __m128i t625 = _mm_add_epi16(b[1], b[3]);
+      __m128i t938 = _mm_add_epi16(_mm_add_epi16(b[2], px[2][1]), px[2][3]);
+      __m128i t1406 = px[2][2];
+
+      __m128i sums[2];
+      for (uint8_t h = 0; h < 2; h++) {
+        __m128i p0 = h ? _mm_unpackhi_epi16(t39, t156) : _mm_unpacklo_epi16(t39, t156);
+        __m128i p1 = h ? _mm_unpackhi_epi16(t234, t625) : _mm_unpacklo_epi16(t234, t625);
+        __m128i p2 = h ? _mm_unpackhi_epi16(t938, t1406) : _mm_unpacklo_epi16(t938, t1406);
+        __m128i acc = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(p0, w39_156), _mm_madd_epi16(p1, w234_625)),
+                                    _mm_madd_epi16(p2, w938_1406));
+
+        // Divide by 10000 with 64 bit products of the even and odd lanes
+        __m128i even = _mm_srli_epi64(_mm_mul_epu32(acc, div_mul), PYRAMID_DIV_SHIFT);
+        __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(acc, 32), div_mul), PYRAMID_DIV_SHIFT);
+        sums[h] = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+      }
+      __m128i res = _mm_packs_epi32(sums[0], sums[1]);
+      _mm_storel_epi64((__m128i *)&output_buf[i * output->w + j], _mm_packus_epi16(res, res));
+    }
+#endif
+
+    for (; j < output->w; j++) {
       col = border_size + 2 * j;
 
       sum =    39 * (input_buf[(row - 2) * w + (col - 2)] + input_buf[(row - 2) * w + (col + 2)] +
@@ -372,9 +734,9 @@ void image_subpixel_window(struct image_t *input, struct image_t *output, struct
   uint32_t subpixel_w = input->w * subpixel_factor;
   uint32_t subpixel_h = input->h * subpixel_factor;
 
-  // Go through the whole window size in normal coordinates
-  for (uint16_t i = 0; i < output->w; i++) {
-    for (uint16_t j = 0; j < output->h; j++) {
+  // Go through the whole window size in normal coordinates (row by row for memory access)
+  for (uint16_t j = 0; j < output->h; j++) {
+    for (uint16_t i = 0; i < output->w; i++) {
       // Calculate the subpixel coordinate
       uint32_t x = center->x + border_size * subpixel_factor + (i - half_window) * subpixel_factor ;
       uint32_t y = center->y + border_size * subpixel_factor + (j - half_window) * subpixel_factor ;
@@ -425,12 +787,34 @@ void image_gradients(struct image_t *input, struct image_t *dx, struct image_t *
   int16_t *dx_buf = (int16_t *)dx->buf;
   int16_t *dy_buf = (int16_t *)dy->buf;
 
-  // Go trough all pixels except the borders
-  for (uint16_t x = 1; x < input->w - 1; x++) {
-    for (uint16_t y = 1; y < input->h - 1; y++) {
-      dx_buf[(y - 1)*dx->w + (x - 1)] = (int16_t)input_buf[y * input->w + x + 1] - (int16_t)input_buf[y * input->w + x - 1];
-      dy_buf[(y - 1)*dy->w + (x - 1)] = (int16_t)input_buf[(y + 1) * input->w + x] - (int16_t)
-                                        input_buf[(y - 1) * input->w + x];
+  // Go trough all pixels except the borders (row by row)
+  for (uint16_t y = 1; y < input->h - 1; y++) {
+    uint8_t *row = &input_buf[y * input->w];
+    uint8_t *row_up = &input_buf[(y - 1) * input->w];
+    uint8_t *row_down = &input_buf[(y + 1) * input->w];
+    int16_t *dx_row = &dx_buf[(y - 1) * dx->w];
+    int16_t *dy_row = &dy_buf[(y - 1) * dy->w];
+    uint16_t x = 1;
+
+#if IMAGE_NEON
+    for (; x + 8 < input->w; x += 8) {
+      vst1q_s16(&dx_row[x - 1], vreinterpretq_s16_u16(vsubl_u8(vld1_u8(&row[x + 1]), vld1_u8(&row[x - 1]))));
+      vst1q_s16(&dy_row[x - 1], vreinterpretq_s16_u16(vsubl_u8(vld1_u8(&row_down[x]), vld1_u8(&row_up[x]))));
+    }
+#elif IMAGE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 8 < input->w; x += 8) {
+      __m128i right = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)&row[x + 1]), zero);
+      __m128i left = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)&row[x - 1]), zero);
+      __m128i down = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)&row_down[x]), zero);
+      __m128i up = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)&row_up[x]), zero);
+      _mm_storeu_si128((__m128i *)&dx_row[x - 1], _mm_sub_epi16(right, left));
+      _mm_storeu_si128((__m128i *)&dy_row[x - 1], _mm_sub_epi16(down, up));
+    }
+#endif
+    for (; x < input->w - 1; x++) {
+      dx_row[x - 1] = (int16_t)row[x + 1] - (int16_t)row[x - 1];
+      dy_row[x - 1] = (int16_t)row_down[x] - (int16_t)row_up[x];
     }
   }
 }
@@ -451,11 +835,48 @@ void image_calculate_g(struct image_t *dx, struct image_t *dy, int32_t *g)
   int16_t *dy_buf = (int16_t *)dy->buf;
 
   // Calculate the different sums
-  for (uint16_t x = 0; x < dx->w; x++) {
-    for (uint16_t y = 0; y < dy->h; y++) {
-      sum_dxx += ((int32_t)dx_buf[y * dx->w + x] * dx_buf[y * dx->w + x]);
-      sum_dxy += ((int32_t)dx_buf[y * dx->w + x] * dy_buf[y * dy->w + x]);
-      sum_dyy += ((int32_t)dy_buf[y * dy->w + x] * dy_buf[y * dy->w + x]);
+  for (uint16_t y = 0; y < dy->h; y++) {
+    int16_t *dx_row = &dx_buf[y * dx->w];
+    int16_t *dy_row = &dy_buf[y * dy->w];
+    uint16_t x = 0;
+
+#if IMAGE_NEON
+    int32x4_t acc_xx = vdupq_n_s32(0), acc_xy = vdupq_n_s32(0), acc_yy = vdupq_n_s32(0);
+    for (; x + 4 <= dx->w; x += 4) {
+      int16x4_t vx = vld1_s16(&dx_row[x]);
+      int16x4_t vy = vld1_s16(&dy_row[x]);
+      acc_xx = vmlal_s16(acc_xx, vx, vx);
+      acc_xy = vmlal_s16(acc_xy, vx, vy);
+      acc_yy = vmlal_s16(acc_yy, vy, vy);
+    }
+    int32_t tmp[4];
+    vst1q_s32(tmp, acc_xx);
+    sum_dxx += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+    vst1q_s32(tmp, acc_xy);
+    sum_dxy += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+    vst1q_s32(tmp, acc_yy);
+    sum_dyy += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#elif IMAGE_SSE2
+    __m128i acc_xx = _mm_setzero_si128(), acc_xy = _mm_setzero_si128(), acc_yy = _mm_setzero_si128();
+    for (; x + 8 <= dx->w; x += 8) {
+      __m128i vx = _mm_loadu_si128((__m128i *)&dx_row[x]);
+      __m128i vy = _mm_loadu_si128((__m128i *)&dy_row[x]);
+      acc_xx = _mm_add_epi32(acc_xx, _mm_madd_epi16(vx, vx));
+      acc_xy = _mm_add_epi32(acc_xy, _mm_madd_epi16(vx, vy));
+      acc_yy = _mm_add_epi32(acc_yy, _mm_madd_epi16(vy, vy));
+    }
+    int32_t tmp[4];
+    _mm_storeu_si128((__m128i *)tmp, acc_xx);
+    sum_dxx += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+    _mm_storeu_si128((__m128i *)tmp, acc_xy);
+    sum_dxy += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+    _mm_storeu_si128((__m128i *)tmp, acc_yy);
+    sum_dyy += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+    for (; x < dx->w; x++) {
+      sum_dxx += ((int32_t)dx_row[x] * dx_row[x]);
+      sum_dxy += ((int32_t)dx_row[x] * dy_row[x]);
+      sum_dyy += ((int32_t)dy_row[x] * dy_row[x]);
     }
   }
 
@@ -489,14 +910,48 @@ uint32_t image_difference(struct image_t *img_a, struct image_t *img_b, struct i
   }
 
   // Go trough the imagge pixels and calculate the difference
-  for (uint16_t x = 0; x < img_b->w; x++) {
-    for (uint16_t y = 0; y < img_b->h; y++) {
-      int16_t diff_c = img_a_buf[(y + 1) * img_a->w + (x + 1)] - img_b_buf[y * img_b->w + x];
+  for (uint16_t y = 0; y < img_b->h; y++) {
+    uint8_t *a_row = &img_a_buf[(y + 1) * img_a->w + 1];
+    uint8_t *b_row = &img_b_buf[y * img_b->w];
+    int16_t *diff_row = (diff_buf != NULL) ? &diff_buf[y * diff->w] : NULL;
+    uint16_t x = 0;
+
+#if IMAGE_NEON
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; x + 8 <= img_b->w; x += 8) {
+      int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(&a_row[x]), vld1_u8(&b_row[x])));
+      acc = vaddq_u32(acc, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(d), vget_low_s16(d))));
+      acc = vaddq_u32(acc, vreinterpretq_u32_s32(vmull_s16(vget_high_s16(d), vget_high_s16(d))));
+      if (diff_row != NULL) {
+        vst1q_s16(&diff_row[x], d);
+      }
+    }
+    uint32_t tmp[4];
+    vst1q_u32(tmp, acc);
+    sum_diff2 += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#elif IMAGE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    for (; x + 8 <= img_b->w; x += 8) {
+      __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)&a_row[x]), zero);
+      __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)&b_row[x]), zero);
+      __m128i d = _mm_sub_epi16(a, b);
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(d, d));
+      if (diff_row != NULL) {
+        _mm_storeu_si128((__m128i *)&diff_row[x], d);
+      }
+    }
+    uint32_t tmp[4];
+    _mm_storeu_si128((__m128i *)tmp, acc);
+    sum_diff2 += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+    for (; x < img_b->w; x++) {
+      int16_t diff_c = a_row[x] - b_row[x];
       sum_diff2 += diff_c * diff_c;
 
       // Set the difference image
-      if (diff_buf != NULL) {
-        diff_buf[y * diff->w + x] = diff_c;
+      if (diff_row != NULL) {
+        diff_row[x] = diff_c;
       }
     }
   }
@@ -525,14 +980,46 @@ int32_t image_multiply(struct image_t *img_a, struct image_t *img_b, struct imag
   }
 
   // Calculate the multiplication
-  for (uint16_t x = 0; x < img_a->w; x++) {
-    for (uint16_t y = 0; y < img_a->h; y++) {
-      int32_t mult_c = img_a_buf[y * img_a->w + x] * img_b_buf[y * img_b->w + x];
+  for (uint16_t y = 0; y < img_a->h; y++) {
+    int16_t *a_row = &img_a_buf[y * img_a->w];
+    int16_t *b_row = &img_b_buf[y * img_b->w];
+    int16_t *mult_row = (mult_buf != NULL) ? &mult_buf[y * mult->w] : NULL;
+    uint16_t x = 0;
+
+#if IMAGE_NEON
+    int32x4_t acc = vdupq_n_s32(0);
+    for (; x + 4 <= img_a->w; x += 4) {
+      int16x4_t a = vld1_s16(&a_row[x]);
+      int16x4_t b = vld1_s16(&b_row[x]);
+      acc = vmlal_s16(acc, a, b);
+      if (mult_row != NULL) {
+        vst1_s16(&mult_row[x], vmul_s16(a, b));
+      }
+    }
+    int32_t tmp[4];
+    vst1q_s32(tmp, acc);
+    sum += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#elif IMAGE_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for (; x + 8 <= img_a->w; x += 8) {
+      __m128i a = _mm_loadu_si128((__m128i *)&a_row[x]);
+      __m128i b = _mm_loadu_si128((__m128i *)&b_row[x]);
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(a, b));
+      if (mult_row != NULL) {
+        _mm_storeu_si128((__m128i *)&mult_row[x], _mm_mullo_epi16(a, b));
+      }
+    }
+    int32_t tmp[4];
+    _mm_storeu_si128((__m128i *)tmp, acc);
+    sum += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+    for (; x < img_a->w; x++) {
+      int32_t mult_c = a_row[x] * b_row[x];
       sum += mult_c;
 
       // Set the difference image
-      if (mult_buf != NULL) {
-        mult_buf[y * mult->w + x] = mult_c;
+      if (mult_row != NULL) {
+        mult_row[x] = mult_c;
       }
     }
   }
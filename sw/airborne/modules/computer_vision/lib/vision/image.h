@@ -78,10 +78,22 @@ struct crop_t {
   uint16_t h;    ///< height of the cropped area
 };
 
+/* Image buffer pool statistics */
+struct image_pool_stats_t {
+  uint32_t hits;          ///< Requests served by a free buffer from the pool
+  uint32_t misses;        ///< Requests that needed a new buffer allocation for the pool
+  uint32_t overflows;     ///< Requests that did not fit in the pool and were allocated on the heap
+  uint16_t in_use;        ///< Pool buffers currently handed out
+};
+extern struct image_pool_stats_t image_pool_stats;
+
 /* Usefull image functions */
 void image_add_border(struct image_t *input, struct image_t *output, uint8_t border_size);
 void image_create(struct image_t *img, uint16_t width, uint16_t height, enum image_type type);
+void image_create_pooled(struct image_t *img, uint16_t width, uint16_t height, enum image_type type);
 void image_free(struct image_t *img);
+void *image_pool_alloc(uint32_t size);
+void image_pool_free(void *buf);
 void image_copy(struct image_t *input, struct image_t *output);
 void image_switch(struct image_t *a, struct image_t *b);
 void image_to_grayscale(struct image_t *input, struct image_t *output);
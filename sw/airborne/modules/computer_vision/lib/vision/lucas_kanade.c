@@ -33,8 +33,312 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <pthread.h>
 #include "lucas_kanade.h"
 
+/* The window images used while tracking a single point */
+struct lk_windows_t {
+  uint16_t patch_size;            ///< The patch size the windows are created for
+  struct image_t I;               ///< Subpixel window in the old image (padded)
+  struct image_t J;               ///< Subpixel window in the new image
+  struct image_t DX;              ///< X gradient of window I
+  struct image_t DY;              ///< Y gradient of window I
+  struct image_t diff;            ///< Difference between window I and J
+};
+
+/* All the information needed to track the points of a single pyramid level */
+struct lk_level_t {
+  struct image_t *img_old;        ///< The old image of this level (padded)
+  struct image_t *img_new;        ///< The new image of this level (padded)
+  struct point_t *points;         ///< The original points (used at the top level)
+  struct flow_t *vectors;         ///< The vectors of the previous level (used at lower levels)
+  struct flow_t *cand;            ///< The resulting vector of every point
+  bool *tracked;                  ///< Whether every point was tracked
+  bool top_level;                 ///< Whether this is the first level which is tracked
+  float skip_points;              ///< The amount of points to skip
+  uint8_t pyramid_level;          ///< The total amount of pyramid levels
+  uint16_t patch_size;            ///< The patch size
+  uint16_t subpixel_factor;       ///< The subpixel factor
+  uint8_t max_iterations;         ///< Maximum amount of iterations
+  uint8_t step_threshold;         ///< Threshold of subpixel flow at which iterations stop
+  uint32_t error_threshold;       ///< Error at which a point is not tracked anymore
+  uint8_t border_size;            ///< The padding of the pyramid images
+};
+
+/* A worker thread of the tracker */
+struct lk_worker_t {
+  pthread_t thread;               ///< The worker thread
+  struct lk_windows_t win;        ///< Scratch windows of this worker
+  uint16_t from;                  ///< First point to track in the current job
+  uint16_t to;                    ///< Last point (exclusive) to track in the current job
+};
+
+/* The pool of worker threads, shared by all opticFlowLK calls */
+static struct {
+  pthread_mutex_t owner;          ///< Held by the opticFlowLK call using the workers
+  pthread_mutex_t mutex;          ///< Protects the job information
+  pthread_cond_t job_cond;        ///< Signalled when a new job is available
+  pthread_cond_t done_cond;       ///< Signalled when all workers finished the job
+  uint8_t started;                ///< Amount of workers started
+  uint8_t active;                 ///< Amount of workers taking part in the current job
+  uint8_t busy;                   ///< Amount of workers still working on the current job
+  uint32_t job_id;                ///< Incremented for every new job
+  struct lk_level_t *job;         ///< The current job
+  struct lk_worker_t workers[LK_MAX_THREADS - 1];
+} lk_pool = {
+  .owner = PTHREAD_MUTEX_INITIALIZER,
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .job_cond = PTHREAD_COND_INITIALIZER,
+  .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * (Re)create the window images for a patch size
+ * @param[in,out] *win The windows
+ * @param[in] patch_size The patch size (window J, DX, DY and diff), window I is padded with 1 pixel
+ */
+static void lk_windows_create(struct lk_windows_t *win, uint16_t patch_size)
+{
+  uint16_t padded_patch_size = patch_size + 2;
+  image_create_pooled(&win->I, padded_patch_size, padded_patch_size, IMAGE_GRAYSCALE);
+  image_create_pooled(&win->J, patch_size, patch_size, IMAGE_GRAYSCALE);
+  image_create_pooled(&win->DX, patch_size, patch_size, IMAGE_GRADIENT);
+  image_create_pooled(&win->DY, patch_size, patch_size, IMAGE_GRADIENT);
+  image_create_pooled(&win->diff, patch_size, patch_size, IMAGE_GRADIENT);
+  win->patch_size = patch_size;
+}
+
+/**
+ * Free the window images
+ * @param[in] *win The windows to free
+ */
+static void lk_windows_free(struct lk_windows_t *win)
+{
+  image_free(&win->I);
+  image_free(&win->J);
+  image_free(&win->DX);
+  image_free(&win->DY);
+  image_free(&win->diff);
+  win->patch_size = 0;
+}
+
+/**
+ * Track a single point on one pyramid level (steps 1 to 4 of opticFlowLK)
+ * @param[in] *lvl The pyramid level information
+ * @param[in] *win Scratch windows to use
+ * @param[in,out] *vector The initial position and flow, returns the tracked flow
+ * @return Whether the point was tracked
+ */
+static bool lk_track_point(struct lk_level_t *lvl, struct lk_windows_t *win, struct flow_t *vector)
+{
+  uint16_t subpixel_factor = lvl->subpixel_factor;
+  uint8_t border_size = lvl->border_size;
+
+  // If the pixel is outside original image, do not track it
+  if ((((int32_t) vector->pos.x + vector->flow_x) < 0)
+      || ((vector->pos.x + vector->flow_x) > ((lvl->img_new->w - 1 - 2 * border_size)* subpixel_factor))
+      || (((int32_t) vector->pos.y + vector->flow_y) < 0)
+      || ((vector->pos.y + vector->flow_y) > ((lvl->img_new->h - 1 - 2 * border_size)* subpixel_factor))) {
+    return false;
+  }
+
+  // (1) determine the subpixel neighborhood in the old image
+  image_subpixel_window(lvl->img_old, &win->I, &vector->pos, subpixel_factor, border_size);
+
+  // (2) get the x- and y- gradients
+  image_gradients(&win->I, &win->DX, &win->DY);
+
+  // (3) determine the 'G'-matrix [sum(Axx) sum(Axy); sum(Axy) sum(Ayy)], where sum is over the window
+  int32_t G[4];
+  image_calculate_g(&win->DX, &win->DY, G);
+
+  // calculate G's determinant in subpixel units:
+  int32_t Det = (G[0] * G[3] - G[1] * G[2]);
+
+  // Check if the determinant is bigger than 1
+  if (Det < 1) {
+    return false;
+  }
+
+  // (4) iterate over taking steps in the image to minimize the error:
+  for (uint8_t it = lvl->max_iterations; it--;) {
+    struct point_t new_point = { vector->pos.x  + vector->flow_x,
+             vector->pos.y + vector->flow_y
+    };
+
+    // If the pixel is outside original image, do not track it
+    if ((((int32_t)vector->pos.x  + vector->flow_x) < 0)
+        || (new_point.x > ((lvl->img_new->w - 1 - 2 * border_size)*subpixel_factor))
+        || (((int32_t)vector->pos.y  + vector->flow_y) < 0)
+        || (new_point.y > ((lvl->img_new->h - 1 - 2 * border_size)*subpixel_factor))) {
+      return false;
+    }
+
+    //     [a] get the subpixel neighborhood in the new image
+    image_subpixel_window(lvl->img_new, &win->J, &new_point, subpixel_factor, border_size);
+
+    //     [b] determine the image difference between the two neighborhoods
+    uint32_t error = image_difference(&win->I, &win->J, &win->diff);
+
+    if (error > lvl->error_threshold && it < lvl->max_iterations / 2) {
+      return false;
+    }
+
+    int32_t b_x = image_multiply(&win->diff, &win->DX, NULL) / 255;
+    int32_t b_y = image_multiply(&win->diff, &win->DY, NULL) / 255;
+
+
+    //     [d] calculate the additional flow step and possibly terminate the iteration
+    int16_t step_x = (((int64_t) G[3] * b_x - G[1] * b_y) * subpixel_factor) / Det;
+    int16_t step_y = (((int64_t) G[0] * b_y - G[2] * b_x) * subpixel_factor) / Det;
+
+    vector->flow_x = vector->flow_x + step_x;
+    vector->flow_y = vector->flow_y + step_y;
+
+    // Check if we exceeded the treshold CHANGED made this better for 0.03
+    if ((abs(step_x) + abs(step_y)) < lvl->step_threshold) {
+      break;
+    }
+  } // lucas kanade step iteration
+
+  return true;
+}
+
+/**
+ * Track a range of points on one pyramid level
+ * @param[in] *lvl The pyramid level information
+ * @param[in] *win Scratch windows to use
+ * @param[in] from First point to track
+ * @param[in] to Last point to track (exclusive)
+ */
+static void lk_track_range(struct lk_level_t *lvl, struct lk_windows_t *win, uint16_t from, uint16_t to)
+{
+  for (uint16_t i = from; i < to; i++) {
+    uint16_t p = i * lvl->skip_points;
+    struct flow_t *vector = &lvl->cand[i];
+
+    if (lvl->top_level) {
+      // Convert point position on original image to a subpixel coordinate on the top pyramid level
+      vector->pos.x = (lvl->points[p].x * lvl->subpixel_factor) >> lvl->pyramid_level;
+      vector->pos.y = (lvl->points[p].y * lvl->subpixel_factor) >> lvl->pyramid_level;
+      vector->flow_x = 0;
+      vector->flow_y = 0;
+    } else {
+      // (5) use calculated flow as initial flow estimation for next level of pyramid
+      vector->pos.x = lvl->vectors[p].pos.x << 1;
+      vector->pos.y = lvl->vectors[p].pos.y << 1;
+      vector->flow_x = lvl->vectors[p].flow_x << 1;
+      vector->flow_y = lvl->vectors[p].flow_y << 1;
+    }
+
+    lvl->tracked[i] = lk_track_point(lvl, win, vector);
+  }
+}
+
+/**
+ * The worker thread, tracks its part of the points for every job
+ * @param[in] *data The worker structure
+ */
+static void *lk_worker_thread(void *data)
+{
+  struct lk_worker_t *worker = (struct lk_worker_t *)data;
+  uint8_t idx = worker - lk_pool.workers;
+  uint32_t last_job = 0;
+  worker->win.patch_size = 0;
+
+  pthread_mutex_lock(&lk_pool.mutex);
+  while (true) {
+    // Wait for a new job
+    while (lk_pool.job_id == last_job) {
+      pthread_cond_wait(&lk_pool.job_cond, &lk_pool.mutex);
+    }
+    last_job = lk_pool.job_id;
+
+    // Not needed for this job
+    if (idx >= lk_pool.active) {
+      continue;
+    }
+
+    struct lk_level_t *job = lk_pool.job;
+    pthread_mutex_unlock(&lk_pool.mutex);
+
+    // Make sure the scratch windows have the right size
+    if (worker->win.patch_size != job->patch_size) {
+      if (worker->win.patch_size != 0) {
+        lk_windows_free(&worker->win);
+      }
+      lk_windows_create(&worker->win, job->patch_size);
+    }
+    lk_track_range(job, &worker->win, worker->from, worker->to);
+
+    // Report back
+    pthread_mutex_lock(&lk_pool.mutex);
+    if (--lk_pool.busy == 0) {
+      pthread_cond_signal(&lk_pool.done_cond);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Track all the points of a pyramid level, split over the calling thread and the workers
+ * @param[in] *lvl The pyramid level information
+ * @param[in] *win Scratch windows of the calling thread
+ * @param[in] cnt The amount of points to track
+ * @param[in] n_threads The amount of threads to use (including the calling thread)
+ */
+static void lk_track_level(struct lk_level_t *lvl, struct lk_windows_t *win, uint16_t cnt, uint8_t n_threads)
+{
+  // Track serially when the workers are used by another caller (e.g. another camera)
+  if (n_threads <= 1 || pthread_mutex_trylock(&lk_pool.owner) != 0) {
+    lk_track_range(lvl, win, 0, cnt);
+    return;
+  }
+
+  // Start extra workers if needed (they keep running for the next calls)
+  while (lk_pool.started < n_threads - 1) {
+    if (pthread_create(&lk_pool.workers[lk_pool.started].thread, NULL, lk_worker_thread,
+                       &lk_pool.workers[lk_pool.started]) != 0) {
+      printf("[lucas_kanade] Could not create worker thread %d\n", lk_pool.started);
+      break;
+    }
+    lk_pool.started++;
+  }
+  if (n_threads > lk_pool.started + 1) {
+    n_threads = lk_pool.started + 1;
+  }
+
+  // Not worth to split
+  if (n_threads <= 1 || cnt < n_threads) {
+    pthread_mutex_unlock(&lk_pool.owner);
+    lk_track_range(lvl, win, 0, cnt);
+    return;
+  }
+
+  // Hand out the jobs, the calling thread takes the first part
+  pthread_mutex_lock(&lk_pool.mutex);
+  lk_pool.job = lvl;
+  lk_pool.active = n_threads - 1;
+  lk_pool.busy = n_threads - 1;
+  for (uint8_t t = 0; t < n_threads - 1; t++) {
+    lk_pool.workers[t].from = (uint32_t)cnt * (t + 1) / n_threads;
+    lk_pool.workers[t].to = (uint32_t)cnt * (t + 2) / n_threads;
+  }
+  lk_pool.job_id++;
+  pthread_cond_broadcast(&lk_pool.job_cond);
+  pthread_mutex_unlock(&lk_pool.mutex);
+
+  lk_track_range(lvl, win, 0, cnt / n_threads);
+
+  // Wait for the workers to finish
+  pthread_mutex_lock(&lk_pool.mutex);
+  while (lk_pool.busy > 0) {
+    pthread_cond_wait(&lk_pool.done_cond, &lk_pool.mutex);
+  }
+  pthread_mutex_unlock(&lk_pool.mutex);
+  pthread_mutex_unlock(&lk_pool.owner);
+}
 
 /**
  * @file lucas_kanade.c
@@ -53,13 +357,14 @@
  * @param[in] step_threshold The threshold of additional subpixel flow at which the iterations should stop
  * @param[in] max_points The maximum amount of points to track, we skip x points and then take a point.
  * @param[in] pyramid_level Level of pyramid used in computation (0 == no pyramids used)
- * @return The vectors from the original *points in subpixels
+ * @param[in] n_threads Amount of threads to track the points with (1 == only the calling thread, max LK_MAX_THREADS)
+ * @return The vectors from the original *points in subpixels (free with image_pool_free)
  *
  * Pyramidal implementation of Lucas-Kanade feature tracker.
  *
  * Uses input images to build pyramid of padded images.
  * <p>For every pyramid level:</p>
- * <p>  For all points:</p>
+ * <p>  For all points (split over the worker threads, the points are independent):</p>
  * - (1) determine the subpixel neighborhood in the old image
  * - (2) get the x- and y- gradients
  * - (3) determine the 'G'-matrix [sum(Axx) sum(Axy); sum(Axy) sum(Ayy)], where sum is over the window
@@ -69,10 +374,14 @@
  *   + [c] calculate the 'b'-vector
  *   + [d] calculate the additional flow step and possibly terminate the iteration
  * - (5) use calculated flow as initial flow estimation for next level of pyramid
+ *
+ * The tracked points are merged in their original order, so the result does not
+ * depend on the amount of threads.
  */
 struct flow_t *opticFlowLK(struct image_t *new_img, struct image_t *old_img, struct point_t *points,
                            uint16_t *points_cnt, uint16_t half_window_size,
-                           uint16_t subpixel_factor, uint8_t max_iterations, uint8_t step_threshold, uint8_t max_points, uint8_t pyramid_level)
+                           uint16_t subpixel_factor, uint8_t max_iterations, uint8_t step_threshold, uint8_t max_points, uint8_t pyramid_level,
+                           uint8_t n_threads)
 {
 
   // if no pyramids, use the old code:
@@ -82,154 +391,80 @@ struct flow_t *opticFlowLK(struct image_t *new_img, struct image_t *old_img, str
     return opticFlowLK_flat(new_img, old_img, points, points_cnt, half_window_size, subpixel_factor, max_iterations, step_threshold, max_points);
   }
 
-  // Allocate some memory for returning the vectors
-  struct flow_t *vectors = malloc(sizeof(struct flow_t) * max_points);
+  if (n_threads > LK_MAX_THREADS) {
+    n_threads = LK_MAX_THREADS;
+  }
+
+  // Allocate some memory for returning the vectors (from the pool, free with image_pool_free)
+  struct flow_t *vectors = image_pool_alloc(sizeof(struct flow_t) * max_points);
+
+  // Per point results of a level, merged into the vectors afterwards
+  struct flow_t *cand = image_pool_alloc(sizeof(struct flow_t) * max_points);
+  bool *tracked = image_pool_alloc(sizeof(bool) * max_points);
 
   // Determine patch sizes and initialize neighborhoods
   uint16_t patch_size = 2 * half_window_size + 1;
-  uint32_t error_threshold = (25 * 25) * (patch_size * patch_size);
   uint16_t padded_patch_size = patch_size + 2;
   uint8_t border_size = padded_patch_size / 2 + 2; // amount of padding added to images
 
-  // Allocate memory for image pyramids
-  struct image_t *pyramid_old = malloc(sizeof(struct image_t) * (pyramid_level + 1));
-  struct image_t *pyramid_new = malloc(sizeof(struct image_t) * (pyramid_level + 1));
+  // Image pyramids, the levels themselves are allocated from the image pool
+  struct image_t pyramid_old[pyramid_level + 1];
+  struct image_t pyramid_new[pyramid_level + 1];
 
   // Build pyramid levels
   pyramid_build(old_img, pyramid_old, pyramid_level, border_size);
   pyramid_build(new_img, pyramid_new, pyramid_level, border_size);
 
-  // Create the window images
-  struct image_t window_I, window_J, window_DX, window_DY, window_diff;
-  image_create(&window_I, padded_patch_size, padded_patch_size, IMAGE_GRAYSCALE);
-  image_create(&window_J, patch_size, patch_size, IMAGE_GRAYSCALE);
-  image_create(&window_DX, patch_size, patch_size, IMAGE_GRADIENT);
-  image_create(&window_DY, patch_size, patch_size, IMAGE_GRADIENT);
-  image_create(&window_diff, patch_size, patch_size, IMAGE_GRADIENT);
+  // Create the window images of the calling thread
+  struct lk_windows_t win;
+  lk_windows_create(&win, patch_size);
+
+  struct lk_level_t lvl = {
+    .points = points,
+    .vectors = vectors,
+    .cand = cand,
+    .tracked = tracked,
+    .pyramid_level = pyramid_level,
+    .patch_size = patch_size,
+    .subpixel_factor = subpixel_factor,
+    .max_iterations = max_iterations,
+    .step_threshold = step_threshold,
+    .error_threshold = (25 * 25) * (patch_size * patch_size),
+    .border_size = border_size
+  };
 
   // Iterate through pyramid levels
   for (int8_t LVL = pyramid_level; LVL != -1; LVL--) {
     uint16_t points_orig = *points_cnt;
+    uint16_t track_cnt = (points_orig < max_points) ? points_orig : max_points;
     *points_cnt = 0;
-    uint16_t new_p = 0;
 
     // Calculate the amount of points to skip
-    float skip_points = (points_orig > max_points) ? (float)points_orig / max_points : 1;
+    lvl.skip_points = (points_orig > max_points) ? (float)points_orig / max_points : 1;
+    lvl.top_level = (LVL == pyramid_level);
+    lvl.img_old = &pyramid_old[LVL];
+    lvl.img_new = &pyramid_new[LVL];
 
     // Go through all points
-    for (uint16_t i = 0; i < max_points && i < points_orig; i++) {
-      uint16_t p = i * skip_points;
-
-      if (LVL == pyramid_level) {
-        // Convert point position on original image to a subpixel coordinate on the top pyramid level
-        vectors[new_p].pos.x = (points[p].x * subpixel_factor) >> pyramid_level;
-        vectors[new_p].pos.y = (points[p].y * subpixel_factor) >> pyramid_level;
-        vectors[new_p].flow_x = 0;
-        vectors[new_p].flow_y = 0;
-
-      } else {
-        // (5) use calculated flow as initial flow estimation for next level of pyramid
-        vectors[new_p].pos.x = vectors[p].pos.x << 1;
-        vectors[new_p].pos.y = vectors[p].pos.y << 1;
-        vectors[new_p].flow_x = vectors[p].flow_x << 1;
-        vectors[new_p].flow_y = vectors[p].flow_y << 1;
-      }
-
-      // If the pixel is outside original image, do not track it
-      if ((((int32_t) vectors[new_p].pos.x + vectors[new_p].flow_x) < 0)
-          || ((vectors[new_p].pos.x + vectors[new_p].flow_x) > ((pyramid_new[LVL].w - 1 - 2 * border_size)* subpixel_factor))
-          || (((int32_t) vectors[new_p].pos.y + vectors[new_p].flow_y) < 0)
-          || ((vectors[new_p].pos.y + vectors[new_p].flow_y) > ((pyramid_new[LVL].h - 1 - 2 * border_size)* subpixel_factor))) {
-        continue;
-      }
-
-
-      // (1) determine the subpixel neighborhood in the old image
-      image_subpixel_window(&pyramid_old[LVL], &window_I, &vectors[new_p].pos, subpixel_factor, border_size);
-
-      // (2) get the x- and y- gradients
-      image_gradients(&window_I, &window_DX, &window_DY);
-
-      // (3) determine the 'G'-matrix [sum(Axx) sum(Axy); sum(Axy) sum(Ayy)], where sum is over the window
-      int32_t G[4];
-      image_calculate_g(&window_DX, &window_DY, G);
-
-      // calculate G's determinant in subpixel units:
-      int32_t Det = (G[0] * G[3] - G[1] * G[2]);
+    lk_track_level(&lvl, &win, track_cnt, n_threads);
 
-      // Check if the determinant is bigger than 1
-      if (Det < 1) {
-        continue;
+    // Merge the tracked points in the original order
+    for (uint16_t i = 0; i < track_cnt; i++) {
+      if (tracked[i]) {
+        vectors[(*points_cnt)++] = cand[i];
       }
-
-      // (4) iterate over taking steps in the image to minimize the error:
-      bool tracked = true;
-
-      for (uint8_t it = max_iterations; it--;) {
-        struct point_t new_point = { vectors[new_p].pos.x  + vectors[new_p].flow_x,
-                 vectors[new_p].pos.y + vectors[new_p].flow_y
-        };
-
-
-        // If the pixel is outside original image, do not track it
-        if ((((int32_t)vectors[new_p].pos.x  + vectors[new_p].flow_x) < 0)
-            || (new_point.x > ((pyramid_new[LVL].w - 1 - 2 * border_size)*subpixel_factor))
-            || (((int32_t)vectors[new_p].pos.y  + vectors[new_p].flow_y) < 0)
-            || (new_point.y > ((pyramid_new[LVL].h - 1 - 2 * border_size)*subpixel_factor))) {
-          tracked = false;
-          break;
-        }
-
-        //     [a] get the subpixel neighborhood in the new image
-        image_subpixel_window(&pyramid_new[LVL], &window_J, &new_point, subpixel_factor, border_size);
-
-        //     [b] determine the image difference between the two neighborhoods
-        uint32_t error = image_difference(&window_I, &window_J, &window_diff);
-
-        if (error > error_threshold && it < max_iterations / 2) {
-          tracked = false;
-          break;
-        }
-
-        int32_t b_x = image_multiply(&window_diff, &window_DX, NULL) / 255;
-        int32_t b_y = image_multiply(&window_diff, &window_DY, NULL) / 255;
-
-
-        //     [d] calculate the additional flow step and possibly terminate the iteration
-        int16_t step_x = (((int64_t) G[3] * b_x - G[1] * b_y) * subpixel_factor) / Det;
-        int16_t step_y = (((int64_t) G[0] * b_y - G[2] * b_x) * subpixel_factor) / Det;
-
-        vectors[new_p].flow_x = vectors[new_p].flow_x + step_x;
-        vectors[new_p].flow_y = vectors[new_p].flow_y + step_y;
-
-        // Check if we exceeded the treshold CHANGED made this better for 0.03
-        if ((abs(step_x) + abs(step_y)) < step_threshold) {
-          break;
-        }
-      } // lucas kanade step iteration
-
-      // If we tracked the point we update the index and the count
-      if (tracked) {
-        new_p++;
-        (*points_cnt)++;
-      }
-    } // go through all points
-
+    }
   } // LVL of pyramid
 
   // Free the images
-  image_free(&window_I);
-  image_free(&window_J);
-  image_free(&window_DX);
-  image_free(&window_DY);
-  image_free(&window_diff);
+  lk_windows_free(&win);
+  image_pool_free(cand);
+  image_pool_free(tracked);
 
   for (int8_t i = pyramid_level; i != -1; i--) {
     image_free(&pyramid_old[i]);
     image_free(&pyramid_new[i]);
   }
-  pyramid_old = NULL;
-  pyramid_new = NULL;
 
   // Return the vectors
   return vectors;
@@ -263,8 +498,8 @@ struct flow_t *opticFlowLK_flat(struct image_t *new_img, struct image_t *old_img
   //     [c] calculate the 'b'-vector
   //     [d] calculate the additional flow step and possibly terminate the iteration
 
-  // Allocate some memory for returning the vectors
-  struct flow_t *vectors = malloc(sizeof(struct flow_t) * max_points);
+  // Allocate some memory for returning the vectors (from the pool, free with image_pool_free)
+  struct flow_t *vectors = image_pool_alloc(sizeof(struct flow_t) * max_points);
   uint16_t new_p = 0;
   uint16_t points_orig = *points_cnt;
   *points_cnt = 0;
@@ -276,11 +511,11 @@ struct flow_t *opticFlowLK_flat(struct image_t *new_img, struct image_t *old_img
 
   // Create the window images
   struct image_t window_I, window_J, window_DX, window_DY, window_diff;
-  image_create(&window_I, padded_patch_size, padded_patch_size, IMAGE_GRAYSCALE);
-  image_create(&window_J, patch_size, patch_size, IMAGE_GRAYSCALE);
-  image_create(&window_DX, patch_size, patch_size, IMAGE_GRADIENT);
-  image_create(&window_DY, patch_size, patch_size, IMAGE_GRADIENT);
-  image_create(&window_diff, patch_size, patch_size, IMAGE_GRADIENT);
+  image_create_pooled(&window_I, padded_patch_size, padded_patch_size, IMAGE_GRAYSCALE);
+  image_create_pooled(&window_J, patch_size, patch_size, IMAGE_GRAYSCALE);
+  image_create_pooled(&window_DX, patch_size, patch_size, IMAGE_GRADIENT);
+  image_create_pooled(&window_DY, patch_size, patch_size, IMAGE_GRADIENT);
+  image_create_pooled(&window_diff, patch_size, patch_size, IMAGE_GRADIENT);
 
   // Calculate the amount of points to skip
   float skip_points = (points_orig > max_points) ? points_orig / max_points : 1;
@@ -34,9 +34,15 @@
 #include "std.h"
 #include "image.h"
 
+/** Maximum amount of threads used to track the points (including the calling thread) */
+#ifndef LK_MAX_THREADS
+#define LK_MAX_THREADS 4
+#endif
+
 struct flow_t *opticFlowLK(struct image_t *new_img, struct image_t *old_img, struct point_t *points,
                            uint16_t *points_cnt, uint16_t half_window_size,
-                           uint16_t subpixel_factor, uint8_t max_iterations, uint8_t step_threshold, uint8_t max_points, uint8_t pyramid_level);
+                           uint16_t subpixel_factor, uint8_t max_iterations, uint8_t step_threshold, uint8_t max_points, uint8_t pyramid_level,
+                           uint8_t n_threads);
 
 // used when pyramid level is 0:
 struct flow_t *opticFlowLK_flat(struct image_t *new_img, struct image_t *old_img, struct point_t *points, uint16_t *points_cnt,
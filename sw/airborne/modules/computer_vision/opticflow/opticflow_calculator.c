@@ -117,6 +117,11 @@ PRINT_CONFIG_VAR(OPTICFLOW_THRESHOLD_VEC)
 #endif
 PRINT_CONFIG_VAR(OPTICFLOW_PYRAMID_LEVEL)
 
+#ifndef OPTICFLOW_LK_THREADS
+#define OPTICFLOW_LK_THREADS 1
+#endif
+PRINT_CONFIG_VAR(OPTICFLOW_LK_THREADS)
+
 #ifndef OPTICFLOW_FAST9_ADAPTIVE
 #define OPTICFLOW_FAST9_ADAPTIVE TRUE
 #endif
@@ -137,6 +142,21 @@ PRINT_CONFIG_VAR(OPTICFLOW_FAST9_MIN_DISTANCE)
 #endif
 PRINT_CONFIG_VAR(OPTICFLOW_FAST9_PADDING)
 
+#ifndef OPTICFLOW_FAST9_GRID
+#define OPTICFLOW_FAST9_GRID FALSE
+#endif
+PRINT_CONFIG_VAR(OPTICFLOW_FAST9_GRID)
+
+#ifndef OPTICFLOW_FAST9_CELL_SIZE
+#define OPTICFLOW_FAST9_CELL_SIZE 40
+#endif
+PRINT_CONFIG_VAR(OPTICFLOW_FAST9_CELL_SIZE)
+
+#ifndef OPTICFLOW_FAST9_CELL_MAX
+#define OPTICFLOW_FAST9_CELL_MAX 0
+#endif
+PRINT_CONFIG_VAR(OPTICFLOW_FAST9_CELL_MAX)
+
 // thresholds FAST9 that are currently not set from the GCS:
 #define FAST9_LOW_THRESHOLD 5
 #define FAST9_HIGH_THRESHOLD 60
@@ -224,6 +244,7 @@ void opticflow_calc_init(struct opticflow_t *opticflow, uint16_t w, uint16_t h)
   opticflow->max_iterations = OPTICFLOW_MAX_ITERATIONS;
   opticflow->threshold_vec = OPTICFLOW_THRESHOLD_VEC;
   opticflow->pyramid_level = OPTICFLOW_PYRAMID_LEVEL;
+  opticflow->lk_threads = OPTICFLOW_LK_THREADS;
   opticflow->median_filter = OPTICFLOW_MEDIAN_FILTER;
   opticflow->kalman_filter = OPTICFLOW_KALMAN_FILTER;
   opticflow->kalman_filter_process_noise = OPTICFLOW_KALMAN_FILTER_PROCESS_NOISE;
@@ -232,6 +253,9 @@ void opticflow_calc_init(struct opticflow_t *opticflow, uint16_t w, uint16_t h)
   opticflow->fast9_threshold = OPTICFLOW_FAST9_THRESHOLD;
   opticflow->fast9_min_distance = OPTICFLOW_FAST9_MIN_DISTANCE;
   opticflow->fast9_padding = OPTICFLOW_FAST9_PADDING;
+  opticflow->fast9_grid = OPTICFLOW_FAST9_GRID;
+  opticflow->fast9_cell_size = OPTICFLOW_FAST9_CELL_SIZE;
+  opticflow->fast9_cell_max = OPTICFLOW_FAST9_CELL_MAX;
   opticflow->fast9_rsize = 512;
   opticflow->fast9_ret_corners = malloc(sizeof(struct point_t) * opticflow->fast9_rsize);
 
@@ -276,12 +300,19 @@ void calc_fast9_lukas_kanade(struct opticflow_t *opticflow, struct opticflow_sta
   // *************************************************************************************
 
   // FAST corner detection
-  // TODO: There is something wrong with fast9_detect destabilizing FPS. This problem is reduced with putting min_distance
-  // to 0 (see defines), however a more permanent solution should be considered
-  fast9_detect(img, opticflow->fast9_threshold, opticflow->fast9_min_distance,
-               opticflow->fast9_padding, opticflow->fast9_padding, &result->corner_cnt,
-               &opticflow->fast9_rsize,
-               opticflow->fast9_ret_corners);
+  // The min_distance check of fast9_detect walks through the previous corners and can destabilize FPS on textured
+  // images. The grid detector checks the distance in constant time and suppresses the non-maximum corners.
+  if (opticflow->fast9_grid) {
+    fast9_detect_grid(img, opticflow->fast9_threshold, opticflow->fast9_min_distance,
+                      opticflow->fast9_padding, opticflow->fast9_padding, opticflow->fast9_cell_size,
+                      opticflow->fast9_cell_max, &result->corner_cnt, &opticflow->fast9_rsize,
+                      &opticflow->fast9_ret_corners);
+  } else {
+    fast9_detect(img, opticflow->fast9_threshold, opticflow->fast9_min_distance,
+                 opticflow->fast9_padding, opticflow->fast9_padding, &result->corner_cnt,
+                 &opticflow->fast9_rsize,
+                 opticflow->fast9_ret_corners);
+  }
 
   // Adaptive threshold
   if (opticflow->fast9_adaptive) {
@@ -313,7 +344,8 @@ void calc_fast9_lukas_kanade(struct opticflow_t *opticflow, struct opticflow_sta
   struct flow_t *vectors = opticFlowLK(&opticflow->img_gray, &opticflow->prev_img_gray, opticflow->fast9_ret_corners,
                                        &result->tracked_cnt,
                                        opticflow->window_size / 2, opticflow->subpixel_factor, opticflow->max_iterations,
-                                       opticflow->threshold_vec, opticflow->max_track_corners, opticflow->pyramid_level);
+                                       opticflow->threshold_vec, opticflow->max_track_corners, opticflow->pyramid_level,
+                                       opticflow->lk_threads);
 
 #if OPTICFLOW_SHOW_FLOW
   printf("show: n tracked = %d\n", result->tracked_cnt);
@@ -420,7 +452,7 @@ void calc_fast9_lukas_kanade(struct opticflow_t *opticflow, struct opticflow_sta
   // *************************************************************************************
   // Next Loop Preparation
   // *************************************************************************************
-  free(vectors);
+  image_pool_free(vectors);
   image_switch(&opticflow->img_gray, &opticflow->prev_img_gray);
 }
 
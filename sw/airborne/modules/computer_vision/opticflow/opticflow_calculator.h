@@ -60,12 +60,16 @@ struct opticflow_t {
   uint8_t max_iterations;               ///< The maximum amount of iterations the Lucas Kanade algorithm should do
   uint8_t threshold_vec;                ///< The threshold in x, y subpixels which the algorithm should stop
   uint8_t pyramid_level;              ///< Number of pyramid levels used in Lucas Kanade algorithm (0 == no pyramids used)
+  uint8_t lk_threads;                   ///< Number of threads the pyramidal Lucas Kanade algorithm tracks the corners with
 
   uint8_t max_track_corners;            ///< Maximum amount of corners Lucas Kanade should track
   bool fast9_adaptive;                  ///< Whether the FAST9 threshold should be adaptive
   uint8_t fast9_threshold;              ///< FAST9 corner detection threshold
   uint16_t fast9_min_distance;          ///< Minimum distance in pixels between corners
   uint16_t fast9_padding;               ///< Padding used in FAST9 detector
+  bool fast9_grid;                      ///< Whether the grid detector with non-maximum suppression is used
+  uint16_t fast9_cell_size;             ///< Size in pixels of the cells of the corner budget (grid detector)
+  uint16_t fast9_cell_max;              ///< Maximum amount of corners per cell, 0 for no budget (grid detector)
 
   uint16_t fast9_rsize;             ///< Amount of corners allocated
   struct point_t *fast9_ret_corners;    ///< Corners
@@ -31,10 +31,28 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 #include "modules/computer_vision/cv.h"
 #include "modules/computer_vision/textons.h"
 
-float ** **dictionary;
+/**
+ * Use vectorized (NEON on ARM, SSE on x86) patch to texton distances.
+ * The scalar code is used when no vector unit is available.
+ */
+#ifndef TEXTONS_USE_SIMD
+#define TEXTONS_USE_SIMD TRUE
+#endif
+
+#if TEXTONS_USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define TEXTONS_NEON 1
+#elif TEXTONS_USE_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXTONS_SSE2 1
+#endif
+
+float *dictionary;
 uint32_t learned_samples = 0;
 uint8_t dictionary_initialized = 0;
 float *texton_distribution;
@@ -90,6 +108,17 @@ PRINT_CONFIG_VAR(TEXTONS_BORDER_HEIGHT)
 #endif
 PRINT_CONFIG_VAR(TEXTONS_DICTIONARY_NUMBER)
 
+/** Number of threads the samples of DistributionExtraction are split over (1 == only the video thread) */
+#ifndef TEXTONS_THREADS
+#define TEXTONS_THREADS 1
+#endif
+PRINT_CONFIG_VAR(TEXTONS_THREADS)
+
+/** Maximum number of threads, the worker structures are allocated at compile time */
+#ifndef TEXTONS_MAX_THREADS
+#define TEXTONS_MAX_THREADS 4
+#endif
+
 
 uint8_t load_dictionary = TEXTONS_LOAD_DICTIONARY;
 uint8_t alpha_uint = TEXTONS_ALPHA;
@@ -101,6 +130,7 @@ uint8_t FULL_SAMPLING = TEXTONS_FULL_SAMPLING;
 uint32_t border_width = TEXTONS_BORDER_WIDTH;
 uint32_t border_height = TEXTONS_BORDER_HEIGHT;
 uint8_t dictionary_number = TEXTONS_DICTIONARY_NUMBER;
+uint8_t textons_threads = TEXTONS_THREADS;
 
 // status variables
 uint8_t dictionary_ready = 0;
@@ -112,6 +142,271 @@ static FILE *dictionary_logger = NULL;
 #define DICTIONARY_PATH /data/video/
 #endif
 
+/* Size of the allocated dictionary, it is reallocated when the settings change */
+static uint8_t dict_n_textons = 0;
+static uint8_t dict_patch_size = 0;
+static uint32_t dict_patch_len = 0;   ///< Number of values in a patch (patch_size * patch_size * 2)
+
+/* Sample coordinates of the current image */
+struct texton_sample_t {
+  uint16_t x;
+  uint16_t y;
+};
+
+/* A job of the distribution extraction */
+struct textons_job_t {
+  const uint8_t *frame;           ///< The YUV422 image data
+  uint16_t width;                 ///< The width of the image
+  const struct texton_sample_t *samples; ///< The sample coordinates
+};
+
+/* A thread taking part in the distribution extraction (index 0 is the video thread) */
+struct textons_worker_t {
+  pthread_t thread;               ///< The worker thread
+  float *patch;                   ///< Scratch patch of this worker [dict_patch_len]
+  uint32_t *histogram;            ///< Assignment counts of this worker [dict_n_textons]
+  uint32_t from;                  ///< First sample of the current job
+  uint32_t to;                    ///< Last sample (exclusive) of the current job
+};
+
+/* The worker threads of the distribution extraction */
+static struct {
+  pthread_mutex_t mutex;          ///< Protects the job information
+  pthread_cond_t job_cond;        ///< Signalled when a new job is available
+  pthread_cond_t done_cond;       ///< Signalled when all workers finished the job
+  uint8_t started;                ///< Amount of workers started
+  uint8_t active;                 ///< Amount of workers taking part in the current job
+  uint8_t busy;                   ///< Amount of workers still working on the current job
+  bool quit;                      ///< Set to stop the workers
+  uint32_t job_id;                ///< Incremented for every new job
+  struct textons_job_t job;       ///< The current job
+  struct textons_worker_t workers[TEXTONS_MAX_THREADS];
+} textons_pool = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .job_cond = PTHREAD_COND_INITIALIZER,
+  .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static struct texton_sample_t *samples = NULL;
+static uint32_t samples_size = 0;
+
+/**
+ * (Re)allocate the dictionary, the distribution and the scratch buffers when the
+ * number of textons or the patch size changed. A new dictionary has to be loaded or learned.
+ */
+static void textons_alloc(void)
+{
+  if (dict_n_textons == n_textons && dict_patch_size == patch_size && dictionary != NULL) {
+    return;
+  }
+
+  dict_n_textons = n_textons;
+  dict_patch_size = patch_size;
+  dict_patch_len = (uint32_t)patch_size * patch_size * 2;
+
+  free(dictionary);
+  free(texton_distribution);
+  dictionary = (float *)calloc((uint32_t)dict_n_textons * dict_patch_len, sizeof(float));
+  texton_distribution = (float *)calloc(dict_n_textons, sizeof(float));
+  for (uint8_t t = 0; t < TEXTONS_MAX_THREADS; t++) {
+    free(textons_pool.workers[t].patch);
+    free(textons_pool.workers[t].histogram);
+    textons_pool.workers[t].patch = (float *)malloc(dict_patch_len * sizeof(float));
+    textons_pool.workers[t].histogram = (uint32_t *)calloc(dict_n_textons, sizeof(uint32_t));
+  }
+
+  dictionary_initialized = 0;
+  dictionary_ready = 0;
+  learned_samples = 0;
+}
+
+/**
+ * Copy an image patch to a contiguous float patch.
+ * The values are stored row by row as they are in the image: U/V, Y1/Y2 for every pixel,
+ * which is the same order as the textons in the dictionary (and in the dictionary files).
+ * @param[out] *patch The patch [dict_patch_len]
+ * @param[in] *frame The YUV422 image data
+ * @param[in] width The width of the image
+ * @param[in] x The x coordinate of the top left corner
+ * @param[in] y The y coordinate of the top left corner
+ */
+static void textons_get_patch(float *patch, const uint8_t *frame, uint16_t width, uint16_t x, uint16_t y)
+{
+  uint16_t row_len = 2 * dict_patch_size;
+  for (uint16_t i = 0; i < dict_patch_size; i++) {
+    const uint8_t *buf = frame + (width * 2 * (i + y)) + 2 * x;
+    for (uint16_t j = 0; j < row_len; j++) {
+      *patch++ = (float) buf[j];
+    }
+  }
+}
+
+/**
+ * Squared euclidean distance between a patch and a texton
+ * @param[in] *patch The patch
+ * @param[in] *texton The texton
+ * @param[in] len Number of values in the patch
+ * @return The squared distance
+ */
+static inline float textons_distance(const float *patch, const float *texton, uint32_t len)
+{
+  uint32_t i = 0;
+  float dist = 0.f;
+#if TEXTONS_NEON
+  float32x4_t acc = vdupq_n_f32(0.f);
+  for (; i + 4 <= len; i += 4) {
+    float32x4_t d = vsubq_f32(vld1q_f32(patch + i), vld1q_f32(texton + i));
+    acc = vmlaq_f32(acc, d, d);
+  }
+  float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+  dist = vget_lane_f32(vpadd_f32(sum, sum), 0);
+#elif TEXTONS_SSE2
+  __m128 acc = _mm_setzero_ps();
+  for (; i + 4 <= len; i += 4) {
+    __m128 d = _mm_sub_ps(_mm_loadu_ps(patch + i), _mm_loadu_ps(texton + i));
+    acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+  }
+  acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+  acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+  dist = _mm_cvtss_f32(acc);
+#endif
+  for (; i < len; i++) {
+    float d = patch[i] - texton[i];
+    dist += d * d;
+  }
+  return dist;
+}
+
+/**
+ * Find the texton closest to a patch
+ * @param[in] *patch The patch
+ * @return The index of the closest texton
+ */
+static uint8_t textons_nearest(const float *patch)
+{
+  uint8_t assignment = 0;
+  float min_dist = textons_distance(patch, dictionary, dict_patch_len);
+  for (uint8_t texton = 1; texton < dict_n_textons; texton++) {
+    float dist = textons_distance(patch, &dictionary[texton * dict_patch_len], dict_patch_len);
+    if (dist < min_dist) {
+      min_dist = dist;
+      assignment = texton;
+    }
+  }
+  return assignment;
+}
+
+/**
+ * Assign a range of samples of the current job to their textons
+ * @param[in] *worker The worker with its scratch patch and histogram
+ */
+static void textons_assign_range(struct textons_worker_t *worker)
+{
+  const struct textons_job_t *job = &textons_pool.job;
+  memset(worker->histogram, 0, dict_n_textons * sizeof(uint32_t));
+  for (uint32_t s = worker->from; s < worker->to; s++) {
+    textons_get_patch(worker->patch, job->frame, job->width, job->samples[s].x, job->samples[s].y);
+    worker->histogram[textons_nearest(worker->patch)]++;
+  }
+}
+
+/**
+ * The worker thread, assigns its part of the samples for every job
+ * @param[in] *data The worker structure
+ */
+static void *textons_worker_thread(void *data)
+{
+  struct textons_worker_t *worker = (struct textons_worker_t *)data;
+  uint8_t idx = worker - textons_pool.workers;
+  uint32_t last_job = 0;
+
+  pthread_mutex_lock(&textons_pool.mutex);
+  while (true) {
+    // Wait for a new job
+    while (textons_pool.job_id == last_job && !textons_pool.quit) {
+      pthread_cond_wait(&textons_pool.job_cond, &textons_pool.mutex);
+    }
+    // Stop, but only after the job in progress
+    if (textons_pool.job_id == last_job) {
+      break;
+    }
+    last_job = textons_pool.job_id;
+
+    // Not needed for this job
+    if (idx >= textons_pool.active) {
+      continue;
+    }
+    pthread_mutex_unlock(&textons_pool.mutex);
+
+    textons_assign_range(worker);
+
+    // Report back
+    pthread_mutex_lock(&textons_pool.mutex);
+    if (--textons_pool.busy == 0) {
+      pthread_cond_signal(&textons_pool.done_cond);
+    }
+  }
+  pthread_mutex_unlock(&textons_pool.mutex);
+
+  return NULL;
+}
+
+/**
+ * Assign all the samples of the job, split over the calling thread and the workers
+ * @param[in] n_samples The amount of samples
+ * @return The amount of threads used (their histograms have to be summed)
+ */
+static uint8_t textons_assign_samples(uint32_t n_samples)
+{
+  uint8_t n_threads = textons_threads;
+  if (n_threads > TEXTONS_MAX_THREADS) {
+    n_threads = TEXTONS_MAX_THREADS;
+  }
+
+  // Start extra workers if needed (they keep running for the next images)
+  while (textons_pool.started + 1 < n_threads) {
+    struct textons_worker_t *worker = &textons_pool.workers[textons_pool.started + 1];
+    if (pthread_create(&worker->thread, NULL, textons_worker_thread, worker) != 0) {
+      printf("[textons] Could not create worker thread %d\n", textons_pool.started + 1);
+      break;
+    }
+    textons_pool.started++;
+  }
+  if (n_threads > textons_pool.started + 1) {
+    n_threads = textons_pool.started + 1;
+  }
+
+  // Not worth to split
+  if (n_threads <= 1 || n_samples < n_threads) {
+    textons_pool.workers[0].from = 0;
+    textons_pool.workers[0].to = n_samples;
+    textons_assign_range(&textons_pool.workers[0]);
+    return 1;
+  }
+
+  // Hand out the jobs, the calling thread takes the first part
+  pthread_mutex_lock(&textons_pool.mutex);
+  for (uint8_t t = 0; t < n_threads; t++) {
+    textons_pool.workers[t].from = (uint64_t)n_samples * t / n_threads;
+    textons_pool.workers[t].to = (uint64_t)n_samples * (t + 1) / n_threads;
+  }
+  textons_pool.active = n_threads;
+  textons_pool.busy = n_threads - 1;
+  textons_pool.job_id++;
+  pthread_cond_broadcast(&textons_pool.job_cond);
+  pthread_mutex_unlock(&textons_pool.mutex);
+
+  textons_assign_range(&textons_pool.workers[0]);
+
+  // Wait for the workers to finish
+  pthread_mutex_lock(&textons_pool.mutex);
+  while (textons_pool.busy > 0) {
+    pthread_cond_wait(&textons_pool.done_cond, &textons_pool.mutex);
+  }
+  pthread_mutex_unlock(&textons_pool.mutex);
+  return n_threads;
+}
+
 /**
  * Main texton processing function that first either loads or learns a dictionary and then extracts the texton histogram.
  * @param[out] *img The output image
@@ -129,6 +424,9 @@ struct image_t *texton_func(struct image_t *img)
   // if patch size odd, correct:
   if (patch_size % 2 == 1) { patch_size++; }
 
+  // patch or dictionary size changed from the settings
+  textons_alloc();
+
   // if dictionary not initialized:
   if (dictionary_ready == 0) {
     if (load_dictionary == 0) {
@@ -159,17 +457,21 @@ struct image_t *texton_func(struct image_t *img)
 /**
  * Function that performs one pass for dictionary training. It extracts samples from an image, finds the closest texton
  * and moves it towards the sample.
+ * The samples are learned one after the other, as every assignment depends on the previous updates.
  * @param[in] frame* The YUV image data
  * @param[in] width The width of the image
  * @param[in] height The height of the image
  */
 void DictionaryTrainingYUV(uint8_t *frame, uint16_t width, uint16_t height)
 {
-  int i, j, w, s, texton, c; // iterators
+  int i, w; // iterators
+  uint32_t s;
   int x, y; // image coordinates
-  float error_texton; // distance between an image patch and a texton
+  float *patch = textons_pool.workers[0].patch;
 
-  uint8_t *buf;
+  if (width <= dict_patch_size || height <= dict_patch_size) {
+    return;
+  }
 
   // ***********************
   //   DICTIONARY LEARNING
@@ -180,257 +482,122 @@ void DictionaryTrainingYUV(uint8_t *frame, uint16_t width, uint16_t height)
     // INITIALISATION
     // **************
 
-    printf("Intializing dictionary!\n");
+    printf("[textons] Initializing dictionary\n");
 
     // in the first image, we initialize the textons to random patches in the image
-    for (w = 0; w < n_textons; w++) {
+    for (w = 0; w < dict_n_textons; w++) {
       // select a coordinate
-      x = rand() % (width - patch_size);
-      y = rand() % (height - patch_size);
-
-      //printf("(x,y) = (%d,%d), (w,h) = (%d,%d), ps = %d\n", x, y, width, height, patch_size);
-      // take the sample
-      for (i = 0; i < patch_size; i++) {
-        buf = frame + (width * 2 * (i + y)) + 2 * x;
-        for (j = 0; j < patch_size; j++) {
-          // put it in a texton
-          printf("Setting dictionary:\n");
-          // U/V component
-
-          dictionary[w][i][j][0] = (float) * buf;
-          buf += 1;
-          // Y1/Y2 component
-          dictionary[w][i][j][1] = (float) * buf;
-          buf += 1;
-          printf("Done!\n");
-        }
-      }
+      x = rand() % (width - dict_patch_size);
+      y = rand() % (height - dict_patch_size);
+
+      // take the sample as texton
+      textons_get_patch(&dictionary[w * dict_patch_len], frame, width, x, y);
     }
     dictionary_initialized = 1;
   } else {
     // ********
     // LEARNING
     // ********
-    printf("Learning!");
     alpha = ((float) alpha_uint) / 255.0;
 
-    float *texton_distances, * **patch;
-    texton_distances = (float *)calloc(n_textons, sizeof(float));
-    patch = (float ** *)calloc(patch_size, sizeof(float **));
-
-    for (i = 0; i < patch_size; i++) {
-      patch[i] = (float **)calloc(patch_size, sizeof(float *));
-      for (j = 0; j < patch_size; j++) {
-        patch[i][j] = (float *)calloc(2, sizeof(float));
-      }
-    }
-
     // Extract and learn from n_samples_image per image
     for (s = 0; s < n_samples_image; s++) {
       // select a random sample from the image
-      x = rand() % (width - patch_size);
-      y = rand() % (height - patch_size);
-
-      // reset texton_distances
-      for (texton = 0; texton < n_textons; texton++) {
-        texton_distances[texton] = 0;
-      }
-
-      // extract sample
-      for (i = 0; i < patch_size; i++) {
-        buf = frame + (width * 2 * (i + y)) + 2 * x;
-        for (j = 0; j < patch_size; j++) {
-          // U/V component
-          patch[i][j][0] = (float) * buf;
-          buf += 1;
-          // Y1/Y2 component
-          patch[i][j][1] = (float) * buf;
-          buf += 1;
-        }
-      }
-
-      // determine distances to the textons:
-      for (i = 0; i < patch_size; i++) {
-        for (j = 0; j < patch_size; j++) {
-          for (c = 0; c < 2; c++) {
-            // determine the distance to textons
-            for (texton = 0; texton < n_textons; texton++) {
-              texton_distances[texton] += (patch[i][j][c] - dictionary[texton][i][j][c])
-                                          * (patch[i][j][c] - dictionary[texton][i][j][c]);
-            }
-          }
-        }
-      }
+      x = rand() % (width - dict_patch_size);
+      y = rand() % (height - dict_patch_size);
 
-      // search the closest texton
-      int assignment = 0;
-      float min_dist = texton_distances[0];
-      for (texton = 1; texton < n_textons; texton++) {
-        if (texton_distances[texton] < min_dist) {
-          min_dist = texton_distances[texton];
-          assignment = texton;
-        }
-      }
+      // extract sample and search the closest texton
+      textons_get_patch(patch, frame, width, x, y);
+      float *texton = &dictionary[textons_nearest(patch) * dict_patch_len];
 
       // move the neighbour closer to the input
-      for (i = 0; i < patch_size; i++) {
-        for (j = 0; j < patch_size; j++) {
-          for (c = 0; c < 2; c++) {
-            error_texton = patch[i][j][c] - dictionary[assignment][i][j][c];
-            dictionary[assignment][i][j][c] += (alpha * error_texton);
-          }
-        }
+      for (i = 0; i < (int)dict_patch_len; i++) {
+        texton[i] += alpha * (patch[i] - texton[i]);
       }
 
       // Augment the number of learned samples:
       learned_samples++;
     }
-
-    // Free the allocated memory:
-    for (i = 0; i < patch_size; i++) {
-      for (j = 0; j < patch_size; j++) {
-        free(patch[i][j]);
-      }
-      free(patch[i]);
-    }
-    free(patch);
-    free(texton_distances);
   }
-
-  // Free the buffer
-  buf = NULL;
-  free(buf);
 }
 
 /**
  * Function that extracts a texton histogram from an image.
+ * The sample coordinates are drawn first, the samples are then assigned to their closest texton,
+ * optionally split over TEXTONS_THREADS threads.
  * @param[in] frame* The YUV image data
  * @param[in] width The width of the image
  * @param[in] height The height of the image
  */
 void DistributionExtraction(uint8_t *frame, uint16_t width, uint16_t height)
 {
-  int i, j, texton, c; // iterators
-  int x, y; // coordinates
-  int n_extracted_textons = 0;
+  uint32_t n_samples = 0;
+  int i, x, y;
 
-  uint8_t *buf;
+  if (width <= dict_patch_size || height <= dict_patch_size) {
+    return;
+  }
 
   // ************************
-  //       EXECUTION
+  //       SAMPLING
   // ************************
 
-  printf("Execute!\n");
-
-  // Allocate memory for texton distances and image patch:
-  float *texton_distances, * **patch;
-  texton_distances = (float *)calloc(n_textons, sizeof(float));
-  patch = (float ** *)calloc(patch_size, sizeof(float **));
-  for (i = 0; i < patch_size; i++) {
-    patch[i] = (float **)calloc(patch_size, sizeof(float *));
-    for (j = 0; j < patch_size; j++) {
-      patch[i][j] = (float *)calloc(2, sizeof(float));
+  if (!FULL_SAMPLING) {
+    if (width <= dict_patch_size + 2 * border_width || height <= dict_patch_size + 2 * border_height) {
+      return;
     }
+    n_samples = n_samples_image;
+  } else {
+    // FULL_SAMPLING is actually a sampling that covers the image with a step of a patch in y
+    // True full sampling would require a step of one pixel in y
+    n_samples = (width - dict_patch_size + 1) * ((height - dict_patch_size) / dict_patch_size + 1);
+  }
+  if (n_samples == 0) {
+    return;
   }
 
-  int finished = 0;
-  x = 0;
-  y = 0;
-  while (!finished) {
-    if (!FULL_SAMPLING) {
-      x = border_width + rand() % (width - patch_size - 2 * border_width);
-      y = border_height + rand() % (height - patch_size - 2 * border_height);
-    }
-
-    // reset texton_distances
-    for (texton = 0; texton < n_textons; texton++) {
-      texton_distances[texton] = 0;
-    }
-
-    // extract sample
-    for (i = 0; i < patch_size; i++) {
-      buf = frame + (width * 2 * (i + y)) + 2 * x;
-      for (j = 0; j < patch_size; j++) {
-        // U/V component
-        patch[i][j][0] = (float) * buf;
-        buf += 1;
-        // Y1/Y2 component
-        patch[i][j][1] = (float) * buf;
-        buf += 1;
-      }
-    }
-
-    // determine distances:
-    for (i = 0; i < patch_size; i++) {
-      for (j = 0; j < patch_size; j++) {
-        for (c = 0; c < 2; c++) {
-          // determine the distance to words
-          for (texton = 0; texton < n_textons; texton++) {
-            texton_distances[texton] += (patch[i][j][c] - dictionary[texton][i][j][c])
-                                        * (patch[i][j][c] - dictionary[texton][i][j][c]);
-          }
-        }
-      }
+  if (n_samples > samples_size) {
+    free(samples);
+    samples = (struct texton_sample_t *)malloc(n_samples * sizeof(struct texton_sample_t));
+    samples_size = (samples != NULL) ? n_samples : 0;
+    if (samples == NULL) {
+      return;
     }
+  }
 
-    // determine the nearest neighbour
-    // search the closest centroid
-    int assignment = 0;
-    float min_dist = texton_distances[0];
-    for (texton = 1; texton < n_textons; texton++) {
-      if (texton_distances[texton] < min_dist) {
-        min_dist = texton_distances[texton];
-        assignment = texton;
-      }
+  if (!FULL_SAMPLING) {
+    for (uint32_t s = 0; s < n_samples; s++) {
+      samples[s].x = border_width + rand() % (width - dict_patch_size - 2 * border_width);
+      samples[s].y = border_height + rand() % (height - dict_patch_size - 2 * border_height);
     }
-
-    // put the assignment in the histogram
-    texton_distribution[assignment]++;
-    n_extracted_textons++;
-
-    if (!FULL_SAMPLING && n_extracted_textons == n_samples_image) {
-      finished = 1;
-    } else {
-      // FULL_SAMPLING is actually a sampling that covers the image:
-      y += patch_size;
-      // True full sampling would require:
-      // y++;
-
-      if (y > height - patch_size) {
-        if (!FULL_SAMPLING) {
-          x += patch_size;
-        } else {
-          x++;
-        }
-        y = 0;
-      }
-      if (x > width - patch_size) {
-        finished = 1;
+  } else {
+    uint32_t s = 0;
+    for (x = 0; x <= width - dict_patch_size; x++) {
+      for (y = 0; y <= height - dict_patch_size; y += dict_patch_size) {
+        samples[s].x = x;
+        samples[s].y = y;
+        s++;
       }
     }
   }
 
-  // Normalize distribution:
-  for (i = 0; i < n_textons; i++) {
-    texton_distribution[i] = texton_distribution[i] / (float) n_extracted_textons;
-    // printf("textons[%d] = %f\n", i, texton_distribution[i]);
-  }
-  // printf("\n");
+  // ************************
+  //       EXECUTION
+  // ************************
 
+  textons_pool.job.frame = frame;
+  textons_pool.job.width = width;
+  textons_pool.job.samples = samples;
+  uint8_t n_threads = textons_assign_samples(n_samples);
 
-  // free memory:
-  for (i = 0; i < patch_size; i++) {
-    for (j = 0; j < patch_size; j++) {
-      free(patch[i][j]);
+  // Sum the histograms of the threads and normalize the distribution:
+  for (i = 0; i < dict_n_textons; i++) {
+    uint32_t count = 0;
+    for (uint8_t t = 0; t < n_threads; t++) {
+      count += textons_pool.workers[t].histogram[i];
     }
-    free(patch[i]);
+    texton_distribution[i] = (float) count / (float) n_samples;
   }
-  free(patch);
-  free(texton_distances);
-
-  buf = NULL;
-  free(buf);
-
 } // EXECUTION
 
 
@@ -452,13 +619,8 @@ void save_texton_dictionary(void)
     perror("Error while opening the file.\n");
   } else {
     // (over-)write dictionary
-    for (uint8_t i = 0; i < n_textons; i++) {
-      for (uint8_t j = 0; j < patch_size; j++) {
-        for (uint8_t k = 0; k < patch_size; k++) {
-          fprintf(dictionary_logger, "%f\n", dictionary[i][j][k][0]);
-          fprintf(dictionary_logger, "%f\n", dictionary[i][j][k][1]);
-        }
-      }
+    for (uint32_t i = 0; i < (uint32_t)dict_n_textons * dict_patch_len; i++) {
+      fprintf(dictionary_logger, "%f\n", dictionary[i]);
     }
     fclose(dictionary_logger);
   }
@@ -475,13 +637,8 @@ void load_texton_dictionary(void)
 
   if ((dictionary_logger = fopen(filename, "r"))) {
     // Load the dictionary:
-    for (int i = 0; i < n_textons; i++) {
-      for (int j = 0; j < patch_size; j++) {
-        for (int k = 0; k < patch_size; k++) {
-          if (fscanf(dictionary_logger, "%f\n", &dictionary[i][j][k][0]) == EOF) { break; }
-          if (fscanf(dictionary_logger, "%f\n", &dictionary[i][j][k][1]) == EOF) { break; }
-        }
-      }
+    for (uint32_t i = 0; i < (uint32_t)dict_n_textons * dict_patch_len; i++) {
+      if (fscanf(dictionary_logger, "%f\n", &dictionary[i]) == EOF) { break; }
     }
 
     fclose(dictionary_logger);
@@ -501,27 +658,37 @@ void load_texton_dictionary(void)
 void textons_init(void)
 {
   printf("Textons init\n");
-  texton_distribution = (float *)calloc(n_textons, sizeof(float));
-  dictionary_initialized = 0;
-  learned_samples = 0;
-  dictionary_ready = 0;
-  dictionary = (float ** **)calloc(n_textons, sizeof(float ** *));
-  for (int w = 0; w < n_textons; w++) {
-    dictionary[w] = (float ** *) calloc(patch_size, sizeof(float **));
-    for (int i = 0; i < patch_size; i++) {
-      dictionary[w][i] = (float **) calloc(patch_size, sizeof(float *));
-      for (int j = 0; j < patch_size; j++) {
-        dictionary[w][i][j] = (float *) calloc(2, sizeof(float));
-      }
-    }
-  }
+  textons_alloc();
 
-  cv_add(texton_func);
+  struct video_listener *listener = cv_add_to_device(&TEXTONS_CAMERA, texton_func);
+  listener->read_only = true;
 }
 
 void textons_stop(void)
 {
+  // Stop the worker threads, they are started again by the next extraction
+  pthread_mutex_lock(&textons_pool.mutex);
+  textons_pool.quit = true;
+  pthread_cond_broadcast(&textons_pool.job_cond);
+  pthread_mutex_unlock(&textons_pool.mutex);
+  for (uint8_t t = 1; t <= textons_pool.started; t++) {
+    pthread_join(textons_pool.workers[t].thread, NULL);
+  }
+  textons_pool.started = 0;
+  textons_pool.quit = false;
+  for (uint8_t t = 0; t < TEXTONS_MAX_THREADS; t++) {
+    free(textons_pool.workers[t].patch);
+    free(textons_pool.workers[t].histogram);
+    textons_pool.workers[t].patch = NULL;
+    textons_pool.workers[t].histogram = NULL;
+  }
+  free(samples);
+  samples = NULL;
+  samples_size = 0;
+
   free(texton_distribution);
   free(dictionary);
+  texton_distribution = NULL;
+  dictionary = NULL;
+  dict_n_textons = 0;
 }
-
@@ -49,11 +49,12 @@ extern uint8_t FULL_SAMPLING;
 extern uint32_t border_width;
 extern uint32_t border_height;
 extern uint8_t dictionary_number;
+extern uint8_t textons_threads;
 
 // status variables
 extern uint8_t dictionary_ready;
 extern float alpha;
-extern float ** **dictionary;
+extern float *dictionary; // n_textons x (patch_size * patch_size * 2) values, each texton stored row by row as U/V, Y per pixel
 extern uint32_t learned_samples;
 extern uint8_t dictionary_initialized;
 
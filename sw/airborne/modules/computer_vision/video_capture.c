@@ -65,8 +65,9 @@ void video_capture_init(void)
     return;
   }
 
-  // Add function to computer vision pipeline
-  cv_add_to_device(&VIDEO_CAPTURE_CAMERA, video_capture_func);
+  // Add function to computer vision pipeline, the image is only read
+  struct video_listener *listener = cv_add_to_device(&VIDEO_CAPTURE_CAMERA, video_capture_func);
+  listener->read_only = true;
 }
 
 
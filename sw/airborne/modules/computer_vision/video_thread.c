@@ -33,6 +33,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <math.h>
 
 // Video
@@ -41,6 +42,7 @@
 #include "lib/vision/bayer.h"
 
 #include "mcu_periph/sys_time.h"
+#include "pprzlink/messages.h"
 
 // include board for bottom_camera and front_camera on ARDrone2 and Bebop
 #include BOARD_CONFIG
@@ -66,6 +68,14 @@ PRINT_CONFIG_VAR(VIDEO_THREAD_NICE_LEVEL)
 #endif
 PRINT_CONFIG_VAR(VIDEO_THREAD_MAX_CAMERAS)
 
+/** Low pass filter factor of the latency statistics (1 for no filtering) */
+#ifndef VIDEO_THREAD_LATENCY_FILTER
+#define VIDEO_THREAD_LATENCY_FILTER 0.1f
+#endif
+
+/** Maximum amount of listeners reported in the VIDEO_THREAD_LATENCY message */
+#define VIDEO_THREAD_LATENCY_MAX_LISTENERS 8
+
 static struct video_config_t *cameras[VIDEO_THREAD_MAX_CAMERAS] = {NULL};
 
 // Main thread
@@ -79,6 +89,49 @@ void video_thread_periodic(void)
   /* currently no direct periodic functionality */
 }
 
+/**
+ * Current time in us since system startup, with the resolution of the monotonic
+ * clock instead of the sys tick
+ */
+static uint32_t video_thread_time_usec(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return sys_time_usec_of_monotonic(&now);
+}
+
+/*
+ * Update a filtered latency with the time elapsed since the frame capture
+ */
+void video_thread_latency_update(float *latency, uint32_t pprz_ts)
+{
+  int32_t dt = (int32_t)(video_thread_time_usec() - pprz_ts);
+  if (dt < 0) {
+    dt = 0;
+  }
+  *latency += VIDEO_THREAD_LATENCY_FILTER * ((float)dt - *latency);
+}
+
+/**
+ * Add a time in ns to a timespec
+ */
+static void timespec_add_ns(struct timespec *ts, uint32_t ns)
+{
+  ts->tv_nsec += ns;
+  while (ts->tv_nsec >= 1000000000L) {
+    ts->tv_nsec -= 1000000000L;
+    ts->tv_sec++;
+  }
+}
+
+/**
+ * Time from a to b in ns (negative when b is before a)
+ */
+static int64_t timespec_diff_ns(struct timespec *a, struct timespec *b)
+{
+  return (int64_t)(b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
 
 /**
  * Handles all the video streaming and saving of the image shots
@@ -117,33 +170,42 @@ static void *video_thread_function(void *data)
   set_nice_level(VIDEO_THREAD_NICE_LEVEL);
   fprintf(stdout, "[%s] Set nice level to %i.\n", print_tag, VIDEO_THREAD_NICE_LEVEL);
 
-  // Initialize timing
+  // Initialize timing, the frames are taken at absolute deadlines so the processing
+  // time and the wait for a frame don't add up
   struct timespec time_now;
-  struct timespec time_prev;
-  clock_gettime(CLOCK_MONOTONIC, &time_prev);
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  memset(&vid->thread.stats, 0, sizeof(vid->thread.stats));
 
   // Start streaming
   vid->thread.is_running = true;
   while (vid->thread.is_running) {
+    struct image_t img;
 
-    // get time in us since last run
-    clock_gettime(CLOCK_MONOTONIC, &time_now);
-    uint32_t dt_us = sys_time_elapsed_us(&time_prev, &time_now);
-    time_prev = time_now;
-
-    // sleep remaining time to limit to specified fps
     if (vid->fps != 0) {
-      uint32_t fps_period_us = 1000000 / vid->fps;
-      if (dt_us < fps_period_us) {
-        usleep(fps_period_us - dt_us);
-      } else {
-        fprintf(stderr, "[%s] desired %i fps, only managing %.1f fps\n", print_tag, vid->fps, 1000000.f / dt_us);
+      uint32_t period_ns = 1000000000UL / vid->fps;
+
+      // When the previous frame took more than a period, restart from now instead of
+      // processing the missed deadlines in a burst
+      clock_gettime(CLOCK_MONOTONIC, &time_now);
+      if (timespec_diff_ns(&deadline, &time_now) > period_ns) {
+        vid->thread.stats.overruns++;
+        deadline = time_now;
       }
-    }
 
-    // Wait for a new frame (blocking)
-    struct image_t img;
-    v4l2_image_get(vid->thread.dev, &img);
+      // Sleep until the deadline of this frame
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+      timespec_add_ns(&deadline, period_ns);
+
+      // Take the frame that is ready, only wait when none was captured since the last one
+      if (!v4l2_image_get_nonblock(vid->thread.dev, &img)) {
+        v4l2_image_get(vid->thread.dev, &img);
+      }
+    } else {
+      // Wait for a new frame (blocking)
+      v4l2_image_get(vid->thread.dev, &img);
+    }
+    video_thread_latency_update(&vid->thread.stats.dequeue_latency, img.pprz_ts);
 
     // pointer to the final image to pass for saving and further processing
     struct image_t *img_final = &img;
@@ -151,15 +213,19 @@ static void *video_thread_function(void *data)
     // run selected filters
     if (vid->filters & VIDEO_FILTER_DEBAYER) {
       BayerToYUV(&img, &img_color, 0, 0);
+      img_color.ts = img.ts;
+      img_color.pprz_ts = img.pprz_ts;
       // use color image for further processing
       img_final = &img_color;
     }
+    video_thread_latency_update(&vid->thread.stats.filter_latency, img.pprz_ts);
 
     // Run processing if required
     cv_run_device(vid, img_final);
 
     // Free the image
     v4l2_image_free(vid->thread.dev, &img);
+    vid->thread.stats.frames++;
   }
 
   image_free(&img_color);
@@ -185,10 +251,36 @@ static bool initialize_camera(struct video_config_t *camera)
     return false;
   }
 
+  // Keep every frame in order when the processing needs consecutive frames
+  if (camera->queue_size > 1) {
+    v4l2_set_capture_mode(camera->thread.dev, V4L2_CAPTURE_QUEUE, camera->queue_size);
+  }
+
   // Initialize OK
   return true;
 }
 
+/*
+ * Take an extra reference on the current frame of a video device, so it can be
+ * used by another thread without copying it. Returns false when the image is not
+ * a frame of the device (e.g. after a filter) or no buffers can be spared.
+ */
+bool video_thread_image_ref(struct video_config_t *device, struct image_t *img)
+{
+  if (device == NULL || device->thread.dev == NULL) {
+    return false;
+  }
+  return v4l2_image_ref(device->thread.dev, img);
+}
+
+/*
+ * Release a reference taken with video_thread_image_ref
+ */
+void video_thread_image_unref(struct video_config_t *device, struct image_t *img)
+{
+  v4l2_image_free(device->thread.dev, img);
+}
+
 /*
  * Add a new video device to the list
  */
@@ -258,11 +350,64 @@ static void stop_video_thread(struct video_config_t *device)
 
 }
 
+#if PERIODIC_TELEMETRY
+#ifdef PPRZ_MSG_ID_VIDEO_THREAD_LATENCY
+#define VIDEO_THREAD_LATENCY_MSG_ID PPRZ_MSG_ID_VIDEO_THREAD_LATENCY
+#else
+#define VIDEO_THREAD_LATENCY_MSG_ID PPRZ_MSG_ID_PAYLOAD_FLOAT
+/** First PAYLOAD_FLOAT value, tells these messages apart from other PAYLOAD_FLOAT users ('V' 'T') */
+#define VIDEO_THREAD_LATENCY_TAG -0x5654
+#endif
+#include "subsystems/datalink/telemetry.h"
+
+/**
+ * Send the timing statistics, one camera per message
+ * Uses the VIDEO_THREAD_LATENCY message when it is defined, else PAYLOAD_FLOAT with
+ * [VIDEO_THREAD_LATENCY_TAG, cam, frames, overruns, dequeue, filter, listeners...]
+ */
+static void send_video_thread_latency(struct transport_tx *trans, struct link_device *dev)
+{
+  static uint8_t cam = 0;
+  float listeners[VIDEO_THREAD_LATENCY_MAX_LISTENERS];
+  uint8_t nb = 0;
+
+  // Find the next running camera
+  for (uint8_t i = 0; i < VIDEO_THREAD_MAX_CAMERAS; i++) {
+    cam = (cam + 1) % VIDEO_THREAD_MAX_CAMERAS;
+    if (cameras[cam] != NULL && cameras[cam]->thread.is_running) {
+      break;
+    }
+  }
+  struct video_config_t *vid = cameras[cam];
+  if (vid == NULL || !vid->thread.is_running) {
+    return;
+  }
+
+  for (struct video_listener *l = vid->cv_listener; l != NULL && nb < VIDEO_THREAD_LATENCY_MAX_LISTENERS; l = l->next) {
+    listeners[nb++] = l->latency;
+  }
+  struct video_thread_stats *s = &vid->thread.stats;
+#ifdef PPRZ_MSG_ID_VIDEO_THREAD_LATENCY
+  pprz_msg_send_VIDEO_THREAD_LATENCY(trans, dev, AC_ID, &cam, &s->frames, &s->overruns,
+                                     &s->dequeue_latency, &s->filter_latency, nb, listeners);
+#else
+  float payload[6 + VIDEO_THREAD_LATENCY_MAX_LISTENERS] = {
+    VIDEO_THREAD_LATENCY_TAG, cam, s->frames, s->overruns, s->dequeue_latency, s->filter_latency
+  };
+  memcpy(&payload[6], listeners, nb * sizeof(float));
+  pprz_msg_send_PAYLOAD_FLOAT(trans, dev, AC_ID, 6 + nb, payload);
+#endif
+}
+#endif
+
 /**
  * Initialize the view video
  */
 void video_thread_init(void)
 {
+#if PERIODIC_TELEMETRY
+  register_periodic_telemetry(DefaultPeriodic, VIDEO_THREAD_LATENCY_MSG_ID, send_video_thread_latency);
+#endif
 }
 
 /**
@@ -79,3 +79,10 @@ void video_thread_stop(void) {}
 void video_thread_take_shot(bool take __attribute__((unused))) {}
 
 bool add_video_device(struct video_config_t *device __attribute__((unused))){ return true; }
+
+bool video_thread_image_ref(struct video_config_t *device __attribute__((unused)),
+                            struct image_t *img __attribute__((unused))) { return false; }
+void video_thread_image_unref(struct video_config_t *device __attribute__((unused)),
+                              struct image_t *img __attribute__((unused))) {}
+void video_thread_latency_update(float *latency __attribute__((unused)),
+                                 uint32_t pprz_ts __attribute__((unused))) {}
@@ -43,6 +43,12 @@
 #define VIDEO_USB_LOGGER_PATH /data/video/usb
 #endif
 
+/** Amount of threads used for the JPEG encoding (more than 1 encodes with restart intervals) */
+#ifndef VIDEO_USB_LOGGER_JPEG_THREADS
+#define VIDEO_USB_LOGGER_JPEG_THREADS 1
+#endif
+PRINT_CONFIG_VAR(VIDEO_USB_LOGGER_JPEG_THREADS)
+
 /** The file pointer */
 static FILE *video_usb_logger = NULL;
 struct image_t img_jpeg_global;
@@ -63,7 +69,11 @@ static void save_shot_on_disk(struct image_t *img, struct image_t *img_jpeg)
   if (access(save_name, F_OK) == -1) {
 
     // Create a high quality image (99% JPEG encoded)
+#if VIDEO_USB_LOGGER_JPEG_THREADS > 1
+    jpeg_encode_image_mt(img, img_jpeg, 99, TRUE, VIDEO_USB_LOGGER_JPEG_THREADS);
+#else
     jpeg_encode_image(img, img_jpeg, 99, TRUE);
+#endif
 
 #if VIDEO_USB_LOGGER_JPEG_WITH_EXIF_HEADER
     write_exif_jpeg(save_name, img_jpeg->buf, img_jpeg->buf_size, img_jpeg->w, img_jpeg->h);
@@ -142,8 +152,9 @@ void video_usb_logger_start(void)
     fprintf(video_usb_logger, "counter,image,roll,pitch,yaw,x,y,z,accelx,accely,accelz,ratep,rateq,rater,sonar\n");
   }
 
-  // Subscribe to a camera
-  cv_add_to_device(&VIDEO_USB_LOGGER_CAMERA, log_image);
+  // Subscribe to a camera, the image is only read
+  struct video_listener *listener = cv_add_to_device(&VIDEO_USB_LOGGER_CAMERA, log_image);
+  listener->read_only = true;
 }
 
 /** Stop the logger an nicely close the file */
@@ -60,6 +60,12 @@ PRINT_CONFIG_VAR(VIEWVIDEO_DOWNSIZE_FACTOR)
 #endif
 PRINT_CONFIG_VAR(VIEWVIDEO_QUALITY_FACTOR)
 
+// Amount of threads used for the JPEG encoding (more than 1 encodes with restart intervals)
+#ifndef VIEWVIDEO_JPEG_THREADS
+#define VIEWVIDEO_JPEG_THREADS 1
+#endif
+PRINT_CONFIG_VAR(VIEWVIDEO_JPEG_THREADS)
+
 // RTP time increment at 90kHz (default: 0 for automatic)
 #ifndef VIEWVIDEO_RTP_TIME_INC
 #define VIEWVIDEO_RTP_TIME_INC 0
@@ -112,6 +118,20 @@ struct viewvideo_t viewvideo = {
 #endif
 };
 
+/**
+ * JPEG encode an image for the stream
+ * @param[in] *img The image to encode
+ * @param[out] *img_jpeg The JPEG encoded image
+ */
+static void viewvideo_encode(struct image_t *img, struct image_t *img_jpeg)
+{
+#if VIEWVIDEO_JPEG_THREADS > 1
+  jpeg_encode_image_mt(img, img_jpeg, VIEWVIDEO_QUALITY_FACTOR, VIEWVIDEO_USE_NETCAT, VIEWVIDEO_JPEG_THREADS);
+#else
+  jpeg_encode_image(img, img_jpeg, VIEWVIDEO_QUALITY_FACTOR, VIEWVIDEO_USE_NETCAT);
+#endif
+}
+
 /**
  * Handles all the video streaming and saving of the image shots
  * This is a separate thread, so it needs to be thread safe!
@@ -120,14 +140,14 @@ static struct image_t *viewvideo_function(struct UdpSocket *socket, struct image
 {
   // Resize image if needed
   struct image_t img_small;
-  image_create(&img_small,
+  image_create_pooled(&img_small,
                img->w / viewvideo.downsize_factor,
                img->h / viewvideo.downsize_factor,
                IMAGE_YUV422);
 
   // Create the JPEG encoded image
   struct image_t img_jpeg;
-  image_create(&img_jpeg, img_small.w, img_small.h, IMAGE_JPEG);
+  image_create_pooled(&img_jpeg, img_small.w, img_small.h, IMAGE_JPEG);
 
 #if VIEWVIDEO_USE_NETCAT
   char nc_cmd[64];
@@ -139,9 +159,9 @@ static struct image_t *viewvideo_function(struct UdpSocket *socket, struct image
     // Only resize when needed
     if (viewvideo.downsize_factor != 1) {
       image_yuv422_downsample(img, &img_small, viewvideo.downsize_factor);
-      jpeg_encode_image(&img_small, &img_jpeg, VIEWVIDEO_QUALITY_FACTOR, VIEWVIDEO_USE_NETCAT);
+      viewvideo_encode(&img_small, &img_jpeg);
     } else {
-      jpeg_encode_image(img, &img_jpeg, VIEWVIDEO_QUALITY_FACTOR, VIEWVIDEO_USE_NETCAT);
+      viewvideo_encode(img, &img_jpeg);
     }
 
 #if VIEWVIDEO_USE_NETCAT
@@ -174,7 +194,7 @@ static struct image_t *viewvideo_function(struct UdpSocket *socket, struct image
         &img_jpeg,
         0,                        // Format 422
         VIEWVIDEO_QUALITY_FACTOR, // Jpeg-Quality
-        0,                        // DRI Header
+        VIEWVIDEO_JPEG_THREADS > 1, // DRI Header
         (img->ts.tv_sec * 1000000 + img->ts.tv_usec),
         rtp_frame_nr
       );
@@ -248,6 +268,7 @@ void viewvideo_init(void)
   struct video_listener *listener1 = cv_add_to_device_async(&VIEWVIDEO_CAMERA, viewvideo_function1,
                                      VIEWVIDEO_NICE_LEVEL);
   listener1->maximum_fps = VIEWVIDEO_FPS;
+  listener1->read_only = true;
   fprintf(stderr, "[viewvideo] Added asynchronous video streamer lister for CAMERA1\n");
 #endif
 
@@ -255,6 +276,7 @@ void viewvideo_init(void)
   struct video_listener *listener2 = cv_add_to_device_async(&VIEWVIDEO_CAMERA2, viewvideo_function2,
                                      VIEWVIDEO_NICE_LEVEL);
   listener2->maximum_fps = VIEWVIDEO_FPS;
+  listener2->read_only = true;
   fprintf(stderr, "[viewvideo] Added asynchronous video streamer lister for CAMERA2\n");
 #endif
 }
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/** \file modules_profile.c
+ *
+ * Execution time profiler of the modules periodic and event functions.
+ * Statistics are accumulated since startup (or the last reset) and
+ * reported one function per MODULES_PROFILE message.
+ */
+
+#define MODULES_PROFILE_C
+#include "core/modules_profile.h"
+#include "generated/modules.h"
+#include "pprzlink/messages.h"
+#include <string.h>
+
+/** Execution time in usec above which a call is counted as overrun (default one main loop period) */
+#ifndef MODULES_PROFILE_OVERRUN
+#define MODULES_PROFILE_OVERRUN (1000000 / MODULES_FREQUENCY)
+#endif
+
+static struct ModulesProfileStat modules_profile_stats[MODULES_PROFILE_NB];
+static uint16_t modules_profile_report_id;
+
+bool modules_profile_reset_flag;
+
+/** Histogram bin of an execution time, two bins per power of two */
+static inline uint8_t modules_profile_bin(uint32_t dt)
+{
+  if (dt < 2) {
+    return dt;
+  }
+  uint8_t msb = 31 - __builtin_clz(dt);
+  uint8_t bin = 2 * msb + ((dt >> (msb - 1)) & 1);
+  return Min(bin, MODULES_PROFILE_BINS - 1);
+}
+
+/** Lowest execution time in usec that falls in a bin */
+static inline uint32_t modules_profile_bin_start(uint8_t bin)
+{
+  if (bin < 2) {
+    return bin;
+  }
+  uint8_t msb = bin / 2;
+  return (1 << msb) | ((bin & 1) << (msb - 1));
+}
+
+/**
+ * Percentile of the execution time, from the histogram
+ * @param[in] *s The statistics of a function
+ * @param[in] pct The percentile (1 to 100)
+ * @return upper bound of the percentile in usec
+ */
+static uint16_t modules_profile_percentile(struct ModulesProfileStat *s, uint8_t pct)
+{
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < MODULES_PROFILE_BINS; i++) {
+    total += s->hist[i];
+  }
+  uint32_t target = (total * pct + 99) / 100;
+  uint32_t acc = 0;
+  for (uint8_t i = 0; i < MODULES_PROFILE_BINS - 1; i++) {
+    acc += s->hist[i];
+    if (acc >= target && acc > 0) {
+      return Min(modules_profile_bin_start(i + 1) - 1, s->max);
+    }
+  }
+  return s->max;
+}
+
+#if PERIODIC_TELEMETRY
+#ifdef PPRZ_MSG_ID_MODULES_PROFILE
+#define MODULES_PROFILE_MSG_ID PPRZ_MSG_ID_MODULES_PROFILE
+#else
+#define MODULES_PROFILE_MSG_ID PPRZ_MSG_ID_PAYLOAD_FLOAT
+/** First PAYLOAD_FLOAT value, tells these messages apart from other PAYLOAD_FLOAT users ('M' 'P') */
+#define MODULES_PROFILE_TAG -0x4D50
+#endif
+#include "subsystems/datalink/telemetry.h"
+
+/**
+ * Send the statistics of one function
+ * Uses the MODULES_PROFILE message when it is defined, else PAYLOAD_FLOAT with
+ * [MODULES_PROFILE_TAG, id, count, min, mean, max, p99, overruns]
+ */
+static void send_modules_profile(struct transport_tx *trans, struct link_device *dev)
+{
+  uint16_t id = modules_profile_report_id;
+  modules_profile_report_id = (id + 1) % MODULES_PROFILE_NB;
+
+  struct ModulesProfileStat *s = &modules_profile_stats[id];
+  uint16_t min = (s->count > 0) ? s->min : 0;
+  uint16_t mean = (s->count > 0) ? Min(s->sum / s->count, 0xFFFF) : 0;
+  uint16_t p99 = modules_profile_percentile(s, 99);
+#ifdef PPRZ_MSG_ID_MODULES_PROFILE
+  char *name = (char *)modules_profile_names[id];
+  pprz_msg_send_MODULES_PROFILE(trans, dev, AC_ID, &id, strlen(name), name, &s->count,
+                                &min, &mean, &s->max, &p99, &s->overruns);
+#else
+  float payload[] = { MODULES_PROFILE_TAG, id, s->count, min, mean, s->max, p99, s->overruns };
+  pprz_msg_send_PAYLOAD_FLOAT(trans, dev, AC_ID, sizeof(payload) / sizeof(float), payload);
+#endif
+}
+#endif
+
+#ifdef SITL
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+
+void modules_profile_init(void)
+{
+  modules_profile_reset(true);
+  modules_profile_report_id = 0;
+
+#if PERIODIC_TELEMETRY
+  register_periodic_telemetry(DefaultPeriodic, MODULES_PROFILE_MSG_ID, send_modules_profile);
+#endif
+
+#ifdef SITL
+  // dump the full table when the simulation ends
+  atexit(modules_profile_print);
+#endif
+}
+
+void modules_profile_reset(bool reset)
+{
+  if (reset) {
+    memset(modules_profile_stats, 0, sizeof(modules_profile_stats));
+    for (uint16_t i = 0; i < MODULES_PROFILE_NB; i++) {
+      modules_profile_stats[i].min = 0xFFFF;
+    }
+  }
+  modules_profile_reset_flag = false;
+}
+
+void modules_profile_add(uint16_t id, uint32_t dt)
+{
+  struct ModulesProfileStat *s = &modules_profile_stats[id];
+  uint16_t dt16 = Min(dt, 0xFFFF);
+
+  s->count++;
+  s->sum += dt;
+  if (dt16 < s->min) {
+    s->min = dt16;
+  }
+  if (dt16 > s->max) {
+    s->max = dt16;
+  }
+  if (dt > MODULES_PROFILE_OVERRUN && s->overruns < 0xFFFF) {
+    s->overruns++;
+  }
+
+  uint8_t bin = modules_profile_bin(dt);
+  if (s->hist[bin] == 0xFFFF) {
+    // keep the distribution when a bin is full
+    for (uint8_t i = 0; i < MODULES_PROFILE_BINS; i++) {
+      s->hist[i] /= 2;
+    }
+  }
+  s->hist[bin]++;
+}
+
+void modules_profile_print(void)
+{
+#ifdef SITL
+  printf("%-40s %10s %6s %6s %6s %6s %8s\n", "function", "count", "min", "mean", "max", "p99", "overruns");
+  for (uint16_t i = 0; i < MODULES_PROFILE_NB; i++) {
+    struct ModulesProfileStat *s = &modules_profile_stats[i];
+    if (s->count == 0) {
+      continue;
+    }
+    printf("%-40s %10u %6u %6u %6u %6u %8u\n", modules_profile_names[i], s->count, s->min,
+           s->sum / s->count, s->max, modules_profile_percentile(s, 99), s->overruns);
+  }
+#endif
+}
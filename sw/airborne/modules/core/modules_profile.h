@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/** \file modules_profile.h
+ *
+ * Execution time profiler of the modules periodic and event functions.
+ * When this header is included by the generated modules.h, every call
+ * is wrapped with a timestamp before and after.
+ */
+
+#ifndef MODULES_PROFILE_H
+#define MODULES_PROFILE_H
+
+#include "std.h"
+#include "mcu_periph/sys_time.h"
+
+/** Number of histogram bins, two per power of two of the execution time in usec */
+#define MODULES_PROFILE_BINS 32
+
+/** Execution time statistics of a single function */
+struct ModulesProfileStat {
+  uint32_t count;       ///< number of calls
+  uint32_t sum;         ///< total execution time in usec
+  uint16_t min;         ///< minimum execution time in usec
+  uint16_t max;         ///< maximum execution time in usec
+  uint16_t overruns;    ///< number of calls longer than MODULES_PROFILE_OVERRUN usec
+  uint16_t hist[MODULES_PROFILE_BINS]; ///< execution time histogram, for the percentiles
+};
+
+/** Init profiler
+ */
+extern void modules_profile_init(void);
+
+/** Add a measured execution time
+ * @param[in] id The profiler id of the function, given by the generator
+ * @param[in] dt The execution time in usec
+ */
+extern void modules_profile_add(uint16_t id, uint32_t dt);
+
+/** Reset all the statistics
+ * @param[in] reset Reset when true (settings handler)
+ */
+extern void modules_profile_reset(bool reset);
+
+/** Print all the statistics to stdout (for simulation)
+ */
+extern void modules_profile_print(void);
+
+/** Reset setting, always reads false */
+extern bool modules_profile_reset_flag;
+
+/** Wrap a module function call with timestamps */
+#define ModulesProfileCall(_id, ...) do {          \
+    uint32_t _profile_start = get_sys_time_usec(); \
+    __VA_ARGS__;                                   \
+    modules_profile_add(_id, get_sys_time_usec() - _profile_start); \
+  } while (0)
+
+#endif /* MODULES_PROFILE_H */
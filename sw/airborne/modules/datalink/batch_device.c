@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file modules/datalink/batch_device.c
+ *  \brief Batch the frames sent on a device into a single device write
+ */
+
+#include "modules/datalink/batch_device.h"
+#include <string.h>
+
+void batch_device_flush(struct batch_device *b)
+{
+  if (b->idx > 0 && (b->nb_frames == 0 || b->ends[b->nb_frames - 1] != b->idx)) {
+    // bytes sent without end of message
+    if (b->nb_frames < BATCH_DEVICE_MAX_FRAMES) {
+      b->nb_frames++;
+    }
+    b->ends[b->nb_frames - 1] = b->idx;
+  }
+  uint16_t start = 0;
+  uint8_t first = 0;
+  while (first < b->nb_frames) {
+    // largest group of whole frames the real device can take
+    uint8_t last = b->nb_frames;
+    long fd = 0;
+    while (last > first && !b->dev->check_free_space(b->dev->periph, &fd, b->ends[last - 1] - start)) {
+      last--;
+    }
+    if (last == first) {
+      // the remaining frames are lost
+      b->device.nb_ovrn++;
+      break;
+    }
+    b->dev->put_buffer(b->dev->periph, fd, &b->buf[start], b->ends[last - 1] - start);
+    b->dev->send_message(b->dev->periph, fd);
+    b->nb_flush++;
+    start = b->ends[last - 1];
+    first = last;
+  }
+  b->idx = 0;
+  b->nb_frames = 0;
+}
+
+static int batch_device_check_free_space(struct batch_device *b, long *fd __attribute__((unused)), uint16_t len)
+{
+  if (len > BATCH_DEVICE_BUFFER_SIZE - b->idx || b->nb_frames >= BATCH_DEVICE_MAX_FRAMES - 1) {
+    // make room for the new frame
+    batch_device_flush(b);
+  }
+  return len <= BATCH_DEVICE_BUFFER_SIZE - b->idx;
+}
+
+static void batch_device_put_buffer(struct batch_device *b, long fd __attribute__((unused)), const uint8_t *data,
+                                    uint16_t len)
+{
+  if (len > BATCH_DEVICE_BUFFER_SIZE - b->idx) {
+    batch_device_flush(b);
+    if (len > BATCH_DEVICE_BUFFER_SIZE) {
+      return;
+    }
+  }
+  memcpy(&b->buf[b->idx], data, len);
+  b->idx += len;
+}
+
+static void batch_device_put_byte(struct batch_device *b, long fd, uint8_t data)
+{
+  batch_device_put_buffer(b, fd, &data, 1);
+}
+
+// end of a frame, it will be written with the next flush
+static void batch_device_send_message(struct batch_device *b, long fd __attribute__((unused)))
+{
+  if (b->nb_frames > 0 && b->ends[b->nb_frames - 1] == b->idx) {
+    return;
+  }
+  if (b->nb_frames >= BATCH_DEVICE_MAX_FRAMES) {
+    batch_device_flush(b);
+  } else {
+    b->ends[b->nb_frames++] = b->idx;
+  }
+}
+
+// uplink is read directly from the real device
+static int batch_device_char_available(struct batch_device *b)
+{
+  return b->dev->char_available(b->dev->periph);
+}
+
+static uint8_t batch_device_get_byte(struct batch_device *b)
+{
+  return b->dev->get_byte(b->dev->periph);
+}
+
+static void batch_device_set_baudrate(struct batch_device *b, uint32_t baudrate)
+{
+  b->dev->set_baudrate(b->dev->periph, baudrate);
+}
+
+void batch_device_init(struct batch_device *b, struct link_device *dev)
+{
+  b->dev = dev;
+  b->idx = 0;
+  b->nb_frames = 0;
+  b->nb_flush = 0;
+  b->device.periph = (void *)b;
+  b->device.check_free_space = (check_free_space_t) batch_device_check_free_space;
+  b->device.put_byte = (put_byte_t) batch_device_put_byte;
+  b->device.put_buffer = (put_buffer_t) batch_device_put_buffer;
+  b->device.send_message = (send_message_t) batch_device_send_message;
+  b->device.char_available = (char_available_t) batch_device_char_available;
+  b->device.get_byte = (get_byte_t) batch_device_get_byte;
+  b->device.set_baudrate = (set_baudrate_t) batch_device_set_baudrate;
+  b->device.nb_msgs = 0;
+  b->device.nb_ovrn = 0;
+  b->device.nb_bytes = 0;
+}
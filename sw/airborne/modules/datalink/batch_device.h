@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file modules/datalink/batch_device.h
+ *  \brief Batch the frames sent on a device into a single device write
+ *
+ *  A batch device sits between a transport (pprz_tp, pprzlog_tp, ...) and
+ *  the real device. Complete frames are accumulated in a buffer and written
+ *  with one transaction when flushed, typically once per telemetry tick.
+ *  Frames are not modified, so the ground side parses them as usual.
+ */
+
+#ifndef BATCH_DEVICE_H
+#define BATCH_DEVICE_H
+
+#include "std.h"
+#include "pprzlink/pprzlink_device.h"
+
+/** Size of the batch buffer.
+ *  Frames are written in groups fitting in the tx buffer of the real device,
+ *  so that a larger batch is split in several writes (UDP datagrams for instance).
+ */
+#ifndef BATCH_DEVICE_BUFFER_SIZE
+#define BATCH_DEVICE_BUFFER_SIZE 1024
+#endif
+
+/** Maximum number of frames in a batch */
+#ifndef BATCH_DEVICE_MAX_FRAMES
+#define BATCH_DEVICE_MAX_FRAMES 64
+#endif
+
+struct batch_device {
+  struct link_device device;              ///< device interface given to the transports
+  struct link_device *dev;                ///< real device
+  uint8_t buf[BATCH_DEVICE_BUFFER_SIZE];  ///< pending frames
+  uint16_t idx;                           ///< number of pending bytes
+  uint16_t ends[BATCH_DEVICE_MAX_FRAMES]; ///< end of each pending frame in the buffer
+  uint8_t nb_frames;                      ///< number of pending frames
+  uint32_t nb_flush;                      ///< number of writes to the real device
+};
+
+/** Init a batch device
+ * @param b batch device
+ * @param dev real device
+ */
+extern void batch_device_init(struct batch_device *b, struct link_device *dev);
+
+/** Write the pending frames to the real device
+ * @param b batch device
+ */
+extern void batch_device_flush(struct batch_device *b);
+
+#endif /* BATCH_DEVICE_H */
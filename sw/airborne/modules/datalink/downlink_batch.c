@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file modules/datalink/downlink_batch.c
+ *  \brief Send all downlink frames of a telemetry tick with one device write
+ */
+
+#include "modules/datalink/downlink_batch.h"
+#include "modules/datalink/pprz_dl.h"
+
+#ifndef DOWNLINK_BATCH_DEVICE
+#define DOWNLINK_BATCH_DEVICE DOWNLINK_DEVICE
+#endif
+
+struct batch_device downlink_batch;
+
+void downlink_batch_init(void)
+{
+  batch_device_init(&downlink_batch, &(DOWNLINK_BATCH_DEVICE).device);
+}
+
+/** Frames sent since the last call (periodic telemetry tick,
+ *  datalink replies, ...) are written at once
+ */
+void downlink_batch_event(void)
+{
+  batch_device_flush(&downlink_batch);
+}
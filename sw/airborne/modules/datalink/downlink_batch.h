@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** \file modules/datalink/downlink_batch.h
+ *  \brief Send all downlink frames of a telemetry tick with one device write
+ */
+
+#ifndef DOWNLINK_BATCH_H
+#define DOWNLINK_BATCH_H
+
+#include "modules/datalink/batch_device.h"
+
+/** Batch device of the downlink, used as DefaultDevice */
+extern struct batch_device downlink_batch;
+
+/** Init function */
+extern void downlink_batch_init(void);
+
+/** Flush the frames sent since the last call */
+extern void downlink_batch_event(void);
+
+#endif /* DOWNLINK_BATCH_H */
@@ -26,6 +26,8 @@
 #include "modules/datalink/pprz_dl.h"
 #include "subsystems/datalink/datalink.h"
 
+#include <string.h>
+
 struct pprz_transport pprz_tp;
 
 void pprz_dl_init(void)
@@ -33,8 +35,37 @@ void pprz_dl_init(void)
   pprz_transport_init(&pprz_tp);
 }
 
+#if USE_UDP
+/**
+ * Parse all the bytes received by an UDP peripheral, read in bulk.
+ * Each complete message is handled before parsing the next one
+ * since they are decoded in the single dl_buffer.
+ */
+static void pprz_dl_udp_event(struct udp_periph *udp)
+{
+  uint8_t buf[UDP_RX_BUFFER_SIZE];
+  uint16_t len = udp_read(udp, buf, sizeof(buf));
+  for (uint16_t i = 0; i < len; i++) {
+    parse_pprz(&pprz_tp, buf[i]);
+    if (pprz_tp.trans_rx.msg_received) {
+      memcpy(dl_buffer, pprz_tp.trans_rx.payload, pprz_tp.trans_rx.payload_len);
+      dl_msg_available = true;
+      pprz_tp.trans_rx.msg_received = false;
+      DlCheckAndParse(&DOWNLINK_DEVICE.device, &pprz_tp.trans_tx, dl_buffer);
+    }
+  }
+}
+#endif
+
 void pprz_dl_event(void)
 {
+#if USE_UDP
+  /* bulk read when the datalink device is an UDP peripheral */
+  if (DOWNLINK_DEVICE.device.get_byte == (get_byte_t) udp_getch) {
+    pprz_dl_udp_event((struct udp_periph *)DOWNLINK_DEVICE.device.periph);
+    return;
+  }
+#endif
   pprz_check_and_parse(&DOWNLINK_DEVICE.device, &pprz_tp, dl_buffer, &dl_msg_available);
   DlCheckAndParse(&DOWNLINK_DEVICE.device, &pprz_tp.trans_tx, dl_buffer);
 }
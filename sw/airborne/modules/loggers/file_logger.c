@@ -22,24 +22,202 @@
 
 /** @file modules/loggers/file_logger.c
  *  @brief File logger for Linux based autopilots
+ *
+ *  Fixed layout binary records are pushed by the periodic function into a
+ *  lock-free ring, a background thread writes the ring to the file by large
+ *  aligned blocks. The file starts with a header block describing the record
+ *  layout, see sw/logalizer/file_logger_convert.c to convert it to CSV or columns.
  */
 
+#define _GNU_SOURCE // O_DIRECT, fallocate
 #include "file_logger.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
 #include "std.h"
 
 #include "subsystems/imu.h"
 #include "firmwares/rotorcraft/stabilization.h"
 #include "state.h"
+#include "mcu_periph/sys_time.h"
 
 /** Set the default File logger path to the USB drive */
 #ifndef FILE_LOGGER_PATH
 #define FILE_LOGGER_PATH /data/video/usb
 #endif
 
-/** The file pointer */
-static FILE *file_logger = NULL;
+/** Size of the blocks written to the file (multiple of 4096) */
+#ifndef FILE_LOGGER_BLOCK_SIZE
+#define FILE_LOGGER_BLOCK_SIZE (64 * 1024)
+#endif
+
+/** Number of blocks in the ring between the periodic function and the writer */
+#ifndef FILE_LOGGER_RING_BLOCKS
+#define FILE_LOGGER_RING_BLOCKS 16
+#endif
+
+/** Space reserved on disk when the file is created, in bytes (0 to disable) */
+#ifndef FILE_LOGGER_PREALLOCATE
+#define FILE_LOGGER_PREALLOCATE (64 * 1024 * 1024)
+#endif
+
+/** Writer thread polling period in microseconds */
+#ifndef FILE_LOGGER_WRITER_PERIOD
+#define FILE_LOGGER_WRITER_PERIOD 20000
+#endif
+
+#define FILE_LOGGER_RING_SIZE (FILE_LOGGER_BLOCK_SIZE * FILE_LOGGER_RING_BLOCKS)
+#define FILE_LOGGER_HEADER_SIZE 4096
+#define FILE_LOGGER_MAGIC "PPRZBLG"
+#define FILE_LOGGER_VERSION 1
+
+#define FileLoggerIdxLoad(_idx) __atomic_load_n(&(_idx), __ATOMIC_ACQUIRE)
+#define FileLoggerIdxStore(_idx, _val) __atomic_store_n(&(_idx), (_val), __ATOMIC_RELEASE)
+
+/** One log record, written as is in the file */
+struct __attribute__((packed)) file_logger_record {
+  uint32_t counter;
+  uint32_t time;    ///< usec since startup
+  int32_t gyro_unscaled_p;
+  int32_t gyro_unscaled_q;
+  int32_t gyro_unscaled_r;
+  int32_t accel_unscaled_x;
+  int32_t accel_unscaled_y;
+  int32_t accel_unscaled_z;
+  int32_t mag_unscaled_x;
+  int32_t mag_unscaled_y;
+  int32_t mag_unscaled_z;
+  int32_t cmd_thrust;
+  int32_t cmd_roll;
+  int32_t cmd_pitch;
+  int32_t cmd_yaw;
+  int32_t qi;
+  int32_t qx;
+  int32_t qy;
+  int32_t qz;
+};
+
+/** Field description in the file header */
+struct __attribute__((packed)) file_logger_field {
+  char name[28];
+  char type;        ///< 'i' signed integer, 'u' unsigned integer, 'f' float
+  uint8_t size;     ///< size in bytes
+  uint16_t offset;  ///< offset in the record
+};
+
+/** File header, padded to FILE_LOGGER_HEADER_SIZE, little endian */
+struct __attribute__((packed)) file_logger_header {
+  char magic[8];
+  uint16_t version;
+  uint16_t header_size;
+  uint16_t record_size;
+  uint16_t nb_fields;
+  struct file_logger_field fields[];
+};
+
+#define FILE_LOGGER_FIELD(_type, _name) \
+  { #_name, _type, sizeof(((struct file_logger_record *)0)->_name), offsetof(struct file_logger_record, _name) }
+
+static const struct file_logger_field file_logger_fields[] = {
+  FILE_LOGGER_FIELD('u', counter),
+  FILE_LOGGER_FIELD('u', time),
+  FILE_LOGGER_FIELD('i', gyro_unscaled_p),
+  FILE_LOGGER_FIELD('i', gyro_unscaled_q),
+  FILE_LOGGER_FIELD('i', gyro_unscaled_r),
+  FILE_LOGGER_FIELD('i', accel_unscaled_x),
+  FILE_LOGGER_FIELD('i', accel_unscaled_y),
+  FILE_LOGGER_FIELD('i', accel_unscaled_z),
+  FILE_LOGGER_FIELD('i', mag_unscaled_x),
+  FILE_LOGGER_FIELD('i', mag_unscaled_y),
+  FILE_LOGGER_FIELD('i', mag_unscaled_z),
+  FILE_LOGGER_FIELD('i', cmd_thrust),
+  FILE_LOGGER_FIELD('i', cmd_roll),
+  FILE_LOGGER_FIELD('i', cmd_pitch),
+  FILE_LOGGER_FIELD('i', cmd_yaw),
+  FILE_LOGGER_FIELD('i', qi),
+  FILE_LOGGER_FIELD('i', qx),
+  FILE_LOGGER_FIELD('i', qy),
+  FILE_LOGGER_FIELD('i', qz),
+};
+
+#define FILE_LOGGER_NB_FIELDS (sizeof(file_logger_fields) / sizeof(file_logger_fields[0]))
+
+#if FILE_LOGGER_BLOCK_SIZE % 4096 || FILE_LOGGER_RING_BLOCKS < 2
+#error "FILE_LOGGER_BLOCK_SIZE should be a multiple of 4096 and FILE_LOGGER_RING_BLOCKS at least 2"
+#endif
+
+/** Logger state, the ring is written by the periodic function and read by the writer thread */
+static struct {
+  int fd;
+  uint8_t *ring;            ///< block aligned ring buffer
+  uint32_t insert_idx;      ///< bytes pushed, only written by the periodic function
+  uint32_t extract_idx;     ///< bytes written to the file, only written by the writer
+  uint32_t dropped;         ///< records lost because the ring was full
+  bool running;
+  pthread_t writer;
+} file_logger = { .fd = -1 };
+
+/** Write a block aligned buffer, retrying on short writes */
+static int file_logger_write(const uint8_t *buf, size_t len)
+{
+  while (len > 0) {
+    ssize_t n = write(file_logger.fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/** Write thread: write every full block of the ring */
+static void *file_logger_writer(void *data __attribute__((unused)))
+{
+  while (FileLoggerIdxLoad(file_logger.running)) {
+    uint32_t extract = file_logger.extract_idx;
+    while (FileLoggerIdxLoad(file_logger.insert_idx) - extract >= FILE_LOGGER_BLOCK_SIZE) {
+      // the ring is a multiple of the block size, a block never wraps
+      if (file_logger_write(&file_logger.ring[extract % FILE_LOGGER_RING_SIZE], FILE_LOGGER_BLOCK_SIZE) < 0) {
+        perror("[file_logger] write failed");
+      }
+      extract += FILE_LOGGER_BLOCK_SIZE;
+      FileLoggerIdxStore(file_logger.extract_idx, extract);
+    }
+    usleep(FILE_LOGGER_WRITER_PERIOD);
+  }
+  return NULL;
+}
+
+/** Open the file, direct I/O if supported by the file system */
+static int file_logger_open(const char *filename)
+{
+  int fd = open(filename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd >= 0) {
+    // O_DIRECT is set afterwards, an open with O_CREAT can create the file and still fail on it.
+    // Ignored when the file system does not support it, all writes are whole aligned blocks anyway.
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) {
+      fcntl(fd, F_SETFL, flags | O_DIRECT);
+    }
+  }
+#if FILE_LOGGER_PREALLOCATE
+  if (fd >= 0) {
+    // reserve the space without changing the file size, ignored if not supported
+    fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, FILE_LOGGER_PREALLOCATE);
+  }
+#endif
+  return fd;
+}
 
 /** Start the file logger and open a new file */
 void file_logger_start(void)
@@ -47,62 +225,135 @@ void file_logger_start(void)
   uint32_t counter = 0;
   char filename[512];
 
-  // Check for available files
-  sprintf(filename, "%s/%05d.csv", STRINGIFY(FILE_LOGGER_PATH), counter);
-  while ((file_logger = fopen(filename, "r"))) {
-    fclose(file_logger);
+  if (file_logger.fd >= 0) {
+    return;
+  }
 
+  // Check for available files
+  do {
+    sprintf(filename, "%s/%05d.bin", STRINGIFY(FILE_LOGGER_PATH), counter);
+    file_logger.fd = file_logger_open(filename);
     counter++;
-    sprintf(filename, "%s/%05d.csv", STRINGIFY(FILE_LOGGER_PATH), counter);
+  } while (file_logger.fd < 0 && errno == EEXIST);
+
+  if (file_logger.fd < 0) {
+    printf("[file_logger] Could not open %s: %s\n", filename, strerror(errno));
+    return;
   }
 
-  file_logger = fopen(filename, "w");
+  if (posix_memalign((void **)&file_logger.ring, 4096, FILE_LOGGER_RING_SIZE) != 0) {
+    printf("[file_logger] Could not allocate the ring buffer\n");
+    close(file_logger.fd);
+    file_logger.fd = -1;
+    return;
+  }
 
-  if (file_logger != NULL) {
-    fprintf(
-      file_logger,
-      "counter,gyro_unscaled_p,gyro_unscaled_q,gyro_unscaled_r,accel_unscaled_x,accel_unscaled_y,accel_unscaled_z,mag_unscaled_x,mag_unscaled_y,mag_unscaled_z,COMMAND_THRUST,COMMAND_ROLL,COMMAND_PITCH,COMMAND_YAW,qi,qx,qy,qz\n"
-    );
+  // Self describing header block
+  struct file_logger_header *header = (struct file_logger_header *)file_logger.ring;
+  memset(header, 0, FILE_LOGGER_HEADER_SIZE);
+  memcpy(header->magic, FILE_LOGGER_MAGIC, sizeof(FILE_LOGGER_MAGIC));
+  header->version = FILE_LOGGER_VERSION;
+  header->header_size = FILE_LOGGER_HEADER_SIZE;
+  header->record_size = sizeof(struct file_logger_record);
+  header->nb_fields = FILE_LOGGER_NB_FIELDS;
+  memcpy(header->fields, file_logger_fields, sizeof(file_logger_fields));
+  if (file_logger_write(file_logger.ring, FILE_LOGGER_HEADER_SIZE) < 0) {
+    perror("[file_logger] write failed");
+  }
+
+  file_logger.insert_idx = 0;
+  file_logger.extract_idx = 0;
+  file_logger.dropped = 0;
+  file_logger.running = true;
+  if (pthread_create(&file_logger.writer, NULL, file_logger_writer, NULL) != 0) {
+    printf("[file_logger] Could not create the writer thread\n");
+    file_logger.running = false;
+    free(file_logger.ring);
+    close(file_logger.fd);
+    file_logger.fd = -1;
   }
 }
 
 /** Stop the logger an nicely close the file */
 void file_logger_stop(void)
 {
-  if (file_logger != NULL) {
-    fclose(file_logger);
-    file_logger = NULL;
+  if (file_logger.fd < 0) {
+    return;
+  }
+
+  FileLoggerIdxStore(file_logger.running, false);
+  pthread_join(file_logger.writer, NULL);
+
+  // write the remaining blocks, the last one padded, then cut the padding
+  uint32_t extract = file_logger.extract_idx;
+  uint32_t insert = file_logger.insert_idx;
+  while (extract != insert) {
+    uint32_t offset = extract % FILE_LOGGER_RING_SIZE;
+    uint32_t len = Min(insert - extract, FILE_LOGGER_BLOCK_SIZE);
+    memset(&file_logger.ring[offset + len], 0, FILE_LOGGER_BLOCK_SIZE - len);
+    if (file_logger_write(&file_logger.ring[offset], FILE_LOGGER_BLOCK_SIZE) < 0) {
+      perror("[file_logger] write failed");
+    }
+    extract += len;
+  }
+  if (ftruncate(file_logger.fd, FILE_LOGGER_HEADER_SIZE + (off_t)insert) < 0) {
+    perror("[file_logger] truncate failed");
+  }
+
+  close(file_logger.fd);
+  file_logger.fd = -1;
+  free(file_logger.ring);
+  file_logger.ring = NULL;
+  if (file_logger.dropped > 0) {
+    printf("[file_logger] %u records dropped\n", file_logger.dropped);
+  }
+}
+
+/** Push a record in the ring, never blocks */
+static void file_logger_push(const struct file_logger_record *record)
+{
+  uint32_t insert = file_logger.insert_idx;
+  if (FILE_LOGGER_RING_SIZE - (insert - FileLoggerIdxLoad(file_logger.extract_idx)) < sizeof(*record)) {
+    file_logger.dropped++;
+    return;
   }
+  uint32_t offset = insert % FILE_LOGGER_RING_SIZE;
+  uint32_t len = Min(sizeof(*record), FILE_LOGGER_RING_SIZE - offset);
+  memcpy(&file_logger.ring[offset], record, len);
+  memcpy(file_logger.ring, (const uint8_t *)record + len, sizeof(*record) - len);
+  FileLoggerIdxStore(file_logger.insert_idx, insert + sizeof(*record));
 }
 
-/** Log the values to a csv file */
+/** Log the values to the ring */
 void file_logger_periodic(void)
 {
-  if (file_logger == NULL) {
+  if (file_logger.fd < 0) {
     return;
   }
   static uint32_t counter;
   struct Int32Quat *quat = stateGetNedToBodyQuat_i();
 
-  fprintf(file_logger, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
-          counter,
-          imu.gyro_unscaled.p,
-          imu.gyro_unscaled.q,
-          imu.gyro_unscaled.r,
-          imu.accel_unscaled.x,
-          imu.accel_unscaled.y,
-          imu.accel_unscaled.z,
-          imu.mag_unscaled.x,
-          imu.mag_unscaled.y,
-          imu.mag_unscaled.z,
-          stabilization_cmd[COMMAND_THRUST],
-          stabilization_cmd[COMMAND_ROLL],
-          stabilization_cmd[COMMAND_PITCH],
-          stabilization_cmd[COMMAND_YAW],
-          quat->qi,
-          quat->qx,
-          quat->qy,
-          quat->qz
-         );
+  struct file_logger_record record = {
+    .counter = counter,
+    .time = get_sys_time_usec(),
+    .gyro_unscaled_p = imu.gyro_unscaled.p,
+    .gyro_unscaled_q = imu.gyro_unscaled.q,
+    .gyro_unscaled_r = imu.gyro_unscaled.r,
+    .accel_unscaled_x = imu.accel_unscaled.x,
+    .accel_unscaled_y = imu.accel_unscaled.y,
+    .accel_unscaled_z = imu.accel_unscaled.z,
+    .mag_unscaled_x = imu.mag_unscaled.x,
+    .mag_unscaled_y = imu.mag_unscaled.y,
+    .mag_unscaled_z = imu.mag_unscaled.z,
+    .cmd_thrust = stabilization_cmd[COMMAND_THRUST],
+    .cmd_roll = stabilization_cmd[COMMAND_ROLL],
+    .cmd_pitch = stabilization_cmd[COMMAND_PITCH],
+    .cmd_yaw = stabilization_cmd[COMMAND_YAW],
+    .qi = quat->qi,
+    .qx = quat->qx,
+    .qy = quat->qy,
+    .qz = quat->qz,
+  };
+  file_logger_push(&record);
   counter++;
 }
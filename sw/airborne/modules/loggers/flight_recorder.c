@@ -45,6 +45,15 @@ struct chibios_sdlog flightrecorder_sdlog;
 #include "subsystems/datalink/downlink.h"
 #endif
 
+/** Write the frames of a telemetry tick at once */
+#if FLIGHTRECORDER_BATCH
+#include "modules/datalink/batch_device.h"
+static struct batch_device flightrecorder_batch;
+#define FLIGHTRECORDER_TX_DEVICE flightrecorder_batch
+#else
+#define FLIGHTRECORDER_TX_DEVICE FLIGHTRECORDER_DEVICE
+#endif
+
 #ifndef TELEMETRY_PROCESS_FlightRecorder
 #error "You need to use a telemetry xml file with FlightRecorder process!"
 #endif
@@ -54,6 +63,9 @@ void flight_recorder_init()
 #if FLIGHTRECORDER_SDLOG
   chibios_sdlog_init(&flightrecorder_sdlog, &flightRecorderLogFile);
 #endif
+#if FLIGHTRECORDER_BATCH
+  batch_device_init(&flightrecorder_batch, &(FLIGHTRECORDER_DEVICE).device);
+#endif
 }
 
 void flight_recorder_periodic()
@@ -64,7 +76,10 @@ void flight_recorder_periodic()
 #endif
 
 #if PERIODIC_TELEMETRY
-  periodic_telemetry_send_FlightRecorder(DefaultPeriodic, &pprzlog_tp.trans_tx, &(FLIGHTRECORDER_DEVICE).device);
+  periodic_telemetry_send_FlightRecorder(DefaultPeriodic, &pprzlog_tp.trans_tx, &(FLIGHTRECORDER_TX_DEVICE).device);
+#if FLIGHTRECORDER_BATCH
+  batch_device_flush(&flightrecorder_batch);
+#endif
 #endif
 }
 
@@ -20,63 +20,150 @@
 /**
  * @file "modules/pose_history/pose_history.c"
  * @author Roland Meertens
- * Ask this module for the pose the drone had closest to a given timestamp
+ * Ask this module for the pose the drone had at a given timestamp
+ * The history is a single writer ring that readers never lock: the samples are
+ * found by binary search on their timestamps and interpolated.
  */
 
 #include "modules/pose_history/pose_history.h"
-#include <sys/time.h>
 #include "mcu_periph/sys_time.h"
 #include "state.h"
-#ifdef __linux__
-#include <pthread.h>
-#endif
+#include <string.h>
 
 #ifndef POSE_HISTORY_SIZE
 #define POSE_HISTORY_SIZE 1024
 #endif
 
 struct rotation_history_ring_buffer_t {
-  uint32_t ring_index;
-  uint32_t ring_size;
+  uint32_t head;        ///< Number of poses written, the next pose goes to ring_data[head % POSE_HISTORY_SIZE]
   struct pose_t ring_data[POSE_HISTORY_SIZE];
 };
 
 struct rotation_history_ring_buffer_t location_history;
 
-#ifdef __linux__
-pthread_mutex_t pose_mutex;
-#endif
+/** Publish/read the head of the ring, the poses before head are complete */
+#define PoseHeadLoad() __atomic_load_n(&location_history.head, __ATOMIC_ACQUIRE)
+#define PoseHeadStore(_v) __atomic_store_n(&location_history.head, _v, __ATOMIC_RELEASE)
+
+/**
+ * Spherical linear interpolation between two unit quaternions
+ * @param[out] q interpolated quaternion
+ * @param[in] q1 quaternion at t = 0
+ * @param[in] q2 quaternion at t = 1
+ * @param[in] t interpolation factor [0, 1]
+ */
+static void pose_quat_slerp(struct FloatQuat *q, struct FloatQuat *q1, struct FloatQuat *q2, float t)
+{
+  struct FloatQuat q2s = *q2;
+  float cos_theta = q1->qi * q2->qi + q1->qx * q2->qx + q1->qy * q2->qy + q1->qz * q2->qz;
+
+  // take the shortest path
+  if (cos_theta < 0.f) {
+    QUAT_EXPLEMENTARY(q2s, *q2);
+    cos_theta = -cos_theta;
+  }
+
+  float s1, s2;
+  if (cos_theta > 0.9995f) {
+    // nearly the same rotation, linear interpolation is accurate and avoids the division
+    s1 = 1.f - t;
+    s2 = t;
+  } else {
+    float theta = acosf(cos_theta);
+    float sin_theta = sinf(theta);
+    s1 = sinf((1.f - t) * theta) / sin_theta;
+    s2 = sinf(t * theta) / sin_theta;
+  }
+  q->qi = s1 * q1->qi + s2 * q2s.qi;
+  q->qx = s1 * q1->qx + s2 * q2s.qx;
+  q->qy = s1 * q1->qy + s2 * q2s.qy;
+  q->qz = s1 * q1->qz + s2 * q2s.qz;
+  float_quat_normalize(q);
+}
+
+/**
+ * Interpolate between two poses
+ * @param[out] pose interpolated pose
+ * @param[in] p1 pose at t = 0
+ * @param[in] p2 pose at t = 1
+ * @param[in] t interpolation factor [0, 1]
+ */
+static void pose_interpolate(struct pose_t *pose, struct pose_t *p1, struct pose_t *p2, float t)
+{
+  pose_quat_slerp(&pose->quat, &p1->quat, &p2->quat, t);
+  float_eulers_of_quat(&pose->eulers, &pose->quat);
+  pose->rates.p = p1->rates.p + t * (p2->rates.p - p1->rates.p);
+  pose->rates.q = p1->rates.q + t * (p2->rates.q - p1->rates.q);
+  pose->rates.r = p1->rates.r + t * (p2->rates.r - p1->rates.r);
+  struct NedCoor_f diff;
+  VECT3_DIFF(diff, p2->pos, p1->pos);
+  VECT3_SUM_SCALED(pose->pos, p1->pos, diff, t);
+  VECT3_DIFF(diff, p2->speed, p1->speed);
+  VECT3_SUM_SCALED(pose->speed, p1->speed, diff, t);
+}
 
 /**
- * Given a pprz timestamp in used (obtained with get_sys_time_usec) we return the pose in FloatEulers closest to that time.
+ * Given a pprz timestamp in us (obtained with get_sys_time_usec) we return the pose the drone had at that time,
+ * interpolated between the two surrounding samples. Outside of the history the oldest or newest pose is returned.
+ * This never blocks the writer: the search is repeated in the rare case the ring wrapped over the samples
+ * while they were read.
  */
 struct pose_t get_rotation_at_timestamp(uint32_t timestamp)
 {
-#ifdef __linux__
-  pthread_mutex_lock(&pose_mutex);
-#endif
-  uint32_t index_history = 0;
-  uint32_t closestTimeDiff = abs(timestamp - location_history.ring_data[0].timestamp);
-  uint32_t closestIndex = 0;
-
-  // Seach for the timestamp closes to the timestamp argument of this function.
-  for (index_history = 0; index_history < location_history.ring_size; index_history++) {
-    uint32_t diff = abs(timestamp - location_history.ring_data[index_history].timestamp);
-    if (diff < closestTimeDiff) {
-      closestIndex = index_history;
-      closestTimeDiff = diff;
+  struct pose_t pose;
+  struct pose_t p1, p2;
+  uint32_t head, first;
+
+  do {
+    head = PoseHeadLoad();
+    if (head == 0) {
+      // No history yet
+      memset(&pose, 0, sizeof(pose));
+      float_quat_identity(&pose.quat);
+      pose.timestamp = timestamp;
+      return pose;
     }
-  }
 
-  // Save the pose closest to the given timestamp and return this
-  struct pose_t closest_pose;
-  closest_pose.eulers = location_history.ring_data[closestIndex].eulers;
-  closest_pose.rates = location_history.ring_data[closestIndex].rates;
+    // The slot of the pose being written is excluded
+    first = (head > POSE_HISTORY_SIZE - 1) ? head - (POSE_HISTORY_SIZE - 1) : 0;
+    uint32_t t0 = location_history.ring_data[first % POSE_HISTORY_SIZE].timestamp;
 
-#ifdef __linux__
-  pthread_mutex_unlock(&pose_mutex);
-#endif
-  return closest_pose;
+    // Times relative to the oldest pose are monotonic, also when the sys time wraps
+    uint32_t dt = timestamp - t0;
+    if ((int32_t)dt < 0) {
+      dt = 0;
+    }
+
+    // Binary search of the last pose at or before the timestamp
+    uint32_t lo = first, hi = head - 1;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo + 1) / 2;
+      if (location_history.ring_data[mid % POSE_HISTORY_SIZE].timestamp - t0 <= dt) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+
+    p1 = location_history.ring_data[lo % POSE_HISTORY_SIZE];
+    p2 = location_history.ring_data[((lo + 1 < head) ? lo + 1 : lo) % POSE_HISTORY_SIZE];
+    first = lo;
+
+    // Make sure the poses were not overwritten while reading them
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (PoseHeadLoad() >= first + POSE_HISTORY_SIZE);
+
+  uint32_t dt1 = timestamp - p1.timestamp;
+  uint32_t dt12 = p2.timestamp - p1.timestamp;
+  if ((int32_t)dt1 <= 0 || dt12 == 0) {
+    pose = p1;
+  } else if (dt1 >= dt12) {
+    pose = p2;
+  } else {
+    pose_interpolate(&pose, &p1, &p2, (float)dt1 / (float)dt12);
+  }
+  pose.timestamp = timestamp;
+  return pose;
 }
 
 /**
@@ -84,8 +171,7 @@ struct pose_t get_rotation_at_timestamp(uint32_t timestamp)
  */
 void pose_init()
 {
-  location_history.ring_index = 0;
-  location_history.ring_size = POSE_HISTORY_SIZE;
+  location_history.head = 0;
 }
 
 
@@ -94,22 +180,15 @@ void pose_init()
  */
 void pose_periodic()
 {
-  uint32_t now_ts = get_sys_time_usec();
-#ifdef __linux__
-  pthread_mutex_lock(&pose_mutex);
-#endif
-  struct pose_t *current_time_and_rotation = &location_history.ring_data[location_history.ring_index];
+  uint32_t head = location_history.head;
+  struct pose_t *current_time_and_rotation = &location_history.ring_data[head % POSE_HISTORY_SIZE];
+  current_time_and_rotation->timestamp = get_sys_time_usec();
   current_time_and_rotation->eulers = *stateGetNedToBodyEulers_f();
+  current_time_and_rotation->quat = *stateGetNedToBodyQuat_f();
   current_time_and_rotation->rates = *stateGetBodyRates_f();
+  current_time_and_rotation->pos = *stateGetPositionNed_f();
+  current_time_and_rotation->speed = *stateGetSpeedNed_f();
 
-  current_time_and_rotation->timestamp = now_ts;
-
-  // increase index location history
-  location_history.ring_index = (location_history.ring_index + 1) % location_history.ring_size;
-
-#ifdef __linux__
-  pthread_mutex_unlock(&pose_mutex);
-#endif
+  // publish the pose
+  PoseHeadStore(head + 1);
 }
-
-
@@ -27,11 +27,15 @@
 #define POSE_HISTORY_H
 
 #include "math/pprz_algebra_float.h"
+#include "math/pprz_geodetic_float.h"
 
 struct pose_t {
-  uint32_t timestamp;
-  struct FloatEulers eulers;
-  struct FloatRates rates;
+  uint32_t timestamp;         ///< Time of the pose in us since system startup
+  struct FloatEulers eulers;  ///< Attitude as euler angles (of the interpolated quaternion)
+  struct FloatQuat quat;      ///< Attitude as quaternion (spherical linear interpolation)
+  struct FloatRates rates;    ///< Body rates (linear interpolation)
+  struct NedCoor_f pos;       ///< Position in NED (linear interpolation)
+  struct NedCoor_f speed;     ///< Speed in NED (linear interpolation)
 };
 
 extern void pose_init(void);
@@ -34,10 +34,19 @@
 #define VIDEO_FILTER_DEBAYER  (0x1 << 0)  ///<Enable software debayer
 #define VIDEO_FILTER_ISP      (0x1 << 1)  ///<Enable ISP
 
+/** Timing statistics of a video thread, latencies are low pass filtered in us since frame capture */
+struct video_thread_stats {
+  uint32_t frames;                ///< Number of processed frames
+  uint16_t overruns;              ///< Number of frame deadlines missed by more than a period
+  float dequeue_latency;          ///< Time from frame capture until it was dequeued
+  float filter_latency;           ///< Time from frame capture until the end of the filters
+};
+
 // Main video_thread structure
 struct video_thread_t {
   volatile bool is_running;       ///< When the device is running
   struct v4l2_device *dev;        ///< The V4L2 device that is used for the video stream
+  struct video_thread_stats stats; ///< Timing statistics of the thread
 };
 
 /** V4L2 device settings */
@@ -50,6 +59,7 @@ struct video_config_t {
   uint32_t format;          ///< Video format
   uint32_t subdev_format;   ///< Subdevice video format
   uint8_t buf_cnt;          ///< Amount of V4L2 video device buffers
+  uint8_t queue_size;       ///< Frames queued in order for the processing (0 or 1: only the latest frame)
   uint8_t filters;          ///< filters to use (bitfield with VIDEO_FILTER_x)
   struct video_thread_t thread; ///< Information about the thread this camera is running on
   struct video_listener *cv_listener; ///< The first computer vision listener in the linked list for this video device
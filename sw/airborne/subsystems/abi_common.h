@@ -69,6 +69,16 @@ struct abi_struct {
 };
 typedef struct abi_struct abi_event;
 
+/** Wake up the event loop after a message was sent from another thread,
+ * the callbacks may have left work for the event functions of the main loop.
+ */
+#if USE_EVENT_LOOP
+#include "mcu_periph/sys_time.h"
+#define ABI_EVENT_NOTIFY() sys_time_event_notify_from_thread()
+#else
+#define ABI_EVENT_NOTIFY() {}
+#endif
+
 /** Macros for linked list */
 #define ABI_FOREACH(head,el) for(el=head; el; el=el->next)
 #define ABI_PREPEND(head,add) { (add)->next = head; head = add; }
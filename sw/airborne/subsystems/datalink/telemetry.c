@@ -66,6 +66,214 @@ int8_t register_periodic_telemetry(struct periodic_telemetry *_pt, uint8_t _id,
   return -1;
 }
 
+#if PERIODIC_TELEMETRY_ADAPTIVE
+
+#define TELEMETRY_ADAPTIVE_TICKS ((uint16_t)(TELEMETRY_ADAPTIVE_PERIOD * TELEMETRY_FREQUENCY))
+
+/** Bandwidth of a message in bytes/s at its current period */
+static uint32_t sched_msg_rate(struct telemetry_sched_msg *m)
+{
+  if (m->period == 0) { return 0; }
+  return ((uint32_t)m->size * TELEMETRY_FREQUENCY) / m->period;
+}
+
+/** Bandwidth of all messages in bytes/s at their current periods */
+static uint32_t sched_demand(struct telemetry_sched *s)
+{
+  uint32_t demand = 0;
+  for (uint8_t i = 0; i < s->nb; i++) {
+    demand += sched_msg_rate(&s->msgs[i]);
+  }
+  return demand;
+}
+
+/** Start scheduling a new messages table at nominal rates */
+static void sched_reset(struct telemetry_sched *s, struct telemetry_sched_msg *msgs, uint8_t nb)
+{
+  s->msgs = msgs;
+  s->nb = nb;
+  s->tokens = 0;
+  s->credit = 0;
+  s->sent = 0;
+  s->ticks = 0;
+  s->congested = false;
+  s->degraded = 0;
+  s->dropped = 0;
+  for (uint8_t i = 0; i < nb; i++) {
+    msgs[i].period = msgs[i].period_min;
+    // spread the first messages like the static scheduler: 1 message every 10Hz
+    msgs[i].counter = (uint16_t)(((uint32_t)i * (TELEMETRY_FREQUENCY / 10)) % msgs[i].period_min);
+  }
+}
+
+/** Slow down, or drop if already at its slowest rate, the lowest priority message
+ *  with the highest bandwidth.
+ * @return false if nothing can be degraded anymore
+ */
+static bool sched_degrade(struct telemetry_sched *s)
+{
+  struct telemetry_sched_msg *best = NULL;
+  for (uint8_t i = 0; i < s->nb; i++) {
+    struct telemetry_sched_msg *m = &s->msgs[i];
+    if (m->period == 0 || (m->period >= m->period_max && m->priority == TELEMETRY_PRIORITY_CRITICAL)) {
+      continue;
+    }
+    // all messages are slowed down to their max period before any is dropped
+    bool droppable = m->period >= m->period_max;
+    bool best_droppable = best != NULL && best->period >= best->period_max;
+    if (best == NULL || (best_droppable && !droppable) ||
+        (best_droppable == droppable && (m->priority > best->priority ||
+            (m->priority == best->priority && sched_msg_rate(m) > sched_msg_rate(best))))) {
+      best = m;
+    }
+  }
+  if (best == NULL) {
+    return false;
+  }
+  if (best->period >= best->period_max) {
+    if (best->period != best->period_min) {
+      s->degraded--;
+    }
+    best->period = 0;
+    s->dropped++;
+  } else {
+    if (best->period == best->period_min) {
+      s->degraded++;
+    }
+    best->period = Min((uint32_t)best->period * 2, best->period_max);
+  }
+  return true;
+}
+
+/** Speed up, or restore if dropped, the highest priority degraded message
+ *  if the predicted demand stays below the restore threshold.
+ */
+static void sched_restore(struct telemetry_sched *s, uint32_t demand)
+{
+  struct telemetry_sched_msg *best = NULL;
+  for (uint8_t i = 0; i < s->nb; i++) {
+    struct telemetry_sched_msg *m = &s->msgs[i];
+    if (m->period == m->period_min) {
+      continue;
+    }
+    // dropped messages are restored first, at their slowest rate
+    bool dropped = m->period == 0;
+    bool best_dropped = best != NULL && best->period == 0;
+    if (best == NULL || (dropped && !best_dropped) ||
+        (dropped == best_dropped && m->priority < best->priority)) {
+      best = m;
+    }
+  }
+  if (best == NULL) {
+    return;
+  }
+  uint16_t period = best->period == 0 ? best->period_max : Max(best->period / 2, best->period_min);
+  uint32_t rate = ((uint32_t)best->size * TELEMETRY_FREQUENCY) / period;
+  if ((uint64_t)(demand - sched_msg_rate(best) + rate) * 100 > (uint64_t)s->budget * TELEMETRY_ADAPTIVE_RESTORE_LOAD) {
+    return;
+  }
+  if (best->period == 0) {
+    s->dropped--;
+    if (period != best->period_min) {
+      s->degraded++;
+    }
+  } else if (period == best->period_min) {
+    s->degraded--;
+  }
+  best->period = period;
+}
+
+/** Adapt the messages rates to the budget, once per adaptation period */
+static void sched_adapt(struct telemetry_sched *s)
+{
+  uint32_t window = ((uint32_t)s->budget * s->ticks) / TELEMETRY_FREQUENCY;
+  s->load = window > 0 ? Min((s->sent * 100) / window, 255) : 255;
+
+  uint32_t demand = sched_demand(s);
+  if (s->congested || demand > s->budget) {
+    // at least one step on congestion, then until the predicted demand fits in the budget
+    do {
+      if (!sched_degrade(s)) {
+        break;
+      }
+      demand = sched_demand(s);
+    } while (demand > s->budget);
+  } else {
+    sched_restore(s, demand);
+  }
+
+  s->sent = 0;
+  s->ticks = 0;
+  s->congested = false;
+}
+
+void periodic_telemetry_sched_send(struct telemetry_sched *s, struct telemetry_sched_msg *msgs, uint8_t nb,
+                                   struct periodic_telemetry *telemetry, struct transport_tx *trans, struct link_device *dev)
+{
+  if (s->msgs != msgs) {
+    // mode changed
+    sched_reset(s, msgs, nb);
+  }
+
+  // refill the token bucket, with at most 100ms of burst
+  s->credit += s->budget;
+  s->tokens += s->credit / TELEMETRY_FREQUENCY;
+  s->credit %= TELEMETRY_FREQUENCY;
+  s->tokens = Min(s->tokens, (int32_t)Max(s->budget / 10, 256));
+
+  if (dev != NULL && dev->nb_ovrn != s->nb_ovrn) {
+    // the device dropped messages since last time
+    s->nb_ovrn = dev->nb_ovrn;
+    s->congested = true;
+  }
+
+  // messages are sorted by priority
+  for (uint8_t i = 0; i < nb; i++) {
+    struct telemetry_sched_msg *m = &msgs[i];
+    if (m->counter < UINT16_MAX) {
+      m->counter++;
+    }
+    if (m->period == 0 || m->counter < m->period) {
+      continue;
+    }
+    if (dev != NULL) {
+      // defer the message if it is over budget or if the device has no room for it
+      if (m->size > s->tokens) {
+        s->congested = true;
+        continue;
+      }
+      long fd = 0;
+      if (!dev->check_free_space(dev->periph, &fd, m->size)) {
+        s->congested = true;
+        continue;
+      }
+      // release the device, the transport will check it again
+      dev->send_message(dev->periph, fd);
+    }
+    uint32_t nb_bytes = dev != NULL ? dev->nb_bytes : 0;
+    for (uint8_t j = 0; j < TELEMETRY_NB_CBS; j++) {
+      if (telemetry->cbs[m->idx].slots[j] == NULL) {
+        break;
+      }
+      telemetry->cbs[m->idx].slots[j](trans, dev);
+    }
+    if (dev != NULL) {
+      uint32_t size = dev->nb_bytes - nb_bytes;
+      // smooth the size of variable length messages
+      m->size = m->size == 0 ? size : (3 * (uint32_t)m->size + size) / 4;
+      s->tokens -= size;
+      s->sent += size;
+    }
+    m->counter = 0;
+  }
+
+  if (++s->ticks >= TELEMETRY_ADAPTIVE_TICKS) {
+    sched_adapt(s);
+  }
+}
+
+#endif
+
 #if USE_PERIODIC_TELEMETRY_REPORT
 
 #include "subsystems/datalink/downlink.h"
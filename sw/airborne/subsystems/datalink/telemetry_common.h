@@ -74,6 +74,78 @@ static inline int8_t register_periodic_telemetry(struct periodic_telemetry *_pt
     uint8_t _id __attribute__((unused)), telemetry_cb _cb __attribute__((unused))) { return -1; }
 #endif
 
+#if PERIODIC_TELEMETRY_ADAPTIVE
+
+/** Default link budget of the adaptive scheduler in bytes/s
+ *  (about 85% of a 57600 baud 8N1 link)
+ */
+#ifndef TELEMETRY_ADAPTIVE_BUDGET
+#define TELEMETRY_ADAPTIVE_BUDGET 4900
+#endif
+
+/** Adaptation period of the scheduler in seconds */
+#ifndef TELEMETRY_ADAPTIVE_PERIOD
+#define TELEMETRY_ADAPTIVE_PERIOD 0.5
+#endif
+
+/** Load of the budget in percent below which degraded messages are restored */
+#ifndef TELEMETRY_ADAPTIVE_RESTORE_LOAD
+#define TELEMETRY_ADAPTIVE_RESTORE_LOAD 75
+#endif
+
+/** Messages with this priority are degraded but never dropped */
+#define TELEMETRY_PRIORITY_CRITICAL 0
+
+/** Adaptive scheduler state of a periodic message.
+ *  Tables are generated for each telemetry mode, sorted by priority.
+ */
+struct telemetry_sched_msg {
+  uint8_t idx;          ///< index of the message in the callbacks table
+  uint8_t priority;     ///< priority, 0 is the highest
+  uint16_t period_min;  ///< nominal period (fastest rate) in ticks
+  uint16_t period_max;  ///< slowest period before dropping in ticks
+  uint16_t period;      ///< current period in ticks, 0 when dropped
+  uint16_t counter;     ///< ticks since the last send
+  uint16_t size;        ///< measured size in bytes, 0 if unknown
+};
+
+/** Adaptive scheduler state of a telemetry process
+ */
+struct telemetry_sched {
+  bool enabled;                     ///< use the adaptive scheduler instead of the static one
+  uint32_t budget;                  ///< link budget in bytes/s
+  struct telemetry_sched_msg *msgs; ///< messages of the current mode
+  uint8_t nb;                       ///< number of messages of the current mode
+  int32_t tokens;                   ///< bytes that can be sent now
+  uint32_t credit;                  ///< remainder of the tokens refill
+  uint32_t sent;                    ///< bytes sent during the current adaptation period
+  uint16_t ticks;                   ///< ticks in the current adaptation period
+  bool congested;                   ///< a message was deferred or dropped by the device
+  uint8_t nb_ovrn;                  ///< last overrun counter of the device
+  uint8_t load;                     ///< measured load of the budget in percent
+  uint8_t degraded;                 ///< number of messages slower than nominal
+  uint8_t dropped;                  ///< number of dropped messages
+};
+
+#define TELEMETRY_SCHED_INIT(_budget) { .enabled = true, .budget = _budget, .msgs = NULL, .nb = 0 }
+
+/** Send the due messages of a mode with the adaptive scheduler.
+ *  Messages are sent by priority within the token bucket of the link budget
+ *  and if the device has room for them, otherwise they are deferred.
+ *  Low priority messages are slowed down, then dropped, when the predicted
+ *  or measured load exceeds the budget, and restored when it is available again.
+ * @param _s process scheduler
+ * @param _msgs messages table of the current mode
+ * @param _nb number of messages in the table
+ * @param _pt periodic telemetry structure
+ * @param _trans transport
+ * @param _dev device
+ */
+extern void periodic_telemetry_sched_send(struct telemetry_sched *_s, struct telemetry_sched_msg *_msgs, uint8_t _nb,
+    struct periodic_telemetry *_pt, struct transport_tx *_trans, struct link_device *_dev);
+
+#endif
+
 #if USE_PERIODIC_TELEMETRY_REPORT
 /** Send an error report when trying to send message that as not been register
  * @param _process telemetry process id
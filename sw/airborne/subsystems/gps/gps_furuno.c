@@ -95,7 +95,7 @@ void nmea_parse_prop_init(void)
 
 bool nmea_parse_prop_msg(void)
 {
-  if (gps_nmea.msg_len > 5 && !strncmp(gps_nmea.msg_buf , "PERDCRV", 7)) {
+  if (gps_nmea.msg_len > 5 && !strncmp(gps_nmea.msg , "PERDCRV", 7)) {
     return nmea_parse_perdcrv();
   }
   return false;
@@ -112,15 +112,13 @@ bool nmea_parse_perdcrv(void)
   nmea_read_until(&i);
 
   //EAST VEL
-  double east_vel = strtod(&gps_nmea.msg_buf[i], NULL);
-  gps_nmea.state.ned_vel.y = east_vel * 100; // in cm/s
+  gps_nmea.state.ned_vel.y = nmea_read_fixed(i, 2); // in cm/s
 
   // Ignore reserved
   nmea_read_until(&i);
 
   // NORTH VEL
-  double north_vel = strtod(&gps_nmea.msg_buf[i], NULL);
-  gps_nmea.state.ned_vel.x = north_vel * 100; // in cm/s
+  gps_nmea.state.ned_vel.x = nmea_read_fixed(i, 2); // in cm/s
 
   //Convert velocity to ecef
   struct LtpDef_i ltp;
@@ -40,7 +40,6 @@
 #include <inttypes.h>
 #include <string.h>
 #include <math.h>
-#include <stdlib.h>
 
 #ifndef NMEA_PRINT
 #define NMEA_PRINT(...) {};
@@ -71,24 +70,28 @@ void gps_nmea_init(void)
   gps_nmea.have_gsv = false;
   gps_nmea.gps_nb_ovrn = 0;
   gps_nmea.msg_len = 0;
+  gps_nmea.msg = gps_nmea.msg_buf;
   nmea_parse_prop_init();
   nmea_configure();
 }
 
 void gps_nmea_event(void)
 {
-  struct link_device *dev = &((NMEA_GPS_LINK).device);
+  uint8_t *data;
+  uint16_t len;
 
   if (!gps_nmea.is_configured) {
     nmea_configure();
     return;
   }
-  while (dev->char_available(dev->periph)) {
-    nmea_parse_char(dev->get_byte(dev->periph));
+  // parse the lines in place in the uart receive buffer, released once parsed
+  while ((len = uart_rx_span(&(NMEA_GPS_LINK), &data)) > 0) {
+    uint16_t used = nmea_parse_buf(data, len);
     if (gps_nmea.msg_available) {
       nmea_gps_msg();
       gps_nmea.msg_available = false;
     }
+    uart_rx_consume(&(NMEA_GPS_LINK), used);
   }
 }
 
@@ -125,7 +128,7 @@ bool WEAK nmea_parse_prop_msg(void)
 }
 
 /**
- * nmea_parse_char() has a complete line.
+ * nmea_parse_buf() has a complete line.
  * Find out what type of message it is and
  * hand it to the parser for that type.
  * @return true if msg was valid and gps_nmea.state updated
@@ -134,31 +137,27 @@ bool nmea_parse_msg(void)
 {
   bool msg_valid = false;
 
-  if (gps_nmea.msg_len > 5 && !strncmp(&gps_nmea.msg_buf[2] , "RMC", 3)) {
-    gps_nmea.msg_buf[gps_nmea.msg_len] = 0;
-    NMEA_PRINT("RMC: \"%s\" \n\r", gps_nmea.msg_buf);
+  if (gps_nmea.msg_len > 5 && !strncmp(&gps_nmea.msg[2] , "RMC", 3)) {
+    NMEA_PRINT("RMC: \"%.*s\" \n\r", gps_nmea.msg_len, gps_nmea.msg);
     msg_valid = nmea_parse_RMC();
-  } else if (gps_nmea.msg_len > 5 && !strncmp(&gps_nmea.msg_buf[2] , "GGA", 3)) {
-    gps_nmea.msg_buf[gps_nmea.msg_len] = 0;
-    NMEA_PRINT("GGA: \"%s\" \n\r", gps_nmea.msg_buf);
+  } else if (gps_nmea.msg_len > 5 && !strncmp(&gps_nmea.msg[2] , "GGA", 3)) {
+    NMEA_PRINT("GGA: \"%.*s\" \n\r", gps_nmea.msg_len, gps_nmea.msg);
     msg_valid = nmea_parse_GGA();
-  } else if (gps_nmea.msg_len > 5 && !strncmp(&gps_nmea.msg_buf[2] , "GSA", 3)) {
-    gps_nmea.msg_buf[gps_nmea.msg_len] = 0;
-    NMEA_PRINT("GSA: \"%s\" \n\r", gps_nmea.msg_buf);
+  } else if (gps_nmea.msg_len > 5 && !strncmp(&gps_nmea.msg[2] , "GSA", 3)) {
+    NMEA_PRINT("GSA: \"%.*s\" \n\r", gps_nmea.msg_len, gps_nmea.msg);
     msg_valid = nmea_parse_GSA();
-  } else if (gps_nmea.msg_len > 5 && !strncmp(&gps_nmea.msg_buf[2] , "GSV", 3)) {
-    gps_nmea.msg_buf[gps_nmea.msg_len] = 0;
+  } else if (gps_nmea.msg_len > 5 && !strncmp(&gps_nmea.msg[2] , "GSV", 3)) {
     gps_nmea.have_gsv = true;
-    NMEA_PRINT("GSV: \"%s\" \n\r", gps_nmea.msg_buf);
+    NMEA_PRINT("GSV: \"%.*s\" \n\r", gps_nmea.msg_len, gps_nmea.msg);
     msg_valid = nmea_parse_GSV();
   } else {
-    gps_nmea.msg_buf[gps_nmea.msg_len] = 0;
-    NMEA_PRINT("Other/propriarty message: len=%i \n\r \"%s\" \n\r", gps_nmea.msg_len, gps_nmea.msg_buf);
+    NMEA_PRINT("Other/propriarty message: len=%i \n\r \"%.*s\" \n\r", gps_nmea.msg_len, gps_nmea.msg_len, gps_nmea.msg);
     msg_valid = nmea_parse_prop_msg();
   }
 
   // reset line parser
   gps_nmea.status = WAIT;
+  gps_nmea.msg_len = 0;
 
   /* indicate if msg was valid/supported and gps_nmea.state updated */
   return msg_valid;
@@ -166,75 +165,155 @@ bool nmea_parse_msg(void)
 
 
 /**
- * This is the actual parser.
- * It reads one character at a time
- * setting gps_nmea.msg_available to TRUE
- * after a full line.
+ * Parse one character, see nmea_parse_buf().
  */
 void nmea_parse_char(uint8_t c)
 {
+  nmea_parse_buf(&c, 1);
+}
 
-  switch (gps_nmea.status) {
-    case WAIT:
-      gps_nmea.msg_len = 0;
-      /* valid message needs to start with dollar sign */
-      if (c == '$') {
+/**
+ * This is the actual parser.
+ * It scans a block of received bytes up to the end of the next line,
+ * setting gps_nmea.msg_available to TRUE after a full line.
+ * A line that is entirely in the block is not copied, gps_nmea.msg then points
+ * into the block which must stay valid until the line is parsed.
+ * A line received in several blocks is assembled in gps_nmea.msg_buf.
+ * @param buf received bytes
+ * @param len number of bytes
+ * @return number of bytes used, the rest has to be passed again after the line is parsed
+ */
+uint16_t nmea_parse_buf(const uint8_t *buf, uint16_t len)
+{
+  uint16_t i = 0;
+
+  while (i < len) {
+    switch (gps_nmea.status) {
+      case WAIT: {
+        /* valid message needs to start with dollar sign */
+        const uint8_t *start = memchr(&buf[i], '$', len - i);
+        if (start == NULL) {
+          return len;
+        }
+        i = start - buf + 1;
+        gps_nmea.msg_len = 0;
         gps_nmea.status = GOT_START;
+        break;
       }
-      break;
-
-    case GOT_START:
-      switch (c) {
-        case '\r':
-        case '\n':
-          if (gps_nmea.msg_len == 0) {
-            //reject empty lines
-            gps_nmea.status = WAIT;
-            break;
-          }
-          else {
-            // TODO: check for CRC before setting msg as available
-            gps_nmea.status = GOT_END;
-            gps_nmea.msg_available = true;
-          }
-          break;
 
-        case '$':
+      case GOT_START: {
+        uint16_t end = i;
+        while (end < len && buf[end] != '\r' && buf[end] != '\n' && buf[end] != '$') {
+          end++;
+        }
+        uint16_t n = end - i;
+        if (gps_nmea.msg_len + n > NMEA_MAXLEN - 1) {
+          NMEA_PRINT("nmea_parse_buf: msg too long, len=%i\n\r", gps_nmea.msg_len + n);
+          gps_nmea.status = WAIT;
+          i = end;
+          break;
+        }
+        if (end == len) {
+          // line continues in the next block
+          memcpy(&gps_nmea.msg_buf[gps_nmea.msg_len], &buf[i], n);
+          gps_nmea.msg_len += n;
+          return len;
+        }
+        if (buf[end] == '$') {
           // got another dollar sign, msg incomplete: reset
-          gps_nmea.msg_buf[gps_nmea.msg_len] = 0;
-          NMEA_PRINT("nmea_parse_char: skipping incomplete msg: len=%i, \"%s\"\n\r",
-                     gps_nmea.msg_len, gps_nmea.msg_buf);
+          NMEA_PRINT("nmea_parse_buf: skipping incomplete msg: len=%i\n\r", gps_nmea.msg_len + n);
           gps_nmea.status = WAIT;
+          i = end;
           break;
-
-        default:
-           // fill the buffer, unless it's full
-          if (gps_nmea.msg_len < NMEA_MAXLEN - 1) {
-            gps_nmea.msg_buf[gps_nmea.msg_len] = c;
-            gps_nmea.msg_len++;
-          }
-          else {
-            gps_nmea.msg_buf[gps_nmea.msg_len] = 0;
-            NMEA_PRINT("nmea_parse_char: msg too long, len=%i, \"%s\"\n\r",
-                       gps_nmea.msg_len, gps_nmea.msg_buf);
-            gps_nmea.status = WAIT;
-          }
+        }
+        if (gps_nmea.msg_len + n == 0) {
+          //reject empty lines
+          gps_nmea.status = WAIT;
+          i = end + 1;
           break;
+        }
+        if (gps_nmea.msg_len == 0) {
+          // whole line in this block, no copy
+          gps_nmea.msg = (const char *)&buf[i];
+        } else {
+          memcpy(&gps_nmea.msg_buf[gps_nmea.msg_len], &buf[i], n);
+          gps_nmea.msg_buf[gps_nmea.msg_len + n] = 0;
+          gps_nmea.msg = gps_nmea.msg_buf;
+        }
+        gps_nmea.msg_len += n;
+        // TODO: check for CRC before setting msg as available
+        gps_nmea.status = GOT_END;
+        gps_nmea.msg_available = true;
+        return end + 1;
       }
-      break;
 
-    case GOT_CHECKSUM:
-      // TODO
-      break;
+      case GOT_END:
+        // shouldn't really happen, msg should be parsed and state reset before the next char
+        NMEA_PRINT("nmea_parse_buf: this should not happen!");
+        return len;
 
-    case GOT_END:
-      // shouldn't really happen, msg should be parsed and state reset before the next char
-      NMEA_PRINT("nmea_parse_char: this should not happen!");
-      break;
+      default:
+        gps_nmea.status = WAIT;
+        break;
+    }
+  }
+  return len;
+}
 
-    default:
-      break;
+/**
+ * Read a decimal field at position i of the current nmea-line as a fixed-point integer.
+ * Locale independent replacement of strtod, digits after the given number of decimals are truncated.
+ * @param i position of the field
+ * @param decimals number of decimals of the result
+ * @return value * 10^decimals, 0 for an empty field
+ */
+int32_t nmea_read_fixed(int i, uint8_t decimals)
+{
+  int32_t val = 0;
+  bool neg = false;
+  if (i < gps_nmea.msg_len && (gps_nmea.msg[i] == '-' || gps_nmea.msg[i] == '+')) {
+    neg = (gps_nmea.msg[i] == '-');
+    i++;
+  }
+  while (i < gps_nmea.msg_len && gps_nmea.msg[i] >= '0' && gps_nmea.msg[i] <= '9') {
+    val = val * 10 + (gps_nmea.msg[i++] - '0');
+  }
+  if (i < gps_nmea.msg_len && gps_nmea.msg[i] == '.') {
+    i++;
+  }
+  for (; decimals > 0; decimals--) {
+    val *= 10;
+    if (i < gps_nmea.msg_len && gps_nmea.msg[i] >= '0' && gps_nmea.msg[i] <= '9') {
+      val += gps_nmea.msg[i++] - '0';
+    }
+  }
+  return neg ? -val : val;
+}
+
+/**
+ * Read a latitude or longitude field [dddmm.mmmmm] at position i.
+ * @return angle in degrees * 1e7
+ */
+static int32_t nmea_read_angle(int i)
+{
+  int32_t deg_min = 0;
+  while (i < gps_nmea.msg_len && gps_nmea.msg[i] >= '0' && gps_nmea.msg[i] <= '9') {
+    deg_min = deg_min * 10 + (gps_nmea.msg[i++] - '0');
+  }
+  // fraction of minutes, in 1e-7 minutes
+  int32_t frac = 0;
+  if (i < gps_nmea.msg_len && gps_nmea.msg[i] == '.') {
+    i++;
+  }
+  for (int d = 0; d < 7; d++) {
+    frac *= 10;
+    if (i < gps_nmea.msg_len && gps_nmea.msg[i] >= '0' && gps_nmea.msg[i] <= '9') {
+      frac += gps_nmea.msg[i++] - '0';
+    }
   }
+  int32_t deg = deg_min / 100;
+  int32_t min = deg_min % 100;
+  return deg * 10000000 + (min * 10000000 + frac + 30) / 60;
 }
 
 /**
@@ -255,7 +334,7 @@ uint8_t nmea_calc_crc(const char *buff, int buff_sz)
 /**
  * Parse GSA NMEA messages.
  * GPS DOP and active satellites.
- * Msg stored in gps_nmea.msg_buf.
+ * Msg stored in gps_nmea.msg.
  * @return true if msg was valid and gps_nmea.state updated
  */
 static bool nmea_parse_GSA(void)
@@ -263,7 +342,7 @@ static bool nmea_parse_GSA(void)
   int i = 6;     // current position in the message, start after: GPGSA,
 
   // attempt to reject empty packets right away
-  if (gps_nmea.msg_buf[i] == ',' && gps_nmea.msg_buf[i + 1] == ',') {
+  if (gps_nmea.msg_len < i + 2 || (gps_nmea.msg[i] == ',' && gps_nmea.msg[i + 1] == ',')) {
     NMEA_PRINT("p_GSA() - skipping empty message\n\r");
     return false;
   }
@@ -274,7 +353,7 @@ static bool nmea_parse_GSA(void)
 
   // get 2D/3D-fix
   // set gps_mode=3=3d, 2=2d, 1=no fix or 0
-  gps_nmea.state.fix = atoi(&gps_nmea.msg_buf[i]);
+  gps_nmea.state.fix = nmea_read_int(i);
   if (gps_nmea.state.fix == 1) {
     gps_nmea.state.fix = 0;
   }
@@ -285,8 +364,8 @@ static bool nmea_parse_GSA(void)
   int satcount = 0;
   int prn_cnt;
   for (prn_cnt = 0; prn_cnt < 12; prn_cnt++) {
-    if (gps_nmea.msg_buf[i] != ',') {
-      int prn = atoi(&gps_nmea.msg_buf[i]);
+    if (gps_nmea.msg[i] != ',') {
+      int prn = nmea_read_int(i);
       NMEA_PRINT("p_GSA() - PRN %i=%i\n\r", satcount, prn);
       if (!gps_nmea.have_gsv) {
         gps_nmea.state.svinfos[prn_cnt].svid = prn;
@@ -302,19 +381,18 @@ static bool nmea_parse_GSA(void)
   }
 
   // PDOP
-  float pdop = strtof(&gps_nmea.msg_buf[i], NULL);
-  gps_nmea.state.pdop = pdop * 100;
-  NMEA_PRINT("p_GSA() - pdop=%f\n\r", pdop);
+  gps_nmea.state.pdop = nmea_read_fixed(i, 2);
+  NMEA_PRINT("p_GSA() - pdop=%i\n\r", gps_nmea.state.pdop);
   nmea_read_until(&i);
 
   // HDOP
-  float hdop __attribute__((unused)) = strtof(&gps_nmea.msg_buf[i], NULL);
-  NMEA_PRINT("p_GSA() - hdop=%f\n\r", hdop);
+  int32_t hdop __attribute__((unused)) = nmea_read_fixed(i, 2);
+  NMEA_PRINT("p_GSA() - hdop=%i\n\r", hdop);
   nmea_read_until(&i);
 
   // VDOP
-  float vdop __attribute__((unused)) = strtof(&gps_nmea.msg_buf[i], NULL);
-  NMEA_PRINT("p_GSA() - vdop=%f\n\r", vdop);
+  int32_t vdop __attribute__((unused)) = nmea_read_fixed(i, 2);
+  NMEA_PRINT("p_GSA() - vdop=%i\n\r", vdop);
   nmea_read_until(&i);
 
   /* indicate that msg was valid and gps_nmea.state updated */
@@ -324,7 +402,7 @@ static bool nmea_parse_GSA(void)
 /**
  * Parse RMC NMEA messages.
  * Recommended minimum GPS sentence.
- * Msg stored in gps_nmea.msg_buf.
+ * Msg stored in gps_nmea.msg.
  * @return true if msg was valid and gps_nmea.state updated
  */
 static bool nmea_parse_RMC(void)
@@ -332,7 +410,7 @@ static bool nmea_parse_RMC(void)
   int i = 6;     // current position in the message, start after: GPRMC,
 
   // attempt to reject empty packets right away
-  if (gps_nmea.msg_buf[i] == ',' && gps_nmea.msg_buf[i + 1] == ',') {
+  if (gps_nmea.msg_len < i + 2 || (gps_nmea.msg[i] == ',' && gps_nmea.msg[i + 1] == ',')) {
     NMEA_PRINT("p_RMC() - skipping empty message\n\r");
     return false;
   }
@@ -355,15 +433,17 @@ static bool nmea_parse_RMC(void)
 
   // get speed
   nmea_read_until(&i);
-  double speed = strtod(&gps_nmea.msg_buf[i], NULL);
-  gps_nmea.state.gspeed = speed * 1.852 * 100 / (60 * 60);
-  NMEA_PRINT("p_RMC() - ground-speed=%f knot = %d cm/s\n\r", speed, (gps_nmea.state.gspeed * 1000));
+  // knots with 3 decimals to cm/s: 1852 * 100 / 3600 / 1000 = 463 / 9000
+  int32_t speed = nmea_read_fixed(i, 3);
+  gps_nmea.state.gspeed = (speed * 463 + 4500) / 9000;
+  NMEA_PRINT("p_RMC() - ground-speed=%i knot/1000 = %d cm/s\n\r", speed, gps_nmea.state.gspeed);
 
   // get course
   nmea_read_until(&i);
-  double course = strtod(&gps_nmea.msg_buf[i], NULL);
-  gps_nmea.state.course = RadOfDeg(course) * 1e7;
-  NMEA_PRINT("p_RMC() - course: %f deg\n\r", course);
+  // degrees with 3 decimals to 1e-7 rad
+  int32_t course = nmea_read_fixed(i, 3);
+  gps_nmea.state.course = course * (float)(M_PI / 180. * 1e4);
+  NMEA_PRINT("p_RMC() - course: %i deg/1000\n\r", course);
   SetBit(gps_nmea.state.valid_fields, GPS_VALID_COURSE_BIT);
 
   /* indicate that msg was valid and gps_nmea.state updated */
@@ -374,70 +454,62 @@ static bool nmea_parse_RMC(void)
 /**
  * Parse GGA NMEA messages.
  * GGA has essential fix data providing 3D location and HDOP.
- * Msg stored in gps_nmea.msg_buf.
+ * Msg stored in gps_nmea.msg.
  * @return true if msg was valid and gps_nmea.state updated
  */
 static bool nmea_parse_GGA(void)
 {
   int i = 6;     // current position in the message, start after: GPGGA,
-  double degrees, minutesfrac;
   struct LlaCoor_f lla_f;
 
   // attempt to reject empty packets right away
-  if (gps_nmea.msg_buf[i] == ',' && gps_nmea.msg_buf[i + 1] == ',') {
+  if (gps_nmea.msg_len < i + 2 || (gps_nmea.msg[i] == ',' && gps_nmea.msg[i + 1] == ',')) {
     NMEA_PRINT("p_GGA() - skipping empty message\n\r");
     return false;
   }
 
   // get UTC time [hhmmss.sss]
-  // ignored GpsInfo.PosLLA.TimeOfFix.f = strtod(&packet[i], NULL);
   // FIXME: parse UTC time correctly
-  double utc_time = strtod(&gps_nmea.msg_buf[i], NULL);
-  gps_nmea.state.tow = (uint32_t)((utc_time + 1) * 1000);
+  int32_t utc_time = nmea_read_fixed(i, 3);
+  gps_nmea.state.tow = (uint32_t)(utc_time + 1000);
 
   // get latitude [ddmm.mmmmm]
   nmea_read_until(&i);
-  double lat = strtod(&gps_nmea.msg_buf[i], NULL);
-  // convert to pure degrees [dd.dddd] format
-  minutesfrac = modf(lat / 100, &degrees);
-  lat = degrees + (minutesfrac * 100) / 60;
+  int32_t lat = nmea_read_angle(i);
 
   // get latitute N/S
   nmea_read_until(&i);
-  if (gps_nmea.msg_buf[i] == 'S') {
+  if (gps_nmea.msg[i] == 'S') {
     lat = -lat;
   }
 
   // convert to radians
-  lla_f.lat = RadOfDeg(lat);
-  gps_nmea.state.lla_pos.lat = lat * 1e7; // convert to fixed-point
-  NMEA_PRINT("p_GGA() - lat=%f gps_lat=%f\n\r", (lat * 1000), lla_f.lat);
+  lla_f.lat = RadOfDeg(lat / 1e7);
+  gps_nmea.state.lla_pos.lat = lat;
+  NMEA_PRINT("p_GGA() - lat=%i gps_lat=%f\n\r", lat, lla_f.lat);
 
 
-  // get longitude [ddmm.mmmmm]
+  // get longitude [dddmm.mmmmm]
   nmea_read_until(&i);
-  double lon = strtod(&gps_nmea.msg_buf[i], NULL);
-  // convert to pure degrees [dd.dddd] format
-  minutesfrac = modf(lon / 100, &degrees);
-  lon = degrees + (minutesfrac * 100) / 60;
+  int32_t lon = nmea_read_angle(i);
 
   // get longitude E/W
   nmea_read_until(&i);
-  if (gps_nmea.msg_buf[i] == 'W') {
+  if (gps_nmea.msg[i] == 'W') {
     lon = -lon;
   }
 
   // convert to radians
-  lla_f.lon = RadOfDeg(lon);
-  gps_nmea.state.lla_pos.lon = lon * 1e7; // convert to fixed-point
-  NMEA_PRINT("p_GGA() - lon=%f gps_lon=%f time=%u\n\r", (lon * 1000), lla_f.lon, gps_nmea.state.tow);
+  lla_f.lon = RadOfDeg(lon / 1e7);
+  gps_nmea.state.lla_pos.lon = lon;
+  NMEA_PRINT("p_GGA() - lon=%i gps_lon=%f time=%u\n\r", lon, lla_f.lon, gps_nmea.state.tow);
   SetBit(gps_nmea.state.valid_fields, GPS_VALID_POS_LLA_BIT);
 
   // get position fix status
   nmea_read_until(&i);
   // 0 = Invalid, 1 = Valid SPS, 2 = Valid DGPS, 3 = Valid PPS
   // check for good position fix
-  if ((gps_nmea.msg_buf[i] != '0') && (gps_nmea.msg_buf[i] != ','))  {
+  if ((gps_nmea.msg[i] != '0') && (gps_nmea.msg[i] != ','))  {
     NMEA_PRINT("p_GGA() - POS_AVAILABLE == TRUE\n\r");
   } else {
     NMEA_PRINT("p_GGA() - gps_pos_available == false\n\r");
@@ -445,18 +517,16 @@ static bool nmea_parse_GGA(void)
 
   // get number of satellites used in GPS solution
   nmea_read_until(&i);
-  gps_nmea.state.num_sv = atoi(&gps_nmea.msg_buf[i]);
+  gps_nmea.state.num_sv = nmea_read_int(i);
   NMEA_PRINT("p_GGA() - gps_numSatlitesUsed=%i\n\r", gps_nmea.state.num_sv);
 
   // get HDOP, but we use PDOP from GSA message
   nmea_read_until(&i);
-  //float hdop = strtof(&gps_nmea.msg_buf[i], NULL);
-  //gps_nmea.state.pdop = hdop * 100;
+  //gps_nmea.state.pdop = nmea_read_fixed(i, 2);
 
   // get altitude (in meters) above geoid (MSL)
   nmea_read_until(&i);
-  float hmsl = strtof(&gps_nmea.msg_buf[i], NULL);
-  gps_nmea.state.hmsl = hmsl * 1000;
+  gps_nmea.state.hmsl = nmea_read_fixed(i, 3);
   NMEA_PRINT("p_GGA() - gps_nmea.state.hmsl=%i\n\r", gps_nmea.state.hmsl);
   SetBit(gps_nmea.state.valid_fields, GPS_VALID_HMSL_BIT);
 
@@ -465,11 +535,11 @@ static bool nmea_parse_GGA(void)
 
   // get geoid seperation
   nmea_read_until(&i);
-  float geoid = strtof(&gps_nmea.msg_buf[i], NULL);
-  NMEA_PRINT("p_GGA() - geoid alt=%f\n\r", geoid);
+  int32_t geoid = nmea_read_fixed(i, 3);
+  NMEA_PRINT("p_GGA() - geoid alt=%i mm\n\r", geoid);
   // height above ellipsoid
-  lla_f.alt = hmsl + geoid;
-  gps_nmea.state.lla_pos.alt = lla_f.alt * 1000;
+  gps_nmea.state.lla_pos.alt = gps_nmea.state.hmsl + geoid;
+  lla_f.alt = gps_nmea.state.lla_pos.alt / 1000.f;
   NMEA_PRINT("p_GGA() - gps_nmea.state.alt=%i\n\r", gps_nmea.state.lla_pos.alt);
 
   // get seperations units
@@ -492,7 +562,7 @@ static bool nmea_parse_GGA(void)
 
 /**
  * Parse GSV-nmea-messages.
- * Msg stored in gps_nmea.msg_buf.
+ * Msg stored in gps_nmea.msg.
  * @return true if msg was valid and gps_nmea.state updated
  */
 static bool nmea_parse_GSV(void)
@@ -500,7 +570,7 @@ static bool nmea_parse_GSV(void)
   int i = 6;     // current position in the message, start after: GxGSA,
 
   // attempt to reject empty packets right away
-  if (gps_nmea.msg_buf[i] == ',' && gps_nmea.msg_buf[i + 1] == ',') {
+  if (gps_nmea.msg_len < i + 2 || (gps_nmea.msg[i] == ',' && gps_nmea.msg[i + 1] == ',')) {
     NMEA_PRINT("p_GSV() - skipping empty message\n\r");
     return false;
   }
@@ -509,37 +579,37 @@ static bool nmea_parse_GSV(void)
   // GPGSV -> GPS
   // GLGSV -> GLONASS
   bool is_glonass = false;
-  if (!strncmp(&gps_nmea.msg_buf[0] , "GL", 2)) {
+  if (!strncmp(&gps_nmea.msg[0] , "GL", 2)) {
     is_glonass = true;
   }
 
   // total sentences
-  int nb_sen __attribute__((unused)) = atoi(&gps_nmea.msg_buf[i]);
+  int nb_sen __attribute__((unused)) = nmea_read_int(i);
   NMEA_PRINT("p_GSV() - %i sentences\n\r", nb_sen);
   nmea_read_until(&i);
 
   // current sentence
-  int cur_sen = atoi(&gps_nmea.msg_buf[i]);
+  int cur_sen = nmea_read_int(i);
   NMEA_PRINT("p_GSV() - sentence=%i\n\r", cur_sen);
   nmea_read_until(&i);
 
   // num satellites in view
-  int num_sat __attribute__((unused)) = atoi(&gps_nmea.msg_buf[i]);
+  int num_sat __attribute__((unused)) = nmea_read_int(i);
   NMEA_PRINT("p_GSV() - num_sat=%i\n\r", num_sat);
   nmea_read_until(&i);
 
   // up to 4 sats per sentence
   int sat_cnt;
   for (sat_cnt = 0; sat_cnt < 4; sat_cnt++) {
-    if (gps_nmea.msg_buf[i] == ',') break;
+    if (i >= gps_nmea.msg_len || gps_nmea.msg[i] == ',') break;
     // 4 fields per sat: PRN, elevation (deg), azimuth (deg), SNR
-    int prn = atoi(&gps_nmea.msg_buf[i]);
+    int prn = nmea_read_int(i);
     nmea_read_until(&i);
-    int elev = atoi(&gps_nmea.msg_buf[i]);
+    int elev = nmea_read_int(i);
     nmea_read_until(&i);
-    int azim = atoi(&gps_nmea.msg_buf[i]);
+    int azim = nmea_read_int(i);
     nmea_read_until(&i);
-    int snr = atoi(&gps_nmea.msg_buf[i]);
+    int snr = nmea_read_int(i);
     nmea_read_until(&i);
 
     int ch_idx = (cur_sen - 1) * 4 + sat_cnt;
@@ -45,7 +45,8 @@ struct GpsNmea {
   bool is_configured;       ///< flag set to TRUE if configuration is finished
   bool have_gsv;            ///< flag set to TRUE if GPGSV message received
   uint8_t gps_nb_ovrn;        ///< number if incomplete nmea-messages
-  char msg_buf[NMEA_MAXLEN];  ///< buffer for storing one nmea-line
+  char msg_buf[NMEA_MAXLEN];  ///< buffer for storing one nmea-line received in several parts
+  const char *msg;            ///< current nmea-line, in the receive buffer or in msg_buf
   int msg_len;
   uint8_t status;             ///< line parser status
 
@@ -69,19 +70,23 @@ extern void gps_nmea_event(void);
 
 extern void nmea_configure(void);
 extern void nmea_parse_char(uint8_t c);
+extern uint16_t nmea_parse_buf(const uint8_t *buf, uint16_t len);
 extern bool nmea_parse_msg(void);
 extern uint8_t nmea_calc_crc(const char *buff, int buff_sz);
 extern void nmea_parse_prop_init(void);
 extern bool nmea_parse_prop_msg(void);
 extern void nmea_gps_msg(void);
+extern int32_t nmea_read_fixed(int i, uint8_t decimals);
 
-/** Read until a certain character, placed here for proprietary includes */
+/** Read an integer field at position i of the current nmea-line */
+#define nmea_read_int(_i) nmea_read_fixed(_i, 0)
+
+/** Read until after the next field separator, placed here for proprietary includes
+ *  The position stays at most msg_len, the character at msg_len (end of line) can always be read.
+ */
 static inline void nmea_read_until(int *i)
 {
-  while (gps_nmea.msg_buf[(*i)++] != ',') {
-    if (*i >= gps_nmea.msg_len) {
-      return;
-    }
+  while (*i < gps_nmea.msg_len && gps_nmea.msg[(*i)++] != ',') {
   }
 }
 
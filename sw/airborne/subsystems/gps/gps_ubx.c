@@ -24,6 +24,8 @@
 #include "subsystems/abi.h"
 #include "led.h"
 
+#include <string.h>
+
 /** Includes macros generated from ubx.xml */
 #include "ubx_protocol.h"
 
@@ -69,6 +71,7 @@ void gps_ubx_init(void)
 
 void gps_ubx_event(void)
 {
+#ifdef GPS_I2C
   struct link_device *dev = &((UBX_GPS_LINK).device);
 
   while (dev->char_available(dev->periph)) {
@@ -77,6 +80,18 @@ void gps_ubx_event(void)
       gps_ubx_msg();
     }
   }
+#else
+  uint8_t *data;
+  uint16_t len;
+
+  // parse in place in the uart receive buffer
+  while ((len = uart_rx_span(&(UBX_GPS_LINK), &data)) > 0) {
+    uart_rx_consume(&(UBX_GPS_LINK), gps_ubx_parse_buf(data, len));
+    if (gps_ubx.msg_available) {
+      gps_ubx_msg();
+    }
+  }
+#endif
 }
 
 void gps_ubx_read_message(void)
@@ -188,12 +203,9 @@ void gps_ubx_read_message(void)
 #include "modules/loggers/sdlog_chibios.h"
 #endif
 
-/* UBX parsing */
-void gps_ubx_parse(uint8_t c)
+/* UBX parsing, one byte */
+static void gps_ubx_parse_byte(uint8_t c)
 {
-#if LOG_RAW_GPS
-  sdLogWriteByte(pprzLogFile, c);
-#endif
   if (gps_ubx.status < GOT_PAYLOAD) {
     gps_ubx.ck_a += c;
     gps_ubx.ck_b += gps_ubx.ck_a;
@@ -238,6 +250,10 @@ void gps_ubx_parse(uint8_t c)
       }
       gps_ubx.msg_idx = 0;
       gps_ubx.status++;
+      if (gps_ubx.len == 0) {
+        /* no payload, next byte is the checksum */
+        gps_ubx.status++;
+      }
       break;
     case GOT_LEN2:
       gps_ubx.msg_buf[gps_ubx.msg_idx] = c;
@@ -273,6 +289,53 @@ restart:
   return;
 }
 
+void gps_ubx_parse(uint8_t c)
+{
+#if LOG_RAW_GPS
+  sdLogWriteByte(pprzLogFile, c);
+#endif
+  gps_ubx_parse_byte(c);
+}
+
+/**
+ * Parse a block of received bytes, up to the end of the next message.
+ * The payload is copied at once in the aligned gps_ubx.msg_buf,
+ * where the fields are read in place by the ubx_protocol.h accessors.
+ * @param buf received bytes
+ * @param len number of bytes
+ * @return number of bytes used, stops after a complete message (gps_ubx.msg_available)
+ */
+uint16_t gps_ubx_parse_buf(const uint8_t *buf, uint16_t len)
+{
+  uint16_t i = 0;
+
+  while (i < len && !gps_ubx.msg_available) {
+    if (gps_ubx.status == GOT_LEN2) {
+      uint16_t n = Min(gps_ubx.len - gps_ubx.msg_idx, len - i);
+      uint8_t ck_a = gps_ubx.ck_a;
+      uint8_t ck_b = gps_ubx.ck_b;
+      for (uint16_t j = 0; j < n; j++) {
+        ck_a += buf[i + j];
+        ck_b += ck_a;
+      }
+      gps_ubx.ck_a = ck_a;
+      gps_ubx.ck_b = ck_b;
+      memcpy(&gps_ubx.msg_buf[gps_ubx.msg_idx], &buf[i], n);
+      gps_ubx.msg_idx += n;
+      i += n;
+      if (gps_ubx.msg_idx >= gps_ubx.len) {
+        gps_ubx.status++;
+      }
+    } else {
+      gps_ubx_parse_byte(buf[i++]);
+    }
+  }
+#if LOG_RAW_GPS
+  sdLogWriteRaw(pprzLogFile, buf, i);
+#endif
+  return i;
+}
+
 static void ubx_send_1byte(struct link_device *dev, uint8_t byte)
 {
   dev->put_byte(dev->periph, 0, byte);
@@ -106,6 +106,7 @@ extern void ubx_send_cfg_rst(struct link_device *dev, uint16_t bbr, uint8_t rese
 
 extern void gps_ubx_read_message(void);
 extern void gps_ubx_parse(uint8_t c);
+extern uint16_t gps_ubx_parse_buf(const uint8_t *buf, uint16_t len);
 extern void gps_ubx_msg(void);
 
 /*
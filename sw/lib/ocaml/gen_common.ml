@@ -383,3 +383,106 @@ let is_element_unselected = fun ?(verbose=false) target modules name ->
         unselected
     | _ -> false
   with _ -> false
+
+(** normalize white spaces of a function or message name *)
+let cost_name_regexp = Str.regexp "[ \t]+"
+let normalize_cost_name = fun name ->
+  String.concat " " (Str.split cost_name_regexp name)
+
+(** [read_cost_profile file]
+ * Read a per-function execution time profile, one entry per line.
+ * The table printed by the modules_profile module
+ * (name count min mean max p99 overruns) is accepted, the p99 column is used as cost.
+ * Plain "name cost" lines are accepted as well.
+ * Empty lines, comments starting with '#' and the table header are skipped *)
+let read_cost_profile = fun file ->
+  let is_int = fun s -> try ignore (int_of_string s); true with _ -> false in
+  let ic = open_in file in
+  let rec loop = fun l ->
+    match (try Some (input_line ic) with End_of_file -> None) with
+    | None -> close_in ic; List.rev l
+    | Some line ->
+        let fields = Array.of_list (Str.split cost_name_regexp line) in
+        let n = Array.length fields in
+        let name_of = fun k -> String.concat " " (Array.to_list (Array.sub fields 0 k)) in
+        if n = 0 || fields.(0).[0] = '#' || fields.(0) = "function" then loop l
+        else if n >= 7 && List.for_all is_int (Array.to_list (Array.sub fields (n - 6) 6)) then
+          loop ((name_of (n - 6), float_of_string fields.(n - 2)) :: l)
+        else begin
+          let cost = if n >= 2 then (try Some (float_of_string fields.(n - 1)) with Failure _ -> None) else None in
+          match cost with
+          | Some c -> loop ((name_of (n - 1), c) :: l)
+          | None ->
+              eprintf "Warning: invalid line in cost profile %s: %s\n%!" file line;
+              loop l
+        end
+  in
+  loop []
+
+(** [cost_of_profile profile name]
+ * Returns the cost of function or message [name], raise Not_found if not in profile *)
+let cost_of_profile = fun profile name ->
+  List.assoc (normalize_cost_name name) profile
+
+(** [balance_phases tasks]
+ * Choose the phase of periodic tasks in order to minimise the worst-case load of a tick.
+ * The tasks are placed greedily by decreasing cost on the phase giving the lowest
+ * peak load, then the lowest total load, over the ticks where they run.
+ * Tasks with a fixed phase are placed first and are not moved. *)
+let balance_phases = fun tasks ->
+  let rec gcd = fun a b -> if b = 0 then a else gcd b (a mod b) in
+  let max_horizon = 1 lsl 20 in
+  let lcm = List.fold_left (fun h (p, _, _) ->
+    if h > max_horizon then h else h / (gcd h p) * p) 1 tasks in
+  let horizon =
+    if lcm <= max_horizon then lcm
+    else begin
+      let p_max = List.fold_left (fun m (p, _, _) -> max m p) 1 tasks in
+      eprintf "Warning: periods hyperperiod is too long, phase balancing is approximated\n%!";
+      max_horizon - (max_horizon mod p_max)
+    end in
+  let load = Array.make horizon 0. in
+  let add = fun p phase cost ->
+    let t = ref (phase mod p) in
+    while !t < horizon do
+      load.(!t) <- load.(!t) +. cost;
+      t := !t + p
+    done in
+  let eval = fun p phase cost ->
+    let t = ref phase and peak = ref 0. and sum = ref 0. in
+    while !t < horizon do
+      let v = load.(!t) +. cost in
+      if v > !peak then peak := v;
+      sum := !sum +. v;
+      t := !t + p
+    done;
+    (!peak, !sum) in
+  let tasks = Array.of_list tasks in
+  let phases = Array.make (Array.length tasks) 0 in
+  (* fixed phases first *)
+  Array.iteri (fun k (p, cost, fixed) ->
+    match fixed with
+    | Some phase -> phases.(k) <- phase; add p phase cost
+    | None -> ()) tasks;
+  (* then by decreasing cost, shortest period first *)
+  let free = List.filter (fun k -> let (_, _, f) = tasks.(k) in f = None)
+      (Array.to_list (Array.init (Array.length tasks) (fun k -> k))) in
+  let free = List.stable_sort (fun a b ->
+    let (pa, ca, _) = tasks.(a) and (pb, cb, _) = tasks.(b) in
+    if ca <> cb then compare cb ca else compare pa pb) free in
+  List.iter (fun k ->
+    let (p, cost, _) = tasks.(k) in
+    let best = ref 0 and best_load = ref (eval p 0 cost) in
+    for phase = 1 to p - 1 do
+      let l = eval p phase cost in
+      if l < !best_load then begin best := phase; best_load := l end
+    done;
+    phases.(k) <- !best;
+    add p !best cost) free;
+  (Array.to_list phases, load)
+
+(** [tick_load_stats load] Returns (peak, mean) of the tick loads *)
+let tick_load_stats = fun load ->
+  let n = Array.length load in
+  if n = 0 then (0., 0.)
+  else (Array.fold_left max 0. load, (Array.fold_left (+.) 0. load) /. float n)
@@ -100,3 +100,22 @@ val get_autopilot_of_airframe : Xml.xml -> (string * string option)
  * [file] being the file name of an Xml file (module or setting) *)
 val is_element_unselected : ?verbose:bool -> string -> module_conf list -> string -> bool
 
+
+(** [read_cost_profile file]
+ * Returns a list of (function or message name, cost) from an execution time profile,
+ * either the table printed by the modules_profile module (p99 column is used)
+ * or plain "name cost" lines *)
+val read_cost_profile : string -> (string * float) list
+
+(** [cost_of_profile profile name]
+ * Returns the cost of [name] from a profile, raise Not_found if unknown *)
+val cost_of_profile : (string * float) list -> string -> float
+
+(** [balance_phases tasks]
+ * [tasks] is a list of (period in ticks, cost, fixed phase).
+ * Returns the phases minimizing the worst-case load of a tick (in the order of [tasks])
+ * and the predicted load of each tick over the hyperperiod *)
+val balance_phases : (int * float * int option) list -> int list * float array
+
+(** [tick_load_stats load] Returns (peak, mean) of the tick loads *)
+val tick_load_stats : float array -> float * float
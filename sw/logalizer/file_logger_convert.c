@@ -0,0 +1,203 @@
+/*
+ * Converter for the binary logs of the file_logger module
+ *
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/** Converts a binary log of modules/loggers/file_logger.c to CSV,
+    or to one raw little endian array per field (columns).
+    The layout of the records is read from the header of the file.
+
+    usage: file_logger_convert [-c dir] log.bin [> log.csv]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FILE_LOGGER_MAGIC "PPRZBLG"
+
+/* Same layout as in modules/loggers/file_logger.c */
+struct __attribute__((packed)) field {
+  char name[28];
+  char type;
+  uint8_t size;
+  uint16_t offset;
+};
+
+struct __attribute__((packed)) header {
+  char magic[8];
+  uint16_t version;
+  uint16_t header_size;
+  uint16_t record_size;
+  uint16_t nb_fields;
+  struct field fields[];
+};
+
+/* Read a field as a signed or unsigned integer, or a float */
+static void print_field(FILE *out, const struct field *f, const uint8_t *record)
+{
+  const uint8_t *p = record + f->offset;
+  if (f->type == 'f' && f->size == 4) {
+    float v;
+    memcpy(&v, p, 4);
+    fprintf(out, "%.9g", v);
+  } else if (f->type == 'f' && f->size == 8) {
+    double v;
+    memcpy(&v, p, 8);
+    fprintf(out, "%.17g", v);
+  } else {
+    uint64_t v = 0;
+    memcpy(&v, p, f->size);
+    if (f->type == 'i' && f->size < 8 && (v >> (8 * f->size - 1)) & 1) {
+      // sign extension
+      v |= ~0ULL << (8 * f->size);
+    }
+    if (f->type == 'i') {
+      fprintf(out, "%lld", (long long)v);
+    } else {
+      fprintf(out, "%llu", (unsigned long long)v);
+    }
+  }
+}
+
+static void write_csv(const struct header *h, const uint8_t *records, size_t nb)
+{
+  for (int i = 0; i < h->nb_fields; i++) {
+    printf("%s%.28s", i ? "," : "", h->fields[i].name);
+  }
+  printf("\n");
+  for (size_t r = 0; r < nb; r++) {
+    const uint8_t *record = records + r * h->record_size;
+    for (int i = 0; i < h->nb_fields; i++) {
+      if (i) {
+        putchar(',');
+      }
+      print_field(stdout, &h->fields[i], record);
+    }
+    putchar('\n');
+  }
+}
+
+/* One file per field: <dir>/<name>.<type><bits> */
+static int write_columns(const struct header *h, const uint8_t *records, size_t nb, const char *dir)
+{
+  char filename[512];
+  uint8_t *column = malloc(nb * 8 + 1);
+  if (column == NULL) {
+    fprintf(stderr, "Not enough memory\n");
+    return -1;
+  }
+  for (int i = 0; i < h->nb_fields; i++) {
+    const struct field *f = &h->fields[i];
+    snprintf(filename, sizeof(filename), "%s/%.28s.%c%d", dir, f->name, f->type, f->size * 8);
+    for (size_t r = 0; r < nb; r++) {
+      memcpy(column + r * f->size, records + r * h->record_size + f->offset, f->size);
+    }
+    FILE *out = fopen(filename, "wb");
+    if (out == NULL || fwrite(column, f->size, nb, out) != nb) {
+      perror(filename);
+      if (out != NULL) {
+        fclose(out);
+      }
+      free(column);
+      return -1;
+    }
+    fclose(out);
+  }
+  free(column);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *dir = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:h")) != -1) {
+    switch (opt) {
+      case 'c':
+        dir = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-c dir] log.bin\n", argv[0]);
+        fprintf(stderr, "  convert to CSV on stdout, or with -c to one binary file per field in dir\n");
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-c dir] log.bin\n", argv[0]);
+    return 1;
+  }
+
+  int fd = open(argv[optind], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(argv[optind]);
+    return 1;
+  }
+  if ((size_t)st.st_size < sizeof(struct header)) {
+    fprintf(stderr, "%s: file too short\n", argv[optind]);
+    return 1;
+  }
+  const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+  const struct header *h = (const struct header *)data;
+  if (memcmp(h->magic, FILE_LOGGER_MAGIC, sizeof(FILE_LOGGER_MAGIC)) != 0 ||
+      h->header_size > st.st_size || h->record_size == 0 ||
+      sizeof(struct header) + h->nb_fields * sizeof(struct field) > h->header_size) {
+    fprintf(stderr, "%s: not a file_logger binary log\n", argv[optind]);
+    return 1;
+  }
+  for (int i = 0; i < h->nb_fields; i++) {
+    if (h->fields[i].offset + h->fields[i].size > h->record_size || h->fields[i].size > 8) {
+      fprintf(stderr, "%s: invalid field %.28s\n", argv[optind], h->fields[i].name);
+      return 1;
+    }
+  }
+
+  size_t nb = (st.st_size - h->header_size) / h->record_size;
+  if ((st.st_size - h->header_size) % h->record_size) {
+    fprintf(stderr, "%s: last record truncated\n", argv[optind]);
+  }
+  const uint8_t *records = data + h->header_size;
+
+  int ret = 0;
+  if (dir != NULL) {
+    ret = write_columns(h, records, nb, dir);
+    fprintf(stderr, "%zu records, %d fields written to %s\n", nb, h->nb_fields, dir);
+  } else {
+    write_csv(h, records, nb);
+  }
+
+  munmap((void *)data, st.st_size);
+  close(fd);
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,712 @@
+/*
+ * Fast decoder and extractor for pprzlog files (flight recorder / SD logger)
+ *
+ * Copyright (C) 2026 The Paparazzi Team
+ *
+ * This file is part of paparazzi.
+ *
+ * paparazzi is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * paparazzi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paparazzi; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/** Native replacement for the slow path of sd2log / logplotter on large logs.
+
+    The log file is mapped in memory and scanned once to build, for each
+    source (0: telemetry, 1: datalink) and message id, the sorted list of
+    frame offsets. Selected messages are then decoded in parallel into one
+    array per field, optionally restricted to a time window (binary search
+    on the index).
+
+    pprzlog frame (pprzlink v1, little endian):
+      STX(0x99) LEN SOURCE TIMESTAMP[4] PAYLOAD[LEN] CHECKSUM
+    where TIMESTAMP is in 1e-4 s, PAYLOAD is AC_ID MSG_ID FIELDS...
+    and CHECKSUM is the 8 bits sum of all bytes from LEN to the end of PAYLOAD.
+
+    usage: pprzlog_extract [options] file.tlm [MSG[:field,...] ...]
+      -m file  messages.xml (default $PAPARAZZI_HOME/var/messages.xml)
+      -a id    only keep messages from this aircraft
+      -s t     start time (s)
+      -e t     end time (s)
+      -j n     number of decoding threads (default: number of cpus)
+      -o dir   write one binary column per field to dir/MSG.field.type
+               instead of CSV on stdout
+      -l       list messages found in the log
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PPRZLOG_STX 0x99
+#define PPRZLOG_HEADER_LEN 7
+#define PPRZLOG_TIME_UNIT 1e-4
+#define PPRZLOG_NB_SOURCES 2
+
+#define MAX_MESSAGES 256
+#define MAX_FIELDS 64
+#define MAX_NAME 64
+
+/** Field types of messages.xml */
+enum field_type { T_INT8, T_UINT8, T_INT16, T_UINT16, T_INT32, T_UINT32, T_INT64, T_UINT64, T_FLOAT, T_DOUBLE, T_CHAR };
+
+static const struct {
+  const char *name;
+  uint8_t size;
+  const char *suffix;
+} types[] = {
+  [T_INT8]   = { "int8",   1, "i8"  },
+  [T_UINT8]  = { "uint8",  1, "u8"  },
+  [T_INT16]  = { "int16",  2, "i16" },
+  [T_UINT16] = { "uint16", 2, "u16" },
+  [T_INT32]  = { "int32",  4, "i32" },
+  [T_UINT32] = { "uint32", 4, "u32" },
+  [T_INT64]  = { "int64",  8, "i64" },
+  [T_UINT64] = { "uint64", 8, "u64" },
+  [T_FLOAT]  = { "float",  4, "f32" },
+  [T_DOUBLE] = { "double", 8, "f64" },
+  [T_CHAR]   = { "char",   1, "u8"  },
+};
+
+/** Field of a message description
+ *  nb is the number of elements of a fixed array (1 for scalars), 0 for variable arrays
+ *  (preceded by their uint8 length in the payload)
+ */
+struct field {
+  char name[MAX_NAME];
+  enum field_type type;
+  int nb;
+};
+
+struct message {
+  char name[MAX_NAME];
+  int nb_fields;
+  struct field fields[MAX_FIELDS];
+};
+
+/** Message descriptions for each source, indexed by message id */
+static struct message *messages[PPRZLOG_NB_SOURCES][MAX_MESSAGES];
+
+/** Index: offsets of the frames of each message, in file order (hence time order) */
+struct index {
+  uint64_t *offsets;
+  size_t nb;
+  size_t size;
+};
+
+static struct index indexes[PPRZLOG_NB_SOURCES][MAX_MESSAGES];
+
+/** Selected column: one element of a field of a selected message */
+struct column {
+  int field;
+  int elt;
+  uint8_t *data;
+};
+
+/** Selected message with the range of the index to extract */
+struct selection {
+  int source;
+  int id;
+  size_t first;
+  size_t nb;
+  double *time;
+  int nb_columns;
+  struct column columns[MAX_FIELDS];
+};
+
+static const uint8_t *log_data;
+static size_t log_size;
+static struct selection *selections;
+static int nb_selections;
+static int nb_threads;
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline double frame_time(uint64_t offset)
+{
+  return get_u32(log_data + offset + 3) * PPRZLOG_TIME_UNIT;
+}
+
+/******************************************************************************
+ * messages.xml
+ *
+ * Only the tags and attributes needed to compute the payload layout are read,
+ * this is not a general XML parser.
+ */
+
+/** Copy the value of attribute attr of the tag starting at tag into dst */
+static bool get_attrib(const char *tag, const char *end, const char *attr, char *dst, size_t len)
+{
+  size_t n = strlen(attr);
+  for (const char *p = tag + 1; p + n + 2 < end; p++) {
+    if (p[-1] <= ' ' && strncmp(p, attr, n) == 0 && p[n] == '=' && (p[n + 1] == '"' || p[n + 1] == '\'')) {
+      const char *v = p + n + 2;
+      const char *e = memchr(v, p[n + 1], end - v);
+      if (e == NULL || (size_t)(e - v) >= len) {
+        return false;
+      }
+      memcpy(dst, v, e - v);
+      dst[e - v] = '\0';
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool parse_type(const char *str, struct field *f)
+{
+  char base[MAX_NAME];
+  const char *bracket = strchr(str, '[');
+  size_t n = bracket ? (size_t)(bracket - str) : strlen(str);
+  if (n >= sizeof(base)) {
+    return false;
+  }
+  memcpy(base, str, n);
+  base[n] = '\0';
+  f->nb = bracket ? atoi(bracket + 1) : 1;
+  for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+    if (strcmp(base, types[t].name) == 0) {
+      f->type = t;
+      return true;
+    }
+  }
+  if (strcmp(base, "string") == 0) {
+    f->type = T_CHAR;
+    f->nb = 0;
+    return true;
+  }
+  return false;
+}
+
+static int load_messages(const char *filename)
+{
+  FILE *f = fopen(filename, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *xml = malloc(len + 1);
+  if (xml == NULL || fread(xml, 1, len, f) != (size_t)len) {
+    fclose(f);
+    free(xml);
+    return -1;
+  }
+  xml[len] = '\0';
+  fclose(f);
+
+  char value[MAX_NAME];
+  int source = -1;
+  struct message *msg = NULL;
+  for (char *p = strchr(xml, '<'); p != NULL; p = strchr(p + 1, '<')) {
+    char *end = strchr(p, '>');
+    if (end == NULL) {
+      break;
+    }
+    if (strncmp(p, "<msg_class", 10) == 0 && get_attrib(p, end, "name", value, sizeof(value))) {
+      source = strcmp(value, "telemetry") == 0 ? 0 : (strcmp(value, "datalink") == 0 ? 1 : -1);
+    } else if (strncmp(p, "</msg_class", 11) == 0) {
+      source = -1;
+    } else if (strncmp(p, "<message", 8) == 0 && p[8] <= ' ' && source >= 0) {
+      msg = NULL;
+      if (get_attrib(p, end, "id", value, sizeof(value))) {
+        int id = atoi(value);
+        if (id >= 0 && id < MAX_MESSAGES && messages[source][id] == NULL) {
+          msg = calloc(1, sizeof(struct message));
+          get_attrib(p, end, "name", msg->name, sizeof(msg->name));
+          messages[source][id] = msg;
+        }
+      }
+    } else if (strncmp(p, "</message", 9) == 0) {
+      msg = NULL;
+    } else if (strncmp(p, "<field", 6) == 0 && msg != NULL && msg->nb_fields < MAX_FIELDS) {
+      struct field *fd = &msg->fields[msg->nb_fields];
+      if (get_attrib(p, end, "name", fd->name, sizeof(fd->name)) &&
+          get_attrib(p, end, "type", value, sizeof(value)) && parse_type(value, fd)) {
+        msg->nb_fields++;
+      } else {
+        fprintf(stderr, "Unknown field type in message %s, ignoring the rest of it\n", msg->name);
+        msg = NULL;
+      }
+    }
+    p = end;
+  }
+  free(xml);
+  return 0;
+}
+
+static int find_message(const char *name, int *source)
+{
+  for (int s = 0; s < PPRZLOG_NB_SOURCES; s++) {
+    for (int id = 0; id < MAX_MESSAGES; id++) {
+      if (messages[s][id] != NULL && strcmp(messages[s][id]->name, name) == 0) {
+        *source = s;
+        return id;
+      }
+    }
+  }
+  return -1;
+}
+
+/******************************************************************************
+ * Indexing
+ */
+
+static unsigned long nb_frames, nb_bad_checksums, nb_skipped_bytes;
+
+static void index_add(struct index *idx, uint64_t offset)
+{
+  if (idx->nb == idx->size) {
+    idx->size = idx->size ? 2 * idx->size : 1024;
+    idx->offsets = realloc(idx->offsets, idx->size * sizeof(uint64_t));
+    if (idx->offsets == NULL) {
+      fprintf(stderr, "Not enough memory for the index\n");
+      exit(1);
+    }
+  }
+  idx->offsets[idx->nb++] = offset;
+}
+
+/** Scan the whole log once, resynchronizing on the next STX after a bad frame */
+static void build_index(int ac_id)
+{
+  size_t i = 0;
+  while (i + PPRZLOG_HEADER_LEN + 3 <= log_size) {
+    const uint8_t *stx = memchr(log_data + i, PPRZLOG_STX, log_size - i);
+    if (stx == NULL) {
+      nb_skipped_bytes += log_size - i;
+      break;
+    }
+    nb_skipped_bytes += stx - (log_data + i);
+    i = stx - log_data;
+    const uint8_t len = stx[1];
+    size_t frame_len = PPRZLOG_HEADER_LEN + len + 1;
+    if (i + frame_len > log_size || len < 2) {
+      i++;
+      nb_skipped_bytes++;
+      continue;
+    }
+    uint8_t ck = 0;
+    for (size_t k = 1; k < frame_len - 1; k++) {
+      ck += stx[k];
+    }
+    if (ck != stx[frame_len - 1] || stx[2] >= PPRZLOG_NB_SOURCES) {
+      nb_bad_checksums++;
+      i++;
+      nb_skipped_bytes++;
+      continue;
+    }
+    const uint8_t *payload = stx + PPRZLOG_HEADER_LEN;
+    if (ac_id < 0 || stx[2] != 0 || payload[0] == ac_id) {
+      index_add(&indexes[stx[2]][payload[1]], i);
+    }
+    nb_frames++;
+    i += frame_len;
+  }
+}
+
+/** First index position with time >= t */
+static size_t index_lower_bound(const struct index *idx, double t)
+{
+  size_t lo = 0, hi = idx->nb;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (frame_time(idx->offsets[mid]) < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void list_messages(void)
+{
+  printf("%lu frames, %lu bad checksums, %lu bytes skipped\n", nb_frames, nb_bad_checksums, nb_skipped_bytes);
+  printf("%-9s %4s %-32s %10s %10s %10s %8s\n", "source", "id", "name", "count", "first", "last", "rate");
+  for (int s = 0; s < PPRZLOG_NB_SOURCES; s++) {
+    for (int id = 0; id < MAX_MESSAGES; id++) {
+      const struct index *idx = &indexes[s][id];
+      if (idx->nb == 0) {
+        continue;
+      }
+      double first = frame_time(idx->offsets[0]);
+      double last = frame_time(idx->offsets[idx->nb - 1]);
+      printf("%-9s %4d %-32s %10zu %10.3f %10.3f %8.2f\n", s ? "datalink" : "telemetry", id,
+             messages[s][id] ? messages[s][id]->name : "?", idx->nb, first, last,
+             last > first ? (idx->nb - 1) / (last - first) : 0.);
+    }
+  }
+}
+
+/******************************************************************************
+ * Extraction
+ */
+
+/** Offset in the payload of each field, walking over the variable arrays */
+static bool field_offsets(const struct message *msg, const uint8_t *payload, size_t len, size_t *offsets)
+{
+  size_t o = 2; // ac_id, msg_id
+  for (int f = 0; f < msg->nb_fields; f++) {
+    const struct field *fd = &msg->fields[f];
+    size_t nb = fd->nb;
+    if (nb == 0) {
+      if (o >= len) {
+        return false;
+      }
+      nb = payload[o];
+      o++;
+    }
+    offsets[f] = o;
+    o += nb * types[fd->type].size;
+  }
+  return o <= len;
+}
+
+struct job {
+  int thread;
+  unsigned long nb_errors;
+};
+
+/** Decode a slice of every selected message */
+static void *extract_thread(void *arg)
+{
+  struct job *job = arg;
+  size_t offsets[MAX_FIELDS];
+  for (int s = 0; s < nb_selections; s++) {
+    struct selection *sel = &selections[s];
+    const struct message *msg = messages[sel->source][sel->id];
+    const struct index *idx = &indexes[sel->source][sel->id];
+    size_t start = sel->nb * job->thread / nb_threads;
+    size_t end = sel->nb * (job->thread + 1) / nb_threads;
+    for (size_t r = start; r < end; r++) {
+      uint64_t frame = idx->offsets[sel->first + r];
+      const uint8_t *payload = log_data + frame + PPRZLOG_HEADER_LEN;
+      size_t len = log_data[frame + 1];
+      sel->time[r] = frame_time(frame);
+      bool valid = field_offsets(msg, payload, len, offsets);
+      if (!valid) {
+        job->nb_errors++;
+      }
+      for (int c = 0; c < sel->nb_columns; c++) {
+        struct column *col = &sel->columns[c];
+        const struct field *fd = &msg->fields[col->field];
+        size_t size = types[fd->type].size;
+        size_t o = offsets[col->field] + col->elt * size;
+        if (valid && o + size <= len) {
+          memcpy(col->data + r * size, payload + o, size);
+        } else {
+          memset(col->data + r * size, 0, size);
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+/** Parse "MSG" or "MSG:field,field" into a selection */
+static int add_selection(const char *arg, double t_start, double t_end)
+{
+  char name[MAX_NAME];
+  const char *colon = strchr(arg, ':');
+  size_t n = colon ? (size_t)(colon - arg) : strlen(arg);
+  if (n >= sizeof(name)) {
+    return -1;
+  }
+  memcpy(name, arg, n);
+  name[n] = '\0';
+
+  struct selection *sel = &selections[nb_selections];
+  memset(sel, 0, sizeof(*sel));
+  sel->id = find_message(name, &sel->source);
+  if (sel->id < 0) {
+    fprintf(stderr, "Unknown message %s\n", name);
+    return -1;
+  }
+  const struct message *msg = messages[sel->source][sel->id];
+  for (int f = 0; f < msg->nb_fields; f++) {
+    const struct field *fd = &msg->fields[f];
+    if (colon != NULL) {
+      // look for the field name in the comma separated list
+      size_t fl = strlen(fd->name);
+      const char *p = colon + 1;
+      bool found = false;
+      while (*p && !found) {
+        const char *e = strchr(p, ',');
+        size_t pl = e ? (size_t)(e - p) : strlen(p);
+        found = (pl == fl && strncmp(p, fd->name, fl) == 0);
+        p += pl + (e ? 1 : 0);
+      }
+      if (!found) {
+        continue;
+      }
+    } else if (fd->nb == 0) {
+      continue; // variable arrays are not columns, unless explicitly asked for their first element
+    }
+    int nb = fd->nb ? fd->nb : 1;
+    for (int e = 0; e < nb && sel->nb_columns < MAX_FIELDS; e++) {
+      sel->columns[sel->nb_columns].field = f;
+      sel->columns[sel->nb_columns].elt = e;
+      sel->nb_columns++;
+    }
+  }
+
+  const struct index *idx = &indexes[sel->source][sel->id];
+  sel->first = index_lower_bound(idx, t_start);
+  sel->nb = 0;
+  if (index_lower_bound(idx, t_end) > sel->first) {
+    sel->nb = index_lower_bound(idx, t_end) - sel->first;
+  }
+  sel->time = malloc(sel->nb * sizeof(double) + 1);
+  if (sel->time == NULL) {
+    fprintf(stderr, "Not enough memory for %s\n", name);
+    return -1;
+  }
+  for (int c = 0; c < sel->nb_columns; c++) {
+    const struct field *fd = &msg->fields[sel->columns[c].field];
+    sel->columns[c].data = malloc(sel->nb * types[fd->type].size + 1);
+    if (sel->columns[c].data == NULL) {
+      fprintf(stderr, "Not enough memory for %s\n", name);
+      return -1;
+    }
+  }
+  nb_selections++;
+  return 0;
+}
+
+static void column_name(char *dst, size_t len, const struct message *msg, const struct column *col)
+{
+  const struct field *fd = &msg->fields[col->field];
+  if (fd->nb == 1) {
+    snprintf(dst, len, "%s", fd->name);
+  } else {
+    snprintf(dst, len, "%s_%d", fd->name, col->elt);
+  }
+}
+
+static void print_value(const uint8_t *p, enum field_type type)
+{
+  union {
+    int8_t i8; uint8_t u8; int16_t i16; uint16_t u16; int32_t i32; uint32_t u32;
+    int64_t i64; uint64_t u64; float f; double d;
+  } v;
+  memcpy(&v, p, types[type].size);
+  switch (type) {
+    case T_INT8: printf("%d", v.i8); break;
+    case T_UINT8: case T_CHAR: printf("%u", v.u8); break;
+    case T_INT16: printf("%d", v.i16); break;
+    case T_UINT16: printf("%u", v.u16); break;
+    case T_INT32: printf("%d", v.i32); break;
+    case T_UINT32: printf("%u", v.u32); break;
+    case T_INT64: printf("%lld", (long long)v.i64); break;
+    case T_UINT64: printf("%llu", (unsigned long long)v.u64); break;
+    case T_FLOAT: printf("%.9g", v.f); break;
+    case T_DOUBLE: printf("%.17g", v.d); break;
+  }
+}
+
+static void write_csv(const struct selection *sel)
+{
+  const struct message *msg = messages[sel->source][sel->id];
+  char name[2 * MAX_NAME];
+  printf("# %s\ntime", msg->name);
+  for (int c = 0; c < sel->nb_columns; c++) {
+    column_name(name, sizeof(name), msg, &sel->columns[c]);
+    printf(",%s", name);
+  }
+  printf("\n");
+  for (size_t r = 0; r < sel->nb; r++) {
+    printf("%.4f", sel->time[r]);
+    for (int c = 0; c < sel->nb_columns; c++) {
+      enum field_type type = msg->fields[sel->columns[c].field].type;
+      putchar(',');
+      print_value(sel->columns[c].data + r * types[type].size, type);
+    }
+    putchar('\n');
+  }
+}
+
+static int write_file(const char *dir, const char *name, const char *suffix, const void *data, size_t size)
+{
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s/%s.%s", dir, name, suffix);
+  FILE *out = fopen(filename, "wb");
+  if (out == NULL || fwrite(data, 1, size, out) != size) {
+    perror(filename);
+    if (out != NULL) {
+      fclose(out);
+    }
+    return -1;
+  }
+  fclose(out);
+  return 0;
+}
+
+static int write_columns(const struct selection *sel, const char *dir)
+{
+  const struct message *msg = messages[sel->source][sel->id];
+  char name[4 * MAX_NAME], col_name[2 * MAX_NAME];
+  snprintf(name, sizeof(name), "%s.time", msg->name);
+  if (write_file(dir, name, "f64", sel->time, sel->nb * sizeof(double)) < 0) {
+    return -1;
+  }
+  for (int c = 0; c < sel->nb_columns; c++) {
+    enum field_type type = msg->fields[sel->columns[c].field].type;
+    column_name(col_name, sizeof(col_name), msg, &sel->columns[c]);
+    snprintf(name, sizeof(name), "%s.%s", msg->name, col_name);
+    if (write_file(dir, name, types[type].suffix, sel->columns[c].data, sel->nb * types[type].size) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [options] file.tlm [MSG[:field,...] ...]\n", prog);
+  fprintf(stderr, "  -m file  messages.xml (default $PAPARAZZI_HOME/var/messages.xml)\n");
+  fprintf(stderr, "  -a id    only keep telemetry from this aircraft\n");
+  fprintf(stderr, "  -s t     start time (s)\n");
+  fprintf(stderr, "  -e t     end time (s)\n");
+  fprintf(stderr, "  -j n     number of decoding threads\n");
+  fprintf(stderr, "  -o dir   write binary columns dir/MSG.field.type instead of CSV\n");
+  fprintf(stderr, "  -l       list messages found in the log\n");
+}
+
+int main(int argc, char **argv)
+{
+  const char *messages_file = NULL;
+  const char *out_dir = NULL;
+  char default_messages[512];
+  int ac_id = -1;
+  double t_start = 0., t_end = 1e12;
+  bool list = false;
+  nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:a:s:e:j:o:lh")) != -1) {
+    switch (opt) {
+      case 'm': messages_file = optarg; break;
+      case 'a': ac_id = atoi(optarg); break;
+      case 's': t_start = atof(optarg); break;
+      case 'e': t_end = atof(optarg); break;
+      case 'j': nb_threads = atoi(optarg); break;
+      case 'o': out_dir = optarg; break;
+      case 'l': list = true; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (nb_threads < 1) {
+    nb_threads = 1;
+  }
+  if (t_start > t_end) {
+    fprintf(stderr, "Start time %g is after end time %g\n", t_start, t_end);
+    return 1;
+  }
+
+  if (messages_file == NULL) {
+    const char *home = getenv("PAPARAZZI_HOME");
+    snprintf(default_messages, sizeof(default_messages), "%s/var/messages.xml", home ? home : ".");
+    messages_file = default_messages;
+  }
+  if (load_messages(messages_file) < 0) {
+    fprintf(stderr, "Warning: could not read %s, messages can only be listed by id\n", messages_file);
+  }
+
+  const char *log_name = argv[optind];
+  int fd = open(log_name, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(log_name);
+    return 1;
+  }
+  log_size = st.st_size;
+  if (log_size == 0) {
+    fprintf(stderr, "%s: empty file\n", log_name);
+    return 1;
+  }
+  log_data = mmap(NULL, log_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (log_data == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  madvise((void *)log_data, log_size, MADV_SEQUENTIAL);
+  build_index(ac_id);
+  madvise((void *)log_data, log_size, MADV_RANDOM);
+
+  if (list || optind + 1 >= argc) {
+    list_messages();
+  }
+
+  int nb_args = argc - optind - 1;
+  selections = calloc(nb_args + 1, sizeof(struct selection));
+  for (int i = 0; i < nb_args; i++) {
+    if (add_selection(argv[optind + 1 + i], t_start, t_end) < 0) {
+      return 1;
+    }
+  }
+
+  if (nb_selections > 0) {
+    pthread_t threads[nb_threads];
+    struct job jobs[nb_threads];
+    unsigned long nb_errors = 0;
+    for (int t = 0; t < nb_threads; t++) {
+      jobs[t].thread = t;
+      jobs[t].nb_errors = 0;
+      if (pthread_create(&threads[t], NULL, extract_thread, &jobs[t]) != 0) {
+        fprintf(stderr, "Could not create decoding thread\n");
+        return 1;
+      }
+    }
+    for (int t = 0; t < nb_threads; t++) {
+      pthread_join(threads[t], NULL);
+      nb_errors += jobs[t].nb_errors;
+    }
+    if (nb_errors > 0) {
+      fprintf(stderr, "Warning: %lu messages shorter than their description (set to 0)\n", nb_errors);
+    }
+
+    for (int s = 0; s < nb_selections; s++) {
+      if (out_dir != NULL) {
+        if (write_columns(&selections[s], out_dir) < 0) {
+          return 1;
+        }
+      } else {
+        write_csv(&selections[s]);
+      }
+    }
+  }
+
+  munmap((void *)log_data, log_size);
+  close(fd);
+  return 0;
+}
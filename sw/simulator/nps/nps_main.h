@@ -64,6 +64,10 @@ struct NpsMain {
   int rc_script;
   bool norc;
   char *ivy_bus;
+  bool headless;      ///< run lock-step as fast as possible, without Ivy and FlightGear
+  double stop_time;   ///< stop the simulation at this sim time in seconds (0 to run forever)
+  char *stop_block;   ///< stop the simulation when this flight plan block is reached
+  unsigned long int seed; ///< seed of the sensor noise generator
 };
 
 struct NpsMain nps_main;
@@ -29,6 +29,7 @@
 #include "nps_flightgear.h"
 
 #include "nps_ivy.h"
+#include "nps_random.h"
 
 #ifdef __MACH__
 pthread_mutex_t clock_mutex; // mutex for clock
@@ -97,6 +98,7 @@ int nps_main_init(int argc, char **argv)
   nps_main.real_initial_time = time_to_double(&t);
   nps_main.scaled_initial_time = time_to_double(&t);
 
+  nps_random_init(&nps_random, nps_main.seed);
   nps_fdm_init(SIM_DT);
   nps_atmosphere_init();
   nps_sensors_init(nps_main.sim_time);
@@ -108,9 +110,13 @@ int nps_main_init(int argc, char **argv)
   printf("host_time_factor,host_time_elapsed,host_time_now,scaled_initial_time,sim_time_before,display_time_before,sim_time_after,display_time_after\n");
 #endif
 
-  signal(SIGCONT, cont_hdl);
-  signal(SIGTSTP, tstp_hdl);
-  printf("Time factor is %f. (Press Ctrl-Z to change)\n", nps_main.host_time_factor);
+  if (nps_main.headless) {
+    printf("Running headless as fast as possible.\n");
+  } else {
+    signal(SIGCONT, cont_hdl);
+    signal(SIGTSTP, tstp_hdl);
+    printf("Time factor is %f. (Press Ctrl-Z to change)\n", nps_main.host_time_factor);
+  }
 
   return 0;
 }
@@ -158,6 +164,10 @@ bool nps_main_parse_options(int argc, char **argv)
   nps_main.ivy_bus = NULL;
   nps_main.host_time_factor = 1.0;
   nps_main.fg_fdm = 0;
+  nps_main.headless = false;
+  nps_main.stop_time = 0.;
+  nps_main.stop_block = NULL;
+  nps_main.seed = 0;
 
   static const char *usage =
     "Usage: %s [options]\n"
@@ -173,7 +183,11 @@ bool nps_main_parse_options(int argc, char **argv)
     "   --norc                                 e.g. disable RC\n"
     "   --ivy_bus <ivy bus>                    e.g. 127.255.255.255\n"
     "   --time_factor <factor>                 e.g. 2.5\n"
-    "   --fg_fdm";
+    "   --fg_fdm\n"
+    "   --headless                             run as fast as possible without Ivy and FlightGear\n"
+    "   --stop_time <sim seconds>              e.g. 300\n"
+    "   --stop_block <flight plan block name>  e.g. Standby\n"
+    "   --seed <sensor noise seed>             e.g. 42\n";
 
 
   while (1) {
@@ -190,6 +204,10 @@ bool nps_main_parse_options(int argc, char **argv)
       {"time_factor", 1, NULL, 0},
       {"fg_fdm", 0, NULL, 0},
       {"fg_port_in", 1, NULL, 0},
+      {"headless", 0, NULL, 0},
+      {"stop_time", 1, NULL, 0},
+      {"stop_block", 1, NULL, 0},
+      {"seed", 1, NULL, 0},
       {0, 0, 0, 0}
     };
     int option_index = 0;
@@ -226,6 +244,14 @@ bool nps_main_parse_options(int argc, char **argv)
             nps_main.fg_fdm = 1; break;
           case 10:
             nps_main.fg_port_in = atoi(optarg); break;
+          case 11:
+            nps_main.headless = true; break;
+          case 12:
+            nps_main.stop_time = atof(optarg); break;
+          case 13:
+            nps_main.stop_block = strdup(optarg); break;
+          case 14:
+            nps_main.seed = strtoul(optarg, NULL, 0); break;
         }
         break;
 
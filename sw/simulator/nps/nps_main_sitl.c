@@ -28,8 +28,10 @@
 
 #include "nps_main.h"
 #include "nps_fdm.h"
+#include "generated/flight_plan.h"
+#include "subsystems/navigation/common_flight_plan.h"
 
-
+static int nps_main_headless_loop(void);
 
 
 int main(int argc, char **argv)
@@ -38,6 +40,10 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  if (nps_main.headless) {
+    return nps_main_headless_loop();
+  }
+
   if (nps_main.fg_host) {
     pthread_create(&th_flight_gear, NULL, nps_flight_gear_loop, NULL);
   }
@@ -182,3 +188,56 @@ void *nps_main_loop(void *data __attribute__((unused)))
   }
   return(NULL);
 }
+
+
+/**
+ * Lock-step simulation loop without real time pacing, Ivy or FlightGear.
+ * Runs until the stop time or the stop block of the flight plan is reached.
+ * @return exit status, failure when a stop block was given but not reached
+ */
+static int nps_main_headless_loop(void)
+{
+  int stop_block = -1;
+  if (nps_main.stop_block != NULL) {
+    static const char *blocks[] = FP_BLOCKS;
+    for (int i = 0; i < NB_BLOCK; i++) {
+      if (strcmp(blocks[i], nps_main.stop_block) == 0) {
+        stop_block = i;
+        break;
+      }
+    }
+    if (stop_block < 0) {
+      printf("Unknown flight plan block: %s\n", nps_main.stop_block);
+      return 1;
+    }
+  } else if (nps_main.stop_time <= 0.) {
+    printf("Warning: no --stop_time or --stop_block given, the headless simulation runs forever.\n");
+  }
+
+  struct timespec start, end;
+  clock_get_current_time(&start);
+
+  bool block_reached = false;
+  while (nps_main.stop_time <= 0. || nps_main.sim_time < nps_main.stop_time) {
+    nps_main_run_sim_step();
+    nps_main.sim_time += SIM_DT;
+
+    if (stop_block >= 0 && nav_block == stop_block) {
+      block_reached = true;
+      break;
+    }
+  }
+
+  clock_get_current_time(&end);
+  double wall_time = ntime_to_double(&end) - ntime_to_double(&start);
+
+  if (block_reached) {
+    printf("Reached block %s at sim time %f s\n", nps_main.stop_block, nps_main.sim_time);
+  } else if (stop_block >= 0) {
+    printf("Block %s not reached before sim time %f s\n", nps_main.stop_block, nps_main.sim_time);
+  }
+  printf("Simulated %f s in %f s wall time (%f sim s per wall s)\n",
+         nps_main.sim_time, wall_time, wall_time > 0. ? nps_main.sim_time / wall_time : 0.);
+
+  return (stop_block < 0 || block_reached) ? 0 : 1;
+}
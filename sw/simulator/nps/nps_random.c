@@ -106,12 +106,30 @@ double get_gaussian_noise(void)
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_randist.h>
 #include <stdlib.h>
-double get_gaussian_noise(void)
+
+struct NpsRandom nps_random = { .rng = NULL };
+
+/**
+ * Initialize a random number generator
+ * @param[out] random The generator state
+ * @param[in] seed The seed, 0 gives the default gsl sequence
+ */
+void nps_random_init(struct NpsRandom *random, unsigned long int seed)
 {
-  static gsl_rng *r = NULL;
   // select random number generator
-  if (!r) { r = gsl_rng_alloc(gsl_rng_mt19937); }
-  return gsl_ran_gaussian(r, 1.);
+  if (!random->rng) { random->rng = gsl_rng_alloc(gsl_rng_mt19937); }
+  gsl_rng_set(random->rng, seed);
+}
+
+double nps_random_gaussian(struct NpsRandom *random)
+{
+  if (!random->rng) { nps_random_init(random, 0); }
+  return gsl_ran_gaussian(random->rng, 1.);
+}
+
+double get_gaussian_noise(void)
+{
+  return nps_random_gaussian(&nps_random);
 }
 #endif
 
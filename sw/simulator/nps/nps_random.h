@@ -3,6 +3,21 @@
 
 #include "math/pprz_algebra_double.h"
 
+/**
+ * Random number generator state.
+ * The sensor models use the single global nps_random, which is seeded once at startup
+ * with nps_random_init() so a run can be reproduced with the same seed.
+ */
+struct NpsRandom {
+  void *rng;  ///< gsl_rng generator, allocated by nps_random_init()
+};
+
+/** Generator used by the sensor models */
+extern struct NpsRandom nps_random;
+
+extern void nps_random_init(struct NpsRandom *random, unsigned long int seed);
+extern double nps_random_gaussian(struct NpsRandom *random);
+
 extern double get_gaussian_noise(void);
 extern void double_vect3_add_gaussian_noise(struct DoubleVect3 *vect, struct DoubleVect3 *std_dev);
 extern void double_vect3_get_gaussian_noise(struct DoubleVect3 *vect, struct DoubleVect3 *std_dev);
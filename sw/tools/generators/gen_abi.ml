@@ -145,6 +145,7 @@ module Gen_onboard = struct
     args h msg.fields;
     Printf.fprintf h "    }\n";
     Printf.fprintf h "  }\n";
+    Printf.fprintf h "  ABI_EVENT_NOTIFY();\n";
     Printf.fprintf h "}\n"
 
   (* Print bind and send functions for all messages *)
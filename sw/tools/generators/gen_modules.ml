@@ -42,6 +42,18 @@ let lprintf = fun out f ->
   fprintf out "%s" (String.make !margin ' ');
   fprintf out f
 
+(** Optional (file, execution time profile) used to balance the periodic phases *)
+let cost_profile = ref None
+
+(** Functions called from the periodic and event tasks, the index is the profiler id *)
+let profiled = ref []
+
+(** Print a function call, wrapped for the optional execution time profiler *)
+let print_call = fun f ->
+  let id = List.length !profiled in
+  profiled := !profiled @ [f];
+  lprintf out_h "ModulesProfileCall(%d, %s);\n" id f
+
 let print_headers = fun modules ->
   lprintf out_h  "#include \"std.h\"\n";
   List.iter (fun m ->
@@ -214,57 +226,79 @@ let print_periodic = fun task modules ->
     modules;
   (** Print periodic functions *)
   let functions = List.sort (fun (_,p) (_,p') -> compare p p') functions_modulo in
-  let i = ref 0 in (** Basic balancing:1 function every 10Hz FIXME *)
+  let test_delay = fun x -> try let _ = Xml.attrib x "delay" in true with _ -> false in
+  let get_delay = fun func p ->
+    let delay = int_of_string (Xml.attrib func "delay") in
+    if delay >= p then fprintf stderr "Warning: delay is bound between 0 and %d for function %s\n" (p-1) (ExtXml.attrib func "fun");
+    delay mod p in
+  (** Basic balancing:1 function every 10Hz FIXME *)
+  let i = ref 0 in
+  let phases = List.rev (List.fold_left (fun l ((func, _), p) ->
+    if p = 1 then 0 :: l
+    else if test_delay func then (get_delay func p) :: l
+    else begin
+      i := !i mod p;
+      let phase = !i in
+      let incr = p / ((List.length (List.filter (fun (_,p') -> compare p p' == 0) functions)) + 1) in
+      i := !i + incr;
+      phase :: l
+    end) [] functions) in
+  (** Cost aware balancing if a profile is available *)
+  let phases = match !cost_profile with
+    | None -> phases
+    | Some (file, profile) ->
+        let known = List.fold_left (fun l ((func, _), _) ->
+          try (GC.cost_of_profile profile (ExtXml.attrib func "fun")) :: l with Not_found -> l) [] functions in
+        let default_cost = match known with
+          | [] -> 1.
+          | _ -> (List.fold_left (+.) 0. known) /. float (List.length known) in
+        let tasks = List.map2 (fun ((func, _), p) phase ->
+          let function_name = ExtXml.attrib func "fun" in
+          let cost = try GC.cost_of_profile profile function_name with Not_found ->
+            fprintf stderr "Warning: function %s not found in cost profile %s, using %.1f\n" function_name file default_cost;
+            default_cost in
+          let fixed = if p = 1 || test_delay func then Some phase else None in
+          (p, cost, fixed)) functions phases in
+        let _, rr_load = GC.balance_phases (List.map2 (fun (p, c, _) phase -> (p, c, Some phase)) tasks phases) in
+        let phases, load = GC.balance_phases tasks in
+        let rr_peak, _ = GC.tick_load_stats rr_load
+        and peak, mean = GC.tick_load_stats load in
+        nl ();
+        lprintf out_h "/* phases balanced from cost profile %s\n" file;
+        lprintf out_h " * predicted tick load: peak %.1f, mean %.1f (round-robin peak %.1f) */\n" peak mean rr_peak;
+        fprintf stderr "Info: modules %s periodic task predicted tick load: peak %.1f, mean %.1f (round-robin peak %.1f)\n%!" task peak mean rr_peak;
+        phases
+  in
   let l = ref [] in
   nl ();
-  let test_delay = fun x -> try let _ = Xml.attrib x "delay" in true with _ -> false in
-  List.iter (fun ((func, name), p) ->
+  List.iter2 (fun ((func, name), p) phase ->
     let function_name = ExtXml.attrib func "fun" in
     if p = 1 then
       begin
         if (is_status_lock func) then
-          lprintf out_h "%s;\n" function_name
+          print_call function_name
         else begin
           lprintf out_h "if (%s == MODULES_RUN) {\n" (get_status_name func name);
           right ();
-          lprintf out_h "%s;\n" function_name;
+          print_call function_name;
           left ();
           lprintf out_h "}\n";
         end
       end
     else
       begin
-        if (test_delay func) then begin
-          (** Delay is set by user *)
-          let delay = int_of_string (Xml.attrib func "delay") in
-          if delay >= p then fprintf stderr "Warning: delay is bound between 0 and %d for function %s\n" (p-1) function_name;
-          let delay_p = delay mod p in
-          let else_ = if List.mem_assoc p !l && not (List.mem (p, delay_p) !l) then
-              "else " else "" in
-          if (is_status_lock func) then
-            lprintf out_h "%sif (i%d == %d) {\n" else_ p delay_p
-          else
-            lprintf out_h "%sif (i%d == %d && %s == MODULES_RUN) {\n" else_ p delay_p (get_status_name func name);
-          l := (p, delay_p) :: !l;
-        end
-        else begin
-          (** Delay is automtically set *)
-          i := !i mod p;
-          let else_ = if List.mem_assoc p !l && not (List.mem (p, !i) !l) then "else " else "" in
-          if (is_status_lock func) then
-            lprintf out_h "%sif (i%d == %d) {\n" else_ p !i
-          else
-            lprintf out_h "%sif (i%d == %d && %s == MODULES_RUN) {\n" else_ p !i (get_status_name func name);
-          l := (p, !i) :: !l;
-          let incr = p / ((List.length (List.filter (fun (_,p') -> compare p p' == 0) functions)) + 1) in
-          i := !i + incr;
-        end;
+        let else_ = if List.mem_assoc p !l && not (List.mem (p, phase) !l) then "else " else "" in
+        if (is_status_lock func) then
+          lprintf out_h "%sif (i%d == %d) {\n" else_ p phase
+        else
+          lprintf out_h "%sif (i%d == %d && %s == MODULES_RUN) {\n" else_ p phase (get_status_name func name);
+        l := (p, phase) :: !l;
         right ();
-        lprintf out_h "%s;\n" function_name;
+        print_call function_name;
         left ();
         lprintf out_h "}\n"
       end;
-  ) functions;
+  ) functions phases;
   left ();
   lprintf out_h "}\n"
 
@@ -284,7 +318,7 @@ let print_event = fun task modules ->
   List.iter (fun m ->
     List.iter (fun i ->
       match Xml.tag i with
-          "event" -> lprintf out_h "%s;\n" (Xml.attrib i "fun")
+          "event" -> print_call (Xml.attrib i "fun")
         | _ -> ())
       (Xml.children m))
     modules;
@@ -301,6 +335,22 @@ let print_event_functions = fun modules ->
   lprintf out_h "}\n"
 
 
+(** Calls are not profiled unless the modules_profile module defines the macro *)
+let print_profile_default = fun () ->
+  lprintf out_h "#ifndef ModulesProfileCall\n";
+  lprintf out_h "#define ModulesProfileCall(_id, ...) __VA_ARGS__\n";
+  lprintf out_h "#endif\n"
+
+let print_profile_names = fun () ->
+  lprintf out_h "#define MODULES_PROFILE_NB %d\n" (List.length !profiled);
+  fprintf out_h "#ifdef MODULES_PROFILE_C\n";
+  lprintf out_h "static const char *modules_profile_names[] = {\n";
+  right ();
+  List.iter (fun f -> lprintf out_h "\"%s\",\n" (String.escaped f)) !profiled;
+  left ();
+  lprintf out_h "};\n";
+  fprintf out_h "#endif // MODULES_PROFILE_C\n"
+
 let print_datalink_functions = fun modules ->
   lprintf out_h "\n#include \"pprzlink/messages.h\"\n";
   lprintf out_h "#include \"generated/airframe.h\"\n";
@@ -321,6 +371,8 @@ let print_datalink_functions = fun modules ->
 
 let parse_modules modules =
   print_headers modules;
+  nl ();
+  print_profile_default ();
   print_function_freq modules;
   print_status modules;
   nl ();
@@ -328,6 +380,8 @@ let parse_modules modules =
   print_periodic_functions modules;
   print_event_functions modules;
   nl ();
+  print_profile_names ();
+  nl ();
   fprintf out_h "#ifdef MODULES_DATALINK_C\n";
   print_datalink_functions modules;
   nl ();
@@ -435,6 +489,11 @@ let () =
     let modules = try (ExtXml.child xml "modules") with _ -> Xml.Element("modules",[],[]) in
     let main_freq = try (int_of_string (Xml.attrib modules "main_freq")) with _ -> default_freq in
     freq := main_freq;
+    (* Load the optional cost profile *)
+    begin try
+      let file = Sys.getenv "MODULES_COST_PROFILE" in
+      if file <> "" then cost_profile := Some (file, GC.read_cost_profile file)
+    with Not_found -> () end;
     fprintf out_h "#define MODULES_FREQUENCY %d\n" !freq;
     nl ();
     fprintf out_h "#ifdef MODULES_C\n";
@@ -37,6 +37,9 @@ let lprintf = fun c f ->
   fprintf c "%s" (String.make !margin ' ');
   fprintf c f
 
+(** Optional (file, cost profile) used to balance the messages phases *)
+let cost_profile = ref None
+
 let output_modes = fun out_h process_name telem_type modes freq ->
   let min_period = 1./.float freq in
   let max_period = 65536. /. float freq in
@@ -55,6 +58,32 @@ let output_modes = fun out_h process_name telem_type modes freq ->
           fprintf stderr "Warning: period is bound between %.3fs and %.3fs for message %s\n%!" min_period max_period (ExtXml.attrib x "name");
         (x, min 65535 (max 1 (int_of_float (p*.float_of_int freq))))
       ) (Xml.children mode) in
+
+      (** Messages table of the adaptive scheduler, sorted by priority *)
+      if List.length messages > 0 then begin
+        let sched = List.stable_sort (fun (_, pr, _, _) (_, pr', _, _) -> compare pr pr')
+          (List.map (fun (x, p) ->
+            let priority = int_of_string (ExtXml.attrib_or_default x "priority" "1") in
+            let p_max = try int_of_float (float_of_string (ExtXml.attrib x "max_period") *. float_of_int freq) with _ -> 8 * p in
+            (ExtXml.attrib x "name", priority, p, min 65535 (max p p_max))
+          ) messages) in
+        fprintf out_h "#if PERIODIC_TELEMETRY_ADAPTIVE\n";
+        lprintf out_h "static struct telemetry_sched_msg sched_msgs[] = {\n";
+        right ();
+        List.iter (fun (n, pr, p, p_max) ->
+          lprintf out_h "{ .idx = TELEMETRY_%s_MSG_%s_IDX, .priority = %d, .period_min = %d, .period_max = %d },\n" telem_type n pr p p_max
+        ) sched;
+        left ();
+        lprintf out_h "};\n";
+        lprintf out_h "if (telemetry_sched_%s.enabled) {\n" process_name;
+        right ();
+        lprintf out_h "periodic_telemetry_sched_send(&telemetry_sched_%s, sched_msgs, %d, telemetry, trans, dev);\n" process_name (List.length sched);
+        lprintf out_h "return;\n";
+        left ();
+        lprintf out_h "}\n";
+        fprintf out_h "#endif\n"
+      end;
+
       let modulos = GC.singletonize (List.map snd messages) in
       List.iter (fun m ->
         let v = sprintf "i%d" m in
@@ -67,21 +96,44 @@ let output_modes = fun out_h process_name telem_type modes freq ->
         lprintf out_h "uint8_t j;\n";
 
       (** For each message in this mode *)
-      let messages = List.sort (fun (_,p) (_,p') -> compare p p') messages in
+      let messages = List.rev (List.sort (fun (_,p) (_,p') -> compare p p') messages) in
+      let fixed_phase = fun message ->
+        try Some (int_of_float (float_of_string (ExtXml.attrib message "phase")*.float_of_int freq)) with _ -> None in
       let i = ref 0 in (** Basic balancing:1 message every 10Hz *)
-      let phase = ref 0 in
+      let phases = List.rev (List.fold_left (fun l (message, p) ->
+        i := !i mod p;
+        (* if phase attribute is present, use it, otherwise shedule at 10Hz *)
+        let phase = match fixed_phase message with Some ph -> ph | None -> !i in
+        i := !i + freq/10;
+        phase :: l) [] messages) in
+      (** Cost aware balancing if a profile is available *)
+      let phases = match !cost_profile with
+        | None -> phases
+        | Some (file, profile) ->
+            let known = List.fold_left (fun l (message, _) ->
+              try (GC.cost_of_profile profile (ExtXml.attrib message "name")) :: l with Not_found -> l) [] messages in
+            let default_cost = match known with
+              | [] -> 1.
+              | _ -> (List.fold_left (+.) 0. known) /. float (List.length known) in
+            let tasks = List.map (fun (message, p) ->
+              let cost = try GC.cost_of_profile profile (ExtXml.attrib message "name") with Not_found -> default_cost in
+              (p, cost, fixed_phase message)) messages in
+            let _, rr_load = GC.balance_phases (List.map2 (fun (p, c, _) phase -> (p, c, Some phase)) tasks phases) in
+            let phases, load = GC.balance_phases tasks in
+            let rr_peak, _ = GC.tick_load_stats rr_load
+            and peak, mean = GC.tick_load_stats load in
+            lprintf out_h "/* phases balanced from cost profile %s\n" file;
+            lprintf out_h " * predicted tick load: peak %.1f, mean %.1f (round-robin peak %.1f) */\n" peak mean rr_peak;
+            fprintf stderr "Info: telemetry %s mode %s predicted tick load: peak %.1f, mean %.1f (round-robin peak %.1f)\n%!" process_name mode_name peak mean rr_peak;
+            phases
+      in
       let l = ref [] in
-      List.iter
-        (fun (message, p) ->
+      List.iter2
+        (fun (message, p) phase ->
           let message_name = ExtXml.attrib message "name" in
-          i := !i mod p;
-          (* if phase attribute is present, use it, otherwise shedule at 10Hz *)
-          let message_phase = try int_of_float (float_of_string (ExtXml.attrib message "phase")*.float_of_int freq) with _ -> !i in
-          phase := message_phase;
-          let else_ = if List.mem_assoc p !l && not (List.mem (p, !phase) !l) then "else " else "" in
-          lprintf out_h "%sif (i%d == %d) {\n" else_ p !phase;
-          l := (p, !phase) :: !l;
-          i := !i + freq/10;
+          let else_ = if List.mem_assoc p !l && not (List.mem (p, phase) !l) then "else " else "" in
+          lprintf out_h "%sif (i%d == %d) {\n" else_ p phase;
+          l := (p, phase) :: !l;
           right ();
           lprintf out_h "for (j = 0; j < TELEMETRY_NB_CBS; j++) {\n";
           right ();
@@ -98,7 +150,7 @@ let output_modes = fun out_h process_name telem_type modes freq ->
           left ();
           lprintf out_h "}\n"
         )
-        (List.rev messages);
+        messages phases;
       left ();
       lprintf out_h "}\n")
     modes
@@ -208,6 +260,18 @@ let print_process_send = fun out_h xml freq ->
       fprintf out_h "extern uint8_t telemetry_mode_%s;\n" process_name;
       fprintf out_h "#endif /* PERIODIC_C_%s */\n" (String.uppercase process_name);
 
+      (** Adaptive scheduler state *)
+      fprintf out_h "#if PERIODIC_TELEMETRY_ADAPTIVE\n";
+      fprintf out_h "#ifdef PERIODIC_C_%s\n" (String.uppercase process_name);
+      fprintf out_h "#ifndef TELEMETRY_ADAPTIVE_BUDGET_%s\n" (String.uppercase process_name);
+      fprintf out_h "#define TELEMETRY_ADAPTIVE_BUDGET_%s TELEMETRY_ADAPTIVE_BUDGET\n" (String.uppercase process_name);
+      fprintf out_h "#endif\n";
+      fprintf out_h "struct telemetry_sched telemetry_sched_%s = TELEMETRY_SCHED_INIT(TELEMETRY_ADAPTIVE_BUDGET_%s);\n" process_name (String.uppercase process_name);
+      fprintf out_h "#else\n";
+      fprintf out_h "extern struct telemetry_sched telemetry_sched_%s;\n" process_name;
+      fprintf out_h "#endif\n";
+      fprintf out_h "#endif /* PERIODIC_TELEMETRY_ADAPTIVE */\n";
+
       lprintf out_h "static inline void periodic_telemetry_send_%s(struct periodic_telemetry *telemetry, struct transport_tx *trans, struct link_device *dev) {  /* %dHz */\n" process_name freq;
       right ();
       output_modes out_h process_name telem_type modes freq;
@@ -232,6 +296,12 @@ let _ =
 
   let out_h = stdout in
 
+  (** Load the optional cost profile *)
+  begin try
+    let file = Sys.getenv "TELEMETRY_COST_PROFILE" in
+    if file <> "" then cost_profile := Some (file, GC.read_cost_profile file)
+  with Not_found -> () end;
+
   (** Print header *)
   fprintf out_h "/* This file has been generated by gen_periodic from %s and %s */\n" Sys.argv.(1) Sys.argv.(2);
   fprintf out_h "/* Version %s */\n" (Env.get_paparazzi_version ());